@@ -0,0 +1,517 @@
+/**
+ * corpusgen.c
+ *
+ * Description: Generates a synthetic web site for scale testing: numPages linked HTML
+ *              pages whose text is drawn from a vocabulary with Zipfian word frequencies,
+ *              the way real text's are. It is written either as a site (index.html and
+ *              1.html, 2.html, ... in a directory) for testserver to serve and the
+ *              crawler to crawl, or straight into a crawler page directory, marked with
+ *              .crawler, in any layout, for the indexer and querier.
+ *
+ *              The pages form a tree: page i's first links are to pages i*b+1 ... i*b+b,
+ *              with the branching b the smallest that reaches every page within the depth
+ *              asked for, then to pages already linked from earlier ones, up to the
+ *              fan-out. So every page is at most depth links from the index, and a
+ *              single-threaded breadth-first crawl of the site at that depth fetches
+ *              page i as document i+1: exactly what --pagedir writes.
+ *
+ *              The same options and seed always give the same corpus.
+ *
+ * Usage: ./corpusgen [--pages N] [--vocabulary V] [--zipf S] [--words W] [--fanout F]
+ *                    [--depth D] [--duplicates PERCENT] [--seed N] [--url URL]
+ *                    (--site | --pagedir [--archive | --compress]) directory
+ *
+ *        --pages      number of pages (default 1000).
+ *        --vocabulary number of distinct words (default 50000).
+ *        --zipf       exponent of the word frequencies (default 1.0): the r-th most
+ *                     frequent word occurs in proportion to 1/r^S.
+ *        --words      mean words per page (default 200), anywhere from half to one and a
+ *                     half times as many.
+ *        --fanout     links per page (default 10).
+ *        --depth      most links from the index to any page (default: as few as the
+ *                     fan-out allows).
+ *        --duplicates percentage of pages whose text copies an earlier page's (default 0).
+ *        --seed       seed for the generator (default 1).
+ *        --url        URL of the directory the pages are in, for --pagedir (default
+ *                     http://cs50tse.cs.dartmouth.edu/tse/corpus/).
+ */
+#define _POSIX_C_SOURCE 200809L    // mkdir
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include "webpage.h"
+#include "pagedir.h"
+#include "mem.h"
+
+#define MAX_PAGES 100000000
+#define MAX_VOCABULARY 10000000
+#define MAX_FANOUT 1000
+#define WORDS_PER_LINE 12
+#define DEFAULT_URL "http://cs50tse.cs.dartmouth.edu/tse/corpus/"
+
+// What to generate, as given on the command line
+typedef struct corpusOptions {
+    int numPages;
+    int vocabulary;
+    double zipf;
+    int words;                  // mean words per page
+    int fanout;
+    int depth;                  // 0 for as shallow as the fan-out allows
+    int duplicates;             // percentage of pages copying an earlier page's text
+    uint64_t seed;
+    const char* url;
+    bool site;                  // a site to serve, rather than a page directory
+    pagedirLayout_t layout;
+} corpusOptions_t;
+
+// The vocabulary, and an alias table (Vose) to draw words from it in constant time
+typedef struct vocabulary {
+    char** words;               // words[r] is the (r+1)-th most frequent word
+    double* keep;               // draw slot r: keep word r with probability keep[r]...
+    int* alias;                 // ...and take word alias[r] otherwise
+    int size;
+} vocabulary_t;
+
+// A small fast random number generator (xorshift64*), one per page so pages can be
+// regenerated on their own
+typedef struct rng {
+    uint64_t state;
+} rng_t;
+
+static void parseArgs(const int argc, char* argv[], corpusOptions_t* options, char** directory);
+static int parseOption(const char* arg, const char* name, const int min, const int max);
+static int branching(const corpusOptions_t* options);
+static int levelOf(int page, const int b);
+static vocabulary_t* vocabulary_new(const int size, const double exponent);
+static void vocabulary_delete(vocabulary_t* vocabulary);
+static char* makePage(const int page, const int b, const corpusOptions_t* options, const vocabulary_t* vocabulary);
+static void appendf(char** buffer, size_t* len, size_t* cap, const char* format, ...);
+static rng_t rngFor(const uint64_t seed, const uint64_t stream, const int page);
+static uint64_t nextRandom(rng_t* rng);
+static long randomBelow(rng_t* rng, const long bound);
+static double randomUnit(rng_t* rng);
+
+
+int
+main(const int argc, char* argv[]){
+    corpusOptions_t options = { .numPages = 1000, .vocabulary = 50000, .zipf = 1.0, .words = 200,
+                                .fanout = 10, .depth = 0, .duplicates = 0, .seed = 1,
+                                .url = DEFAULT_URL, .site = false, .layout = PAGEDIR_FILES };
+    char* directory;
+    parseArgs(argc, argv, &options, &directory);
+    int b = branching(&options);
+    vocabulary_t* vocabulary = vocabulary_new(options.vocabulary, options.zipf);
+
+    pagedir_t* pages = NULL;
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST){
+        fprintf(stderr, "Error: Can't create %s.\n", directory);
+        exit(1);
+    }
+    if (!options.site && (!pagedir_create(directory, options.layout) || (pages = pagedir_open(directory)) == NULL)){
+        fprintf(stderr, "Error: Can't create the page directory %s.\n", directory);
+        exit(1);
+    }
+
+    long bytes = 0;
+    for (int page = 0; page < options.numPages; page++){
+        char* html = makePage(page, b, &options, vocabulary);
+        bytes += strlen(html);
+        bool ok;
+        if (options.site){
+            char path[strlen(directory) + 24];
+            if (page == 0) sprintf(path, "%s/index.html", directory);
+            else sprintf(path, "%s/%d.html", directory, page);
+            FILE* fp = fopen(path, "w");
+            ok = fp != NULL && fputs(html, fp) != EOF;
+            if (fp != NULL && fclose(fp) != 0) ok = false;
+            mem_free(html);
+        } else {
+            // Saved the way the crawler saves it, as the document a breadth-first crawl gives it
+            char* url = mem_assert(mem_malloc(strlen(options.url) + 16), "Error: Failed to allocate memory for URL.\n");
+            if (page == 0) sprintf(url, "%sindex.html", options.url);
+            else sprintf(url, "%s%d.html", options.url, page);
+            webpage_t* webpage = webpage_new(url, levelOf(page, b), html);
+            ok = pagedir_write(pages, webpage, page + 1);
+            webpage_delete(webpage);
+        }
+        if (!ok){
+            fprintf(stderr, "Error: Can't write page %d.\n", page);
+            exit(1);
+        }
+    }
+    if (pages != NULL && !pagedir_sync(pages)){
+        fprintf(stderr, "Error: Can't write the page directory %s.\n", directory);
+        exit(1);
+    }
+    pagedir_close(pages);
+    vocabulary_delete(vocabulary);
+    fprintf(stdout, "%d pages, %ld bytes of HTML, depth %d (branching %d)\n",
+            options.numPages, bytes, levelOf(options.numPages - 1, b), b);
+    exit(0);
+}
+
+/**
+* Description: Parses and validates command-line arguments, exiting on any trouble.
+* @param argc: Number of arguments.
+* @param argv: Argument values.
+* @param options: The corpus options; those not given are left alone.
+* @param directory: Set to the directory to write.
+* @return void
+*/
+static void
+parseArgs(const int argc, char* argv[], corpusOptions_t* options, char** directory){
+    static const struct option longOptions[] = {
+        {"pages", required_argument, NULL, 'n'},
+        {"vocabulary", required_argument, NULL, 'v'},
+        {"zipf", required_argument, NULL, 'z'},
+        {"words", required_argument, NULL, 'w'},
+        {"fanout", required_argument, NULL, 'f'},
+        {"depth", required_argument, NULL, 'd'},
+        {"duplicates", required_argument, NULL, 'D'},
+        {"seed", required_argument, NULL, 's'},
+        {"url", required_argument, NULL, 'u'},
+        {"site", no_argument, NULL, 'S'},
+        {"pagedir", no_argument, NULL, 'P'},
+        {"archive", no_argument, NULL, 'A'},
+        {"compress", no_argument, NULL, 'C'},
+        {NULL, 0, NULL, 0}
+    };
+    const char* usage = "Usage: ./corpusgen [--pages N] [--vocabulary V] [--zipf S] [--words W] [--fanout F] [--depth D] [--duplicates PERCENT] [--seed N] [--url URL] (--site | --pagedir [--archive | --compress]) directory\n";
+    bool site = false, pagedir = false;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", longOptions, NULL)) != -1){
+        switch (opt){
+        case 'n':
+            options->numPages = parseOption(optarg, "Number of pages", 1, MAX_PAGES);
+            break;
+        case 'v':
+            options->vocabulary = parseOption(optarg, "Vocabulary", 1, MAX_VOCABULARY);
+            break;
+        case 'z':
+            if (sscanf(optarg, "%lf", &options->zipf) != 1 || options->zipf < 0 || options->zipf > 10){
+                fprintf(stderr, "Error: Zipf exponent must be a number between 0 and 10.\n");
+                exit(1);
+            }
+            break;
+        case 'w':
+            options->words = parseOption(optarg, "Words per page", 0, 1000000);
+            break;
+        case 'f':
+            options->fanout = parseOption(optarg, "Fan-out", 1, MAX_FANOUT);
+            break;
+        case 'd':
+            options->depth = parseOption(optarg, "Depth", 1, MAX_PAGES);
+            break;
+        case 'D':
+            options->duplicates = parseOption(optarg, "Duplicate percentage", 0, 100);
+            break;
+        case 's':
+            options->seed = parseOption(optarg, "Seed", 0, 2000000000);
+            break;
+        case 'u':
+            options->url = optarg;
+            break;
+        case 'S':
+            site = true;
+            break;
+        case 'P':
+            pagedir = true;
+            break;
+        case 'A':
+            if (options->layout == PAGEDIR_FILES) options->layout = PAGEDIR_ARCHIVE;
+            break;
+        case 'C':
+            options->layout = PAGEDIR_COMPRESSED;
+            break;
+        default:
+            fprintf(stderr, "%s", usage);
+            exit(1);
+        }
+    }
+    if (site == pagedir || argc - optind != 1){
+        fprintf(stderr, "%s", usage);
+        exit(1);
+    }
+    if (site && options->layout != PAGEDIR_FILES){
+        fprintf(stderr, "Error: --archive and --compress are for --pagedir.\n");
+        exit(1);
+    }
+    options->site = site;
+    *directory = argv[optind];
+}
+
+/**
+* Description: Parses the integer value of a command-line option, exiting if it isn't one
+*              within [min, max].
+* @param arg: The option's value.
+* @param name: What the option is, for the error message.
+* @param min: Smallest value allowed.
+* @param max: Largest value allowed.
+* @return The value.
+*/
+static int
+parseOption(const char* arg, const char* name, const int min, const int max){
+    int value;
+    if (sscanf(arg, "%d", &value) != 1 || value < min || value > max){
+        fprintf(stderr, "Error: %s must be an integer between %d and %d.\n", name, min, max);
+        exit(1);
+    }
+    return value;
+}
+
+/**
+* Description: Works out the tree's branching: the fan-out if no depth was asked for,
+*              otherwise the smallest that fits every page within the depth. Exits if
+*              that takes more links than the fan-out.
+* @param options: The corpus options.
+* @return The branching.
+*/
+static int
+branching(const corpusOptions_t* options){
+    if (options->depth == 0 || options->numPages == 1) return options->fanout;
+    for (int b = 1; b <= options->fanout; b++){
+        // Pages within the depth: 1 + b + b^2 + ... + b^depth, stopping once it is enough
+        long reach = 1, level = 1;
+        for (int d = 1; d <= options->depth && reach < options->numPages; d++){
+            level *= b;
+            reach += level;
+        }
+        if (reach >= options->numPages) return b;
+    }
+    fprintf(stderr, "Error: %d pages don't fit within depth %d with a fan-out of %d.\n",
+            options->numPages, options->depth, options->fanout);
+    exit(1);
+}
+
+/**
+* Description: Returns a page's depth: how many links it is from the index.
+* @param page: The page number.
+* @param b: The tree's branching.
+* @return The depth.
+*/
+static int
+levelOf(int page, const int b){
+    int level = 0;
+    while (page > 0){
+        page = (page - 1) / b;
+        level++;
+    }
+    return level;
+}
+
+/**
+* Description: Makes the vocabulary: size words built from consonant-vowel syllables, so
+*              each is at least four letters (the indexer skips shorter ones) and all are
+*              different, with an alias table for drawing them with probability in
+*              proportion to 1/rank^exponent.
+* @param size: Number of words.
+* @param exponent: The Zipf exponent.
+* @return The new vocabulary.
+*/
+static vocabulary_t*
+vocabulary_new(const int size, const double exponent){
+    const char* consonants = "bcdfghjklmnprstvwxyz";
+    const char* vowels = "aeiou";
+    int syllables = strlen(consonants) * strlen(vowels);
+    vocabulary_t* vocabulary = mem_assert(mem_malloc(sizeof(vocabulary_t)), "Error: Failed to allocate memory for vocabulary.\n");
+    vocabulary->size = size;
+    vocabulary->words = mem_assert(mem_malloc(size * sizeof(char*)), "Error: Failed to allocate memory for vocabulary.\n");
+    vocabulary->keep = mem_assert(mem_malloc(size * sizeof(double)), "Error: Failed to allocate memory for vocabulary.\n");
+    vocabulary->alias = mem_assert(mem_malloc(size * sizeof(int)), "Error: Failed to allocate memory for vocabulary.\n");
+    for (int r = 0; r < size; r++){
+        // The digits of r + syllables in base syllables: never fewer than two
+        char word[32];
+        int len = 0;
+        for (long n = (long)r + syllables; n > 0; n /= syllables){
+            int syllable = n % syllables;
+            word[len++] = consonants[syllable / strlen(vowels)];
+            word[len++] = vowels[syllable % strlen(vowels)];
+        }
+        word[len] = '\0';
+        vocabulary->words[r] = mem_assert(mem_malloc(len + 1), "Error: Failed to allocate memory for vocabulary.\n");
+        strcpy(vocabulary->words[r], word);
+    }
+
+    // Vose's alias method: scale the probabilities so they average 1, then pair each slot
+    // below 1 with one above, which gives it the rest of its share
+    double total = 0;
+    for (int r = 0; r < size; r++){
+        vocabulary->keep[r] = pow(r + 1, -exponent);
+        total += vocabulary->keep[r];
+    }
+    int* small = mem_assert(mem_malloc(size * sizeof(int)), "Error: Failed to allocate memory for vocabulary.\n");
+    int* large = mem_assert(mem_malloc(size * sizeof(int)), "Error: Failed to allocate memory for vocabulary.\n");
+    int numSmall = 0, numLarge = 0;
+    for (int r = 0; r < size; r++){
+        vocabulary->keep[r] *= size / total;
+        vocabulary->alias[r] = r;
+        if (vocabulary->keep[r] < 1) small[numSmall++] = r;
+        else large[numLarge++] = r;
+    }
+    while (numSmall > 0 && numLarge > 0){
+        int s = small[--numSmall];
+        int l = large[numLarge - 1];
+        vocabulary->alias[s] = l;
+        vocabulary->keep[l] -= 1 - vocabulary->keep[s];
+        if (vocabulary->keep[l] < 1){
+            numLarge--;
+            small[numSmall++] = l;
+        }
+    }
+    // Whatever is left is 1 but for rounding
+    while (numSmall > 0) vocabulary->keep[small[--numSmall]] = 1;
+    while (numLarge > 0) vocabulary->keep[large[--numLarge]] = 1;
+    mem_free(small);
+    mem_free(large);
+    return vocabulary;
+}
+
+/**
+* Description: Deletes the vocabulary.
+* @param vocabulary: The vocabulary.
+* @return void
+*/
+static void
+vocabulary_delete(vocabulary_t* vocabulary){
+    for (int r = 0; r < vocabulary->size; r++){
+        mem_free(vocabulary->words[r]);
+    }
+    mem_free(vocabulary->words);
+    mem_free(vocabulary->keep);
+    mem_free(vocabulary->alias);
+    mem_free(vocabulary);
+}
+
+/**
+* Description: Makes the HTML of a page: a heading, its text, then its links, first to
+*              its children in the tree and then to pages already linked to. A duplicate
+*              page's text is made exactly as that of the earlier page it copies.
+* @param page: The page number.
+* @param b: The tree's branching.
+* @param options: The corpus options.
+* @param vocabulary: The vocabulary.
+* @return The HTML, which the caller must free.
+*/
+static char*
+makePage(const int page, const int b, const corpusOptions_t* options, const vocabulary_t* vocabulary){
+    size_t len = 0, cap = 4096;
+    char* html = mem_assert(mem_malloc(cap), "Error: Failed to allocate memory for page.\n");
+    appendf(&html, &len, &cap, "<html><head><title>Page %d</title></head><body>\n<h1>Page %d</h1>\n<p>", page, page);
+
+    rng_t links = rngFor(options->seed, 1, page);
+    int source = page;
+    if (page > 0 && randomBelow(&links, 100) < options->duplicates){
+        source = (int)randomBelow(&links, page);
+    }
+    rng_t text = rngFor(options->seed, 2, source);
+    long numWords = options->words / 2 + randomBelow(&text, options->words + 1);
+    for (long w = 0; w < numWords; w++){
+        long slot = randomBelow(&text, vocabulary->size);
+        int r = randomUnit(&text) < vocabulary->keep[slot] ? (int)slot : vocabulary->alias[slot];
+        appendf(&html, &len, &cap, (w + 1) % WORDS_PER_LINE == 0 ? "%s\n" : "%s ", vocabulary->words[r]);
+    }
+    appendf(&html, &len, &cap, "</p>\n");
+
+    // Children first, so a breadth-first crawl finds pages in number order; the other links
+    // go to pages no later than the last child linked so far, which the crawl has seen
+    int numLinks = 0;
+    for (long child = (long)page * b + 1; child <= (long)page * b + b && child < options->numPages; child++){
+        appendf(&html, &len, &cap, "<a href=\"%ld.html\">page %ld</a>\n", child, child);
+        numLinks++;
+    }
+    long seen = (long)page * b + b < options->numPages ? (long)page * b + b : options->numPages - 1;
+    for (; numLinks < options->fanout; numLinks++){
+        long target = randomBelow(&links, seen + 1);
+        if (target == 0) appendf(&html, &len, &cap, "<a href=\"index.html\">home</a>\n");
+        else appendf(&html, &len, &cap, "<a href=\"%ld.html\">page %ld</a>\n", target, target);
+    }
+    appendf(&html, &len, &cap, "</body></html>\n");
+    return html;
+}
+
+/**
+* Description: Appends formatted text to a buffer, doubling it as needed.
+* @param buffer: The buffer.
+* @param len: Bytes in it so far.
+* @param cap: Its size.
+* @param format: printf format of the text.
+* @return void
+*/
+static void
+appendf(char** buffer, size_t* len, size_t* cap, const char* format, ...){
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(*buffer + *len, *cap - *len, format, args);
+    va_end(args);
+    if (*len + n >= *cap){
+        while (*len + n >= *cap) *cap *= 2;
+        char* bigger = mem_assert(mem_malloc(*cap), "Error: Failed to allocate memory for page.\n");
+        memcpy(bigger, *buffer, *len);
+        mem_free(*buffer);
+        *buffer = bigger;
+        va_start(args, format);
+        vsnprintf(*buffer + *len, *cap - *len, format, args);
+        va_end(args);
+    }
+    *len += n;
+}
+
+/**
+* Description: Returns the random number generator for one of a page's streams (its
+*              links or its text), seeded from the corpus seed with splitmix64 so that
+*              nearby pages get unrelated sequences.
+* @param seed: The corpus seed.
+* @param stream: Which of the page's streams.
+* @param page: The page number.
+* @return The generator.
+*/
+static rng_t
+rngFor(const uint64_t seed, const uint64_t stream, const int page){
+    uint64_t z = seed * 0x9E3779B97F4A7C15ULL + stream * 0xBF58476D1CE4E5B9ULL + (uint64_t)page + 1;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return (rng_t){ .state = z != 0 ? z : 1 };
+}
+
+/**
+* Description: Returns the generator's next 64 random bits (xorshift64*).
+* @param rng: The generator.
+* @return The bits.
+*/
+static uint64_t
+nextRandom(rng_t* rng){
+    rng->state ^= rng->state >> 12;
+    rng->state ^= rng->state << 25;
+    rng->state ^= rng->state >> 27;
+    return rng->state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+* Description: Returns a random integer in [0, bound).
+* @param rng: The generator.
+* @param bound: One past the largest value; at least 1.
+* @return The integer.
+*/
+static long
+randomBelow(rng_t* rng, const long bound){
+    return bound > 1 ? (long)(nextRandom(rng) % (uint64_t)bound) : 0;
+}
+
+/**
+* Description: Returns a random number in [0, 1).
+* @param rng: The generator.
+* @return The number.
+*/
+static double
+randomUnit(rng_t* rng){
+    return (nextRandom(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
@@ -0,0 +1,53 @@
+#!/bin/bash
+# indexbench.sh - compares indexer throughput (docs/sec) when it reads the HTML
+#                 stored in the pageDirectory versus re-fetching every page, and
+#                 with 2, 4 and 8 threads (or the counts in THREADS) against one,
+#                 and built in runs of MEMORY megabytes (default 16) with --memory.
+#
+# Usage: ./indexbench.sh pageDirectory [indexer]
+#
+# The --refetch run needs the pages' origin to be reachable; it is skipped
+# with SKIP_REFETCH=1.
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 pageDirectory [indexer]" >&2
+    exit 1
+fi
+
+pageDirectory="$1"
+INDEXER="${2:-../indexer/indexer}"
+indexFile=$(mktemp)
+trap 'rm -f "$indexFile"' EXIT
+
+# the indexer stops at the first missing docID, so count the same way
+numDocs=0
+while [ -f "$pageDirectory/$((numDocs + 1))" ]; do
+    numDocs=$((numDocs + 1))
+done
+if [ $numDocs -eq 0 ]; then
+    echo "No documents found in $pageDirectory" >&2
+    exit 1
+fi
+
+# run label [indexer flags...]
+run() {
+    local label="$1"; shift
+    local start end
+    start=$(date +%s.%N)
+    if ! "$INDEXER" "$@" "$pageDirectory" "$indexFile" > /dev/null; then
+        echo "$label: indexer failed" >&2
+        return 1
+    fi
+    end=$(date +%s.%N)
+    awk -v label="$label" -v n="$numDocs" -v s="$start" -v e="$end" \
+        'BEGIN { t = e - s; printf "%-10s %8d docs %10.3f s %12.1f docs/sec\n", label, n, t, n / t }'
+}
+
+run stored
+for threads in ${THREADS:-2 4 8}; do
+    run "threads=$threads" --threads "$threads"
+done
+run "memory=${MEMORY:-16}" --memory "${MEMORY:-16}"
+if [ -z "$SKIP_REFETCH" ]; then
+    run refetch --refetch
+fi
@@ -0,0 +1,483 @@
+/**
+ * linkbench.c
+ *
+ * Description: Checks the link extractor (common/linkscan.c) against libcs50's
+ *              webpage_getNextURL, and measures the throughput of both in MB of HTML
+ *              per second. The pages are generated from a seed: text and tags with
+ *              links among them written every way getNextURL tells apart (quoted with
+ *              either quote or not at all, any case, whitespace inside the tag and the
+ *              link, fragments, other schemes, "<a" tags without an href, "href=" in
+ *              other tags, tags left open), or read from a crawler's pageDirectory.
+ *
+ *              On every page the extractor must find the same links in the same order,
+ *              each giving the same canonical URL from linkscan_resolve as normalizeURL
+ *              gives for what getNextURL returns. Mismatches are printed; the program
+ *              exits non-zero if there were any. Then three ways through the pages are
+ *              timed: getNextURL alone, linkscan_next alone, and each of them with every
+ *              link canonicalized.
+ *
+ *              Every page is also scanned as if it were arriving in pieces of a random
+ *              size, with linkscan_nextPartial on each longer prefix and linkscan_next
+ *              once it is all there: between them they must find the same links as
+ *              linkscan_next on the whole page.
+ *
+ * Usage: ./linkbench [-n numPages] [-s seed] [-r rounds] [-d pageDirectory]
+ */
+#define _POSIX_C_SOURCE 200809L    // strdup, clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "webpage.h"
+#include "pagedir.h"
+#include "linkscan.h"
+#include "urlcanon.h"
+#include "mem.h"
+
+#define MAX_URL 8192
+#define MAX_MISMATCHES 20           // printed; the rest are only counted
+#define BATCH 64                    // links taken from linkscan_next at a time
+
+// A small fast random number generator (xorshift64*)
+typedef struct rng {
+    uint64_t state;
+} rng_t;
+
+// A page to scan: its URL and HTML
+typedef struct testPage {
+    char* url;
+    char* html;
+    size_t len;
+} testPage_t;
+
+// A growable string
+typedef struct text {
+    char* s;
+    size_t len;
+    size_t cap;
+} text_t;
+
+static const char* BASES[] = { "http://cs50tse.cs.dartmouth.edu/tse/letters/index.html",
+                               "http://cs50tse.cs.dartmouth.edu/tse/wikipedia/Computer_science.html",
+                               "http://cs50tse.cs.dartmouth.edu/tse/",
+                               "http://cs50tse.cs.dartmouth.edu/tse/toscrape/catalogue/page-2.html",
+                               "http://www.example.com/a/b/c.html" };
+static const char* WORDS[] = { "the", "search", "engine", "crawler", "index", "query", "Dartmouth",
+                               "alpha", "beta", "gamma", "href", "hash", "a", "at", "<b>bold</b>",
+                               "<i>it</i>", "&amp;", "x<y", "<br/>", "<img src=\"p.png\">" };
+static const char* TARGETS[] = { "index.html", "B.html", "../wikipedia/Linked_list.html", "./C.html",
+                                 "/tse/letters/A.html", "dir/", "dir/../E.html", "page.htm", "photo.jpg",
+                                 "http://cs50tse.cs.dartmouth.edu/tse/letters/D.html",
+                                 "HTTP://CS50TSE.cs.dartmouth.edu/tse/./letters/F.html",
+                                 "https://en.wikipedia.org/wiki/Algorithm", "http://google.com/",
+                                 "mailto:someone@example.com", "javascript:void(0)", "ftp://x/y.html",
+                                 "#top", "G.html#sec2", "q.html?a=1&b=/c", "", "//other.host/x.html",
+                                 "h.html?x=http://y/", "sp ace.html", "two  words/and\tmore.html" };
+static const char* OPENERS[] = { "<a href=\"%s\">", "<a href=\"%s\">", "<a href=\"%s\">", "<A HREF='%s'>",
+                                 "<a href=%s>", "<a class=\"nav\" href=\"%s\" title=\"t\">",
+                                 "<a\n   href = \"%s\" >", "< a href=\"%s\">", "<a hReF=\"%s\">",
+                                 "<a name=\"n\">x</a><a href=\"%s\">", "<a href=\" %s \">",
+                                 "<a h ref=\"%s\">", "<abbr title=\"%s\">", "<area href=\"%s\">",
+                                 "<a>plain</a><link href=\"%s\">", "<a href=%s title=x>",
+                                 "<a id=x>no link</a><p>%s</p>" };
+
+static void makePage(rng_t* rng, text_t* page);
+static bool checkPage(const testPage_t* page, int* links, int* mismatches);
+static bool checkStreamed(testPage_t* page, const size_t piece, int* mismatches);
+static int scanAll(const char* html, const size_t len, linkSpan_t** spans);
+static char* nextExpected(webpage_t* page, int* pos, bool* more);
+static bool crashesNormalizeURL(const char* url);
+static void text_add(text_t* text, const char* s);
+static const char* pick(rng_t* rng, const char** choices, const int count);
+static uint64_t nextRandom(rng_t* rng);
+static double nowSeconds(void);
+
+#define PICK(rng, choices) pick(rng, choices, sizeof(choices) / sizeof(choices[0]))
+
+
+int
+main(const int argc, char* argv[]){
+    int numPages = 2000;
+    unsigned long seed = 1;
+    int rounds = 3;
+    const char* pageDirectory = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:r:d:")) != -1){
+        bool ok = true;
+        if (opt == 'n'){
+            ok = sscanf(optarg, "%d", &numPages) == 1 && numPages >= 0;
+        } else if (opt == 's'){
+            ok = sscanf(optarg, "%lu", &seed) == 1;
+        } else if (opt == 'r'){
+            ok = sscanf(optarg, "%d", &rounds) == 1 && rounds >= 1;
+        } else if (opt == 'd'){
+            pageDirectory = optarg;
+        } else {
+            ok = false;
+        }
+        if (!ok){
+            fprintf(stderr, "Usage: ./linkbench [-n numPages] [-s seed] [-r rounds] [-d pageDirectory]\n");
+            exit(1);
+        }
+    }
+
+    // The pages: the page directory's, or generated ones
+    testPage_t* pages = NULL;
+    int count = 0;
+    if (pageDirectory != NULL){
+        pagedir_t* pagedir = pagedir_open(pageDirectory);
+        if (pagedir == NULL){
+            fprintf(stderr, "Error: Can't read %s.\n", pageDirectory);
+            exit(1);
+        }
+        webpage_t* stored;
+        int cap = 0;
+        for (int docID = 1; (stored = pagedir_read(pagedir, docID)) != NULL; docID++){
+            if (count == cap){
+                cap = cap > 0 ? cap * 2 : 1024;
+                pages = realloc(pages, cap * sizeof(testPage_t));
+                mem_assert(pages, "Error: Failed to allocate memory for pages.\n");
+            }
+            pages[count].url = strdup(webpage_getURL(stored));
+            pages[count].html = strdup(webpage_getHTML(stored));
+            pages[count].len = strlen(pages[count].html);
+            count++;
+            webpage_delete(stored);
+        }
+        pagedir_close(pagedir);
+    } else {
+        pages = mem_assert(mem_malloc((numPages > 0 ? numPages : 1) * sizeof(testPage_t)), "Error: Failed to allocate memory for pages.\n");
+        rng_t rng = { .state = seed * 0x9E3779B97F4A7C15ULL + 1 };
+        for (count = 0; count < numPages; count++){
+            text_t html = { NULL, 0, 0 };
+            makePage(&rng, &html);
+            pages[count].url = strdup(PICK(&rng, BASES));
+            pages[count].html = html.s;
+            pages[count].len = html.len;
+        }
+    }
+    size_t bytes = 0;
+    for (int i = 0; i < count; i++) bytes += pages[i].len;
+
+    // Same links, page by page
+    int links = 0;
+    int mismatches = 0;
+    for (int i = 0; i < count; i++) checkPage(&pages[i], &links, &mismatches);
+    printf("pages: %d, %.1f MB, %d links, %d mismatches\n", count, bytes / 1e6, links, mismatches);
+
+    // Same links, page by page, as the pages arrive a piece at a time
+    int streamMismatches = 0;
+    rng_t pieces = { .state = seed * 0x9E3779B97F4A7C15ULL + 2 };
+    for (int i = 0; i < count; i++){
+        checkStreamed(&pages[i], 1 + nextRandom(&pieces) % 4096, &streamMismatches);
+    }
+    printf("streamed: %d mismatches\n", streamMismatches);
+    mismatches += streamMismatches;
+
+    // getNextURL squeezes each page as it goes, so it gets fresh copies, made untimed
+    double times[4] = { 0, 0, 0, 0 };
+    long checksum[4] = { 0, 0, 0, 0 };
+    char buf[MAX_URL];
+    for (int way = 0; way < 4; way++){
+        bool canonicalize = way >= 2;
+        bool scanner = way % 2 == 1;
+        for (int r = 0; r < rounds; r++){
+            for (int i = 0; i < count; i++){
+                if (!scanner){
+                    webpage_t* page = webpage_new(strdup(pages[i].url), 0, strdup(pages[i].html));
+                    double start = nowSeconds();
+                    int pos = 0;
+                    char* url;
+                    while ((url = webpage_getNextURL(page, &pos)) != NULL){
+                        if (canonicalize && !crashesNormalizeURL(url)){
+                            char* normalized = normalizeURL(url);
+                            if (normalized != NULL) checksum[way] += normalized[0];
+                            free(normalized);
+                        } else {
+                            checksum[way]++;
+                        }
+                        free(url);
+                    }
+                    times[way] += nowSeconds() - start;
+                    webpage_delete(page);
+                } else {
+                    double start = nowSeconds();
+                    linkSpan_t spans[BATCH];
+                    size_t pos = 0;
+                    int n;
+                    while ((n = linkscan_next(pages[i].html, pages[i].len, &pos, spans, BATCH)) > 0){
+                        for (int k = 0; k < n; k++){
+                            urlView_t view;
+                            if (!canonicalize){
+                                checksum[way]++;
+                            } else if (linkscan_resolve(pages[i].html, &spans[k], pages[i].url, buf, sizeof(buf), &view)){
+                                checksum[way] += view.url[0];
+                            }
+                        }
+                    }
+                    times[way] += nowSeconds() - start;
+                }
+            }
+        }
+    }
+    double mb = bytes * (double)rounds / 1e6;
+    printf("webpage_getNextURL: %.1f MB/s\n", times[0] > 0 ? mb / times[0] : 0);
+    printf("linkscan_next: %.1f MB/s (%.1fx)\n", times[1] > 0 ? mb / times[1] : 0, times[1] > 0 ? times[0] / times[1] : 0);
+    printf("getNextURL + normalizeURL: %.1f MB/s\n", times[2] > 0 ? mb / times[2] : 0);
+    printf("linkscan_next + linkscan_resolve: %.1f MB/s (%.1fx)\n", times[3] > 0 ? mb / times[3] : 0, times[3] > 0 ? times[2] / times[3] : 0);
+    if (checksum[0] != checksum[1] || checksum[2] != checksum[3]) printf("checksums differ (the two disagree)\n");
+
+    for (int i = 0; i < count; i++){
+        free(pages[i].url);
+        free(pages[i].html);
+    }
+    free(pages);
+    return mismatches > 0 ? 1 : 0;
+}
+
+/**
+* Description: Checks one page: linkscan must find the links getNextURL does, in order,
+*              and resolve each to the URL normalizeURL makes of getNextURL's.
+* @param page: The page.
+* @param links: Counts the links found.
+* @param mismatches: Counts the links that don't agree.
+* @return Whether the whole page agreed.
+*/
+static bool
+checkPage(const testPage_t* page, int* links, int* mismatches){
+    webpage_t* copy = webpage_new(strdup(page->url), 0, strdup(page->html));
+    int getPos = 0;
+    size_t scanPos = 0;
+    linkSpan_t spans[BATCH];
+    int numSpans = 0;
+    int next = 0;
+    char buf[MAX_URL];
+    bool agreed = true;
+    while (true){
+        bool more;
+        char* expected = nextExpected(copy, &getPos, &more);
+        if (next == numSpans){
+            numSpans = linkscan_next(page->html, page->len, &scanPos, spans, BATCH);
+            next = 0;
+        }
+        bool found = next < numSpans;
+        if (!more && !found) break;
+        (*links)++;
+        urlView_t view;
+        bool ok = found && linkscan_resolve(page->html, &spans[next], page->url, buf, sizeof(buf), &view);
+        bool same = more && found && (ok ? expected != NULL && strcmp(expected, view.url) == 0 : expected == NULL);
+        if (!same){
+            agreed = false;
+            if ((*mismatches)++ < MAX_MISMATCHES){
+                char link[128] = "(none)";
+                if (found) snprintf(link, sizeof(link), "%.*s", (int)(spans[next].len < 100 ? spans[next].len : 100),
+                                    page->html + spans[next].start);
+                printf("MISMATCH on %s, link %d\n  getNextURL+normalizeURL: %s\n  linkscan:                %s (%s)\n",
+                       page->url, *links, !more ? "(no link)" : expected ? expected : "(rejected)",
+                       !found ? "(no link)" : ok ? view.url : "(rejected)", link);
+            }
+        }
+        free(expected);
+        if (found) next++;
+        if (!more || !found) break;
+    }
+    webpage_delete(copy);
+    return agreed;
+}
+
+/**
+* Description: Checks one page scanned as it arrives, piece by piece: linkscan_nextPartial
+*              on every prefix, then linkscan_next on the whole page, must between them
+*              find exactly the links linkscan_next finds on the whole page alone.
+* @param page: The page; each prefix is ended with a NUL for a moment, as the fetcher does.
+* @param piece: How many bytes arrive at a time.
+* @param mismatches: Counts the pages that don't agree.
+* @return Whether the page agreed.
+*/
+static bool
+checkStreamed(testPage_t* page, const size_t piece, int* mismatches){
+    linkSpan_t* whole = NULL;
+    int wholeCount = scanAll(page->html, page->len, &whole);
+    linkSpan_t* found = mem_assert(mem_malloc((wholeCount + BATCH) * sizeof(linkSpan_t)), "Error: Failed to allocate memory for links.\n");
+    int foundCount = 0;
+    bool agreed = true;
+    size_t pos = 0;
+    for (size_t len = piece; agreed && len < page->len; len += piece){
+        char saved = page->html[len];
+        page->html[len] = '\0';
+        int n;
+        while (agreed && (n = linkscan_nextPartial(page->html, len, &pos, found + foundCount, BATCH)) > 0){
+            foundCount += n;
+            agreed = foundCount <= wholeCount;
+        }
+        page->html[len] = saved;
+    }
+    int n;
+    while (agreed && (n = linkscan_next(page->html, page->len, &pos, found + foundCount, BATCH)) > 0){
+        foundCount += n;
+        agreed = foundCount <= wholeCount;
+    }
+    agreed = agreed && foundCount == wholeCount;
+    for (int i = 0; agreed && i < wholeCount; i++){
+        agreed = found[i].start == whole[i].start && found[i].len == whole[i].len &&
+                 found[i].relative == whole[i].relative && found[i].spaced == whole[i].spaced;
+    }
+    if (!agreed && (*mismatches)++ < MAX_MISMATCHES){
+        printf("STREAMED MISMATCH on %s in pieces of %zu: %d links, not %d\n", page->url, piece, foundCount, wholeCount);
+    }
+    free(whole);
+    free(found);
+    return agreed;
+}
+
+/**
+* Description: Finds all of a page's links with linkscan_next.
+* @param html: The page's HTML.
+* @param len: Its length.
+* @param spans: Set to the links, in an array to be freed.
+* @return How many there are.
+*/
+static int
+scanAll(const char* html, const size_t len, linkSpan_t** spans){
+    int count = 0;
+    int cap = BATCH;
+    *spans = mem_assert(mem_malloc(cap * sizeof(linkSpan_t)), "Error: Failed to allocate memory for links.\n");
+    size_t pos = 0;
+    int n;
+    while ((n = linkscan_next(html, len, &pos, *spans + count, BATCH)) > 0){
+        count += n;
+        if (count + BATCH > cap){
+            cap *= 2;
+            *spans = realloc(*spans, cap * sizeof(linkSpan_t));
+            mem_assert(*spans, "Error: Failed to allocate memory for links.\n");
+        }
+    }
+    return count;
+}
+
+/**
+* Description: Gets getNextURL's next link, normalized.
+* @param page: The page, squeezed as getNextURL goes.
+* @param pos: getNextURL's position.
+* @param more: Set to whether there was a link.
+* @return The normalized URL, or NULL if normalizeURL rejects it.
+*/
+static char*
+nextExpected(webpage_t* page, int* pos, bool* more){
+    char* url = webpage_getNextURL(page, pos);
+    *more = url != NULL;
+    if (url == NULL) return NULL;
+    char* normalized = crashesNormalizeURL(url) ? NULL : normalizeURL(url);
+    free(url);
+    return normalized;
+}
+
+/**
+* Description: Decides whether normalizeURL would crash on a URL: its parser copies the
+*              path from the host's end to the first '?' or '#', and when that comes
+*              before the host's end it asks calloc for a negative size.
+* @param url: The URL.
+* @return Whether to keep the URL away from normalizeURL.
+*/
+static bool
+crashesNormalizeURL(const char* url){
+    const char* schemeEnd = strpbrk(url, ":/?#");
+    if (schemeEnd == NULL || *schemeEnd != ':') return false;
+    schemeEnd++;
+    if (strncmp(schemeEnd, "//", 2) == 0) schemeEnd += 2;
+    const char* hostEnd = strchr(schemeEnd, '/');
+    if (hostEnd == NULL) hostEnd = schemeEnd + strlen(schemeEnd);
+    const char* pathEnd = strpbrk(schemeEnd, "?#");
+    return pathEnd != NULL && pathEnd < hostEnd;
+}
+
+/**
+* Description: Makes a random page: paragraphs of words and tags, with a link after
+*              every few words, and now and then a tag left open at the very end.
+* @param rng: The generator.
+* @param page: Where to write it.
+* @return void
+*/
+static void
+makePage(rng_t* rng, text_t* page){
+    char tag[MAX_URL];
+    text_add(page, "<!DOCTYPE html>\n<html><head><title>Page</title></head>\n<body>\n");
+    int paragraphs = 10 + nextRandom(rng) % 30;
+    for (int p = 0; p < paragraphs; p++){
+        text_add(page, nextRandom(rng) % 4 == 0 ? "<div class=\"section\">\n<p>" : "<p>");
+        int words = 40 + nextRandom(rng) % 80;
+        for (int w = 0; w < words; w++){
+            text_add(page, PICK(rng, WORDS));
+            text_add(page, nextRandom(rng) % 12 == 0 ? "\n" : " ");
+            if (nextRandom(rng) % 10 == 0){
+                snprintf(tag, sizeof(tag), PICK(rng, OPENERS), PICK(rng, TARGETS));
+                text_add(page, tag);
+                text_add(page, "link</a> ");
+            }
+        }
+        text_add(page, "</p>\n");
+    }
+    uint64_t ending = nextRandom(rng) % 8;
+    if (ending == 0) text_add(page, "<a href=\"unterminated.html");
+    if (ending == 1) text_add(page, "<a href=open.html");
+    if (ending == 2) text_add(page, "<a");
+    text_add(page, ending <= 2 ? "" : "</body></html>\n");
+}
+
+/**
+* Description: Appends a string to a growable string.
+* @param text: The string to grow.
+* @param s: What to append.
+* @return void
+*/
+static void
+text_add(text_t* text, const char* s){
+    size_t len = strlen(s);
+    if (text->len + len + 1 > text->cap){
+        text->cap = (text->len + len + 1) * 2;
+        text->s = realloc(text->s, text->cap);
+        mem_assert(text->s, "Error: Failed to allocate memory for page.\n");
+    }
+    memcpy(text->s + text->len, s, len + 1);
+    text->len += len;
+}
+
+/**
+* Description: Picks one of the choices at random.
+* @param rng: The generator.
+* @param choices: The choices.
+* @param count: How many there are.
+* @return The choice.
+*/
+static const char*
+pick(rng_t* rng, const char** choices, const int count){
+    return choices[nextRandom(rng) % count];
+}
+
+/**
+* Description: Returns the generator's next 64 random bits (xorshift64*).
+* @param rng: The generator.
+* @return The bits.
+*/
+static uint64_t
+nextRandom(rng_t* rng){
+    rng->state ^= rng->state >> 12;
+    rng->state ^= rng->state << 25;
+    rng->state ^= rng->state >> 27;
+    return rng->state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+* Description: Returns the monotonic clock in seconds.
+* @return The time.
+*/
+static double
+nowSeconds(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,316 @@
+/**
+ * lookupbench.c
+ *
+ * Description: Times looking words up in an index three ways: in the libcs50
+ *              hashtable index_load builds (jenkins hash, a modulo, then strcmp down
+ *              the chain), in a mapped binary index by its minimal perfect hash (one
+ *              hash, a pilot and a 16-byte slot), and in a binary index saved without
+ *              the hash, by binary search of the sorted dictionary.
+ *
+ *              The words are a generated vocabulary, or those of an index file in
+ *              either format. The index is saved to temporary files in the text format
+ *              and in the binary format with and without the hash, and their sizes
+ *              printed: the hash's slots and pilots cost about 17 bytes a word, less
+ *              the 12 its dictionary entries leave out. Every
+ *              word must be found each way with the same postings as the hashtable's,
+ *              and as many missing words, generated so as not to be in the index,
+ *              must be found none of the ways; mismatches are printed, and the
+ *              program exits non-zero if there were any. Then a shuffled mix of
+ *              present and missing words is looked up each way, and the time per
+ *              lookup printed.
+ *
+ * Usage: ./lookupbench [-n numWords] [-m missingPercent] [-s seed] [-r rounds] [-f indexFile]
+ */
+#define _POSIX_C_SOURCE 200809L    // mkstemp, clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "index.h"
+#include "indexmap.h"
+#include "hashtable.h"
+#include "counters.h"
+#include "mem.h"
+
+#define MAX_WORD 16
+#define MAX_MISMATCHES 20           // printed; the rest are only counted
+
+// A small fast random number generator (xorshift64*)
+typedef struct rng {
+    uint64_t state;
+} rng_t;
+
+// A growable list of words
+typedef struct wordList {
+    char** words;
+    int count;
+    int cap;
+} wordList_t;
+
+static void makeWord(rng_t* rng, char* word);
+static void gatherWord(void* list, const char* word, void* item);
+static bool samePostings(counters_t* ctrs, indexmap_t* map, const char* word);
+static void countDocument(void* docs, const int docID, const int count);
+static long fileSize(const char* filename);
+static void wordList_add(wordList_t* list, const char* word);
+static uint64_t nextRandom(rng_t* rng);
+static double nowSeconds(void);
+
+
+int
+main(const int argc, char* argv[]){
+    int numWords = 200000;
+    int missingPercent = 50;
+    unsigned long seed = 1;
+    int rounds = 5;
+    const char* indexFile = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:m:s:r:f:")) != -1){
+        bool ok = true;
+        if (opt == 'n'){
+            ok = sscanf(optarg, "%d", &numWords) == 1 && numWords >= 1;
+        } else if (opt == 'm'){
+            ok = sscanf(optarg, "%d", &missingPercent) == 1 && missingPercent >= 0 && missingPercent <= 100;
+        } else if (opt == 's'){
+            ok = sscanf(optarg, "%lu", &seed) == 1;
+        } else if (opt == 'r'){
+            ok = sscanf(optarg, "%d", &rounds) == 1 && rounds >= 1;
+        } else if (opt == 'f'){
+            indexFile = optarg;
+        } else {
+            ok = false;
+        }
+        if (!ok){
+            fprintf(stderr, "Usage: ./lookupbench [-n numWords] [-m missingPercent] [-s seed] [-r rounds] [-f indexFile]\n");
+            exit(1);
+        }
+    }
+
+    // The index: loaded from the file, or generated words each in a few documents
+    rng_t rng = { .state = seed * 0x9E3779B97F4A7C15ULL + 1 };
+    char word[MAX_WORD];
+    index_t* index;
+    if (indexFile != NULL){
+        index = index_load(indexFile);
+        if (index == NULL){
+            fprintf(stderr, "Error: Can't load index %s.\n", indexFile);
+            exit(1);
+        }
+    } else {
+        index = index_new(numWords);
+        for (int i = 0; i < numWords; i++){
+            makeWord(&rng, word);
+            int docs = 1 + nextRandom(&rng) % 4;
+            for (int d = 1; d <= docs; d++) index_insert(index, word, d * 7 + i % 5, 1 + nextRandom(&rng) % 9);
+        }
+    }
+    wordList_t present = { NULL, 0, 0 };
+    hashtable_iterate(index, &present, gatherWord);
+    wordList_t missing = { NULL, 0, 0 };
+    while (missing.count < present.count){
+        makeWord(&rng, word);
+        if (index_find(index, word) == NULL) wordList_add(&missing, word);
+    }
+
+    char textFile[] = "/tmp/lookupbench.XXXXXX";
+    char hashedFile[] = "/tmp/lookupbench.XXXXXX";
+    char sortedFile[] = "/tmp/lookupbench.XXXXXX";
+    int textFd = mkstemp(textFile);
+    int hashedFd = mkstemp(hashedFile);
+    int sortedFd = mkstemp(sortedFile);
+    if (textFd < 0 || hashedFd < 0 || sortedFd < 0){
+        fprintf(stderr, "Error: Can't create temporary files.\n");
+        exit(1);
+    }
+    close(textFd);
+    close(hashedFd);
+    close(sortedFd);
+    double start = nowSeconds();
+    bool saved = index_saveBinary(index, hashedFile);
+    double saveTime = nowSeconds() - start;
+    if (!saved || !index_saveBinarySorted(index, sortedFile) || !index_save(index, textFile)){
+        fprintf(stderr, "Error: Can't write the index files.\n");
+        exit(1);
+    }
+    indexmap_t* hashed = indexmap_open(hashedFile);
+    indexmap_t* sorted = indexmap_open(sortedFile);
+    long sizes[3] = { fileSize(textFile), fileSize(sortedFile), fileSize(hashedFile) };
+    unlink(textFile);
+    unlink(hashedFile);
+    unlink(sortedFile);
+    printf("%d words; binary index with hash saved in %.3f s\n", present.count, saveTime);
+    printf("sizes: text %ld B, binary without hash %ld B, binary with hash %ld B (%+.1f B/word for the hash)\n",
+           sizes[0], sizes[1], sizes[2], (double)(sizes[2] - sizes[1]) / present.count);
+
+    // Same answers, word by word
+    int mismatches = 0;
+    for (int i = 0; i < present.count; i++){
+        counters_t* ctrs = index_find(index, present.words[i]);
+        if (!samePostings(ctrs, hashed, present.words[i]) || !samePostings(ctrs, sorted, present.words[i])){
+            if (mismatches++ < MAX_MISMATCHES) printf("mismatch: %s\n", present.words[i]);
+        }
+    }
+    int falseHits = 0;
+    indexmapPostings_t postings;
+    for (int i = 0; i < missing.count; i++){
+        if (indexmap_find(hashed, missing.words[i], &postings)) falseHits++;
+        if (indexmap_find(sorted, missing.words[i], &postings)){
+            if (mismatches++ < MAX_MISMATCHES) printf("found missing: %s\n", missing.words[i]);
+        }
+    }
+    printf("present: %d words, %d mismatches; missing: %d words, %d taken for others by fingerprint\n",
+           present.count, mismatches, missing.count, falseHits);
+
+    // The lookups: present and missing words, shuffled
+    int numQueries = present.count;
+    const char** queries = mem_assert(mem_malloc(numQueries * sizeof(char*)), "Error: Failed to allocate memory for queries.\n");
+    for (int i = 0; i < numQueries; i++){
+        bool miss = (int)(nextRandom(&rng) % 100) < missingPercent;
+        queries[i] = miss ? missing.words[nextRandom(&rng) % missing.count] : present.words[nextRandom(&rng) % present.count];
+    }
+    long found[3] = { 0, 0, 0 };
+    double times[3];
+    start = nowSeconds();
+    for (int r = 0; r < rounds; r++){
+        for (int i = 0; i < numQueries; i++){
+            if (index_find(index, queries[i]) != NULL) found[0]++;
+        }
+    }
+    times[0] = nowSeconds() - start;
+    indexmap_t* maps[] = { hashed, sorted };
+    for (int m = 0; m < 2; m++){
+        start = nowSeconds();
+        for (int r = 0; r < rounds; r++){
+            for (int i = 0; i < numQueries; i++){
+                if (indexmap_find(maps[m], queries[i], &postings)) found[m + 1]++;
+            }
+        }
+        times[m + 1] = nowSeconds() - start;
+    }
+    double calls = (double)rounds * numQueries;
+    printf("%d%% missing words\n", missingPercent);
+    printf("hashtable (index_find): %.1f ns/lookup\n", times[0] / calls * 1e9);
+    printf("minimal perfect hash (indexmap_find): %.1f ns/lookup\n", times[1] / calls * 1e9);
+    printf("binary search (indexmap_find, no hash): %.1f ns/lookup\n", times[2] / calls * 1e9);
+    printf("speedup over hashtable: %.1fx\n", times[1] > 0 ? times[0] / times[1] : 0);
+    if (found[0] != found[1] || found[0] != found[2]) printf("found: %ld, %ld, %ld (the three disagree)\n", found[0], found[1], found[2]);
+
+    indexmap_close(hashed);
+    indexmap_close(sorted);
+    index_delete(index);
+    mem_free(queries);
+    for (int i = 0; i < present.count; i++) mem_free(present.words[i]);
+    for (int i = 0; i < missing.count; i++) mem_free(missing.words[i]);
+    mem_free(present.words);
+    mem_free(missing.words);
+    return mismatches > 0 || found[0] != found[2] ? 1 : 0;
+}
+
+/**
+* Description: Makes a random word of 3 to 12 lowercase letters, as normalizeWord leaves them.
+* @param rng: The generator.
+* @param word: Where to write it; at least MAX_WORD bytes.
+*/
+static void
+makeWord(rng_t* rng, char* word){
+    int len = 3 + nextRandom(rng) % 10;
+    for (int i = 0; i < len; i++) word[i] = 'a' + nextRandom(rng) % 26;
+    word[len] = '\0';
+}
+
+/**
+* Description: hashtable_iterate helper: adds the index's word to a wordList_t.
+*/
+static void
+gatherWord(void* list, const char* word, void* item){
+    wordList_add(list, word);
+}
+
+/**
+* Description: Whether a mapped index has a word with the same postings as its counters.
+* @param ctrs: The word's counters in the hashtable.
+* @param map: The mapped index.
+* @param word: The word.
+* @return true if found, with the same documents and counts.
+*/
+static bool
+samePostings(counters_t* ctrs, indexmap_t* map, const char* word){
+    indexmapPostings_t postings;
+    if (!indexmap_find(map, word, &postings)) return false;
+    int docs = 0;
+    counters_iterate(ctrs, &docs, countDocument);
+    int docID, count;
+    while (indexmap_next(&postings, &docID, &count)){
+        if (counters_get(ctrs, docID) != count) return false;
+        docs--;
+    }
+    return docs == 0;
+}
+
+/**
+* Description: counters_iterate helper: counts the documents.
+*/
+static void
+countDocument(void* docs, const int docID, const int count){
+    (*(int*)docs)++;
+}
+
+/**
+* Description: Returns a file's size.
+* @param filename: The file.
+* @return Its size in bytes, or -1 if it can't be read.
+*/
+static long
+fileSize(const char* filename){
+    FILE* fp = fopen(filename, "r");
+    if (fp == NULL) return -1;
+    long size = fseek(fp, 0, SEEK_END) == 0 ? ftell(fp) : -1;
+    fclose(fp);
+    return size;
+}
+
+/**
+* Description: Appends a copy of a word to a list.
+*/
+static void
+wordList_add(wordList_t* list, const char* word){
+    if (list->count == list->cap){
+        list->cap = list->cap > 0 ? list->cap * 2 : 1024;
+        char** bigger = mem_assert(mem_malloc(list->cap * sizeof(char*)), "Error: Failed to allocate memory for words.\n");
+        if (list->words != NULL){
+            memcpy(bigger, list->words, list->count * sizeof(char*));
+            mem_free(list->words);
+        }
+        list->words = bigger;
+    }
+    list->words[list->count] = mem_assert(mem_malloc(strlen(word) + 1), "Error: Failed to allocate memory for words.\n");
+    strcpy(list->words[list->count++], word);
+}
+
+/**
+* Description: Returns the next number from a xorshift64* generator.
+* @param rng: The generator.
+* @return The number.
+*/
+static uint64_t
+nextRandom(rng_t* rng){
+    rng->state ^= rng->state >> 12;
+    rng->state ^= rng->state << 25;
+    rng->state ^= rng->state >> 27;
+    return rng->state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+* Description: Returns the monotonic clock in seconds.
+* @return The time.
+*/
+static double
+nowSeconds(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,70 @@
+#!/bin/bash
+# scalebench.sh - measures the indexer and the querier on a synthetic corpus of any
+#                 size, generated by corpusgen straight into a page directory.
+#
+# Usage: ./scalebench.sh numPages [files|archive|compress] [numQueries] [corpusgen options...]
+#
+# Generates numPages pages (in the archive layout unless told otherwise), indexes them,
+# then runs numQueries queries (default 1000) through the querier: each one or two words
+# from the index joined by "and" or "or", picked with a fixed seed. Prints the time and
+# rate of each step. Set KEEP=1 to keep the page directory and index.
+
+if [ $# -lt 1 ]; then
+    echo "Usage: $0 numPages [files|archive|compress] [numQueries] [corpusgen options...]" >&2
+    exit 1
+fi
+
+numPages="$1"
+layout="${2:-archive}"
+numQueries="${3:-1000}"
+shift $(( $# < 3 ? $# : 3 ))
+HERE=$(dirname "$0")
+CORPUSGEN="$HERE/corpusgen"
+INDEXER="$HERE/../indexer/indexer"
+QUERIER="$HERE/../querier/querier"
+
+case "$layout" in
+    files) layoutFlag=() ;;
+    archive) layoutFlag=(--archive) ;;
+    compress) layoutFlag=(--compress) ;;
+    *) echo "Layout must be files, archive or compress" >&2; exit 1 ;;
+esac
+
+work=$(mktemp -d)
+pageDirectory="$work/pages"
+indexFile="$work/index"
+if [ -z "$KEEP" ]; then
+    trap 'rm -rf "$work"' EXIT
+else
+    echo "keeping $work"
+fi
+
+# step label count unit command... - runs the command and prints its time and rate
+step() {
+    local label="$1" count="$2" unit="$3"; shift 3
+    local start end
+    start=$(date +%s.%N)
+    if ! "$@" > /dev/null; then
+        echo "$label failed" >&2
+        exit 1
+    fi
+    end=$(date +%s.%N)
+    awk -v label="$label" -v n="$count" -v unit="$unit" -v s="$start" -v e="$end" \
+        'BEGIN { t = e - s; printf "%-9s %9d %-7s %10.3f s %12.1f %s/sec\n", label, n, unit, t, n / t, unit }'
+}
+
+step generate "$numPages" docs "$CORPUSGEN" --pages "$numPages" "$@" --pagedir "${layoutFlag[@]}" "$pageDirectory"
+echo "page directory: $(du -sh "$pageDirectory" | cut -f1)"
+step index "$numPages" docs "$INDEXER" "$pageDirectory" "$indexFile"
+echo "index: $(du -sh "$indexFile" | cut -f1), $(wc -l < "$indexFile") words"
+
+# Queries from the index's own words, so most of them match something
+awk -v n="$numQueries" 'BEGIN { srand(42) } { words[NR] = $1 }
+    END {
+        for (q = 0; q < n; q++) {
+            query = words[int(rand() * NR) + 1]
+            if (rand() < 0.5) query = query (rand() < 0.5 ? " and " : " or ") words[int(rand() * NR) + 1]
+            print query
+        }
+    }' "$indexFile" > "$work/queries"
+step query "$numQueries" queries bash -c "\"$QUERIER\" \"$pageDirectory\" \"$indexFile\" < \"$work/queries\""
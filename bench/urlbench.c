@@ -0,0 +1,388 @@
+/**
+ * urlbench.c
+ *
+ * Description: Checks the URL canonicalizer (common/urlcanon.c) against libcs50's
+ *              normalizeURL on a large corpus of URLs, and times the two. The corpus
+ *              is generated from a seed: absolute URLs built from pieces chosen to
+ *              cover the cases the parser distinguishes (scheme, "//" or not, user
+ *              information, host case and port, dot segments, doubled slashes,
+ *              extensions, query and fragment, '?', '#' and '@' in odd places), and
+ *              relative links resolved against page URLs. URLs can also be read from
+ *              a file, one per line.
+ *
+ *              Each absolute URL must give the same result from urlcanon_normalize as
+ *              from normalizeURL (both rejecting it, or the same string), and each link
+ *              the same from urlcanon_resolve as from normalizeURL on what
+ *              webpage_getNextURL resolves it to. Mismatches are printed; the program
+ *              exits non-zero if there were any. Then both ways are timed over the
+ *              absolute URLs, and the time per URL and the speedup printed.
+ *
+ * Usage: ./urlbench [-n numURLs] [-s seed] [-r rounds] [-f urlFile]
+ */
+#define _POSIX_C_SOURCE 200809L    // strdup, getline, clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "webpage.h"
+#include "urlcanon.h"
+#include "mem.h"
+
+#define MAX_URL 8192
+#define MAX_MISMATCHES 20           // printed; the rest are only counted
+
+// A small fast random number generator (xorshift64*)
+typedef struct rng {
+    uint64_t state;
+} rng_t;
+
+// A growable list of strings
+typedef struct urlList {
+    char** urls;
+    int count;
+    int cap;
+} urlList_t;
+
+static const char* SCHEMES[] = { "http://", "http://", "http://", "HTTP://", "Http://", "https://",
+                                 "ftp://", "mailto:", "http:", "http:/", "file:///" };
+static const char* USERS[] = { "", "", "", "", "", "", "user@", "User:PaSs@" };
+static const char* HOSTS[] = { "cs50tse.cs.dartmouth.edu", "cs50tse.cs.dartmouth.edu",
+                               "CS50TSE.cs.Dartmouth.EDU", "www.example.com", "Example.COM:8080",
+                               "localhost", "a", "" };
+static const char* SEGMENTS[] = { "tse", "tse", "letters", "TSE", "wikipedia", ".", "..", "",
+                                  "a.b", "x..y", "%41b", "~user", "..a", ".b" };
+static const char* FILES[] = { "", "", "index.html", "index.html", "INDEX.HTML", "page.htm",
+                               "page.HTMX", "photo.jpg", "script.php", "dir.", "file.ht", "noext",
+                               "a.html.bak", ".", "..", "C.html", "Computer_science.html" };
+static const char* QUERIES[] = { "", "", "", "", "?a=1", "?A=B&c=d", "?x=/y/../z", "?q=a@b", "?",
+                                 "?p=a.jpg", "?u=http://x/" };
+static const char* FRAGMENTS[] = { "", "", "", "", "#top", "#Sec/../x", "#", "#a?b" };
+static const char* STARTS[] = { "", "", "", "/", "./", "../", "../../", "/tse/", "//" };
+
+static void makeAbsolute(rng_t* rng, char* url);
+static void makeRelative(rng_t* rng, char* rel);
+static void appendPath(rng_t* rng, char* url);
+static const char* pick(rng_t* rng, const char** choices, const int count);
+static bool checkAbsolute(const char* url, int* mismatches);
+static bool checkRelative(const char* base, const char* rel, int* mismatches);
+static bool crashesNormalizeURL(const char* url);
+static void urlList_add(urlList_t* list, const char* url);
+static uint64_t nextRandom(rng_t* rng);
+static double nowSeconds(void);
+
+#define PICK(rng, choices) pick(rng, choices, sizeof(choices) / sizeof(choices[0]))
+
+
+int
+main(const int argc, char* argv[]){
+    int numURLs = 200000;
+    unsigned long seed = 1;
+    int rounds = 5;
+    const char* urlFile = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:r:f:")) != -1){
+        bool ok = true;
+        if (opt == 'n'){
+            ok = sscanf(optarg, "%d", &numURLs) == 1 && numURLs >= 0;
+        } else if (opt == 's'){
+            ok = sscanf(optarg, "%lu", &seed) == 1;
+        } else if (opt == 'r'){
+            ok = sscanf(optarg, "%d", &rounds) == 1 && rounds >= 1;
+        } else if (opt == 'f'){
+            urlFile = optarg;
+        } else {
+            ok = false;
+        }
+        if (!ok){
+            fprintf(stderr, "Usage: ./urlbench [-n numURLs] [-s seed] [-r rounds] [-f urlFile]\n");
+            exit(1);
+        }
+    }
+
+    // The corpus: generated URLs, then any from the file
+    urlList_t urls = { NULL, 0, 0 };
+    rng_t rng = { .state = seed * 0x9E3779B97F4A7C15ULL + 1 };
+    char url[MAX_URL];
+    for (int i = 0; i < numURLs; i++){
+        makeAbsolute(&rng, url);
+        urlList_add(&urls, url);
+    }
+    if (urlFile != NULL){
+        FILE* fp = fopen(urlFile, "r");
+        if (fp == NULL){
+            fprintf(stderr, "Error: Can't read %s.\n", urlFile);
+            exit(1);
+        }
+        char* line = NULL;
+        size_t size = 0;
+        ssize_t len;
+        while ((len = getline(&line, &size, fp)) > 0){
+            if (line[len - 1] == '\n') line[--len] = '\0';
+            if (len > 0 && len < MAX_URL) urlList_add(&urls, line);
+        }
+        free(line);
+        fclose(fp);
+    }
+
+    // Same results, URL by URL
+    int mismatches = 0;
+    int accepted = 0;
+    for (int i = 0; i < urls.count; i++){
+        if (checkAbsolute(urls.urls[i], &mismatches)) accepted++;
+    }
+    printf("absolute: %d URLs, %d accepted, %d mismatches\n", urls.count, accepted, mismatches);
+    int relativeMismatches = 0;
+    int resolved = 0;
+    char rel[MAX_URL];
+    for (int i = 0; i < numURLs; i++){
+        // Bases are the page URLs a crawl has: canonical ones
+        urlView_t base;
+        makeAbsolute(&rng, url);
+        if (!urlcanon_normalize(url, url, sizeof(url), &base)){
+            strcpy(url, "http://cs50tse.cs.dartmouth.edu/tse/letters/index.html");
+        }
+        makeRelative(&rng, rel);
+        if (checkRelative(url, rel, &relativeMismatches)) resolved++;
+    }
+    printf("relative: %d links, %d resolved, %d mismatches\n", numURLs, resolved, relativeMismatches);
+
+    // Time both over the URLs that don't crash normalizeURL
+    urlList_t timed = { NULL, 0, 0 };
+    for (int i = 0; i < urls.count; i++){
+        if (!crashesNormalizeURL(urls.urls[i])) urlList_add(&timed, urls.urls[i]);
+    }
+    double start = nowSeconds();
+    long checksum = 0;
+    for (int r = 0; r < rounds; r++){
+        for (int i = 0; i < timed.count; i++){
+            char* normalized = normalizeURL(timed.urls[i]);
+            if (normalized != NULL) checksum += normalized[0];
+            free(normalized);
+        }
+    }
+    double oldTime = nowSeconds() - start;
+    start = nowSeconds();
+    for (int r = 0; r < rounds; r++){
+        for (int i = 0; i < timed.count; i++){
+            urlView_t view;
+            if (urlcanon_normalize(timed.urls[i], url, sizeof(url), &view)) checksum -= view.url[0];
+        }
+    }
+    double newTime = nowSeconds() - start;
+    double calls = (double)rounds * (timed.count > 0 ? timed.count : 1);
+    printf("normalizeURL: %.1f ns/URL\n", oldTime / calls * 1e9);
+    printf("urlcanon_normalize: %.1f ns/URL (with hash)\n", newTime / calls * 1e9);
+    printf("speedup: %.1fx\n", newTime > 0 ? oldTime / newTime : 0);
+    if (checksum != 0) printf("checksum: %ld (the two disagree)\n", checksum);
+
+    for (int i = 0; i < urls.count; i++) mem_free(urls.urls[i]);
+    for (int i = 0; i < timed.count; i++) mem_free(timed.urls[i]);
+    mem_free(urls.urls);
+    mem_free(timed.urls);
+    return mismatches + relativeMismatches > 0 ? 1 : 0;
+}
+
+/**
+* Description: Checks one absolute URL: urlcanon_normalize must agree with normalizeURL,
+*              into another buffer and in place, and reject the URLs normalizeURL would
+*              crash on. (Normalizing a normalized URL need not change nothing: a path
+*              left starting "//" reads as a host the second time.)
+* @param url: The URL.
+* @param mismatches: Counts the URLs that don't agree.
+* @return Whether the URL was accepted.
+*/
+static bool
+checkAbsolute(const char* url, int* mismatches){
+    char buf[MAX_URL];
+    urlView_t view;
+    bool ok = urlcanon_normalize(url, buf, sizeof(buf), &view);
+    char* expected = crashesNormalizeURL(url) ? NULL : normalizeURL(url);
+    bool same = ok ? expected != NULL && strcmp(expected, view.url) == 0 && view.len == strlen(expected)
+                     && view.hash == urlcanon_hash(expected, strlen(expected))
+                   : expected == NULL;
+    if (ok && same){
+        urlView_t inPlace;
+        strcpy(buf, url);
+        same = urlcanon_normalize(buf, buf, sizeof(buf), &inPlace) && strcmp(inPlace.url, expected) == 0;
+    }
+    if (!same && (*mismatches)++ < MAX_MISMATCHES){
+        printf("MISMATCH %s\n  normalizeURL: %s\n  urlcanon:     %s\n", url,
+               expected ? expected : "(rejected)", ok ? view.url : "(rejected)");
+    }
+    free(expected);
+    return ok;
+}
+
+/**
+* Description: Checks one relative link: urlcanon_resolve must agree with normalizeURL
+*              on the URL webpage_getNextURL resolves the link to, on a page holding
+*              just that link.
+* @param base: The page's URL.
+* @param rel: The link, as it appears in the page.
+* @param mismatches: Counts the links that don't agree.
+* @return Whether the link was resolved to a URL.
+*/
+static bool
+checkRelative(const char* base, const char* rel, int* mismatches){
+    // A base normalizeURL would crash on crashes getNextURL too, and is rejected
+    char* resolvedURL = NULL;
+    if (!crashesNormalizeURL(base)){
+        char* html = mem_assert(mem_malloc(strlen(rel) + 32), "Error: Failed to allocate memory for page.\n");
+        sprintf(html, "<a href=\"%s\">link</a>", rel);
+        webpage_t* page = webpage_new(strdup(base), 0, html);
+        int pos = 0;
+        resolvedURL = webpage_getNextURL(page, &pos);
+        webpage_delete(page);
+    }
+    char* expected = resolvedURL != NULL && !crashesNormalizeURL(resolvedURL) ? normalizeURL(resolvedURL) : NULL;
+
+    // getNextURL leaves a link's fragment out
+    char buf[MAX_URL];
+    urlView_t view;
+    bool ok = urlcanon_resolve(base, rel, strcspn(rel, "#"), buf, sizeof(buf), &view);
+    bool same = ok ? expected != NULL && strcmp(expected, view.url) == 0 : expected == NULL;
+    if (!same && (*mismatches)++ < MAX_MISMATCHES){
+        printf("MISMATCH %s from %s\n  getNextURL+normalizeURL: %s\n  urlcanon_resolve:        %s\n", rel, base,
+               expected ? expected : "(rejected)", ok ? view.url : "(rejected)");
+    }
+    free(expected);
+    free(resolvedURL);
+    return ok;
+}
+
+/**
+* Description: Decides whether normalizeURL would crash on a URL: its parser copies the
+*              path from the host's end to the first '?' or '#', and when that comes
+*              before the host's end it asks calloc for a negative size (which, just
+*              before, is 0 bytes that it then overruns).
+* @param url: The URL.
+* @return Whether to keep the URL away from normalizeURL.
+*/
+static bool
+crashesNormalizeURL(const char* url){
+    const char* schemeEnd = strpbrk(url, ":/?#");
+    if (schemeEnd == NULL || *schemeEnd != ':') return false;
+    schemeEnd++;
+    if (strncmp(schemeEnd, "//", 2) == 0) schemeEnd += 2;
+    const char* hostEnd = strchr(schemeEnd, '/');
+    if (hostEnd == NULL) hostEnd = schemeEnd + strlen(schemeEnd);
+    const char* pathEnd = strpbrk(schemeEnd, "?#");
+    return pathEnd != NULL && pathEnd < hostEnd;
+}
+
+/**
+* Description: Makes a random absolute URL.
+* @param rng: The generator.
+* @param url: Where to write it; MAX_URL bytes.
+* @return void
+*/
+static void
+makeAbsolute(rng_t* rng, char* url){
+    sprintf(url, "%s%s%s", PICK(rng, SCHEMES), PICK(rng, USERS), PICK(rng, HOSTS));
+    // Now and then no path at all, or a '?', '#' or '@' before it
+    uint64_t odd = nextRandom(rng) % 20;
+    if (odd == 0) return;
+    if (odd == 1) strcat(url, "?q");
+    if (odd == 2) strcat(url, "#f");
+    if (odd == 3) strcat(url, "@b");
+    appendPath(rng, url);
+    strcat(url, PICK(rng, QUERIES));
+    strcat(url, PICK(rng, FRAGMENTS));
+}
+
+/**
+* Description: Makes a random relative link: no scheme, and not just a fragment.
+* @param rng: The generator.
+* @param rel: Where to write it; MAX_URL bytes.
+* @return void
+*/
+static void
+makeRelative(rng_t* rng, char* rel){
+    strcpy(rel, PICK(rng, STARTS));
+    appendPath(rng, rel);
+    // appendPath starts with a '/'; half the time drop it
+    if (rel[0] == '/' && nextRandom(rng) % 2 == 0) memmove(rel, rel + 1, strlen(rel));
+    strcat(rel, PICK(rng, QUERIES));
+    strcat(rel, PICK(rng, FRAGMENTS));
+    // Keep it relative, and something getNextURL takes as a link
+    if (rel[0] == '#' || rel[0] == '\0') strcpy(rel, "index.html");
+    char* colon = strchr(rel, ':');
+    if (colon != NULL && colon < rel + strcspn(rel, "/?#")) *colon = '_';
+}
+
+/**
+* Description: Appends a random path: up to five segments, each after a '/' (two, now
+*              and then), then a file name.
+* @param rng: The generator.
+* @param url: The URL to append to.
+* @return void
+*/
+static void
+appendPath(rng_t* rng, char* url){
+    int segments = nextRandom(rng) % 6;
+    for (int i = 0; i < segments; i++){
+        strcat(url, nextRandom(rng) % 16 == 0 ? "//" : "/");
+        strcat(url, PICK(rng, SEGMENTS));
+    }
+    strcat(url, "/");
+    strcat(url, PICK(rng, FILES));
+}
+
+/**
+* Description: Picks one of the choices at random.
+* @param rng: The generator.
+* @param choices: The choices.
+* @param count: How many there are.
+* @return The choice.
+*/
+static const char*
+pick(rng_t* rng, const char** choices, const int count){
+    return choices[nextRandom(rng) % count];
+}
+
+/**
+* Description: Adds a copy of a URL to the list.
+* @param list: The list.
+* @param url: The URL.
+* @return void
+*/
+static void
+urlList_add(urlList_t* list, const char* url){
+    if (list->count == list->cap){
+        list->cap = list->cap > 0 ? list->cap * 2 : 1024;
+        char** bigger = mem_assert(mem_malloc(list->cap * sizeof(char*)), "Error: Failed to allocate memory for URLs.\n");
+        if (list->count > 0) memcpy(bigger, list->urls, list->count * sizeof(char*));
+        if (list->urls != NULL) mem_free(list->urls);
+        list->urls = bigger;
+    }
+    list->urls[list->count] = mem_assert(mem_malloc(strlen(url) + 1), "Error: Failed to allocate memory for URLs.\n");
+    strcpy(list->urls[list->count++], url);
+}
+
+/**
+* Description: Returns the generator's next 64 random bits (xorshift64*).
+* @param rng: The generator.
+* @return The bits.
+*/
+static uint64_t
+nextRandom(rng_t* rng){
+    rng->state ^= rng->state >> 12;
+    rng->state ^= rng->state << 25;
+    rng->state ^= rng->state >> 27;
+    return rng->state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+* Description: Returns the monotonic clock in seconds.
+* @return The time.
+*/
+static double
+nowSeconds(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,167 @@
+/**
+ * asynclog.c
+ *
+ * Description: Implements the asynchronous log as two buffers: lines are appended to
+ *              one under the lock while the writer thread writes the other out, then
+ *              the two are swapped, as the checkpoint's records are.
+ */
+#define _POSIX_C_SOURCE 200809L    // clock_gettime, pthread_condattr_setclock
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "asynclog.h"
+#include "mem.h"
+
+#define FLUSH_MS 100                // how often the writer writes out what is buffered
+#define FLUSH_BYTES (64 << 10)      // wake the writer early once this much is buffered
+#define MAX_BYTES (8 << 20)         // logging waits while this much is buffered
+
+typedef struct asynclog {
+    FILE* fp;
+    char* buffer;               // lines logged since the writer last took them
+    size_t len;
+    size_t cap;
+    bool stopping;
+    pthread_mutex_t lock;       // guards the four above
+    pthread_cond_t wake;        // signaled when the buffer is large, or on delete
+    pthread_cond_t room;        // broadcast when the writer takes the buffer
+    pthread_t writer;
+} asynclog_t;
+
+static void* writeLines(void* arg);
+
+
+/**
+ * Description: Creates a log writing to fp and starts its writer.
+ * @param fp: the stream.
+ * @returns pointer to the new log.
+*/
+asynclog_t* asynclog_new(FILE* fp){
+    if (fp == NULL) return NULL;
+    asynclog_t* log = mem_assert(mem_malloc(sizeof(asynclog_t)), "Error: Failed to allocate memory for log.\n");
+    log->fp = fp;
+    log->cap = 4096;
+    log->buffer = mem_assert(mem_malloc(log->cap), "Error: Failed to allocate memory for log.\n");
+    log->len = 0;
+    log->stopping = false;
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&log->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&log->room, NULL);
+    if (pthread_create(&log->writer, NULL, writeLines, log) != 0){
+        fprintf(stderr, "Error: Failed to start log writer.\n");
+        exit(1);
+    }
+    return log;
+}
+
+/**
+ * Description: Appends a formatted line to the buffer, waiting while the buffer is full
+ *              and waking the writer if it has grown large.
+ * @param log: the log.
+ * @param format: printf format of the line.
+*/
+void asynclog_printf(asynclog_t* log, const char* format, ...){
+    if (log == NULL) return;
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (length <= 0) return;
+
+    pthread_mutex_lock(&log->lock);
+    while (log->len > 0 && log->len + length > MAX_BYTES){
+        pthread_cond_signal(&log->wake);
+        pthread_cond_wait(&log->room, &log->lock);
+    }
+    if (log->len + length + 1 > log->cap){
+        while (log->len + length + 1 > log->cap) log->cap *= 2;
+        char* bigger = mem_assert(mem_malloc(log->cap), "Error: Failed to allocate memory for log.\n");
+        memcpy(bigger, log->buffer, log->len);
+        mem_free(log->buffer);
+        log->buffer = bigger;
+    }
+    va_start(args, format);
+    vsnprintf(log->buffer + log->len, length + 1, format, args);
+    va_end(args);
+    log->len += length;
+    if (log->len >= FLUSH_BYTES) pthread_cond_signal(&log->wake);
+    pthread_mutex_unlock(&log->lock);
+}
+
+/**
+ * Description: Stops the writer, which writes out what is left, and deletes the log.
+ * @param log: the log to delete.
+*/
+void asynclog_delete(asynclog_t* log){
+    if (log == NULL) return;
+    pthread_mutex_lock(&log->lock);
+    log->stopping = true;
+    pthread_cond_signal(&log->wake);
+    pthread_mutex_unlock(&log->lock);
+    pthread_join(log->writer, NULL);
+    fflush(log->fp);
+    mem_free(log->buffer);
+    pthread_mutex_destroy(&log->lock);
+    pthread_cond_destroy(&log->wake);
+    pthread_cond_destroy(&log->room);
+    mem_free(log);
+}
+
+/***
+ * Description: Body of the writer thread. Every FLUSH_MS, or sooner if woken, takes the
+ *              buffered lines and writes them out; exits once everything is written
+ *              after a delete.
+ * @param arg: the log.
+ * @returns NULL
+*/
+static void* writeLines(void* arg){
+    asynclog_t* log = arg;
+    // The lines being written; swapped with the log's buffer each round
+    size_t cap = 4096;
+    char* writing = mem_assert(mem_malloc(cap), "Error: Failed to allocate memory for log.\n");
+
+    pthread_mutex_lock(&log->lock);
+    while (true){
+        if (!log->stopping && log->len < FLUSH_BYTES){
+            struct timespec until;
+            clock_gettime(CLOCK_MONOTONIC, &until);
+            until.tv_nsec += FLUSH_MS * 1000000L;
+            if (until.tv_nsec >= 1000000000){
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&log->wake, &log->lock, &until);
+        }
+        bool stopping = log->stopping;
+        char* lines = log->buffer;
+        size_t len = log->len;
+        log->buffer = writing;
+        log->len = 0;
+        size_t linesCap = log->cap;
+        log->cap = cap;
+        writing = lines;
+        cap = linesCap;
+        pthread_cond_broadcast(&log->room);
+        pthread_mutex_unlock(&log->lock);
+
+        if (len > 0){
+            fwrite(lines, 1, len, log->fp);
+            fflush(log->fp);
+        }
+        pthread_mutex_lock(&log->lock);
+        // Everything logged before the delete was in this round's lines
+        if (stopping) break;
+    }
+    pthread_mutex_unlock(&log->lock);
+    mem_free(writing);
+    return NULL;
+}
@@ -0,0 +1,45 @@
+/**
+ * asynclog.h
+ *
+ * Interface for an asynchronous log: lines are formatted into a buffer in memory, and
+ * a background thread writes the buffer out every FLUSH_MS (sooner once it holds
+ * FLUSH_BYTES), so a thread logging a line never waits on the terminal or the disk.
+ * Lines reach the stream in the order they were logged. Should the writer fall behind
+ * by MAX_BYTES, logging waits for it, so a slow stream slows the logging down instead
+ * of filling memory.
+ *
+ * A NULL log ignores what is logged to it, so logging can be turned off by not
+ * creating one.
+ */
+#ifndef __ASYNCLOG_H
+#define __ASYNCLOG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef struct asynclog asynclog_t;
+
+/***
+ * Description: Creates a log writing to fp and starts its writer.
+ * @param fp: the stream lines are written to; left open.
+ * @returns pointer to the new log; exits if out of memory or the thread can't start.
+ */
+asynclog_t* asynclog_new(FILE* fp);
+
+/***
+ * Description: Logs a formatted line. Thread-safe.
+ * @param log: the log, or NULL.
+ * @param format: printf format of the line, with its newline.
+ */
+void asynclog_printf(asynclog_t* log, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/***
+ * Description: Writes out everything logged so far, stops the writer and deletes the
+ *              log. The stream is flushed, and left open.
+ * @param log: the log to delete, or NULL.
+ */
+void asynclog_delete(asynclog_t* log);
+
+#endif
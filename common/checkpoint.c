@@ -0,0 +1,375 @@
+/**
+ * checkpoint.c
+ *
+ * Description: Implements the crawler's checkpoint journal. Each record is one line:
+ *
+ *                  S depth url      url was added to the seen-set at depth
+ *                  D docID url      url was saved as docID and scanned
+ *                  F url            fetching url failed
+ *
+ *              Records are formatted into a buffer under a mutex; a writer thread
+ *              wakes every interval (or early, once a lot has piled up), swaps the
+ *              buffer for an empty one, syncs the page directory and then writes and
+ *              syncs the records, without holding the lock. A D record is made once
+ *              its page is written, so the sync has its page on disk before it. A
+ *              page's D record is only made after its links' S records, so a saved
+ *              page is never resumed without its links. A line cut short by a crash
+ *              has no newline and is ignored when restoring.
+ */
+#define _POSIX_C_SOURCE 200809L    // getline, fileno, fsync, truncate, clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "checkpoint.h"
+#include "seenset.h"
+#include "frontier.h"
+#include "pagedir.h"
+#include "webpage.h"
+#include "hashtable.h"
+#include "mem.h"
+
+#define FLUSH_BYTES (1 << 20)       // wake the writer early once this much is buffered
+#define DONE_SLOTS 10007            // hashtable slots for the URLs finished, when restoring
+
+typedef struct checkpoint {
+    FILE* fp;                   // NULL once a write has failed
+    char* path;
+    long written;               // length of the file's whole records
+    pagedir_t* pages;           // synced before each write, or NULL
+    char* buffer;               // records not yet handed to the writer
+    size_t len;
+    size_t cap;
+    int intervalMs;
+    bool stopping;
+    bool writeFailed;           // set by the writer; nothing more is recorded or written
+    pthread_mutex_t lock;
+    pthread_cond_t wake;        // signaled when the buffer is large or on delete
+    pthread_t writer;
+} checkpoint_t;
+
+static void record(checkpoint_t* checkpoint, const char* format, ...);
+static void* writeRecords(void* arg);
+static char* checkpointPath(const char* pageDirectory);
+
+
+/**
+ * Description: Opens the checkpoint and starts its writer thread.
+ * @param pageDirectory: the crawl's page directory.
+ * @param pages: the same, open, to sync before each write; or NULL.
+ * @param resume: whether to append to the existing checkpoint.
+ * @param intervalMs: how often records are written out.
+ * @returns pointer to the new checkpoint, or NULL.
+*/
+checkpoint_t* checkpoint_new(const char* pageDirectory, pagedir_t* pages, const bool resume, const int intervalMs){
+    if (pageDirectory == NULL) return NULL;
+    char* path = checkpointPath(pageDirectory);
+    FILE* fp = fopen(path, resume ? "a" : "w");
+    if (fp == NULL || fseek(fp, 0, SEEK_END) != 0){
+        if (fp != NULL) fclose(fp);
+        mem_free(path);
+        return NULL;
+    }
+
+    checkpoint_t* checkpoint = mem_assert(mem_malloc(sizeof(checkpoint_t)), "Error: Failed to allocate memory for checkpoint.\n");
+    checkpoint->fp = fp;
+    checkpoint->path = path;
+    checkpoint->written = ftell(fp);
+    checkpoint->pages = pages;
+    checkpoint->cap = 4096;
+    checkpoint->buffer = mem_assert(mem_malloc(checkpoint->cap), "Error: Failed to allocate memory for checkpoint.\n");
+    checkpoint->len = 0;
+    checkpoint->intervalMs = intervalMs > 0 ? intervalMs : 1;
+    checkpoint->stopping = false;
+    checkpoint->writeFailed = false;
+    pthread_mutex_init(&checkpoint->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&checkpoint->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    if (pthread_create(&checkpoint->writer, NULL, writeRecords, checkpoint) != 0){
+        fprintf(stderr, "Error: Failed to start checkpoint writer.\n");
+        exit(1);
+    }
+    return checkpoint;
+}
+
+/**
+ * Description: Records a URL added to the seen-set.
+ * @param checkpoint: the checkpoint.
+ * @param url: the URL.
+ * @param depth: its depth.
+*/
+void checkpoint_seen(checkpoint_t* checkpoint, const char* url, const int depth){
+    if (checkpoint && url) record(checkpoint, "S %d %s\n", depth, url);
+}
+
+/**
+ * Description: Records a page saved and scanned.
+ * @param checkpoint: the checkpoint.
+ * @param docID: the document's ID.
+ * @param url: the URL.
+*/
+void checkpoint_saved(checkpoint_t* checkpoint, const int docID, const char* url){
+    if (checkpoint && url) record(checkpoint, "D %d %s\n", docID, url);
+}
+
+/**
+ * Description: Records a page whose fetch failed.
+ * @param checkpoint: the checkpoint.
+ * @param url: the URL.
+*/
+void checkpoint_failed(checkpoint_t* checkpoint, const char* url){
+    if (checkpoint && url) record(checkpoint, "F %s\n", url);
+}
+
+/**
+ * Description: Returns whether writing the records out has failed.
+ * @param checkpoint: the checkpoint, or NULL.
+*/
+bool checkpoint_writeFailed(checkpoint_t* checkpoint){
+    if (checkpoint == NULL) return false;
+    pthread_mutex_lock(&checkpoint->lock);
+    bool failed = checkpoint->writeFailed;
+    pthread_mutex_unlock(&checkpoint->lock);
+    return failed;
+}
+
+/**
+ * Description: Flushes the checkpoint, stops its writer and closes it.
+ * @param checkpoint: the checkpoint to delete.
+ * @returns false if any of the records couldn't be written.
+*/
+bool checkpoint_delete(checkpoint_t* checkpoint){
+    if (checkpoint == NULL) return true;
+    pthread_mutex_lock(&checkpoint->lock);
+    checkpoint->stopping = true;
+    pthread_cond_signal(&checkpoint->wake);
+    pthread_mutex_unlock(&checkpoint->lock);
+    pthread_join(checkpoint->writer, NULL);
+    bool ok = !checkpoint->writeFailed;
+    if (checkpoint->fp != NULL) fclose(checkpoint->fp);
+    mem_free(checkpoint->path);
+    pthread_mutex_destroy(&checkpoint->lock);
+    pthread_cond_destroy(&checkpoint->wake);
+    mem_free(checkpoint->buffer);
+    mem_free(checkpoint);
+    return ok;
+}
+
+/**
+ * Description: Deletes the checkpoint.
+ * @param pageDirectory: the crawl's page directory.
+ * @returns false if it is there and couldn't be deleted.
+*/
+bool checkpoint_remove(const char* pageDirectory){
+    if (pageDirectory == NULL) return false;
+    char* path = checkpointPath(pageDirectory);
+    bool ok = remove(path) == 0 || access(path, F_OK) != 0;
+    mem_free(path);
+    return ok;
+}
+
+/**
+ * Description: Rebuilds the seen-set, the frontier and the docIDs in use from the
+ *              checkpoint.
+ * @param pageDirectory: the crawl's page directory.
+ * @param pages: the page directory, open, to check the pages recorded as saved are there.
+ * @param seen: an empty seen-set.
+ * @param frontier: an empty frontier.
+ * @param restore: filled with the docIDs to use next.
+ * @returns false if there is no checkpoint.
+*/
+bool checkpoint_restore(const char* pageDirectory, pagedir_t* pages, seenset_t* seen, frontier_t* frontier, checkpointRestore_t* restore){
+    if (pageDirectory == NULL || pages == NULL || seen == NULL || frontier == NULL || restore == NULL) return false;
+    char* path = checkpointPath(pageDirectory);
+    FILE* fp = fopen(path, "r");
+    mem_free(path);
+    if (fp == NULL) return false;
+
+    // First pass: which URLs are finished, and which docIDs they were saved as
+    hashtable_t* done = mem_assert(hashtable_new(DONE_SLOTS), "Error: Failed to allocate memory for checkpoint.\n");
+    int savedCap = 1024;
+    bool* savedIDs = mem_assert(mem_calloc(savedCap, sizeof(bool)), "Error: Failed to allocate memory for checkpoint.\n");
+    int maxDocID = 0;
+    restore->saved = restore->pending = 0;
+    char* line = NULL;
+    size_t lineCap = 0;
+    ssize_t n;
+    while ((n = getline(&line, &lineCap, fp)) > 0){
+        // A line without its newline was cut short by a crash
+        if (line[n - 1] != '\n') break;
+        line[n - 1] = '\0';
+        int docID, offset = 0;
+        if (sscanf(line, "D %d %n", &docID, &offset) == 1 && offset > 0 && docID > 0){
+            // A page still in a block that was never written out is crawled again
+            char* savedURL = pagedir_getURL(pages, docID);
+            bool there = savedURL != NULL && strcmp(savedURL, line + offset) == 0;
+            free(savedURL);
+            if (!there) continue;
+            hashtable_insert(done, line + offset, "");
+            while (docID >= savedCap){
+                bool* bigger = mem_assert(mem_calloc(savedCap * 2, sizeof(bool)), "Error: Failed to allocate memory for checkpoint.\n");
+                memcpy(bigger, savedIDs, savedCap * sizeof(bool));
+                mem_free(savedIDs);
+                savedIDs = bigger;
+                savedCap *= 2;
+            }
+            if (!savedIDs[docID]) restore->saved++;
+            savedIDs[docID] = true;
+            if (docID > maxDocID) maxDocID = docID;
+        } else if (strncmp(line, "F ", 2) == 0){
+            hashtable_insert(done, line + 2, "");
+        }
+    }
+
+    // Second pass: every URL seen is seen again; the unfinished ones are crawled again
+    rewind(fp);
+    while ((n = getline(&line, &lineCap, fp)) > 0){
+        if (line[n - 1] != '\n') break;
+        line[n - 1] = '\0';
+        int depth, offset = 0;
+        if (sscanf(line, "S %d %n", &depth, &offset) == 1 && offset > 0){
+            char* url = line + offset;
+            if (seenset_insert(seen, url, depth) && hashtable_find(done, url) == NULL){
+                char* copy = mem_assert(mem_malloc(strlen(url) + 1), "Error: Failed to allocate memory for URL.\n");
+                strcpy(copy, url);
+                frontier_insert(frontier, webpage_new(copy, depth, NULL));
+                restore->pending++;
+            }
+        }
+    }
+    free(line);
+    fclose(fp);
+    hashtable_delete(done, NULL);
+
+    // docIDs handed out but never recorded as saved are reused before new ones
+    restore->nextDocID = maxDocID + 1;
+    restore->numFreeDocIDs = 0;
+    restore->freeDocIDs = mem_assert(mem_malloc((maxDocID + 1) * sizeof(int)), "Error: Failed to allocate memory for checkpoint.\n");
+    for (int docID = 1; docID <= maxDocID; docID++){
+        if (!savedIDs[docID]) restore->freeDocIDs[restore->numFreeDocIDs++] = docID;
+    }
+    mem_free(savedIDs);
+    return true;
+}
+
+/***
+ * Description: Appends a formatted record to the buffer, waking the writer if the buffer
+ *              has grown large.
+ * @param checkpoint: the checkpoint.
+ * @param format: printf format of the record.
+*/
+static void record(checkpoint_t* checkpoint, const char* format, ...){
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    pthread_mutex_lock(&checkpoint->lock);
+    if (checkpoint->writeFailed){
+        pthread_mutex_unlock(&checkpoint->lock);
+        return;
+    }
+    if (checkpoint->len + length + 1 > checkpoint->cap){
+        while (checkpoint->len + length + 1 > checkpoint->cap) checkpoint->cap *= 2;
+        char* bigger = mem_assert(mem_malloc(checkpoint->cap), "Error: Failed to allocate memory for checkpoint.\n");
+        memcpy(bigger, checkpoint->buffer, checkpoint->len);
+        mem_free(checkpoint->buffer);
+        checkpoint->buffer = bigger;
+    }
+    va_start(args, format);
+    vsnprintf(checkpoint->buffer + checkpoint->len, length + 1, format, args);
+    va_end(args);
+    checkpoint->len += length;
+    if (checkpoint->len >= FLUSH_BYTES) pthread_cond_signal(&checkpoint->wake);
+    pthread_mutex_unlock(&checkpoint->lock);
+}
+
+/***
+ * Description: Body of the writer thread. Every interval, takes the buffered records and
+ *              writes and syncs them; exits once everything is written after a delete.
+ * @param arg: the checkpoint.
+ * @returns NULL
+*/
+static void* writeRecords(void* arg){
+    checkpoint_t* checkpoint = arg;
+    // The records being written; swapped with the checkpoint's buffer each round
+    size_t cap = 4096;
+    char* writing = mem_assert(mem_malloc(cap), "Error: Failed to allocate memory for checkpoint.\n");
+
+    pthread_mutex_lock(&checkpoint->lock);
+    while (true){
+        if (!checkpoint->stopping && checkpoint->len < FLUSH_BYTES){
+            struct timespec until;
+            clock_gettime(CLOCK_MONOTONIC, &until);
+            until.tv_sec += checkpoint->intervalMs / 1000;
+            until.tv_nsec += (checkpoint->intervalMs % 1000) * 1000000L;
+            if (until.tv_nsec >= 1000000000){
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&checkpoint->wake, &checkpoint->lock, &until);
+        }
+        bool stopping = checkpoint->stopping;
+        char* records = checkpoint->buffer;
+        size_t len = checkpoint->len;
+        checkpoint->buffer = writing;
+        checkpoint->len = 0;
+        size_t recordsCap = checkpoint->cap;
+        checkpoint->cap = cap;
+        writing = records;
+        cap = recordsCap;
+        pthread_mutex_unlock(&checkpoint->lock);
+
+        // Only the writer sets writeFailed, so it reads it without the lock
+        if (len > 0 && !checkpoint->writeFailed){
+            // The pages these records say are saved go to disk first; a page that doesn't
+            // make it is crawled again on resume
+            if (checkpoint->pages != NULL && !pagedir_sync(checkpoint->pages)){
+                fprintf(stderr, "Error: Can't sync the saved pages.\n");
+            }
+            if (fwrite(records, 1, len, checkpoint->fp) != len || fflush(checkpoint->fp) != 0){
+                // Cut the file back to its last whole record, so a resume (which appends)
+                // starts from there; nothing more is written, and the crawler sees the
+                // flag and stops
+                fprintf(stderr, "Error: Can't write the checkpoint.\n");
+                fclose(checkpoint->fp);
+                checkpoint->fp = NULL;
+                if (truncate(checkpoint->path, checkpoint->written) != 0){
+                    fprintf(stderr, "Error: Can't truncate the checkpoint.\n");
+                }
+                pthread_mutex_lock(&checkpoint->lock);
+                checkpoint->writeFailed = true;
+                checkpoint->len = 0;
+                pthread_mutex_unlock(&checkpoint->lock);
+            } else {
+                fsync(fileno(checkpoint->fp));
+                checkpoint->written += len;
+            }
+        }
+        pthread_mutex_lock(&checkpoint->lock);
+        // Everything recorded before the delete was in this round's records
+        if (stopping) break;
+    }
+    pthread_mutex_unlock(&checkpoint->lock);
+    mem_free(writing);
+    return NULL;
+}
+
+/***
+ * Description: Builds the path of pageDirectory's checkpoint.
+ * @param pageDirectory: the page directory.
+ * @returns a new string the caller must mem_free.
+*/
+static char* checkpointPath(const char* pageDirectory){
+    char* path = mem_assert(mem_malloc(strlen(pageDirectory) + strlen("/.checkpoint") + 1), "Error: Couldn't allocate memory for path");
+    sprintf(path, "%s/.checkpoint", pageDirectory);
+    return path;
+}
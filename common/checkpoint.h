@@ -0,0 +1,113 @@
+/**
+ * checkpoint.h
+ *
+ * Interface for the crawler's checkpoint: a journal, pageDirectory/.checkpoint,
+ * from which an interrupted crawl can be resumed. The crawler records every URL it
+ * adds to the seen-set (with its depth), every page once it is saved and scanned
+ * (with its docID), and every page whose fetch failed. Those records are enough to
+ * rebuild the seen-set, the frontier (URLs seen but neither saved nor failed) and
+ * the docIDs in use, without re-fetching any saved page.
+ *
+ * Recording only appends to a buffer in memory; a background thread writes the
+ * buffer out and syncs it every intervalMs, so the fetch loop never waits for the
+ * disk. Each time, it syncs the page directory first, so the pages recorded as saved
+ * are on disk before the records are. Records reach the file in the order they were
+ * made, so whatever survives a crash is a consistent prefix of the crawl.
+ */
+#ifndef __CHECKPOINT_H
+#define __CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "seenset.h"
+#include "frontier.h"
+#include "pagedir.h"
+
+typedef struct checkpoint checkpoint_t;
+
+/* What checkpoint_restore found: the docIDs the crawl may hand out next. */
+typedef struct checkpointRestore {
+    int nextDocID;              // one past the largest docID saved
+    int* freeDocIDs;            // docIDs below nextDocID with no saved page, to reuse first
+    int numFreeDocIDs;
+    long saved;                 // pages saved before the crawl stopped
+    long pending;               // pages put back in the frontier
+} checkpointRestore_t;
+
+/***
+ * Description: Opens pageDirectory's checkpoint for recording and starts its writer.
+ * @param pageDirectory: the crawl's page directory.
+ * @param pages: the same directory, open, synced before each write; or NULL.
+ * @param resume: true to append to the existing checkpoint; false to start a new one.
+ * @param intervalMs: how often the recorded entries are written out and synced.
+ * @returns pointer to the new checkpoint, or NULL if the file can't be opened.
+ */
+checkpoint_t* checkpoint_new(const char* pageDirectory, pagedir_t* pages, const bool resume, const int intervalMs);
+
+/***
+ * Description: Records that url was added to the seen-set at depth. Thread-safe.
+ * @param checkpoint: the checkpoint.
+ * @param url: the URL.
+ * @param depth: its depth.
+ */
+void checkpoint_seen(checkpoint_t* checkpoint, const char* url, const int depth);
+
+/***
+ * Description: Records that url was saved as docID and its links added; call it once
+ *              pagedir_write has returned for the page. Thread-safe.
+ * @param checkpoint: the checkpoint.
+ * @param docID: the document's ID.
+ * @param url: the URL.
+ */
+void checkpoint_saved(checkpoint_t* checkpoint, const int docID, const char* url);
+
+/***
+ * Description: Records that fetching url failed, so it isn't tried again on resume.
+ *              Thread-safe.
+ * @param checkpoint: the checkpoint.
+ * @param url: the URL.
+ */
+void checkpoint_failed(checkpoint_t* checkpoint, const char* url);
+
+/***
+ * Description: Returns whether writing the records out has failed (a full disk, say).
+ *              From then on nothing more is recorded, and the file holds the crawl as far
+ *              as it got; the crawler should stop, to be resumed from there.
+ * @param checkpoint: the checkpoint, or NULL.
+ */
+bool checkpoint_writeFailed(checkpoint_t* checkpoint);
+
+/***
+ * Description: Writes out everything recorded, stops the writer and closes the file.
+ * @param checkpoint: the checkpoint to delete.
+ * @returns false if any of the records couldn't be written.
+ */
+bool checkpoint_delete(checkpoint_t* checkpoint);
+
+/***
+ * Description: Deletes pageDirectory's checkpoint, for a crawl that mustn't be resumed
+ *              from it (a recrawl, which keeps none, changes the pages it records).
+ * @param pageDirectory: the crawl's page directory.
+ * @returns false if there was a checkpoint and it couldn't be deleted.
+ */
+bool checkpoint_remove(const char* pageDirectory);
+
+/***
+ * Description: Rebuilds a crawl from pageDirectory's checkpoint: every URL seen goes in
+ *              the seen-set, and every URL seen but neither saved nor failed goes back in
+ *              the frontier. Pages saved but not yet recorded may be left at docIDs from
+ *              restore->nextDocID up; the caller removes them with pagedir_discard.
+ *              A page recorded as saved that pages doesn't have (compressed pages are
+ *              written a block at a time) is crawled again, and its docID reused.
+ * @param pageDirectory: the crawl's page directory.
+ * @param pages: the same directory, open.
+ * @param seen: an empty seen-set to fill.
+ * @param frontier: an empty frontier to fill.
+ * @param restore: filled with the docIDs to use next; its freeDocIDs must be freed with
+ *                 mem_free.
+ * @returns false if there is no checkpoint to resume from.
+ */
+bool checkpoint_restore(const char* pageDirectory, pagedir_t* pages, seenset_t* seen, frontier_t* frontier, checkpointRestore_t* restore);
+
+#endif
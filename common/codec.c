@@ -0,0 +1,173 @@
+/**
+ * codec.c
+ *
+ * Description: Implements the LZ77 block codec described in codec.h. The compressor
+ *              is greedy: it hashes each 4-byte sequence to find the last place it
+ *              occurred and, when the bytes there match and lie within 64KB, emits
+ *              the longest match from that place. Runs of input without matches are
+ *              skipped over in growing steps, so incompressible data goes quickly.
+ *              The expander checks every length and offset against the buffers, so
+ *              a corrupt block is reported rather than read or written past.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "codec.h"
+
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+#define HASH_BITS 14
+
+static uint32_t read32(const char* p);
+static uint32_t hash(const uint32_t sequence);
+static char* putLength(char* op, long length);
+
+
+/**
+ * Description: Returns the most bytes codec_compress can produce from srcLen bytes:
+ *              all literals, with a token and their length bytes.
+ * @param srcLen: size of the input.
+*/
+long codec_bound(const long srcLen){
+    return srcLen + srcLen / 255 + 16;
+}
+
+/**
+ * Description: Compresses a block.
+ * @param src: the bytes to compress.
+ * @param srcLen: how many.
+ * @param dst: at least codec_bound(srcLen) bytes.
+ * @returns the size of the compressed block.
+*/
+long codec_compress(const char* src, const long srcLen, char* dst){
+    // Where each hashed sequence was last seen, plus one (0 for never)
+    long table[1 << HASH_BITS];
+    memset(table, 0, sizeof(table));
+    char* op = dst;
+    long anchor = 0;            // start of the literals not yet written
+    long ip = 0;
+    while (ip + MIN_MATCH <= srcLen){
+        uint32_t sequence = read32(src + ip);
+        uint32_t h = hash(sequence);
+        long ref = table[h] - 1;
+        table[h] = ip + 1;
+        if (ref < 0 || ip - ref > MAX_OFFSET || read32(src + ref) != sequence){
+            // No match: step further the longer it has been since the last one
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+        long matchLen = MIN_MATCH;
+        while (ip + matchLen < srcLen && src[ref + matchLen] == src[ip + matchLen]){
+            matchLen++;
+        }
+        // Token, literals, offset, then the match length past what the token holds
+        long litLen = ip - anchor;
+        char* token = op++;
+        *token = (char)(((litLen < 15 ? litLen : 15) << 4) | (matchLen - MIN_MATCH < 15 ? matchLen - MIN_MATCH : 15));
+        if (litLen >= 15) op = putLength(op, litLen - 15);
+        memcpy(op, src + anchor, litLen);
+        op += litLen;
+        long offset = ip - ref;
+        *op++ = (char)(offset & 0xff);
+        *op++ = (char)(offset >> 8);
+        if (matchLen - MIN_MATCH >= 15) op = putLength(op, matchLen - MIN_MATCH - 15);
+        ip += matchLen;
+        anchor = ip;
+    }
+    // The rest goes out as literals, ending the block
+    long litLen = srcLen - anchor;
+    *op++ = (char)((litLen < 15 ? litLen : 15) << 4);
+    if (litLen >= 15) op = putLength(op, litLen - 15);
+    memcpy(op, src + anchor, litLen);
+    op += litLen;
+    return op - dst;
+}
+
+/**
+ * Description: Expands a block made by codec_compress.
+ * @param src: the compressed block.
+ * @param srcLen: its size.
+ * @param dst: where to write the original bytes.
+ * @param dstLen: their size.
+ * @returns false if the block is corrupt or doesn't expand to dstLen bytes.
+*/
+bool codec_expand(const char* src, const long srcLen, char* dst, const long dstLen){
+    const unsigned char* ip = (const unsigned char*)src;
+    const unsigned char* end = ip + srcLen;
+    long op = 0;
+    while (ip < end){
+        int token = *ip++;
+        long litLen = token >> 4;
+        if (litLen == 15){
+            int more;
+            do {
+                if (ip >= end) return false;
+                more = *ip++;
+                litLen += more;
+            } while (more == 255);
+        }
+        if (litLen > end - ip || litLen > dstLen - op) return false;
+        memcpy(dst + op, ip, litLen);
+        ip += litLen;
+        op += litLen;
+        // Literals only: that was the last sequence
+        if (ip == end) break;
+
+        if (end - ip < 2) return false;
+        long offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        long matchLen = token & 15;
+        if (matchLen == 15){
+            int more;
+            do {
+                if (ip >= end) return false;
+                more = *ip++;
+                matchLen += more;
+            } while (more == 255);
+        }
+        matchLen += MIN_MATCH;
+        if (offset == 0 || offset > op || matchLen > dstLen - op) return false;
+        if (offset >= matchLen){
+            memcpy(dst + op, dst + op - offset, matchLen);
+            op += matchLen;
+        } else {
+            // Byte by byte: the match overlaps the bytes it is producing
+            for (long i = 0; i < matchLen; i++, op++){
+                dst[op] = dst[op - offset];
+            }
+        }
+    }
+    return op == dstLen;
+}
+
+/***
+ * Description: Reads four bytes as an integer, whatever their alignment.
+*/
+static uint32_t read32(const char* p){
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/***
+ * Description: Hashes a 4-byte sequence to HASH_BITS bits (Knuth's multiplicative hash).
+*/
+static uint32_t hash(const uint32_t sequence){
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/***
+ * Description: Writes the part of a length that didn't fit its nibble, as 255s and a
+ *              final byte below 255.
+ * @returns where the next byte goes.
+*/
+static char* putLength(char* op, long length){
+    while (length >= 255){
+        *op++ = (char)255;
+        length -= 255;
+    }
+    *op++ = (char)length;
+    return op;
+}
@@ -0,0 +1,47 @@
+/**
+ * codec.h
+ *
+ * Interface for a small self-contained LZ77 block codec, used to compress blocks
+ * of saved pages. A block is compressed on its own, with no dictionary carried
+ * from one block to the next, so any block can be expanded without the others.
+ *
+ * The format is a run of sequences, each a token byte (high four bits: how many
+ * literal bytes follow; low four bits: match length minus 4), then the literals,
+ * then a two-byte little-endian offset back into the output to copy the match
+ * from. A nibble of 15 is followed by extra length bytes, each added on, until
+ * one below 255. The last sequence is literals only and ends the block.
+ * Generated HTML, mostly repeated markup, typically shrinks five or six times.
+ */
+#ifndef __CODEC_H
+#define __CODEC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+/***
+ * Description: Returns the most bytes codec_compress can produce from srcLen bytes.
+ * @param srcLen: size of the input.
+ */
+long codec_bound(const long srcLen);
+
+/***
+ * Description: Compresses a block.
+ * @param src: the bytes to compress.
+ * @param srcLen: how many.
+ * @param dst: where to write the compressed block; at least codec_bound(srcLen) bytes.
+ * @returns the size of the compressed block.
+ */
+long codec_compress(const char* src, const long srcLen, char* dst);
+
+/***
+ * Description: Expands a block made by codec_compress.
+ * @param src: the compressed block.
+ * @param srcLen: its size.
+ * @param dst: where to write the original bytes.
+ * @param dstLen: their size, as given to codec_compress.
+ * @returns true if the block expanded to exactly dstLen bytes; false if it is corrupt.
+ */
+bool codec_expand(const char* src, const long srcLen, char* dst, const long dstLen);
+
+#endif
@@ -13,6 +13,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include "document.h"
+#include "pagedir.h"
 #include "file.h"
 #include "mem.h"
 
@@ -52,14 +53,9 @@ int document_getScore(document_t* doc){
     return doc->docScore;
 }
 
-char* document_getURL(document_t* doc, char* pageDir){
-    char* path = mem_assert(mem_malloc((strlen(pageDir) + 3) * sizeof(char)), "Error: Failed to allocate memory for path.\n");
-    sprintf(path, "%s/%s", pageDir, document_getID(doc));
-    FILE* fp = fopen(path, "r");
-    char* URL = file_readLine(fp);
-    fclose(fp);
-    mem_free(path);
-    return URL;
+char* document_getURL(document_t* doc, pagedir_t* pages){
+    if (!doc || !pages) return NULL;
+    return pagedir_getURL(pages, atoi(doc->docID));
 }
 
 
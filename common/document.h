@@ -9,13 +9,15 @@
 #ifndef __DOCUMENT_H
 #define __DOCUMENT_H
 
+#include "pagedir.h"
+
 typedef struct document document_t;
 
 document_t* document_new(const char* docID, int docScore);
 int document_getScore(document_t* doc);
 void document_setScore(document_t* doc, int score);
 char* document_getID(document_t* doc);
-char* document_getURL(document_t* doc, char* pageDir);
+char* document_getURL(document_t* doc, pagedir_t* pages);
 void document_delete(document_t* doc);
 
 #endif
\ No newline at end of file
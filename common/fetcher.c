@@ -0,0 +1,989 @@
+/**
+ * fetcher.c
+ *
+ * Description: Implements the crawler's asynchronous fetch engine. Every fetch in
+ *              flight owns a slot in a fixed array of connections and a non-blocking
+ *              socket registered with epoll; the slot moves from connecting, to sending
+ *              the request, to receiving the response. A response is complete once
+ *              Content-Length bytes have arrived, at the end of a chunked body, or, if it
+ *              gave neither, at EOF. A server that closes before then has cut the body
+ *              short, and the fetch fails.
+ *              Finished slots are queued and only handed to the callback after the
+ *              whole batch of epoll events is processed, so a callback that starts a
+ *              new fetch can never reuse a slot a pending event still refers to.
+ *
+ *              Requests ask for persistent connections. When a response is delimited by
+ *              its length (not by the server closing) and the server didn't refuse
+ *              keep-alive, its socket is parked in a pool of idle connections keyed by
+ *              host:port, and the next fetch from that host reuses it instead of
+ *              resolving and connecting again. Idle sockets are closed after
+ *              IDLE_TIMEOUT_MS, and the pool never holds more than maxConnections. A
+ *              server may close an idle socket at any time, so a reused socket that
+ *              fails before any of the response arrives is replaced by a new one.
+ *
+ *              A 304 (or 204) response has no body whatever its headers say, so it is
+ *              complete at the end of its headers.
+ *
+ *              Once the headers are parsed they are dropped, and the body is decoded as
+ *              it arrives, in place: the buffer holds the body decoded so far, then the
+ *              bytes received but not decoded yet. A chunked body goes through a state
+ *              machine that picks up where the last read left off, wherever in the
+ *              framing that was, so every byte is looked at once. The buffer, trimmed,
+ *              becomes the page's HTML, and the body is never copied. A stream callback,
+ *              if set, is shown the body decoded so far after every read.
+ */
+#define _GNU_SOURCE       // memmem, strdup, strncasecmp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include "fetcher.h"
+#include "resolver.h"
+#include "webpage.h"
+#include "mem.h"
+
+#define MAX_TRY 3                   // connection attempts per fetch, as in webpage_fetch
+#define HTTP_PORT 80                // default web server port
+#define FETCH_TIMEOUT_MS 30000      // a fetch with no progress for this long fails
+#define IDLE_TIMEOUT_MS 4000        // idle pooled sockets are closed after this long
+#define BUFFER_SIZE 16384           // initial response buffer, grown as needed
+
+typedef enum { CONNECTING, SENDING, RECEIVING } connState_t;
+
+// Where a chunked body's decoding is: in a size line, a chunk's data, the CRLF after
+// the data, or the trailer lines after the last chunk; done, or stuck on a bad size line
+typedef enum { CHUNK_SIZE, CHUNK_DATA, CHUNK_CR, CHUNK_LF, CHUNK_TRAILER, CHUNK_DONE, CHUNK_BAD } chunkState_t;
+
+typedef struct connection {
+    webpage_t* page;            // page being fetched; NULL while the slot is free
+    int fd;                     // socket, -1 when closed
+    connState_t state;
+    int tries;                  // new connections attempted so far
+    bool reused;                // the socket came from the idle pool
+    char* host;
+    int port;
+    char* hostKey;              // "host:port", the pool's key
+    resolverAddrs_t addrs;      // count 0 until the host has been resolved
+    int addrIndex;              // the address being tried
+    char* request;              // the full HTTP request
+    size_t requestLen;
+    size_t sent;                // bytes of the request sent so far
+    char* response;             // bytes received so far, always NUL-terminated; once the
+                                // headers are seen, only the body's
+    size_t len;
+    size_t cap;
+    size_t headerLen;           // length of the headers including the blank line, 0 until seen
+    size_t bodyLen;             // bytes of body decoded, at the start of response
+    size_t rawPos;              // where the bytes not decoded yet start
+    chunkState_t chunkState;
+    long chunkLeft;             // bytes of the current chunk's data still to come
+    bool complete;              // the whole response has arrived
+    size_t mark;                // the stream callback's place in the body
+    long contentLength;         // from the headers, -1 if not given
+    bool chunked;               // Transfer-Encoding: chunked
+    bool keepAlive;             // the server lets us reuse the connection
+    int status;                 // from the status line, 0 until the headers are seen
+    char* etag;                 // the response's validators, NULL if not given
+    char* lastModified;
+    long deadline;              // monotonic time (ms) by which the next progress must happen
+    long startedUs;             // monotonic time (us) the fetch was started
+    long elapsedUs;             // how long it took, once finished
+    bool success;               // result, once finished
+    struct connection* nextDone;// finished slots waiting for their callback
+} connection_t;
+
+// A connected socket waiting in the pool for the next fetch from its host
+typedef struct idle {
+    int fd;
+    char* hostKey;
+    long since;                 // when it was parked (ms)
+    struct idle* next;
+} idle_t;
+
+typedef struct fetcher {
+    connection_t* connections;  // maxConnections slots
+    int* freeSlots;             // stack of free slot indices
+    int numFree;
+    int maxConnections;
+    int epfd;
+    struct epoll_event* events;
+    connection_t* doneHead;     // finished slots, in completion order
+    connection_t* doneTail;
+    idle_t* idle;               // pooled sockets, most recently parked first
+    int numIdle;
+    fetcherStats_t stats;
+    histogram_t* latency;       // microseconds from start to finish of every fetch
+    resolver_t* resolver;       // shared DNS cache, or NULL to resolve every time
+    fetcher_done_t done;
+    void* arg;
+    fetcher_stream_t stream;    // shown the body as it arrives, or NULL
+    void* streamArg;
+} fetcher_t;
+
+static bool splitURL(const char* url, char** host, int* port, char** path);
+static bool connectFresh(fetcher_t* fetcher, connection_t* conn);
+static bool openSocket(fetcher_t* fetcher, connection_t* conn);
+static bool nextAddress(connection_t* conn, const int error);
+static bool watch(fetcher_t* fetcher, connection_t* conn, const int op);
+static void closeSocket(connection_t* conn);
+static void handleEvent(fetcher_t* fetcher, connection_t* conn, const uint32_t events);
+static bool sendRequest(fetcher_t* fetcher, connection_t* conn);
+static void receiveResponse(fetcher_t* fetcher, connection_t* conn);
+static void retryFresh(fetcher_t* fetcher, connection_t* conn);
+static void parseHeaders(connection_t* conn);
+static char* headerValue(const char* value);
+static void freeValidators(connection_t* conn);
+static void decodeBody(connection_t* conn);
+static void decodeChunks(connection_t* conn);
+static void streamBody(fetcher_t* fetcher, connection_t* conn);
+static void finish(fetcher_t* fetcher, connection_t* conn, const bool success);
+static int deliver(fetcher_t* fetcher);
+static int pool_take(fetcher_t* fetcher, const char* hostKey);
+static void pool_park(fetcher_t* fetcher, connection_t* conn);
+static void pool_evict(fetcher_t* fetcher, const long olderThan);
+static long nowMs(void);
+static long nowUs(void);
+
+
+/**
+ * Description: Creates a fetcher with room for maxConnections fetches in flight.
+ * @param maxConnections: the most fetches in flight at once.
+ * @param done: callback for completed fetches.
+ * @param arg: passed through to done.
+ * @returns pointer to the new fetcher, or NULL.
+*/
+fetcher_t* fetcher_new(const int maxConnections, fetcher_done_t done, void* arg){
+    if (maxConnections < 1 || done == NULL) return NULL;
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) return NULL;
+    fetcher_t* fetcher = mem_assert(mem_malloc(sizeof(fetcher_t)), "Error: Failed to allocate memory for fetcher.\n");
+    fetcher->connections = mem_assert(mem_calloc(maxConnections, sizeof(connection_t)), "Error: Failed to allocate memory for connections.\n");
+    fetcher->freeSlots = mem_assert(mem_malloc(maxConnections * sizeof(int)), "Error: Failed to allocate memory for connections.\n");
+    fetcher->events = mem_assert(mem_malloc(maxConnections * sizeof(struct epoll_event)), "Error: Failed to allocate memory for events.\n");
+    // Push the slots so that slot 0 is handed out first
+    for (int i = 0; i < maxConnections; i++){
+        fetcher->connections[i].fd = -1;
+        fetcher->freeSlots[i] = maxConnections - 1 - i;
+    }
+    fetcher->numFree = maxConnections;
+    fetcher->maxConnections = maxConnections;
+    fetcher->epfd = epfd;
+    fetcher->doneHead = fetcher->doneTail = NULL;
+    fetcher->idle = NULL;
+    fetcher->numIdle = 0;
+    fetcher->stats = (fetcherStats_t){0};
+    fetcher->latency = histogram_new();
+    fetcher->resolver = NULL;
+    fetcher->done = done;
+    fetcher->arg = arg;
+    fetcher->stream = NULL;
+    fetcher->streamArg = NULL;
+    return fetcher;
+}
+
+/**
+ * Description: Makes the fetcher look hosts up through a DNS cache.
+ * @param fetcher: the fetcher.
+ * @param resolver: the cache, or NULL to resolve every host with getaddrinfo.
+*/
+void fetcher_setResolver(fetcher_t* fetcher, resolver_t* resolver){
+    if (fetcher != NULL) fetcher->resolver = resolver;
+}
+
+/**
+ * Description: Has the fetcher show stream each successful response's body as it arrives.
+ * @param fetcher: the fetcher.
+ * @param stream: the callback, or NULL for none.
+ * @param arg: passed through to stream.
+*/
+void fetcher_setStream(fetcher_t* fetcher, fetcher_stream_t stream, void* arg){
+    if (fetcher == NULL) return;
+    fetcher->stream = stream;
+    fetcher->streamArg = arg;
+}
+
+/**
+ * Description: Starts fetching page in a free slot, on a pooled connection to its host
+ *              if there is one.
+ * @param fetcher: the fetcher.
+ * @param page: the page to fetch.
+ * @returns true if the fetch is under way; false if it couldn't be started.
+*/
+bool fetcher_start(fetcher_t* fetcher, webpage_t* page){
+    return fetcher_startIf(fetcher, page, NULL, NULL);
+}
+
+/**
+ * Description: Starts fetching page as fetcher_start does, asking for it only if it
+ *              doesn't match the validators given.
+ * @param fetcher: the fetcher.
+ * @param page: the page to fetch.
+ * @param etag: sent as If-None-Match, or NULL.
+ * @param lastModified: sent as If-Modified-Since, or NULL.
+ * @returns true if the fetch is under way; false if it couldn't be started.
+*/
+bool fetcher_startIf(fetcher_t* fetcher, webpage_t* page, const char* etag, const char* lastModified){
+    if (fetcher == NULL || page == NULL || webpage_getHTML(page) != NULL || fetcher->numFree == 0) return false;
+
+    char* host;
+    int port;
+    char* path;
+    if (!splitURL(webpage_getURL(page), &host, &port, &path)) return false;
+    connection_t* conn = &fetcher->connections[fetcher->freeSlots[fetcher->numFree - 1]];
+
+    // Same request as webpage_fetch, except that it asks to keep the connection open, the
+    // Host header carries a non-default port, and it may carry validators
+    char hostKey[strlen(host) + 8];
+    sprintf(hostKey, "%s:%d", host, port);
+    const char* httpFormat = "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n%s%s%s%s%s%s\r\n";
+    const char* hostHeader = port == HTTP_PORT ? host : hostKey;
+    const char* ifNoneMatch = etag ? "If-None-Match: " : "";
+    const char* ifModifiedSince = lastModified ? "If-Modified-Since: " : "";
+    const char* etagEnd = etag ? "\r\n" : "";
+    const char* lastModifiedEnd = lastModified ? "\r\n" : "";
+    if (etag == NULL) etag = "";
+    if (lastModified == NULL) lastModified = "";
+    conn->requestLen = snprintf(NULL, 0, httpFormat, path, hostHeader, ifNoneMatch, etag, etagEnd,
+                                ifModifiedSince, lastModified, lastModifiedEnd);
+    conn->request = mem_assert(mem_malloc(conn->requestLen + 1), "Error: Failed to allocate memory for request.\n");
+    sprintf(conn->request, httpFormat, path, hostHeader, ifNoneMatch, etag, etagEnd,
+            ifModifiedSince, lastModified, lastModifiedEnd);
+    mem_free(path);
+
+    conn->page = page;
+    conn->host = host;
+    conn->port = port;
+    conn->hostKey = mem_assert(mem_malloc(strlen(hostKey) + 1), "Error: Failed to allocate memory for host.\n");
+    strcpy(conn->hostKey, hostKey);
+    conn->addrs.count = 0;
+    conn->addrIndex = 0;
+    conn->tries = 0;
+    conn->response = NULL;
+    conn->len = conn->cap = 0;
+    conn->headerLen = 0;
+    conn->mark = 0;
+    conn->status = 0;
+    conn->etag = conn->lastModified = NULL;
+    conn->nextDone = NULL;
+    conn->startedUs = nowUs();
+
+    // Reuse an idle connection to the same host if we have one; otherwise open a new one
+    conn->fd = pool_take(fetcher, conn->hostKey);
+    conn->reused = conn->fd >= 0;
+    conn->sent = 0;
+    bool started;
+    if (conn->reused){
+        conn->state = SENDING;
+        started = watch(fetcher, conn, EPOLL_CTL_ADD);
+        if (started) fetcher->stats.reused++;
+        else closeSocket(conn);
+    } else {
+        started = connectFresh(fetcher, conn);
+    }
+    if (!started){
+        mem_free(conn->request);
+        mem_free(conn->host);
+        mem_free(conn->hostKey);
+        conn->page = NULL;
+        return false;
+    }
+    fetcher->numFree--;
+    return true;
+}
+
+/**
+ * Description: Waits for network activity, advances the fetches that have some, fails
+ *              those that timed out, closes idle connections past their time, then calls
+ *              the callback for every finished fetch.
+ * @param fetcher: the fetcher.
+ * @param timeoutMs: longest time to wait; 0 polls, -1 waits indefinitely.
+ * @returns number of fetches completed.
+*/
+int fetcher_run(fetcher_t* fetcher, const int timeoutMs){
+    if (fetcher == NULL) return 0;
+    // With nothing in flight, waiting indefinitely would never return
+    if (fetcher_active(fetcher) == 0 && timeoutMs < 0) return deliver(fetcher);
+
+    // Never sleep past the earliest deadline, so stalled fetches get failed on time
+    long now = nowMs();
+    long wait = timeoutMs;
+    for (int i = 0; i < fetcher->maxConnections; i++){
+        connection_t* conn = &fetcher->connections[i];
+        if (conn->page != NULL && conn->fd >= 0){
+            long left = conn->deadline > now ? conn->deadline - now : 0;
+            if (wait < 0 || left < wait) wait = left;
+        }
+    }
+
+    int n = epoll_wait(fetcher->epfd, fetcher->events, fetcher->maxConnections, (int)wait);
+    for (int i = 0; i < n; i++){
+        handleEvent(fetcher, fetcher->events[i].data.ptr, fetcher->events[i].events);
+    }
+
+    now = nowMs();
+    for (int i = 0; i < fetcher->maxConnections; i++){
+        connection_t* conn = &fetcher->connections[i];
+        if (conn->page != NULL && conn->fd >= 0 && conn->deadline <= now){
+            finish(fetcher, conn, false);
+        }
+    }
+    pool_evict(fetcher, now - IDLE_TIMEOUT_MS);
+    return deliver(fetcher);
+}
+
+/**
+ * Description: Returns the number of fetches in flight.
+ * @param fetcher: the fetcher.
+*/
+int fetcher_active(fetcher_t* fetcher){
+    return fetcher ? fetcher->maxConnections - fetcher->numFree : 0;
+}
+
+/**
+ * Description: Returns the fetcher's connection counters.
+ * @param fetcher: the fetcher.
+*/
+fetcherStats_t fetcher_stats(fetcher_t* fetcher){
+    return fetcher ? fetcher->stats : (fetcherStats_t){0};
+}
+
+/**
+ * Description: Returns the fetcher's histogram of fetch times, in microseconds.
+ * @param fetcher: the fetcher.
+*/
+const histogram_t* fetcher_latency(fetcher_t* fetcher){
+    return fetcher ? fetcher->latency : NULL;
+}
+
+/**
+ * Description: Deletes the fetcher, abandoning any fetches in flight and closing the
+ *              pooled connections.
+ * @param fetcher: the fetcher to delete.
+*/
+void fetcher_delete(fetcher_t* fetcher){
+    if (fetcher == NULL) return;
+    for (int i = 0; i < fetcher->maxConnections; i++){
+        connection_t* conn = &fetcher->connections[i];
+        if (conn->page != NULL){
+            closeSocket(conn);
+            webpage_delete(conn->page);
+            mem_free(conn->request);
+            mem_free(conn->host);
+            mem_free(conn->hostKey);
+            free(conn->response);
+            freeValidators(conn);
+        }
+    }
+    // Evicting everything parked before "now + 1" empties the pool
+    pool_evict(fetcher, nowMs() + 1);
+    close(fetcher->epfd);
+    histogram_delete(fetcher->latency);
+    mem_free(fetcher->connections);
+    mem_free(fetcher->freeSlots);
+    mem_free(fetcher->events);
+    mem_free(fetcher);
+}
+
+/***
+ * Description: Splits an http URL into its host, port and path (fragment dropped).
+ * @param url: the URL.
+ * @param host: set to a new string holding the host.
+ * @param port: set to the port, 80 if not given.
+ * @param path: set to a new string holding the path and query, "/" if empty.
+ * @returns false if the URL isn't of the form http://host[:port][/path].
+*/
+static bool splitURL(const char* url, char** host, int* port, char** path){
+    const char* scheme = "http://";
+    if (url == NULL || strncasecmp(url, scheme, strlen(scheme)) != 0) return false;
+    const char* start = url + strlen(scheme);
+    size_t hostLen = strcspn(start, ":/?#");
+    if (hostLen == 0) return false;
+
+    const char* rest = start + hostLen;
+    *port = HTTP_PORT;
+    if (*rest == ':'){
+        char* end;
+        long p = strtol(rest + 1, &end, 10);
+        if (end == rest + 1 || p <= 0 || p > 65535) return false;
+        *port = (int)p;
+        rest = end;
+    }
+    size_t pathLen = strcspn(rest, "#");
+    *host = mem_assert(mem_malloc(hostLen + 1), "Error: Failed to allocate memory for host.\n");
+    memcpy(*host, start, hostLen);
+    (*host)[hostLen] = '\0';
+    *path = mem_assert(mem_malloc(pathLen + 2), "Error: Failed to allocate memory for path.\n");
+    if (*rest == '/') sprintf(*path, "%.*s", (int)pathLen, rest);
+    else sprintf(*path, "/%.*s", (int)pathLen, rest);
+    return true;
+}
+
+/***
+ * Description: Gives conn a new connection to its host, resolving the host first (through
+ *              the fetcher's DNS cache, if it has one) if that hasn't been done yet.
+ * @param fetcher: the fetcher.
+ * @param conn: the connection.
+ * @returns false if the host can't be resolved or no socket could be opened.
+*/
+static bool connectFresh(fetcher_t* fetcher, connection_t* conn){
+    conn->reused = false;
+    if (conn->addrs.count == 0){
+        bool found = fetcher->resolver != NULL
+                     ? resolver_lookup(fetcher->resolver, conn->host, conn->port, &conn->addrs)
+                     : resolver_resolve(conn->host, conn->port, &conn->addrs);
+        if (!found){
+            conn->addrs.count = 0;
+            return false;
+        }
+        conn->addrIndex = 0;
+    }
+    return openSocket(fetcher, conn);
+}
+
+/***
+ * Description: Opens a non-blocking socket for conn, starts connecting it to the address
+ *              being tried and registers it with epoll. Counts as one connection attempt.
+ *              If the address is refused or unreachable outright, moves on to the next.
+ * @param fetcher: the fetcher.
+ * @param conn: the connection, with its addresses and request set.
+ * @returns false if no socket could be opened or every address was refused outright.
+*/
+static bool openSocket(fetcher_t* fetcher, connection_t* conn){
+    conn->tries++;
+    conn->sent = 0;
+    const struct sockaddr_storage* addr = &conn->addrs.addr[conn->addrIndex];
+    conn->fd = socket(addr->ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (conn->fd < 0) return nextAddress(conn, errno) && openSocket(fetcher, conn);
+    fetcher->stats.opened++;
+    if (connect(conn->fd, (const struct sockaddr*)addr, conn->addrs.addrLen[conn->addrIndex]) == 0){
+        conn->state = SENDING;
+    } else if (errno == EINPROGRESS){
+        conn->state = CONNECTING;
+    } else {
+        int error = errno;
+        closeSocket(conn);
+        return nextAddress(conn, error) && openSocket(fetcher, conn);
+    }
+    if (!watch(fetcher, conn, EPOLL_CTL_ADD)){
+        closeSocket(conn);
+        return false;
+    }
+    return true;
+}
+
+/***
+ * Description: Moves conn on to its host's next address, with its own MAX_TRY attempts, if
+ *              the last connection failed because nothing listens at this one or it can't
+ *              be reached: a host may be both ::1 and 127.0.0.1, the server on only one.
+ * @param conn: the connection.
+ * @param error: why the connection failed.
+ * @returns false if the error isn't one another address could avoid, or there is none.
+*/
+static bool nextAddress(connection_t* conn, const int error){
+    if (error != ECONNREFUSED && error != ENETUNREACH && error != EHOSTUNREACH
+        && error != EADDRNOTAVAIL && error != EAFNOSUPPORT) return false;
+    if (conn->addrIndex + 1 >= conn->addrs.count) return false;
+    conn->addrIndex++;
+    conn->tries = 0;
+    return true;
+}
+
+/***
+ * Description: Registers conn's socket with epoll (or changes its registration) for the
+ *              event its state waits on, and restarts its deadline.
+ * @param fetcher: the fetcher.
+ * @param conn: the connection.
+ * @param op: EPOLL_CTL_ADD or EPOLL_CTL_MOD.
+ * @returns false if epoll refuses.
+*/
+static bool watch(fetcher_t* fetcher, connection_t* conn, const int op){
+    // Connecting and sending wait for the socket to become writable, receiving for input
+    struct epoll_event event = { .events = conn->state == RECEIVING ? EPOLLIN : EPOLLOUT, .data.ptr = conn };
+    conn->deadline = nowMs() + FETCH_TIMEOUT_MS;
+    return epoll_ctl(fetcher->epfd, op, conn->fd, &event) == 0;
+}
+
+/***
+ * Description: Closes conn's socket, if open; closing also removes it from epoll.
+ * @param conn: the connection.
+*/
+static void closeSocket(connection_t* conn){
+    if (conn->fd >= 0){
+        close(conn->fd);
+        conn->fd = -1;
+    }
+}
+
+/***
+ * Description: Advances conn according to the epoll events reported for it.
+ * @param fetcher: the fetcher.
+ * @param conn: the connection.
+ * @param events: the epoll event mask.
+*/
+static void handleEvent(fetcher_t* fetcher, connection_t* conn, const uint32_t events){
+    if (conn->page == NULL || conn->fd < 0) return;
+    conn->deadline = nowMs() + FETCH_TIMEOUT_MS;
+
+    if (conn->state == CONNECTING){
+        int error = 0;
+        socklen_t errorLen = sizeof(error);
+        if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &errorLen) < 0) error = errno;
+        if (error != 0){
+            // Try the next address, or this one again, up to MAX_TRY attempts in all
+            closeSocket(conn);
+            if (nextAddress(conn, error) && openSocket(fetcher, conn)) return;
+            while (conn->tries < MAX_TRY){
+                if (openSocket(fetcher, conn)) return;
+            }
+            finish(fetcher, conn, false);
+            return;
+        }
+        conn->state = SENDING;
+    }
+    if (conn->state == SENDING){
+        if (!sendRequest(fetcher, conn)){
+            // A pooled socket the server has since closed; start over on a new one
+            if (conn->reused) retryFresh(fetcher, conn);
+            else finish(fetcher, conn, false);
+        }
+        return;
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)){
+        receiveResponse(fetcher, conn);
+    }
+}
+
+/***
+ * Description: Sends as much of the request as the socket takes; once it is all sent,
+ *              switches conn to waiting for the response.
+ * @param fetcher: the fetcher.
+ * @param conn: the connection.
+ * @returns false on a socket error.
+*/
+static bool sendRequest(fetcher_t* fetcher, connection_t* conn){
+    while (conn->sent < conn->requestLen){
+        ssize_t n = send(conn->fd, conn->request + conn->sent, conn->requestLen - conn->sent, MSG_NOSIGNAL);
+        if (n < 0){
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        conn->sent += n;
+    }
+    conn->state = RECEIVING;
+    return watch(fetcher, conn, EPOLL_CTL_MOD);
+}
+
+/***
+ * Description: Reads whatever has arrived on conn and finishes the fetch at EOF, on an
+ *              error, or as soon as the response is complete.
+ * @param fetcher: the fetcher.
+ * @param conn: the connection.
+*/
+static void receiveResponse(fetcher_t* fetcher, connection_t* conn){
+    while (true){
+        if (conn->cap - conn->len < BUFFER_SIZE / 2){
+            conn->cap = conn->cap ? conn->cap * 2 : BUFFER_SIZE;
+            conn->response = mem_assert(realloc(conn->response, conn->cap + 1), "Error: Failed to allocate memory for response.\n");
+        }
+        ssize_t n = recv(conn->fd, conn->response + conn->len, conn->cap - conn->len, 0);
+        if (n > 0){
+            conn->len += n;
+            conn->response[conn->len] = '\0';
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (conn->len == 0 && conn->headerLen == 0 && conn->reused){
+            // The server closed the pooled socket before answering; start over on a new one
+            retryFresh(fetcher, conn);
+        } else if (n == 0 && (conn->len > 0 || conn->headerLen > 0)){
+            // EOF: the server closed the connection. Only a body delimited by the close
+            // is whole now; one short of its length, or cut inside its chunks, is not.
+            parseHeaders(conn);
+            if (conn->headerLen > 0) decodeBody(conn);
+            conn->keepAlive = false;
+            bool whole = conn->complete || (conn->contentLength < 0 && !conn->chunked);
+            finish(fetcher, conn, conn->headerLen > 0 && whole);
+        } else {
+            finish(fetcher, conn, false);
+        }
+        return;
+    }
+
+    // With a length-delimited body, stop as soon as it is all here
+    parseHeaders(conn);
+    if (conn->headerLen == 0) return;
+    decodeBody(conn);
+    streamBody(fetcher, conn);
+    if (conn->complete) finish(fetcher, conn, true);
+}
+
+/***
+ * Description: Abandons conn's pooled socket and sends the request again on a new
+ *              connection, or fails the fetch if one can't be opened.
+ * @param fetcher: the fetcher.
+ * @param conn: the connection.
+*/
+static void retryFresh(fetcher_t* fetcher, connection_t* conn){
+    closeSocket(conn);
+    conn->len = 0;
+    conn->headerLen = 0;
+    conn->mark = 0;
+    conn->status = 0;
+    freeValidators(conn);
+    if (!connectFresh(fetcher, conn)){
+        finish(fetcher, conn, false);
+    }
+}
+
+/***
+ * Description: Once the blank line ending the headers has arrived, records the header
+ *              length, Content-Length, whether the body is chunked and whether the
+ *              server lets us keep the connection, then drops the headers from the
+ *              buffer, leaving the body to be decoded.
+ * @param conn: the connection.
+*/
+static void parseHeaders(connection_t* conn){
+    if (conn->headerLen > 0 || conn->response == NULL) return;
+    char* end = memmem(conn->response, conn->len, "\r\n\r\n", 4);
+    if (end != NULL){
+        conn->headerLen = end - conn->response + 4;
+    } else if ((end = memmem(conn->response, conn->len, "\n\n", 2)) != NULL){
+        conn->headerLen = end - conn->response + 2;
+    } else {
+        return;
+    }
+    conn->contentLength = -1;
+    conn->chunked = false;
+    if (sscanf(conn->response, "HTTP/1.%*d %d", &conn->status) != 1) conn->status = 0;
+    // HTTP/1.1 connections persist unless the server says otherwise; HTTP/1.0 ones close
+    conn->keepAlive = strncmp(conn->response, "HTTP/1.1", 8) == 0;
+    // Walk the header lines after the status line
+    char* line = strchr(conn->response, '\n');
+    while (line != NULL && line - conn->response < (long)conn->headerLen){
+        line++;
+        if (strncasecmp(line, "Content-Length:", 15) == 0){
+            conn->contentLength = strtol(line + 15, NULL, 10);
+        } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0){
+            char* value = line + 18;
+            while (*value == ' ' || *value == '\t') value++;
+            conn->chunked = strncasecmp(value, "chunked", 7) == 0;
+        } else if (strncasecmp(line, "Connection:", 11) == 0){
+            char* value = line + 11;
+            while (*value == ' ' || *value == '\t') value++;
+            if (strncasecmp(value, "close", 5) == 0) conn->keepAlive = false;
+            else if (strncasecmp(value, "keep-alive", 10) == 0) conn->keepAlive = true;
+        } else if (strncasecmp(line, "ETag:", 5) == 0 && conn->etag == NULL){
+            conn->etag = headerValue(line + 5);
+        } else if (strncasecmp(line, "Last-Modified:", 14) == 0 && conn->lastModified == NULL){
+            conn->lastModified = headerValue(line + 14);
+        }
+        line = strchr(line, '\n');
+    }
+    // Any length given for a 304 is the unchanged page's, and a 204 has no body either
+    if (conn->status == FETCH_NOT_MODIFIED || conn->status == 204){
+        conn->contentLength = 0;
+        conn->chunked = false;
+    }
+    // Without a length the body runs to EOF, so the connection can't be reused
+    if (!conn->chunked && conn->contentLength < 0) conn->keepAlive = false;
+
+    conn->len -= conn->headerLen;
+    memmove(conn->response, conn->response + conn->headerLen, conn->len + 1);
+    conn->bodyLen = conn->rawPos = 0;
+    conn->chunkState = CHUNK_SIZE;
+    conn->complete = false;
+}
+
+/***
+ * Description: Copies a header's value, without the whitespace around it.
+ * @param value: the value, just past the header's colon.
+ * @returns a new string, or NULL if the value is empty.
+*/
+static char* headerValue(const char* value){
+    while (*value == ' ' || *value == '\t') value++;
+    size_t length = strcspn(value, "\r\n");
+    while (length > 0 && (value[length - 1] == ' ' || value[length - 1] == '\t')) length--;
+    if (length == 0) return NULL;
+    char* copy = mem_assert(mem_malloc(length + 1), "Error: Failed to allocate memory for header.\n");
+    memcpy(copy, value, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+/***
+ * Description: Frees the validators parsed from conn's response.
+ * @param conn: the connection.
+*/
+static void freeValidators(connection_t* conn){
+    if (conn->etag) mem_free(conn->etag);
+    if (conn->lastModified) mem_free(conn->lastModified);
+    conn->etag = conn->lastModified = NULL;
+}
+
+/***
+ * Description: Decodes the body bytes received since the last call, and notes whether
+ *              the whole response has now arrived.
+ * @param conn: the connection, with its headers parsed.
+*/
+static void decodeBody(connection_t* conn){
+    if (conn->chunked){
+        decodeChunks(conn);
+        return;
+    }
+    size_t length = conn->len;
+    conn->complete = conn->contentLength >= 0 && conn->len >= (size_t)conn->contentLength;
+    if (conn->complete) length = conn->contentLength;
+    conn->bodyLen = conn->rawPos = length;
+}
+
+/***
+ * Description: Decodes a chunked body's new bytes, moving each chunk's data down to the
+ *              end of the body decoded so far. Each chunk is a hex size line, the data
+ *              and a CRLF; a zero size is followed by optional trailer lines and a
+ *              blank line. A line not all here yet is left for the next call.
+ * @param conn: the connection, with its headers parsed.
+*/
+static void decodeChunks(connection_t* conn){
+    char* buf = conn->response;
+    while (conn->rawPos < conn->len){
+        size_t available = conn->len - conn->rawPos;
+        char* at = buf + conn->rawPos;
+        if (conn->chunkState == CHUNK_DATA){
+            size_t take = (size_t)conn->chunkLeft < available ? (size_t)conn->chunkLeft : available;
+            memmove(buf + conn->bodyLen, at, take);
+            conn->bodyLen += take;
+            conn->rawPos += take;
+            conn->chunkLeft -= take;
+            if (conn->chunkLeft == 0) conn->chunkState = CHUNK_CR;
+        } else if (conn->chunkState == CHUNK_CR){
+            // The CRLF after the data, leniently: either may be missing
+            if (*at == '\r') conn->rawPos++;
+            conn->chunkState = CHUNK_LF;
+        } else if (conn->chunkState == CHUNK_LF){
+            if (*at == '\n') conn->rawPos++;
+            conn->chunkState = CHUNK_SIZE;
+        } else if (conn->chunkState == CHUNK_SIZE || conn->chunkState == CHUNK_TRAILER){
+            char* lineEnd = memchr(at, '\n', available);
+            if (lineEnd == NULL) return;
+            conn->rawPos = lineEnd - buf + 1;
+            if (conn->chunkState == CHUNK_TRAILER){
+                // A blank line ends the trailers, and the response
+                if (lineEnd == at || (lineEnd == at + 1 && *at == '\r')){
+                    conn->chunkState = CHUNK_DONE;
+                    conn->complete = true;
+                }
+                continue;
+            }
+            char* sizeEnd;
+            long size = strtol(at, &sizeEnd, 16);
+            if (sizeEnd == at || size < 0){
+                conn->chunkState = CHUNK_BAD;
+                conn->rawPos = conn->len;
+                return;
+            }
+            conn->chunkLeft = size;
+            conn->chunkState = size == 0 ? CHUNK_TRAILER : CHUNK_DATA;
+        } else {
+            // Done, or stuck: anything more is not this body's
+            return;
+        }
+    }
+}
+
+/***
+ * Description: Shows the stream callback a successful response's body decoded so far,
+ *              if there is a callback and the body has grown.
+ * @param fetcher: the fetcher.
+ * @param conn: the connection, with its body decoded.
+*/
+static void streamBody(fetcher_t* fetcher, connection_t* conn){
+    if (fetcher->stream == NULL || conn->status != 200 || conn->bodyLen == 0 || conn->bodyLen <= conn->mark) return;
+    // The body is followed by bytes not decoded yet; end it for the callback meanwhile
+    char saved = conn->response[conn->bodyLen];
+    conn->response[conn->bodyLen] = '\0';
+    fetcher->stream(fetcher->streamArg, conn->page, conn->response, conn->bodyLen, &conn->mark);
+    conn->response[conn->bodyLen] = saved;
+}
+
+/***
+ * Description: Ends conn's fetch and queues it for its callback. On success the response
+ *              must be a 200 with a non-empty body, as webpage_fetch requires; the page is
+ *              then replaced by one holding the body as its HTML, in the buffer it was
+ *              decoded in. A socket whose response ended exactly at its length goes back
+ *              to the pool.
+ * @param fetcher: the fetcher.
+ * @param conn: the connection; its body is decoded.
+ * @param success: whether the transfer itself succeeded.
+*/
+static void finish(fetcher_t* fetcher, connection_t* conn, const bool success){
+    conn->success = false;
+    bool complete = success && conn->complete;
+    size_t length = success ? conn->bodyLen : 0;
+
+    // Only a socket with nothing left over from this response can carry the next request
+    if (complete && conn->keepAlive && conn->rawPos == conn->len){
+        pool_park(fetcher, conn);
+    } else {
+        closeSocket(conn);
+    }
+
+    if (!success) conn->status = 0;
+    if (success && conn->status == 200 && length > 0){
+        // The buffer becomes the HTML; deliver frees a response that is still there
+        char* html = mem_assert(realloc(conn->response, length + 1), "Error: Failed to allocate memory for html.\n");
+        html[length] = '\0';
+        conn->response = NULL;
+        webpage_t* page = webpage_new(strdup(webpage_getURL(conn->page)), webpage_getDepth(conn->page), html);
+        webpage_delete(conn->page);
+        conn->page = page;
+        conn->success = true;
+        fetcher->stats.fetched++;
+        fetcher->stats.bytes += length;
+    } else {
+        if (conn->status == FETCH_NOT_MODIFIED) fetcher->stats.notModified++;
+        else fetcher->stats.failed++;
+    }
+    conn->elapsedUs = nowUs() - conn->startedUs;
+    histogram_add(fetcher->latency, conn->elapsedUs);
+
+    if (fetcher->doneTail == NULL) fetcher->doneHead = conn;
+    else fetcher->doneTail->nextDone = conn;
+    fetcher->doneTail = conn;
+}
+
+/***
+ * Description: Frees the slots of finished fetches and calls the callback for each.
+ * @param fetcher: the fetcher.
+ * @returns the number of fetches delivered.
+*/
+static int deliver(fetcher_t* fetcher){
+    int delivered = 0;
+    connection_t* conn = fetcher->doneHead;
+    fetcher->doneHead = fetcher->doneTail = NULL;
+    while (conn != NULL){
+        connection_t* next = conn->nextDone;
+        webpage_t* page = conn->page;
+        bool success = conn->success;
+        char* etag = conn->etag;
+        char* lastModified = conn->lastModified;
+        fetchResponse_t response = { .status = conn->status, .etag = etag, .lastModified = lastModified,
+                                     .mark = success ? conn->mark : 0, .elapsedUs = conn->elapsedUs };
+        // Free the slot first so the callback can start a new fetch in it.
+        // The response buffer grows with realloc, so it is freed directly
+        mem_free(conn->request);
+        mem_free(conn->host);
+        mem_free(conn->hostKey);
+        free(conn->response);
+        conn->request = conn->response = conn->host = conn->hostKey = NULL;
+        conn->etag = conn->lastModified = NULL;
+        conn->page = NULL;
+        conn->nextDone = NULL;
+        fetcher->freeSlots[fetcher->numFree++] = conn - fetcher->connections;
+        fetcher->done(fetcher->arg, page, success, &response);
+        if (etag) mem_free(etag);
+        if (lastModified) mem_free(lastModified);
+        delivered++;
+        conn = next;
+    }
+    return delivered;
+}
+
+/***
+ * Description: Takes the most recently parked idle socket to hostKey out of the pool.
+ * @param fetcher: the fetcher.
+ * @param hostKey: "host:port".
+ * @returns the socket, or -1 if none is pooled.
+*/
+static int pool_take(fetcher_t* fetcher, const char* hostKey){
+    for (idle_t** link = &fetcher->idle; *link != NULL; link = &(*link)->next){
+        idle_t* entry = *link;
+        if (strcmp(entry->hostKey, hostKey) == 0){
+            int fd = entry->fd;
+            *link = entry->next;
+            mem_free(entry->hostKey);
+            mem_free(entry);
+            fetcher->numIdle--;
+            return fd;
+        }
+    }
+    return -1;
+}
+
+/***
+ * Description: Moves conn's socket into the pool, closing the oldest idle socket if the
+ *              pool is full.
+ * @param fetcher: the fetcher.
+ * @param conn: the connection; its socket is taken from it.
+*/
+static void pool_park(fetcher_t* fetcher, connection_t* conn){
+    // An idle socket has no events to wait for until it is reused
+    epoll_ctl(fetcher->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    idle_t* entry = mem_assert(mem_malloc(sizeof(idle_t)), "Error: Failed to allocate memory for idle connection.\n");
+    entry->fd = conn->fd;
+    entry->hostKey = conn->hostKey;
+    entry->since = nowMs();
+    entry->next = fetcher->idle;
+    fetcher->idle = entry;
+    fetcher->numIdle++;
+    conn->hostKey = NULL;
+    conn->fd = -1;
+
+    if (fetcher->numIdle > fetcher->maxConnections){
+        // The oldest is last in the list
+        idle_t** link = &fetcher->idle;
+        while ((*link)->next != NULL) link = &(*link)->next;
+        close((*link)->fd);
+        mem_free((*link)->hostKey);
+        mem_free(*link);
+        *link = NULL;
+        fetcher->numIdle--;
+        fetcher->stats.evicted++;
+    }
+}
+
+/***
+ * Description: Closes the idle sockets parked before the given time.
+ * @param fetcher: the fetcher.
+ * @param olderThan: monotonic time (ms); sockets parked earlier are closed.
+*/
+static void pool_evict(fetcher_t* fetcher, const long olderThan){
+    idle_t** link = &fetcher->idle;
+    while (*link != NULL){
+        idle_t* entry = *link;
+        if (entry->since < olderThan){
+            *link = entry->next;
+            close(entry->fd);
+            mem_free(entry->hostKey);
+            mem_free(entry);
+            fetcher->numIdle--;
+            fetcher->stats.evicted++;
+        } else {
+            link = &entry->next;
+        }
+    }
+}
+
+/***
+ * Description: Returns the monotonic clock in milliseconds.
+*/
+static long nowMs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+/***
+ * Description: Returns the monotonic clock in microseconds.
+*/
+static long nowUs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
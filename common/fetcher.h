@@ -0,0 +1,157 @@
+/**
+ * fetcher.h
+ *
+ * Interface for the crawler's asynchronous fetch engine. A fetcher keeps up to
+ * maxConnections HTTP fetches in flight from a single thread, using non-blocking
+ * sockets and epoll. Pages are handed to fetcher_start; fetcher_run waits for
+ * network activity and, once all the events it got are processed, calls the
+ * fetcher's callback for every fetch that completed. The callback may start new
+ * fetches.
+ *
+ * The body is decoded as it arrives, and the buffer it is decoded in becomes the
+ * page's HTML. A stream callback can be shown the body so far after every read, to
+ * start work on a page before the whole of it is here.
+ *
+ * Connections are kept open between fetches when the server allows it: a finished
+ * fetch parks its socket in a pool keyed by host and port, and the next fetch from
+ * that host reuses it. Idle sockets are closed after a few seconds.
+ *
+ * A fetch may be conditional: it sends back the validators (ETag, Last-Modified) an
+ * earlier fetch of the page got, and a server whose copy hasn't changed answers 304
+ * Not Modified, with no body.
+ */
+#ifndef __FETCHER_H
+#define __FETCHER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "webpage.h"
+#include "resolver.h"
+#include "histogram.h"
+
+#define FETCH_NOT_MODIFIED 304     // status of a conditional fetch whose page hasn't changed
+
+typedef struct fetcher fetcher_t;
+
+/* What a fetch got back besides the HTML: the status and the response's validators,
+ * which a later fetch of the page can send back. The strings last until the callback
+ * returns. */
+typedef struct fetchResponse {
+    int status;                 // HTTP status code; 0 if no response arrived
+    const char* etag;           // ETag header, or NULL
+    const char* lastModified;   // Last-Modified header, or NULL
+    size_t mark;                // on success, where the stream callback left its mark; 0 without one
+    long elapsedUs;             // how long the fetch took, from start to finish; 0 if never started
+} fetchResponse_t;
+
+/* Called once for every page handed to fetcher_start. On success page holds the
+ * fetched HTML; on failure it is the page as given, without HTML (a conditional fetch
+ * answered FETCH_NOT_MODIFIED is a failure too). Either way the callback owns the page
+ * and must eventually webpage_delete it. */
+typedef void (*fetcher_done_t)(void* arg, webpage_t* page, const bool success, const fetchResponse_t* response);
+
+/* Called, if set, each time more of a 200 response's body has arrived, with all of the
+ * body decoded so far: NUL-terminated, and only valid during the call. The body may
+ * still turn out incomplete, and the fetch fail. mark is the callback's own place in
+ * the body, 0 at first; it is kept from call to call, and handed to the done callback
+ * in the fetchResponse_t. */
+typedef void (*fetcher_stream_t)(void* arg, webpage_t* page, const char* body, const size_t len, size_t* mark);
+
+/* Connection counters, for reporting how well the pool works, and fetch counters. */
+typedef struct fetcherStats {
+    long opened;                // TCP connections opened
+    long reused;                // fetches sent on a pooled connection
+    long evicted;               // idle connections closed by the pool
+    long fetched;               // fetches that succeeded
+    long failed;                // fetches started that failed
+    long notModified;           // conditional fetches answered 304, counted in neither
+    long bytes;                 // bytes of HTML fetched
+} fetcherStats_t;
+
+/***
+ * Description: Creates a new fetcher.
+ * @param maxConnections: the most fetches that may be in flight at once.
+ * @param done: callback for completed fetches.
+ * @param arg: passed through to done.
+ * @returns pointer to the new fetcher, or NULL on bad parameters or if epoll is unavailable.
+ */
+fetcher_t* fetcher_new(const int maxConnections, fetcher_done_t done, void* arg);
+
+/***
+ * Description: Makes the fetcher resolve hosts through a DNS cache, which may be shared
+ *              with other fetchers and must outlive this one. Without one, each new
+ *              connection resolves its host with getaddrinfo.
+ * @param fetcher: the fetcher.
+ * @param resolver: the cache, or NULL.
+ */
+void fetcher_setResolver(fetcher_t* fetcher, resolver_t* resolver);
+
+/***
+ * Description: Has the fetcher show each successful response's body to a callback as it
+ *              arrives, before the fetch completes.
+ * @param fetcher: the fetcher.
+ * @param stream: the callback, or NULL for none.
+ * @param arg: passed through to stream.
+ */
+void fetcher_setStream(fetcher_t* fetcher, fetcher_stream_t stream, void* arg);
+
+/***
+ * Description: Starts fetching a page. The fetcher adopts the page until it is passed
+ *              back to the callback; the fetch runs as fetcher_run is called.
+ * @param fetcher: the fetcher.
+ * @param page: a page with a URL and no HTML yet.
+ * @returns false, leaving the page with the caller, if every connection is in use or
+ *          the fetch couldn't be started (bad URL, unknown host, out of sockets).
+ */
+bool fetcher_start(fetcher_t* fetcher, webpage_t* page);
+
+/***
+ * Description: Starts a conditional fetch of a page: as fetcher_start, but the request
+ *              sends back the validators an earlier fetch of it got, so a server whose
+ *              copy hasn't changed answers FETCH_NOT_MODIFIED instead of the page.
+ * @param fetcher: the fetcher.
+ * @param page: a page with a URL and no HTML yet.
+ * @param etag: sent as If-None-Match, or NULL.
+ * @param lastModified: sent as If-Modified-Since, or NULL.
+ * @returns false, leaving the page with the caller, if the fetch couldn't be started.
+ */
+bool fetcher_startIf(fetcher_t* fetcher, webpage_t* page, const char* etag, const char* lastModified);
+
+/***
+ * Description: Waits up to timeoutMs for network activity, advances every fetch that
+ *              has some, then calls the callback for each fetch that finished.
+ * @param fetcher: the fetcher.
+ * @param timeoutMs: how long to wait; 0 just polls, -1 waits indefinitely.
+ * @returns the number of fetches completed (successfully or not).
+ */
+int fetcher_run(fetcher_t* fetcher, const int timeoutMs);
+
+/***
+ * Description: Returns the number of fetches in flight.
+ * @param fetcher: the fetcher.
+ */
+int fetcher_active(fetcher_t* fetcher);
+
+/***
+ * Description: Returns the fetcher's connection counters.
+ * @param fetcher: the fetcher.
+ */
+fetcherStats_t fetcher_stats(fetcher_t* fetcher);
+
+/***
+ * Description: Returns how long each fetch started took to finish, successfully or not,
+ *              in microseconds. The histogram belongs to the fetcher and is deleted with it.
+ * @param fetcher: the fetcher.
+ */
+const histogram_t* fetcher_latency(fetcher_t* fetcher);
+
+/***
+ * Description: Deletes the fetcher. Fetches still in flight are abandoned and their
+ *              pages deleted without calling the callback; pooled
+ *              connections are closed.
+ * @param fetcher: the fetcher to delete.
+ */
+void fetcher_delete(fetcher_t* fetcher);
+
+#endif
@@ -0,0 +1,233 @@
+/**
+ * frontier.c
+ *
+ * Description: Implements the crawler's frontier as a politeness scheduler of webpages
+ *              guarded by a mutex. A condition variable lets worker threads sleep while
+ *              no page can be taken: either nothing is queued, or every queued page's
+ *              host is still within its delay (then they sleep until the earliest host
+ *              is ready). A count of the pages currently being worked on tells an empty
+ *              frontier apart from the end of the crawl (empty and nothing in flight).
+ */
+#define _POSIX_C_SOURCE 200809L    // clock_gettime, pthread_condattr_setclock
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include "frontier.h"
+#include "scheduler.h"
+#include "webpage.h"
+#include "mem.h"
+
+typedef struct frontier {
+    scheduler_t* pages;         // pages waiting to be crawled, queued by host
+    int inFlight;               // pages taken but not reported done yet
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     // signaled on insert and when the crawl finishes
+} frontier_t;
+
+static webpage_t* frontier_next(frontier_t* frontier, long* waitMs);
+
+
+/**
+ * Description: Creates a new empty frontier.
+ * @param delayMs: least time between taking two pages of the same host.
+ * @param order: the order each host's pages are taken in.
+ * @param window: pages per host kept in memory.
+ * @param spillDirectory: where the rest are written, or NULL.
+ * @returns pointer to the new frontier.
+*/
+frontier_t* frontier_new(const int delayMs, const queueOrder_t order, const int window, const char* spillDirectory){
+    frontier_t* frontier = mem_assert(mem_malloc(sizeof(frontier_t)), "Error: Failed to allocate memory for frontier.\n");
+    frontier->pages = scheduler_new(delayMs, order, window, spillDirectory);
+    frontier->inFlight = 0;
+    pthread_mutex_init(&frontier->lock, NULL);
+    // Timed waits are measured on the same monotonic clock the scheduler uses
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&frontier->changed, &attr);
+    pthread_condattr_destroy(&attr);
+    return frontier;
+}
+
+/**
+ * Description: Makes the frontier hand out pages highest score first.
+ * @param frontier: the frontier, still empty.
+ * @param scorer: the scorer.
+*/
+void frontier_setScorer(frontier_t* frontier, const scorer_t* scorer){
+    if (!frontier) return;
+    pthread_mutex_lock(&frontier->lock);
+    scheduler_setScorer(frontier->pages, scorer);
+    pthread_mutex_unlock(&frontier->lock);
+}
+
+/**
+ * Description: Logs every page taken out of the frontier.
+ * @param frontier: the frontier.
+ * @param fp: where to log, or NULL.
+*/
+void frontier_setLog(frontier_t* frontier, FILE* fp){
+    if (!frontier) return;
+    pthread_mutex_lock(&frontier->lock);
+    scheduler_setLog(frontier->pages, fp);
+    pthread_mutex_unlock(&frontier->lock);
+}
+
+/**
+ * Description: Adds a page to the frontier and wakes one waiting thread.
+ * @param frontier: the frontier to insert into.
+ * @param page: the page to be crawled.
+*/
+void frontier_insert(frontier_t* frontier, webpage_t* page){
+    if (!frontier || !page) return;
+    pthread_mutex_lock(&frontier->lock);
+    scheduler_insert(frontier->pages, page);
+    pthread_cond_signal(&frontier->changed);
+    pthread_mutex_unlock(&frontier->lock);
+}
+
+/**
+ * Description: Counts another link to a page waiting in the frontier.
+ * @param frontier: the frontier.
+ * @param url: the page's canonical URL.
+ * @param key: its urlcanon fingerprint.
+ * @returns false if the page isn't waiting, or the frontier has no scorer.
+*/
+bool frontier_credit(frontier_t* frontier, const char* url, const uint64_t key){
+    if (!frontier || !url) return false;
+    pthread_mutex_lock(&frontier->lock);
+    bool credited = scheduler_credit(frontier->pages, url, key);
+    pthread_mutex_unlock(&frontier->lock);
+    return credited;
+}
+
+/**
+ * Description: Takes a page out of the frontier, waiting while none can be taken but the
+ *              crawl isn't over.
+ * @param frontier: the frontier to take from.
+ * @returns a page, or NULL when the crawl is finished.
+*/
+webpage_t* frontier_take(frontier_t* frontier){
+    if (!frontier) return NULL;
+    pthread_mutex_lock(&frontier->lock);
+    webpage_t* page;
+    long waitMs;
+    while ((page = frontier_next(frontier, &waitMs)) == NULL && (waitMs >= 0 || frontier->inFlight > 0)){
+        if (waitMs < 0){
+            pthread_cond_wait(&frontier->changed, &frontier->lock);
+        } else {
+            // Sleep until the earliest host is ready, unless an insert wakes us sooner
+            struct timespec until;
+            clock_gettime(CLOCK_MONOTONIC, &until);
+            until.tv_sec += waitMs / 1000;
+            until.tv_nsec += (waitMs % 1000) * 1000000;
+            if (until.tv_nsec >= 1000000000){
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&frontier->changed, &frontier->lock, &until);
+        }
+    }
+    if (page == NULL){
+        // Nothing left and nobody can add more: release every other waiting thread too
+        pthread_cond_broadcast(&frontier->changed);
+    }
+    pthread_mutex_unlock(&frontier->lock);
+    return page;
+}
+
+/**
+ * Description: Takes a page out of the frontier if one can be taken now, without waiting.
+ * @param frontier: the frontier to take from.
+ * @param waitMs: when no page is returned, set to how long until one can be taken, or -1
+ *                if the frontier is empty.
+ * @returns a page, or NULL.
+*/
+webpage_t* frontier_tryTake(frontier_t* frontier, long* waitMs){
+    if (!frontier){
+        if (waitMs) *waitMs = -1;
+        return NULL;
+    }
+    pthread_mutex_lock(&frontier->lock);
+    webpage_t* page = frontier_next(frontier, waitMs);
+    pthread_mutex_unlock(&frontier->lock);
+    return page;
+}
+
+/**
+ * Description: Reports a page taken earlier as done.
+ * @param frontier: the frontier the page was taken from.
+*/
+void frontier_done(frontier_t* frontier){
+    if (!frontier) return;
+    pthread_mutex_lock(&frontier->lock);
+    frontier->inFlight--;
+    if (frontier->inFlight == 0 && scheduler_size(frontier->pages) == 0){
+        pthread_cond_broadcast(&frontier->changed);
+    }
+    pthread_mutex_unlock(&frontier->lock);
+}
+
+/**
+ * Description: Returns the number of pages waiting in the frontier.
+ * @param frontier: the frontier.
+*/
+int frontier_size(frontier_t* frontier){
+    if (!frontier) return 0;
+    pthread_mutex_lock(&frontier->lock);
+    int size = scheduler_size(frontier->pages);
+    pthread_mutex_unlock(&frontier->lock);
+    return size;
+}
+
+/**
+ * Description: Returns whether a spill segment couldn't be written or read back.
+ * @param frontier: the frontier.
+*/
+bool frontier_spillFailed(frontier_t* frontier){
+    if (!frontier) return false;
+    pthread_mutex_lock(&frontier->lock);
+    bool failed = scheduler_spillFailed(frontier->pages);
+    pthread_mutex_unlock(&frontier->lock);
+    return failed;
+}
+
+/**
+ * Description: Prints the per-host queue lengths and wait times.
+ * @param frontier: the frontier.
+ * @param fp: where to print.
+*/
+void frontier_report(frontier_t* frontier, FILE* fp){
+    if (!frontier) return;
+    pthread_mutex_lock(&frontier->lock);
+    scheduler_report(frontier->pages, fp);
+    pthread_mutex_unlock(&frontier->lock);
+}
+
+/**
+ * Description: Deletes the frontier and the pages still in it.
+ * @param frontier: the frontier to delete.
+*/
+void frontier_delete(frontier_t* frontier){
+    if (!frontier) return;
+    scheduler_delete(frontier->pages);
+    pthread_mutex_destroy(&frontier->lock);
+    pthread_cond_destroy(&frontier->changed);
+    mem_free(frontier);
+}
+
+/***
+ * Description: Takes the next page the scheduler releases, counting it in flight. The
+ *              caller holds the lock.
+ * @param frontier: the frontier.
+ * @param waitMs: see scheduler_next.
+ * @returns a page, or NULL.
+*/
+static webpage_t* frontier_next(frontier_t* frontier, long* waitMs){
+    webpage_t* page = scheduler_next(frontier->pages, waitMs);
+    if (page != NULL) frontier->inFlight++;
+    return page;
+}
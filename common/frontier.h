@@ -0,0 +1,127 @@
+/**
+ * frontier.h
+ *
+ * Interface for the crawler's frontier: the collection of webpages that still
+ * need to be fetched. Pages are released politely: at most one page per host
+ * every delayMs (see scheduler.h). The frontier is shared by all the crawler's
+ * worker threads;
+ * a thread takes a page, works on it (possibly inserting the new pages it finds),
+ * then reports it done. The crawl is over once the frontier is empty and no page
+ * is being worked on, at which point every waiting thread is released.
+ *
+ * With a scorer the frontier is a priority queue: of the pages that may be taken,
+ * the one with the highest score comes out first.
+ */
+#ifndef __FRONTIER_H
+#define __FRONTIER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "webpage.h"
+#include "urlqueue.h"
+#include "scorer.h"
+
+typedef struct frontier frontier_t;
+
+/***
+ * Description: Creates a new empty frontier.
+ * @param delayMs: least time between taking two pages of the same host.
+ * @param order: QUEUE_FIFO to crawl each host breadth-first, QUEUE_LIFO for most-recent first.
+ * @param window: pages per host kept in memory.
+ * @param spillDirectory: existing directory the rest are written to, or NULL to keep
+ *                        them all in memory.
+ * @returns pointer to the new frontier; exits if out of memory.
+ */
+frontier_t* frontier_new(const int delayMs, const queueOrder_t order, const int window, const char* spillDirectory);
+
+/***
+ * Description: Makes the frontier hand out pages highest score first (see
+ *              scheduler_setScorer). Must be called before any page is inserted.
+ * @param frontier: the frontier.
+ * @param scorer: the scorer; it must outlive the frontier.
+ */
+void frontier_setScorer(frontier_t* frontier, const scorer_t* scorer);
+
+/***
+ * Description: Logs every page taken out of the frontier, in the order they are taken
+ *              (see scheduler_setLog).
+ * @param frontier: the frontier.
+ * @param fp: where to log, or NULL not to.
+ */
+void frontier_setLog(frontier_t* frontier, FILE* fp);
+
+/***
+ * Description: Adds a page to the frontier and wakes up one waiting thread.
+ *              The frontier takes the page; the one taken out later is a copy.
+ * @param frontier: the frontier to insert into.
+ * @param page: the page to be crawled.
+ */
+void frontier_insert(frontier_t* frontier, webpage_t* page);
+
+/***
+ * Description: Counts another link to a page waiting in the frontier, raising its score.
+ * @param frontier: the frontier.
+ * @param url: the page's canonical URL.
+ * @param key: the URL's urlcanon fingerprint.
+ * @returns false if the page isn't waiting, or the frontier has no scorer.
+ */
+bool frontier_credit(frontier_t* frontier, const char* url, const uint64_t key);
+
+/***
+ * Description: Takes a page out of the frontier, blocking while no page's host is ready,
+ *              or while the frontier is empty but other threads are still working on
+ *              pages (they may insert more). Every page taken must later be reported
+ *              with frontier_done.
+ * @param frontier: the frontier to take from.
+ * @returns a page to crawl, or NULL once the crawl is finished.
+ */
+webpage_t* frontier_take(frontier_t* frontier);
+
+/***
+ * Description: Takes a page out of the frontier if one's host is ready, without blocking.
+ *              Every page taken must later be reported with frontier_done.
+ * @param frontier: the frontier to take from.
+ * @param waitMs: when NULL is returned, set to how long until a page can be taken, or
+ *                -1 if the frontier is empty.
+ * @returns a page to crawl, or NULL.
+ */
+webpage_t* frontier_tryTake(frontier_t* frontier, long* waitMs);
+
+/***
+ * Description: Reports that the caller is done with a page it took, and has already
+ *              inserted any pages found on it.
+ * @param frontier: the frontier the page was taken from.
+ */
+void frontier_done(frontier_t* frontier);
+
+/***
+ * Description: Returns the number of pages waiting in the frontier.
+ * @param frontier: the frontier.
+ */
+int frontier_size(frontier_t* frontier);
+
+/***
+ * Description: Returns whether a spill segment couldn't be written or read back (see
+ *              scheduler_spillFailed); the crawl should stop, to be resumed from its
+ *              checkpoint.
+ * @param frontier: the frontier.
+ */
+bool frontier_spillFailed(frontier_t* frontier);
+
+/***
+ * Description: Prints the frontier's per-host queue lengths and wait times (see
+ *              scheduler_report).
+ * @param frontier: the frontier.
+ * @param fp: where to print.
+ */
+void frontier_report(frontier_t* frontier, FILE* fp);
+
+/***
+ * Description: Deletes the frontier and any pages still in it.
+ * @param frontier: the frontier to delete.
+ */
+void frontier_delete(frontier_t* frontier);
+
+#endif
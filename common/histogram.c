@@ -0,0 +1,119 @@
+/**
+ * histogram.c
+ *
+ * Description: Implements the latency histogram as a fixed array of bucket counts.
+ *              A value's bucket comes from its highest set bit and the four bits
+ *              below it, so each bucket is at most 1/16 of its values wide and its
+ *              middle is within 1/32 of any value in it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "histogram.h"
+#include "mem.h"
+
+#define SUB_BITS 4                                  // each power of two split in 16
+#define EXACT (2 << SUB_BITS)                       // values below this have a bucket each
+#define MAX_BITS 48                                 // larger values share the last bucket
+#define NUM_BUCKETS (EXACT + (MAX_BITS - SUB_BITS - 1) * (1 << SUB_BITS))
+
+typedef struct histogram {
+    long counts[NUM_BUCKETS];
+    long count;
+} histogram_t;
+
+static int bucketOf(const long value);
+static long middleOf(const int bucket);
+
+
+/**
+ * Description: Creates a new empty histogram.
+ * @returns pointer to the new histogram.
+*/
+histogram_t* histogram_new(void){
+    return mem_assert(mem_calloc(1, sizeof(histogram_t)), "Error: Failed to allocate memory for histogram.\n");
+}
+
+/**
+ * Description: Counts a value.
+ * @param histogram: the histogram.
+ * @param value: the value; negative values count as 0.
+*/
+void histogram_add(histogram_t* histogram, const long value){
+    if (histogram == NULL) return;
+    histogram->counts[bucketOf(value)]++;
+    histogram->count++;
+}
+
+/**
+ * Description: Adds every value counted in from to into.
+ * @param into: the histogram added to.
+ * @param from: the histogram added.
+*/
+void histogram_merge(histogram_t* into, const histogram_t* from){
+    if (into == NULL || from == NULL) return;
+    for (int i = 0; i < NUM_BUCKETS; i++){
+        into->counts[i] += from->counts[i];
+    }
+    into->count += from->count;
+}
+
+/**
+ * Description: Returns how many values have been counted.
+ * @param histogram: the histogram.
+*/
+long histogram_count(const histogram_t* histogram){
+    return histogram ? histogram->count : 0;
+}
+
+/**
+ * Description: Returns the value below which fraction of the values counted lie.
+ * @param histogram: the histogram.
+ * @param fraction: between 0 and 1.
+ * @returns the middle of the bucket that value falls in, or 0 if the histogram is empty.
+*/
+long histogram_percentile(const histogram_t* histogram, const double fraction){
+    if (histogram == NULL || histogram->count == 0) return 0;
+    // The rank of the value asked for, counting from 1
+    long rank = (long)(fraction * histogram->count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > histogram->count) rank = histogram->count;
+    long seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++){
+        seen += histogram->counts[i];
+        if (seen >= rank) return middleOf(i);
+    }
+    return middleOf(NUM_BUCKETS - 1);
+}
+
+/**
+ * Description: Deletes the histogram.
+ * @param histogram: the histogram to delete.
+*/
+void histogram_delete(histogram_t* histogram){
+    if (histogram != NULL) mem_free(histogram);
+}
+
+/***
+ * Description: Returns the bucket a value is counted in: the value itself below EXACT,
+ *              and past that 16 buckets for each power of two.
+*/
+static int bucketOf(const long value){
+    if (value < EXACT) return value > 0 ? (int)value : 0;
+    int bits = 63 - __builtin_clzl((unsigned long)value);    // position of the highest set bit
+    if (bits >= MAX_BITS) return NUM_BUCKETS - 1;
+    int sub = (int)(value >> (bits - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+    return EXACT + (bits - SUB_BITS - 1) * (1 << SUB_BITS) + sub;
+}
+
+/***
+ * Description: Returns the middle of the range of values counted in a bucket.
+*/
+static long middleOf(const int bucket){
+    if (bucket < EXACT) return bucket;
+    int bits = (bucket - EXACT) / (1 << SUB_BITS) + SUB_BITS + 1;
+    int sub = (bucket - EXACT) % (1 << SUB_BITS);
+    long low = ((long)((1 << SUB_BITS) + sub)) << (bits - SUB_BITS);
+    long width = 1L << (bits - SUB_BITS);
+    return low + width / 2;
+}
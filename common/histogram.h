@@ -0,0 +1,61 @@
+/**
+ * histogram.h
+ *
+ * Interface for a latency histogram: counts of values (microseconds, say) in
+ * buckets that grow with the value, so percentiles come out within about 3% of the
+ * true value from a fixed few kilobytes, however many values are added. Values
+ * below 32 are counted exactly; above that, every power of two is split into 16
+ * buckets. A histogram is not thread-safe; each thread keeps its own and they are
+ * merged.
+ */
+#ifndef __HISTOGRAM_H
+#define __HISTOGRAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef struct histogram histogram_t;
+
+/***
+ * Description: Creates a new empty histogram.
+ * @returns pointer to the new histogram; exits if out of memory.
+ */
+histogram_t* histogram_new(void);
+
+/***
+ * Description: Counts a value; negative values count as 0.
+ * @param histogram: the histogram.
+ * @param value: the value.
+ */
+void histogram_add(histogram_t* histogram, const long value);
+
+/***
+ * Description: Adds every value counted in from to into.
+ * @param into: the histogram added to.
+ * @param from: the histogram added; left as it was.
+ */
+void histogram_merge(histogram_t* into, const histogram_t* from);
+
+/***
+ * Description: Returns how many values have been counted.
+ * @param histogram: the histogram.
+ */
+long histogram_count(const histogram_t* histogram);
+
+/***
+ * Description: Returns the value below which the given fraction of the values counted
+ *              lie (the middle of the bucket it falls in).
+ * @param histogram: the histogram.
+ * @param fraction: between 0 and 1; 0.5 gives the median, 0.99 the 99th percentile.
+ * @returns the value, or 0 if nothing has been counted.
+ */
+long histogram_percentile(const histogram_t* histogram, const double fraction);
+
+/***
+ * Description: Deletes the histogram.
+ * @param histogram: the histogram to delete.
+ */
+void histogram_delete(histogram_t* histogram);
+
+#endif
@@ -6,23 +6,103 @@
  * Implements the following functionality; creating a new index with a fixed number of slots;
  * inserting word-document-count entries; looking up counters for a given word; saving an index
  * to a file in a readable format; loading an index from a file
+ *
+ * It also saves and loads the compact binary format described in index.h, whose terms are
+ * sorted and whose postings are delta-encoded varints. indexWriter_t writes that format a term
+ * at a time: postings go straight to the file after a blank header, while the terms go to a
+ * temporary file that is appended at the end, when the header is filled in. Each term's hash,
+ * term offset, document frequency and postings offset are kept in memory, 24 bytes a term, to
+ * build the minimal perfect hash (mph.h) written after the terms; once it is built, the
+ * dictionary is written with whole entries, or with only the term offsets if the hash's slots
+ * hold the rest.
  * 
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
 #include "hashtable.h"
 #include "counters.h"
 #include "mem.h"
 #include "file.h"
 #include "index.h"
 #include "word.h"
+#include "mph.h"
+#include "indexcodec.h"
 // Aliasing hashtable_t to index_t
 typedef hashtable_t index_t;
 
+// A term's whole dictionary entry, and its hash
+typedef struct indexSlot {
+    uint64_t hash;
+    uint64_t postings;
+    uint32_t termOffset;
+    uint32_t df;
+} indexSlot_t;
+
+typedef struct indexWriter {
+    FILE *fp;               // the index file: the header, then postings as they come
+    FILE *terms;            // terms so far
+    uint64_t offset;        // bytes written to fp
+    uint64_t termsSize;
+    uint32_t numTerms;
+    char *word;             // the current term, NULL before the first
+    uint32_t termOffset;    // its offset in the terms
+    uint64_t postings;      // the offset of its postings
+    uint32_t df;            // its documents so far
+    int lastDocID;
+    indexSlot_t *slots;     // each term's, for the dictionary and the hash
+    uint32_t slotsCap;
+    bool hashed;            // the file gets a hash, if the terms' hashes differ
+    bool ok;                // nothing has failed or come out of order
+} indexWriter_t;
+
+// Where a binary index's sections lie, once its header and hash are checked
+typedef struct indexLayout {
+    const unsigned char *data;
+    uint32_t numTerms;
+    uint64_t dictOffset;
+    uint32_t entrySize;     // INDEX_HASHED_ENTRY_SIZE if the slots hold the rest
+    const char *terms;
+    uint64_t termsSize;
+    uint32_t numBuckets;    // of the hash; 0 if there is none
+    const unsigned char *pilots;
+    const unsigned char *slots;
+} indexLayout_t;
+
+// A word and its counters, gathered to be saved in order
+typedef struct indexTerm {
+    const char *word;
+    counters_t *ctrs;
+} indexTerm_t;
+
+// What hashtable_iterate and counters_iterate gather into
+typedef struct indexGather {
+    void *items;
+    int num;
+    int cap;
+} indexGather_t;
+
 static void counters_delete_helper(void *item);
 static void counters_save_item(void *fp, const int docID, const int count);
 static void index_save_item(void *fp, const char *word, void *item);
+static bool index_save_binary(index_t *index, const char *filename, const bool hashed);
+static index_t *index_load_binary(FILE *fp);
+static bool layout_entry(const indexLayout_t *layout, const uint32_t i, uint32_t *termOffset, uint32_t *df, uint64_t *postings);
+static void index_gather_item(void *gather, const char *word, void *item);
+static void counters_gather_item(void *gather, const int docID, const int count);
+static int compare_terms(const void *a, const void *b);
+static int compare_postings(const void *a, const void *b);
+static void *gather_slot(indexGather_t *gather, const size_t size);
+static indexWriter_t *writer_open(const char *filename, const bool hashed);
+static void writer_end_term(indexWriter_t *writer);
+static void writer_dictionary(indexWriter_t *writer, const bool hashed);
+static void writer_bytes(indexWriter_t *writer, const unsigned char *bytes, const size_t len);
+static void writer_varint(indexWriter_t *writer, uint32_t value);
+static bool copy_file(FILE *from, FILE *to);
+static void writer_hash(indexWriter_t *writer, const uint32_t numBuckets, const uint32_t *pilots, const uint32_t *slotOf);
 /**
  * Description: Creates a new index with # num_slots
  * @param num_slots: Number of slots to allocate in the index
@@ -93,6 +173,14 @@ index_t* index_load(const char* filename) {
     FILE* fp = fopen(filename, "r");
     // Making sure the pointer is not NULL
     if (fp == NULL) return NULL;
+    // A binary index starts with its magic, which no line of a text one can
+    char magic[sizeof(INDEX_MAGIC) - 1];
+    if (fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && memcmp(magic, INDEX_MAGIC, sizeof(magic)) == 0) {
+        index_t* index = index_load_binary(fp);
+        fclose(fp);
+        return index;
+    }
+    rewind(fp);
 
     // Helps in knowing how many slots to allocate in the index
     int nlines = file_numLines(fp);
@@ -105,7 +193,7 @@ index_t* index_load(const char* filename) {
         int numChars; // Will use to advance as needed through the line
 
         // Get the first word
-        if (sscanf(line, "%s%n", word, &numChars) != 1) {
+        if (sscanf(line, "%199s%n", word, &numChars) != 1) {
             // If the number of items parsed is not correct, free the line
             free(line);
             continue;
@@ -119,8 +207,8 @@ index_t* index_load(const char* filename) {
             counters_set(ctrs, docID, count);
             ptr += numChars; // Advancing by the number of characters we have read
         }
-        // Inserting the word and its counters set into the index
-        hashtable_insert(index, word, ctrs);
+        // Inserting the word and its counters set into the index; a word seen before is dropped
+        if (!hashtable_insert(index, word, ctrs)) counters_delete(ctrs);
         // Freeing the line after using it
         free(line);
     }
@@ -129,6 +217,182 @@ index_t* index_load(const char* filename) {
     return index;
 }
 
+/**
+ * Description: Saves an index object into a file with the name filename, in the binary format:
+ *              its words in strcmp order, each with its documents in docID order.
+ * @param index: A pointer to an index object.
+ * @param filename: A string with the filename to save the index content to.
+ *
+ * @returns true if the index was saved successfully, or false if any of the params is null
+ *          or the file couldn't be written
+*/
+bool index_saveBinary(index_t *index, const char *filename) {
+    return index_save_binary(index, filename, true);
+}
+
+/**
+ * Description: Saves an index object into a file in the binary format without the hash, so it
+ *              is read by binary search of its dictionary, as a version 1 file is.
+ * @param index: A pointer to an index object.
+ * @param filename: A string with the filename to save the index content to.
+ *
+ * @returns true if the index was saved successfully, or false if any of the params is null
+ *          or the file couldn't be written
+*/
+bool index_saveBinarySorted(index_t *index, const char *filename) {
+    return index_save_binary(index, filename, false);
+}
+
+/**
+ * Description: Starts a binary index file: a blank header, for the postings to follow.
+ * @param filename: String with the filename to write.
+ *
+ * @returns A pointer to the writer, or NULL if the file or the temporary file can't be opened
+*/
+indexWriter_t *indexWriter_new(const char *filename) {
+    return writer_open(filename, true);
+}
+
+/**
+ * Description: Starts a binary index file that gets no hash.
+ * @param filename: String with the filename to write.
+ *
+ * @returns A pointer to the writer, or NULL if the file or the temporary file can't be opened
+*/
+indexWriter_t *indexWriter_newSorted(const char *filename) {
+    return writer_open(filename, false);
+}
+
+/***
+ * Description: Saves an index in the binary format, a term at a time in strcmp order.
+ * @param index: The index.
+ * @param filename: The file.
+ * @param hashed: Whether the file gets a hash.
+ * @returns false if any of the params is null or the file couldn't be written
+*/
+static bool index_save_binary(index_t *index, const char *filename, const bool hashed) {
+    if (!index || !filename) return false;
+    indexWriter_t *writer = writer_open(filename, hashed);
+    if (writer == NULL) return false;
+    indexGather_t terms = { NULL, 0, 0 };
+    hashtable_iterate(index, &terms, index_gather_item);
+    qsort(terms.items, terms.num, sizeof(indexTerm_t), compare_terms);
+    indexGather_t pairs = { NULL, 0, 0 };
+    for (int i = 0; i < terms.num; i++) {
+        indexTerm_t *term = (indexTerm_t *)terms.items + i;
+        // Counters keep the order documents were set in, which needn't be docID order
+        pairs.num = 0;
+        counters_iterate(term->ctrs, &pairs, counters_gather_item);
+        qsort(pairs.items, pairs.num, 2 * sizeof(int), compare_postings);
+        indexWriter_term(writer, term->word);
+        for (int j = 0; j < pairs.num; j++) {
+            indexWriter_posting(writer, ((int *)pairs.items)[2 * j], ((int *)pairs.items)[2 * j + 1]);
+        }
+    }
+    free(terms.items);
+    free(pairs.items);
+    return indexWriter_close(writer);
+}
+
+/**
+ * Description: Starts the next term of a binary index file, ending the one before.
+ * @param writer: The writer.
+ * @param word: The term; must come after the last one in strcmp order.
+ *
+ * @returns false if the term is out of order
+*/
+bool indexWriter_term(indexWriter_t *writer, const char *word) {
+    if (!writer || !word) return false;
+    if (writer->word != NULL && strcmp(writer->word, word) >= 0) {
+        writer->ok = false;
+        return false;
+    }
+    writer_end_term(writer);
+    size_t len = strlen(word) + 1;
+    writer->word = mem_assert(mem_malloc(len), "Error: Failed to allocate memory for index writer.\n");
+    memcpy(writer->word, word, len);
+    writer->termOffset = writer->termsSize;
+    if (fwrite(word, 1, len, writer->terms) != len) writer->ok = false;
+    writer->termsSize += len;
+    writer->postings = writer->offset;
+    writer->df = 0;
+    writer->lastDocID = 0;
+    return true;
+}
+
+/**
+ * Description: Adds a document to the current term of a binary index file.
+ * @param writer: The writer.
+ * @param docID: The document; at least 1, and after the term's last one.
+ * @param count: The number of occurences of the term in it.
+ *
+ * @returns false if there is no term yet, the document is 0 or out of order, or count negative
+*/
+bool indexWriter_posting(indexWriter_t *writer, const int docID, const int count) {
+    if (!writer) return false;
+    if (docID < 1) {
+        // The first gap is from 0, and gaps are never 0, so there's no way to write docID 0
+        if (writer->ok) fprintf(stderr, "Error: A binary index can't hold docID %d; its docIDs start at 1.\n", docID);
+        writer->ok = false;
+        return false;
+    }
+    if (writer->word == NULL || docID <= writer->lastDocID || count < 0) {
+        writer->ok = false;
+        return false;
+    }
+    writer_varint(writer, docID - writer->lastDocID);
+    writer_varint(writer, count);
+    writer->lastDocID = docID;
+    writer->df++;
+    return true;
+}
+
+/**
+ * Description: Finishes a binary index file: ends the last term, appends the dictionary and the
+ *              terms, and fills in the header. Frees the writer.
+ * @param writer: The writer.
+ *
+ * @returns true if the whole file was written, everything in order
+*/
+bool indexWriter_close(indexWriter_t *writer) {
+    if (!writer) return false;
+    writer_end_term(writer);
+    // The hash is built first: whether there is one decides what the dictionary holds
+    uint32_t numTerms = writer->numTerms;
+    uint32_t numBuckets = writer->hashed ? mph_numBuckets(numTerms) : 0;
+    uint32_t *pilots = mem_assert(mem_malloc((numBuckets + 1) * sizeof(uint32_t)), "Error: Failed to allocate memory for index writer.\n");
+    uint32_t *slotOf = mem_assert(mem_malloc((numTerms + 1) * sizeof(uint32_t)), "Error: Failed to allocate memory for index writer.\n");
+    if (numBuckets > 0) {
+        uint64_t *hashes = mem_assert(mem_malloc((numTerms + 1) * sizeof(uint64_t)), "Error: Failed to allocate memory for index writer.\n");
+        for (uint32_t i = 0; i < numTerms; i++) hashes[i] = writer->slots[i].hash;
+        if (!mph_build(hashes, numTerms, pilots, slotOf)) numBuckets = 0;
+        mem_free(hashes);
+    }
+    uint64_t dictOffset = writer->offset;
+    writer_dictionary(writer, numBuckets > 0);
+    uint64_t termsOffset = writer->offset;
+    bool ok = writer->ok && copy_file(writer->terms, writer->fp);
+    writer->offset += writer->termsSize;
+    writer_hash(writer, numBuckets, pilots, slotOf);
+    ok = ok && writer->ok;
+    mem_free(slotOf);
+    mem_free(pilots);
+    unsigned char header[INDEX_HEADER_SIZE];
+    memcpy(header, INDEX_MAGIC, sizeof(INDEX_MAGIC) - 1);
+    indexcodec_putU32(header + 8, INDEX_VERSION);
+    indexcodec_putU32(header + 12, writer->numTerms);
+    indexcodec_putU64(header + 16, dictOffset);
+    indexcodec_putU64(header + 24, termsOffset);
+    indexcodec_putU64(header + 32, writer->termsSize);
+    ok = ok && fseek(writer->fp, 0, SEEK_SET) == 0 && fwrite(header, 1, sizeof(header), writer->fp) == sizeof(header);
+    ok = !ferror(writer->fp) && ok;
+    ok = fclose(writer->fp) == 0 && ok;
+    fclose(writer->terms);
+    free(writer->slots);
+    mem_free(writer);
+    return ok;
+}
+
 /***
  * Description: Deletes the index and frees the memory allocated for its content.
  * @param index: Pointer to an index.
@@ -172,4 +436,295 @@ static void index_save_item(void *fp, const char *word, void *item) {
     // Iterating over each counter to save its content with counters_save_item
     counters_iterate(ctrs, fp, counters_save_item);
     fprintf((FILE*)fp, "\n");
-}
\ No newline at end of file
+}
+
+/***
+ * Description: Loads a binary index, checking every offset, count and varint against the file,
+ *              so a corrupt or truncated file gives NULL rather than a read past its end.
+ * @param fp: The file, past its magic.
+ * @returns A pointer to an index object, or NULL.
+*/
+static index_t *index_load_binary(FILE *fp) {
+    if (fseek(fp, 0, SEEK_END) != 0) return NULL;
+    long size = ftell(fp);
+    if (size < INDEX_HEADER_SIZE || fseek(fp, 0, SEEK_SET) != 0) return NULL;
+    unsigned char *data = mem_assert(mem_malloc(size), "Error: Failed to allocate memory for index.\n");
+    if (fread(data, 1, size, fp) != (size_t)size || indexcodec_getU32(data + 8) < 1 || indexcodec_getU32(data + 8) > INDEX_VERSION) {
+        mem_free(data);
+        return NULL;
+    }
+    uint32_t version = indexcodec_getU32(data + 8);
+    indexLayout_t layout = { .data = data, .numTerms = indexcodec_getU32(data + 12), .dictOffset = indexcodec_getU64(data + 16),
+                             .entrySize = INDEX_ENTRY_SIZE, .termsSize = indexcodec_getU64(data + 32), .numBuckets = 0 };
+    uint64_t termsOffset = indexcodec_getU64(data + 24);
+    bool ok = layout.dictOffset >= INDEX_HEADER_SIZE && termsOffset >= layout.dictOffset
+              && termsOffset <= (uint64_t)size && layout.termsSize <= (uint64_t)size - termsOffset
+              && (layout.termsSize == 0 || data[termsOffset + layout.termsSize - 1] == '\0');
+    // A version 2 file has a hash section, whose slots, if it has any, hold what the
+    // dictionary's entries leave out
+    uint64_t hashOffset = ok ? INDEX_ALIGN(termsOffset + layout.termsSize) : 0;
+    if (ok && version >= 2) {
+        ok = hashOffset + 8 <= (uint64_t)size;
+        layout.numBuckets = ok ? indexcodec_getU32(data + hashOffset) : 0;
+        uint64_t slotsOffset = INDEX_ALIGN(hashOffset + 8 + (uint64_t)layout.numBuckets * 4);
+        if (layout.numBuckets > 0) {
+            ok = layout.numBuckets == mph_numBuckets(layout.numTerms)
+                 && slotsOffset + (uint64_t)layout.numTerms * INDEX_SLOT_SIZE <= (uint64_t)size;
+            layout.entrySize = INDEX_HASHED_ENTRY_SIZE;
+            layout.pilots = data + hashOffset + 8;
+            layout.slots = data + slotsOffset;
+        }
+    }
+    if (!ok || termsOffset - layout.dictOffset != (uint64_t)layout.numTerms * layout.entrySize) {
+        mem_free(data);
+        return NULL;
+    }
+    layout.terms = (const char *)data + termsOffset;
+
+    index_t *index = index_new(layout.numTerms + 1);
+    // Each term's postings end where the next term's start, so its entry is read a term ahead
+    uint32_t termOffset = 0, df = 0, nextTermOffset = 0, nextDf = 0;
+    uint64_t postings = 0, nextPostings = 0;
+    ok = layout.numTerms == 0 || layout_entry(&layout, 0, &termOffset, &df, &postings);
+    for (uint32_t i = 0; ok && i < layout.numTerms; i++) {
+        uint64_t end = layout.dictOffset;
+        if (i + 1 < layout.numTerms) {
+            ok = layout_entry(&layout, i + 1, &nextTermOffset, &nextDf, &nextPostings);
+            end = nextPostings;
+        }
+        if (!ok || postings < INDEX_HEADER_SIZE || postings > end || end > layout.dictOffset) {
+            ok = false;
+            break;
+        }
+        const unsigned char *p = data + postings;
+        counters_t *ctrs = counters_new();
+        uint64_t docID = 0;
+        for (uint32_t j = 0; ok && j < df; j++) {
+            uint32_t delta, count;
+            ok = indexcodec_getVarint(&p, data + end, &delta) && indexcodec_getVarint(&p, data + end, &count)
+                 && delta > 0 && docID + delta <= INT_MAX && count <= INT_MAX;
+            docID += delta;
+            if (ok) counters_set(ctrs, (int)docID, (int)count);
+        }
+        ok = ok && p == data + end;
+        // A term twice over isn't inserted
+        if (!ok || !hashtable_insert(index, layout.terms + termOffset, ctrs)) {
+            counters_delete(ctrs);
+            ok = false;
+        }
+        termOffset = nextTermOffset;
+        df = nextDf;
+        postings = nextPostings;
+    }
+    mem_free(data);
+    if (!ok) {
+        index_delete(index);
+        return NULL;
+    }
+    return index;
+}
+
+/***
+ * Description: Reads a term's dictionary entry, and if the entries are only term offsets,
+ *              the rest from the term's slot of the hash.
+ * @param layout: The checked sections.
+ * @param i: The term's place in strcmp order.
+ * @param termOffset: Set to its offset in the terms.
+ * @param df: Set to the number of documents it is in.
+ * @param postings: Set to the offset of its postings.
+ * @returns false if the term offset is outside the terms, or the slot's fingerprint isn't the term's.
+*/
+static bool layout_entry(const indexLayout_t *layout, const uint32_t i, uint32_t *termOffset, uint32_t *df, uint64_t *postings) {
+    const unsigned char *entry = layout->data + layout->dictOffset + (uint64_t)i * layout->entrySize;
+    *termOffset = indexcodec_getU32(entry);
+    if (*termOffset >= layout->termsSize) return false;
+    if (layout->numBuckets == 0) {
+        *df = indexcodec_getU32(entry + 4);
+        *postings = indexcodec_getU64(entry + 8);
+        return true;
+    }
+    uint64_t hash = mph_hash(layout->terms + *termOffset);
+    uint32_t pilot = indexcodec_getU32(layout->pilots + 4 * mph_bucket(hash, layout->numBuckets));
+    const unsigned char *slot = layout->slots + (uint64_t)mph_position(hash, pilot, layout->numTerms) * INDEX_SLOT_SIZE;
+    if (indexcodec_getU32(slot) != mph_fingerprint(hash)) return false;
+    *df = indexcodec_getU32(slot + 4);
+    *postings = indexcodec_getU64(slot + 8);
+    return true;
+}
+
+/***
+ * Description: hashtable_iterate helper that gathers a word and its counters set.
+ * @param gather: Pointer to the indexGather_t of indexTerm_t.
+ * @param word: The word.
+ * @param item: Its counters set.
+ * @returns void
+*/
+static void index_gather_item(void *gather, const char *word, void *item) {
+    indexTerm_t *term = gather_slot(gather, sizeof(indexTerm_t));
+    term->word = word;
+    term->ctrs = item;
+}
+
+/***
+ * Description: counters_iterate helper that gathers a (docID, count) pair.
+ * @param gather: Pointer to the indexGather_t of pairs of ints.
+ * @param docID: The id of the document.
+ * @param count: The number of occurences of the word in it.
+ * @returns void
+*/
+static void counters_gather_item(void *gather, const int docID, const int count) {
+    int *pair = gather_slot(gather, 2 * sizeof(int));
+    pair[0] = docID;
+    pair[1] = count;
+}
+
+/***
+ * Description: qsort comparator for indexTerm_t, by word.
+*/
+static int compare_terms(const void *a, const void *b) {
+    return strcmp(((const indexTerm_t *)a)->word, ((const indexTerm_t *)b)->word);
+}
+
+/***
+ * Description: qsort comparator for (docID, count) pairs, by docID.
+*/
+static int compare_postings(const void *a, const void *b) {
+    int docA = *(const int *)a;
+    int docB = *(const int *)b;
+    return (docA > docB) - (docA < docB);
+}
+
+/***
+ * Description: Makes room for one more item at the end of a gather.
+ * @returns Pointer to the new item.
+*/
+static void *gather_slot(indexGather_t *gather, const size_t size) {
+    if (gather->num == gather->cap) {
+        gather->cap = gather->cap > 0 ? gather->cap * 2 : 64;
+        gather->items = mem_assert(realloc(gather->items, gather->cap * size), "Error: Failed to allocate memory for index.\n");
+    }
+    return (char *)gather->items + gather->num++ * size;
+}
+
+/***
+ * Description: Starts a binary index file: a blank header, for the postings to follow.
+ * @param filename: The file.
+ * @param hashed: Whether it gets a hash.
+ * @returns The writer, or NULL if the file or the temporary file can't be opened.
+*/
+static indexWriter_t *writer_open(const char *filename, const bool hashed) {
+    if (!filename) return NULL;
+    indexWriter_t *writer = mem_assert(mem_calloc(1, sizeof(indexWriter_t)), "Error: Failed to allocate memory for index writer.\n");
+    writer->fp = fopen(filename, "w");
+    writer->terms = tmpfile();
+    if (!writer->fp || !writer->terms) {
+        if (writer->fp) fclose(writer->fp);
+        if (writer->terms) fclose(writer->terms);
+        mem_free(writer);
+        return NULL;
+    }
+    writer->hashed = hashed;
+    writer->ok = true;
+    unsigned char header[INDEX_HEADER_SIZE] = { 0 };
+    writer_bytes(writer, header, sizeof(header));
+    return writer;
+}
+
+/***
+ * Description: Keeps the current term's dictionary entry, now its documents are all written.
+*/
+static void writer_end_term(indexWriter_t *writer) {
+    if (writer->word == NULL) return;
+    if (writer->numTerms == writer->slotsCap) {
+        writer->slotsCap = writer->slotsCap > 0 ? writer->slotsCap * 2 : 1024;
+        writer->slots = mem_assert(realloc(writer->slots, writer->slotsCap * sizeof(indexSlot_t)), "Error: Failed to allocate memory for index writer.\n");
+    }
+    writer->slots[writer->numTerms] = (indexSlot_t){ mph_hash(writer->word), writer->postings, writer->termOffset, writer->df };
+    writer->numTerms++;
+    mem_free(writer->word);
+    writer->word = NULL;
+}
+
+/***
+ * Description: Writes the dictionary: each term's offset, and unless the hash's slots hold
+ *              them, its document frequency and postings offset.
+*/
+static void writer_dictionary(indexWriter_t *writer, const bool hashed) {
+    unsigned char entry[INDEX_ENTRY_SIZE];
+    size_t size = hashed ? INDEX_HASHED_ENTRY_SIZE : INDEX_ENTRY_SIZE;
+    for (uint32_t i = 0; i < writer->numTerms; i++) {
+        indexcodec_putU32(entry, writer->slots[i].termOffset);
+        indexcodec_putU32(entry + 4, writer->slots[i].df);
+        indexcodec_putU64(entry + 8, writer->slots[i].postings);
+        writer_bytes(writer, entry, size);
+    }
+}
+
+/***
+ * Description: Writes bytes to the index file, counting them.
+*/
+static void writer_bytes(indexWriter_t *writer, const unsigned char *bytes, const size_t len) {
+    if (fwrite(bytes, 1, len, writer->fp) != len) writer->ok = false;
+    writer->offset += len;
+}
+
+/***
+ * Description: Writes a varint to the index file: 7 bits a byte, least significant first.
+*/
+static void writer_varint(indexWriter_t *writer, uint32_t value) {
+    unsigned char bytes[5];
+    size_t len = 0;
+    while (value >= 0x80) {
+        bytes[len++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    bytes[len++] = value;
+    writer_bytes(writer, bytes, len);
+}
+
+/***
+ * Description: Writes the hash section, from the end of the terms rounded up: the pilots,
+ *              then each term's slot. A hash of no buckets (two terms' hashes were the same,
+ *              or the file is to be binary-searched) is just its number.
+ * @param numBuckets: Of the hash built.
+ * @param pilots: Each bucket's pilot.
+ * @param slotOf: Each term's slot.
+*/
+static void writer_hash(indexWriter_t *writer, const uint32_t numBuckets, const uint32_t *pilots, const uint32_t *slotOf) {
+    uint32_t numTerms = writer->numTerms;
+    unsigned char bytes[INDEX_SLOT_SIZE] = { 0 };
+    writer_bytes(writer, bytes, INDEX_ALIGN(writer->offset) - writer->offset);
+    indexcodec_putU32(bytes, numBuckets);
+    writer_bytes(writer, bytes, 8);
+    for (uint32_t b = 0; b < numBuckets; b++) {
+        indexcodec_putU32(bytes, pilots[b]);
+        writer_bytes(writer, bytes, 4);
+    }
+    if (numBuckets == 0) return;
+    memset(bytes, 0, sizeof(bytes));
+    writer_bytes(writer, bytes, INDEX_ALIGN(writer->offset) - writer->offset);
+    // The slots in slot order, from each term's slot
+    unsigned char *table = mem_assert(mem_calloc(numTerms + 1, INDEX_SLOT_SIZE), "Error: Failed to allocate memory for index writer.\n");
+    for (uint32_t i = 0; i < numTerms; i++) {
+        unsigned char *slot = table + (uint64_t)slotOf[i] * INDEX_SLOT_SIZE;
+        indexcodec_putU32(slot, mph_fingerprint(writer->slots[i].hash));
+        indexcodec_putU32(slot + 4, writer->slots[i].df);
+        indexcodec_putU64(slot + 8, writer->slots[i].postings);
+    }
+    writer_bytes(writer, table, (size_t)numTerms * INDEX_SLOT_SIZE);
+    mem_free(table);
+}
+
+/***
+ * Description: Appends the whole of a temporary file to another file.
+ * @returns false if either fails.
+*/
+static bool copy_file(FILE *from, FILE *to) {
+    char buffer[1 << 16];
+    size_t len;
+    if (fflush(from) != 0 || fseek(from, 0, SEEK_SET) != 0) return false;
+    while ((len = fread(buffer, 1, sizeof(buffer), from)) > 0) {
+        if (fwrite(buffer, 1, len, to) != len) return false;
+    }
+    return !ferror(from);
+}
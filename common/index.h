@@ -4,6 +4,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include "hashtable.h"
 #include "counters.h"
 #include "mem.h"
@@ -12,6 +14,43 @@
 
 typedef hashtable_t index_t;
 
+/*
+ * The binary index format, version 2. Every number is little-endian.
+ *
+ *   header      "TSEINDEX", u32 version, u32 number of terms, u64 offset of the
+ *               dictionary, u64 offset of the terms, u64 size of the terms
+ *   postings    per term, its documents in docID order, each the varint of its
+ *               docID less the one before's (the first's less 0, so docIDs are at
+ *               least 1; a gap of 0 is corrupt) and the varint of the word's count
+ *               in it; a varint is 7 bits a byte, least significant first, the
+ *               high bit set on all but the last byte
+ *   dictionary  per term, in strcmp order: u32 offset of the term in the terms,
+ *               and unless there is a hash, u32 number of documents it is in and
+ *               u64 offset of its postings
+ *   terms       the terms, each ending in '\0'
+ *   hash        from the end of the terms rounded up to a multiple of 16: u32 number
+ *               of buckets of a minimal perfect hash of the terms (mph.h), u32 0,
+ *               u32 pilot of each bucket, zeros up to a multiple of 16, then per
+ *               term, at its slot: u32 fingerprint, u32 number of documents it is
+ *               in, u64 offset of its postings
+ *
+ * A term's postings end where the next term's, or the dictionary, start. A hash of
+ * no buckets means there is none: two terms' hashes were the same, or the file was
+ * saved to be binary-searched. Version 1 files end after the terms, with every
+ * dictionary entry whole; readers take either.
+ */
+#define INDEX_MAGIC "TSEINDEX"
+#define INDEX_VERSION 2
+#define INDEX_HEADER_SIZE 40
+#define INDEX_ENTRY_SIZE 16
+#define INDEX_HASHED_ENTRY_SIZE 4   // a dictionary entry when the slots hold the rest
+#define INDEX_SLOT_SIZE 16
+// Where a section starts after one ending at offset: 16-byte aligned, so no slot straddles a cache line
+#define INDEX_ALIGN(offset) (((offset) + 15) & ~(uint64_t)15)
+
+// Writes a binary index file a term at a time, in strcmp order, without holding it in memory
+typedef struct indexWriter indexWriter_t;
+
 // Creates a new index with # slots given for a specific number of words to index
 index_t *index_new(const int num_slots);
 
@@ -21,9 +60,29 @@ bool index_insert(index_t *index, const char *word, const int docID, const int c
 // Save the index to a file
 bool index_save(index_t *index, const char *filename);
 
-// Load an index from a file
+// Save the index to a file in the binary format; fails if any docID is 0
+bool index_saveBinary(index_t *index, const char *filename);
+
+// Save the index in the binary format without the hash, so readers binary-search its dictionary
+bool index_saveBinarySorted(index_t *index, const char *filename);
+
+// Load an index from a file in either format
 index_t *index_load(const char *filename);
 
+
+// Start a binary index file, with the hash unless sorted
+indexWriter_t *indexWriter_new(const char *filename);
+indexWriter_t *indexWriter_newSorted(const char *filename);
+
+// Start the next term, which must come after the last in strcmp order
+bool indexWriter_term(indexWriter_t *writer, const char *word);
+
+// Add a document to the term, after the term's last in docID order; docIDs start at 1
+bool indexWriter_posting(indexWriter_t *writer, const int docID, const int count);
+
+// Finish the file and free the writer; false if anything couldn't be written or came out of order
+bool indexWriter_close(indexWriter_t *writer);
+
 // Finding the counters set associated with a given word. Returns Null if it doesnt exist.
 counters_t *index_find(index_t* index, const char* word);
 // Delete the index and free all memory
@@ -0,0 +1,61 @@
+/**
+ * indexcodec.h
+ *
+ * The byte-level encoding of the binary index format of index.h: little-endian
+ * fixed-width numbers in the header, dictionary and hash, and the varints of the
+ * postings lists. Defined here, inline, so index.c, which writes and loads the format,
+ * and indexmap.c, which reads it in place, decode it with the same code.
+ */
+#ifndef __INDEXCODEC_H
+#define __INDEXCODEC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/***
+ * Description: Little-endian stores of the header's and dictionary's numbers.
+ * @param p: Where the number goes.
+ * @param value: The number.
+ */
+static inline void indexcodec_putU32(unsigned char* p, const uint32_t value){
+    for (int i = 0; i < 4; i++) p[i] = value >> (8 * i);
+}
+
+static inline void indexcodec_putU64(unsigned char* p, const uint64_t value){
+    for (int i = 0; i < 8; i++) p[i] = value >> (8 * i);
+}
+
+/***
+ * Description: Little-endian loads of the header's and dictionary's numbers.
+ * @param p: Where the number is.
+ */
+static inline uint32_t indexcodec_getU32(const unsigned char* p){
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t indexcodec_getU64(const unsigned char* p){
+    return indexcodec_getU32(p) | (uint64_t)indexcodec_getU32(p + 4) << 32;
+}
+
+/***
+ * Description: Reads a varint, advancing past it.
+ * @param p: Where it starts; moved past it.
+ * @param end: Where the bytes it may take end.
+ * @param value: Set to its value.
+ * @returns false if it runs past end or doesn't fit 32 bits.
+ */
+static inline bool indexcodec_getVarint(const unsigned char** p, const unsigned char* end, uint32_t* value){
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35 && *p < end; shift += 7){
+        unsigned char byte = *(*p)++;
+        if (shift == 28 && byte > 0x0f) return false;
+        result |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)){
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,231 @@
+/**
+ * indexmap.c
+ *
+ * Description: Implements the mapped index. The whole file is mapped with mmap. A
+ *              lookup hashes the word and reads its bucket's pilot and then its slot of
+ *              the minimal perfect hash (mph.h): a 16-byte slot, so one cache line,
+ *              whose fingerprint either matches the word's or shows the word missing.
+ *              Files without a hash are binary-searched instead, by the dictionary's
+ *              fixed-size entries, sorted by word, comparing the words in place; a file
+ *              with a hash has only the words' offsets in its dictionary. The postings
+ *              are decoded a varint at a time as they are read.
+ */
+#define _POSIX_C_SOURCE 200809L    // mmap
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "indexmap.h"
+#include "index.h"
+#include "mph.h"
+#include "indexcodec.h"
+#include "mem.h"
+
+typedef struct indexmap {
+    const unsigned char* data;  // the mapped file
+    size_t size;
+    uint32_t numWords;
+    const unsigned char* dict;  // the dictionary's entries
+    uint64_t dictOffset;
+    const char* terms;          // the words, each ending in '\0'
+    uint64_t termsSize;
+    uint32_t numBuckets;        // of the hash; 0 if there is none
+    const unsigned char* pilots;
+    const unsigned char* slots;
+} indexmap_t;
+
+static bool findHashed(indexmap_t* map, const char* word, indexmapPostings_t* postings);
+static bool findSorted(indexmap_t* map, const char* word, indexmapPostings_t* postings);
+
+
+/**
+ * Description: Maps a binary index file and checks its header.
+ * @param filename: the file.
+ * @returns the mapped index, or NULL.
+*/
+indexmap_t* indexmap_open(const char* filename){
+    if (filename == NULL) return NULL;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < INDEX_HEADER_SIZE){
+        close(fd);
+        return NULL;
+    }
+    size_t size = st.st_size;
+    void* data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping holds the file open
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+
+    const unsigned char* header = data;
+    uint32_t numWords = indexcodec_getU32(header + 12);
+    uint64_t dictOffset = indexcodec_getU64(header + 16);
+    uint64_t termsOffset = indexcodec_getU64(header + 24);
+    uint64_t termsSize = indexcodec_getU64(header + 32);
+    uint32_t version = indexcodec_getU32(header + 8);
+    bool ok = memcmp(header, INDEX_MAGIC, sizeof(INDEX_MAGIC) - 1) == 0 && version >= 1 && version <= INDEX_VERSION
+              && dictOffset >= INDEX_HEADER_SIZE && termsOffset >= dictOffset && termsOffset <= size
+              && termsSize <= size - termsOffset && numWords <= INT_MAX
+              && (termsSize == 0 || header[termsOffset + termsSize - 1] == '\0');
+    // A version 2 file's hash, if it has buckets, holds what the dictionary leaves out
+    uint32_t numBuckets = 0;
+    uint64_t hashOffset = ok ? INDEX_ALIGN(termsOffset + termsSize) : 0;
+    uint64_t slotsOffset = 0;
+    if (ok && version >= 2){
+        ok = hashOffset + 8 <= size;
+        numBuckets = ok ? indexcodec_getU32(header + hashOffset) : 0;
+        slotsOffset = INDEX_ALIGN(hashOffset + 8 + (uint64_t)numBuckets * 4);
+        ok = ok && (numBuckets == 0 || (numBuckets == mph_numBuckets(numWords)
+                                        && slotsOffset + (uint64_t)numWords * INDEX_SLOT_SIZE <= size));
+    }
+    uint32_t entrySize = numBuckets > 0 ? INDEX_HASHED_ENTRY_SIZE : INDEX_ENTRY_SIZE;
+    if (!ok || termsOffset - dictOffset != (uint64_t)numWords * entrySize){
+        munmap(data, size);
+        return NULL;
+    }
+    indexmap_t* map = mem_assert(mem_malloc(sizeof(indexmap_t)), "Error: Failed to allocate memory for index.\n");
+    map->data = data;
+    map->size = size;
+    map->numWords = numWords;
+    map->dict = header + dictOffset;
+    map->dictOffset = dictOffset;
+    map->terms = (const char*)header + termsOffset;
+    map->termsSize = termsSize;
+    map->numBuckets = numBuckets;
+    map->pilots = numBuckets > 0 ? header + hashOffset + 8 : NULL;
+    map->slots = numBuckets > 0 ? header + slotsOffset : NULL;
+    return map;
+}
+
+/**
+ * Description: Returns the number of words in the index.
+ * @param map: the mapped index.
+*/
+int indexmap_numWords(indexmap_t* map){
+    return map ? (int)map->numWords : 0;
+}
+
+/**
+ * Description: Looks a word up, by the hash if the file has one.
+ * @param map: the mapped index.
+ * @param word: the word.
+ * @param postings: set to the start of the word's postings.
+ * @returns false if the word isn't in the index, or its entry is corrupt.
+*/
+bool indexmap_find(indexmap_t* map, const char* word, indexmapPostings_t* postings){
+    if (map == NULL || word == NULL || postings == NULL) return false;
+    return map->numBuckets > 0 ? findHashed(map, word, postings) : findSorted(map, word, postings);
+}
+
+/**
+ * Description: Decodes the next document of a word's postings: its docID's gap from the
+ *              last one's, and its count.
+ * @param postings: from indexmap_find.
+ * @param docID: set to the document's ID.
+ * @param count: set to the word's count in it.
+ * @returns false once every document has been read, or at a corrupt varint.
+*/
+bool indexmap_next(indexmapPostings_t* postings, int* docID, int* count){
+    if (postings == NULL || postings->left <= 0) return false;
+    uint32_t delta, value;
+    if (!indexcodec_getVarint(&postings->next, postings->end, &delta) || !indexcodec_getVarint(&postings->next, postings->end, &value)
+        || delta == 0 || delta > (uint32_t)(INT_MAX - postings->docID) || value > INT_MAX){
+        postings->left = 0;
+        return false;
+    }
+    postings->docID += delta;
+    postings->left--;
+    *docID = postings->docID;
+    *count = value;
+    return true;
+}
+
+/**
+ * Description: Calls itemfunc on each document a word is in.
+ * @param map: the mapped index.
+ * @param word: the word.
+ * @param arg: passed to itemfunc.
+ * @param itemfunc: called with each docID and count.
+ * @returns false if the word isn't in the index.
+*/
+bool indexmap_iterate(indexmap_t* map, const char* word, void* arg,
+                      void (*itemfunc)(void* arg, const int docID, const int count)){
+    indexmapPostings_t postings;
+    if (itemfunc == NULL || !indexmap_find(map, word, &postings)) return false;
+    int docID, count;
+    while (indexmap_next(&postings, &docID, &count)) itemfunc(arg, docID, count);
+    return true;
+}
+
+/**
+ * Description: Unmaps the index and frees it.
+ * @param map: the mapped index, or NULL.
+*/
+void indexmap_close(indexmap_t* map){
+    if (map == NULL) return;
+    munmap((void*)map->data, map->size);
+    mem_free(map);
+}
+
+/***
+ * Description: Looks a word up by the hash: its slot is the only place it can be, and
+ *              the slot's fingerprint tells whether it is. The slot has the postings'
+ *              start but not their end, so they are bounded by the dictionary, which
+ *              every term's postings come before.
+ * @returns false if the word isn't in the index, or its slot is corrupt.
+*/
+static bool findHashed(indexmap_t* map, const char* word, indexmapPostings_t* postings){
+    uint64_t hash = mph_hash(word);
+    uint32_t pilot = indexcodec_getU32(map->pilots + 4 * mph_bucket(hash, map->numBuckets));
+    const unsigned char* slot = map->slots + (uint64_t)mph_position(hash, pilot, map->numWords) * INDEX_SLOT_SIZE;
+    if (indexcodec_getU32(slot) != mph_fingerprint(hash)) return false;
+    uint32_t df = indexcodec_getU32(slot + 4);
+    uint64_t start = indexcodec_getU64(slot + 8);
+    if (start < INDEX_HEADER_SIZE || start > map->dictOffset || df > INT_MAX) return false;
+    postings->next = map->data + start;
+    postings->end = map->data + map->dictOffset;
+    postings->left = df;
+    postings->docID = 0;
+    return true;
+}
+
+/***
+ * Description: Binary-searches the dictionary for a word, then checks its entry's postings
+ *              lie within the file before handing them out.
+ * @returns false if the word isn't in the index, or its entry is corrupt.
+*/
+static bool findSorted(indexmap_t* map, const char* word, indexmapPostings_t* postings){
+    uint32_t low = 0;
+    uint32_t high = map->numWords;
+    while (low < high){
+        uint32_t mid = low + (high - low) / 2;
+        const unsigned char* entry = map->dict + (uint64_t)mid * INDEX_ENTRY_SIZE;
+        uint32_t termOffset = indexcodec_getU32(entry);
+        if (termOffset >= map->termsSize) return false;
+        int order = strcmp(word, map->terms + termOffset);
+        if (order < 0){
+            high = mid;
+        } else if (order > 0){
+            low = mid + 1;
+        } else {
+            uint32_t df = indexcodec_getU32(entry + 4);
+            uint64_t start = indexcodec_getU64(entry + 8);
+            uint64_t end = mid + 1 < map->numWords ? indexcodec_getU64(entry + INDEX_ENTRY_SIZE + 8) : map->dictOffset;
+            if (start < INDEX_HEADER_SIZE || start > end || end > map->dictOffset || df > INT_MAX) return false;
+            postings->next = map->data + start;
+            postings->end = map->data + end;
+            postings->left = df;
+            postings->docID = 0;
+            return true;
+        }
+    }
+    return false;
+}
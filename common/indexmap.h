@@ -0,0 +1,80 @@
+/**
+ * indexmap.h
+ *
+ * Interface for reading a binary index file (index.h) in place: the file is mapped
+ * into memory read-only and shared, and words are looked up and their postings
+ * decoded straight from the mapped pages, with nothing loaded or built up front.
+ * Opening one costs the same however large the index is; the pages a lookup touches
+ * are read in on demand, and every process mapping the same file shares them through
+ * the page cache.
+ *
+ * Opening checks the header; each lookup checks the dictionary entry and the varints
+ * it reads against the file, so a corrupt file gives missing words or cut-short
+ * postings, never a read outside it.
+ */
+#ifndef __INDEXMAP_H
+#define __INDEXMAP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef struct indexmap indexmap_t;
+
+// A word's postings being read, from indexmap_find; a plain struct so it lives on the caller's stack
+typedef struct indexmapPostings {
+    const unsigned char* next;  // the next document's varints
+    const unsigned char* end;   // where the word's postings end
+    int left;                   // documents not yet read
+    int docID;                  // the last document read
+} indexmapPostings_t;
+
+/***
+ * Description: Maps a binary index file.
+ * @param filename: the file.
+ * @returns the mapped index, or NULL if the file can't be mapped or isn't a binary index.
+ */
+indexmap_t* indexmap_open(const char* filename);
+
+/***
+ * Description: Returns the number of words in the index.
+ * @param map: the mapped index.
+ */
+int indexmap_numWords(indexmap_t* map);
+
+/***
+ * Description: Looks a word up.
+ * @param map: the mapped index.
+ * @param word: the word.
+ * @param postings: set to the start of the word's postings, if it is found.
+ * @returns false if the word isn't in the index.
+ */
+bool indexmap_find(indexmap_t* map, const char* word, indexmapPostings_t* postings);
+
+/***
+ * Description: Reads the next document of a word's postings, in docID order.
+ * @param postings: from indexmap_find.
+ * @param docID: set to the document's ID.
+ * @param count: set to the word's count in it.
+ * @returns false once every document has been read.
+ */
+bool indexmap_next(indexmapPostings_t* postings, int* docID, int* count);
+
+/***
+ * Description: Calls itemfunc on each document a word is in, as counters_iterate does.
+ * @param map: the mapped index.
+ * @param word: the word.
+ * @param arg: passed to itemfunc.
+ * @param itemfunc: called with each docID and count, in docID order.
+ * @returns false if the word isn't in the index.
+ */
+bool indexmap_iterate(indexmap_t* map, const char* word, void* arg,
+                      void (*itemfunc)(void* arg, const int docID, const int count));
+
+/***
+ * Description: Unmaps the index.
+ * @param map: the mapped index, or NULL.
+ */
+void indexmap_close(indexmap_t* map);
+
+#endif
@@ -0,0 +1,311 @@
+/**
+ * linkscan.c
+ *
+ * Description: Implements the link extractor. It follows webpage_getNextURL step by
+ *              step, on the page as getNextURL sees it once the whitespace is squeezed
+ *              out: the next "<a" (in any case), the first "href=" after it, the tag's
+ *              '>', then the link, quoted or up to the '>', and cut at any '#'. A link
+ *              whose "href=" is past its tag's '>', that can't be ended, that is only a
+ *              fragment, or that has a scheme other than http, is skipped, and the
+ *              search goes on after its '<'. Every comparison skips whitespace instead,
+ *              so the HTML is left as it is, and positions are the HTML's own.
+ *
+ *              getNextURL searches the rest of the page for each link's '#', and again
+ *              for the next "href=" after every "<a" whose tag has none; here the '#' is
+ *              only looked for inside the link, and an "href=" already found is kept for
+ *              the tags before it, so a page is scanned once.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "mem.h"
+#include "linkscan.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define LINKSCAN_SIMD       // SSE2 always; AVX2 where the CPU has it
+#endif
+
+static int scan(const char* html, const size_t htmlLen, size_t* pos, linkSpan_t* spans,
+                const int maxSpans, const bool partial);
+static const char* findTag(const char* p, const char* end, const bool avx2);
+static const char* findHref(const char* p, const char* end, const char** afterHref);
+static const char* matchFolded(const char* p, const char* pattern);
+static bool isTag(const char* p);
+static bool copyLink(const char* link, const size_t len, char* buf, const size_t bufSize);
+#ifdef LINKSCAN_SIMD
+static const char* skipBlocksSSE2(const char* p, const char* end);
+static const char* skipBlocksAVX2(const char* p, const char* end);
+#endif
+
+// Whitespace, as isspace has it in the C locale
+static inline bool isSpace(const char c){
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+// ASCII letters lowercased, as tolower has it in the C locale
+static inline char fold(const char c){
+    return (unsigned char)(c - 'A') < 26 ? c + ('a' - 'A') : c;
+}
+
+static inline const char* skipSpace(const char* p){
+    while (isSpace(*p)) p++;
+    return p;
+}
+
+
+/**
+ * Description: Finds the page's next links, up to maxSpans of them.
+ * @param html: the page's HTML, NUL-terminated; it isn't changed.
+ * @param htmlLen: its length.
+ * @param pos: where to carry on from; 0 on the first call, and updated.
+ * @param spans: where the links are put.
+ * @param maxSpans: the most to put there.
+ * @returns how many links were found; 0 once there are no more.
+*/
+int linkscan_next(const char* html, const size_t htmlLen, size_t* pos,
+                  linkSpan_t* spans, const int maxSpans){
+    return scan(html, htmlLen, pos, spans, maxSpans, false);
+}
+
+/**
+ * Description: Finds the next links of a page still arriving, up to maxSpans of them.
+ * @param html: the HTML so far, NUL-terminated; it isn't changed.
+ * @param htmlLen: its length.
+ * @param pos: where to carry on from; 0 on the first call, and updated.
+ * @param spans: where the links are put.
+ * @param maxSpans: the most to put there.
+ * @returns how many links were found.
+*/
+int linkscan_nextPartial(const char* html, const size_t htmlLen, size_t* pos,
+                         linkSpan_t* spans, const int maxSpans){
+    return scan(html, htmlLen, pos, spans, maxSpans, true);
+}
+
+/***
+ * Description: linkscan_next, or with partial set linkscan_nextPartial: wherever the
+ *              scan of a tag runs into the end of the HTML without settling the link,
+ *              it stops at the tag, to pick it up again when there is more.
+*/
+static int scan(const char* html, const size_t htmlLen, size_t* pos, linkSpan_t* spans,
+                const int maxSpans, const bool partial){
+    if (html == NULL || pos == NULL || spans == NULL || *pos > htmlLen) return 0;
+#ifdef LINKSCAN_SIMD
+    bool avx2 = __builtin_cpu_supports("avx2");
+#else
+    bool avx2 = false;
+#endif
+    const char* end = html + htmlLen;
+    const char* p = html + *pos;
+    const char* href = NULL;            // the first "href=" at or after the last tag
+    const char* afterHref = NULL;
+    int found = 0;
+    while (found < maxSpans){
+        const char* tag = findTag(p, end, avx2);
+        if (tag == NULL){
+            // A '<' with only whitespace after it may yet turn out a tag
+            const char* last = end;
+            while (partial && last > p && isSpace(last[-1])) last--;
+            p = partial && last > p && last[-1] == '<' ? last - 1 : end;
+            break;
+        }
+        if (href == NULL || href < tag) href = findHref(tag, end, &afterHref);
+        // No "href=" left: no more links, or none here yet
+        if (href == NULL){
+            p = partial ? tag : end;
+            break;
+        }
+        // An "href=" past the tag's end belongs to another tag
+        const char* tagEnd = memchr(tag, '>', end - tag);
+        if (tagEnd != NULL && tagEnd < href){
+            p = tag + 1;
+            continue;
+        }
+
+        // The link: quoted, or up to the tag's end, but not its fragment
+        const char* link = skipSpace(afterHref);
+        const char* linkEnd;
+        if (*link == '"' || *link == '\''){
+            char delim = *link;
+            link = skipSpace(link + 1);
+            linkEnd = memchr(link, delim, end - link);
+        } else {
+            linkEnd = memchr(link, '>', end - link);
+        }
+        if (partial && linkEnd == NULL){
+            p = tag;
+            break;
+        }
+        if (linkEnd == NULL || *link == '#'){
+            p = tag + 1;
+            continue;
+        }
+        const char* hash = memchr(link, '#', linkEnd - link);
+        if (hash != NULL) linkEnd = hash;
+
+        // Absolute if a ':' comes before any '/', '?' or '#', even past the link's end,
+        // and then only http or https
+        const char* mark = strpbrk(link, ":/?#");
+        if (partial && mark == NULL){
+            p = tag;
+            break;
+        }
+        bool relative = mark == NULL || *mark != ':';
+        if (!relative && matchFolded(link, "http") == NULL){
+            p = tag + 1;
+            continue;
+        }
+        bool spaced = false;
+        for (const char* c = link; c < linkEnd && !spaced; c++) spaced = isSpace(*c);
+        spans[found++] = (linkSpan_t){ .start = link - html, .len = linkEnd - link,
+                                       .relative = relative, .spaced = spaced };
+        p = linkEnd;
+    }
+    *pos = p - html;
+    return found;
+}
+
+/**
+ * Description: Turns a link into a canonical URL: the same URL as normalizeURL gives
+ *              for what webpage_getNextURL returns for the link.
+ * @param html: the page's HTML.
+ * @param span: the link.
+ * @param base: the page's URL.
+ * @param buf: where the canonical URL is written.
+ * @param bufSize: the size of buf.
+ * @param view: set to the canonical URL.
+ * @returns false if the URL is rejected, or doesn't fit buf.
+*/
+bool linkscan_resolve(const char* html, const linkSpan_t* span, const char* base,
+                      char* buf, const size_t bufSize, urlView_t* view){
+    if (html == NULL || span == NULL || base == NULL || buf == NULL || view == NULL) return false;
+    const char* link = html + span->start;
+    if (!span->relative){
+        return copyLink(link, span->len, buf, bufSize) && urlcanon_normalize(buf, buf, bufSize, view);
+    }
+    if (!span->spaced) return urlcanon_resolve(base, link, span->len, buf, bufSize, view);
+    // Whitespace in a relative link is rare enough to squeeze out of a copy
+    char* rel = mem_assert(mem_malloc(span->len + 1), "Error: Failed to allocate memory for link.\n");
+    copyLink(link, span->len, rel, span->len + 1);
+    bool resolved = urlcanon_resolve(base, rel, strlen(rel), buf, bufSize, view);
+    mem_free(rel);
+    return resolved;
+}
+
+/***
+ * Description: Finds the next "<a" tag: a '<', then an 'a' or 'A' after any whitespace.
+ * @returns its '<', or NULL if there is none before end.
+*/
+static const char* findTag(const char* p, const char* end, const bool avx2){
+#ifdef LINKSCAN_SIMD
+    p = avx2 ? skipBlocksAVX2(p, end) : skipBlocksSSE2(p, end);
+#endif
+    while (p < end && (p = memchr(p, '<', end - p)) != NULL){
+        if (isTag(p)) return p;
+        p++;
+    }
+    return NULL;
+}
+
+/***
+ * Description: Checks whether the '<' at p starts an "<a" tag.
+*/
+static bool isTag(const char* p){
+    return fold(*skipSpace(p + 1)) == 'a';
+}
+
+/***
+ * Description: Finds the next "href=", in any case and with any whitespace in it.
+ * @param afterHref: set to just after its '='.
+ * @returns its 'h', or NULL if there is none before end.
+*/
+static const char* findHref(const char* p, const char* end, const char** afterHref){
+    for (; p < end; p++){
+        if (fold(*p) == 'h' && (*afterHref = matchFolded(p + 1, "ref=")) != NULL) return p;
+    }
+    return NULL;
+}
+
+/***
+ * Description: Matches a lowercase pattern against the text at p, in any case and
+ *              skipping whitespace before each character.
+ * @returns where the match ends, or NULL if it doesn't match.
+*/
+static const char* matchFolded(const char* p, const char* pattern){
+    for (; *pattern != '\0'; pattern++){
+        p = skipSpace(p);
+        if (fold(*p) != *pattern) return NULL;
+        p++;
+    }
+    return p;
+}
+
+/***
+ * Description: Copies a link without its whitespace, NUL-terminated.
+ * @returns false if it doesn't fit buf.
+*/
+static bool copyLink(const char* link, const size_t len, char* buf, const size_t bufSize){
+    if (bufSize == 0) return false;
+    char* out = buf;
+    char* outEnd = buf + bufSize - 1;
+    for (const char* c = link; c < link + len; c++){
+        if (isSpace(*c)) continue;
+        if (out == outEnd) return false;
+        *out++ = *c;
+    }
+    *out = '\0';
+    return true;
+}
+
+#ifdef LINKSCAN_SIMD
+/***
+ * Description: Looks for "<a" tags sixteen bytes at a time: a '<' followed by an 'a' or
+ *              'A', or by whitespace or a control character (which isTag then checks).
+ *              Reads up to a byte past the block, which end's NUL makes safe.
+ * @returns the first tag's '<', or where fewer than sixteen bytes are left.
+*/
+static const char* skipBlocksSSE2(const char* p, const char* end){
+    const __m128i open = _mm_set1_epi8('<');
+    const __m128i lowerA = _mm_set1_epi8('a');
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    const __m128i space = _mm_set1_epi8(' ');
+    for (; end - p >= 16; p += 16){
+        __m128i here = _mm_loadu_si128((const __m128i*)p);
+        __m128i next = _mm_loadu_si128((const __m128i*)(p + 1));
+        __m128i isOpen = _mm_cmpeq_epi8(here, open);
+        __m128i isA = _mm_cmpeq_epi8(_mm_or_si128(next, caseBit), lowerA);
+        __m128i isBlank = _mm_cmpeq_epi8(_mm_min_epu8(next, space), next);
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(isOpen, _mm_or_si128(isA, isBlank)));
+        for (; mask != 0; mask &= mask - 1){
+            const char* tag = p + __builtin_ctz(mask);
+            if (isTag(tag)) return tag;
+        }
+    }
+    return p;
+}
+
+/***
+ * Description: skipBlocksSSE2, thirty-two bytes at a time.
+*/
+__attribute__((target("avx2")))
+static const char* skipBlocksAVX2(const char* p, const char* end){
+    const __m256i open = _mm256_set1_epi8('<');
+    const __m256i lowerA = _mm256_set1_epi8('a');
+    const __m256i caseBit = _mm256_set1_epi8(0x20);
+    const __m256i space = _mm256_set1_epi8(' ');
+    for (; end - p >= 32; p += 32){
+        __m256i here = _mm256_loadu_si256((const __m256i*)p);
+        __m256i next = _mm256_loadu_si256((const __m256i*)(p + 1));
+        __m256i isOpen = _mm256_cmpeq_epi8(here, open);
+        __m256i isA = _mm256_cmpeq_epi8(_mm256_or_si256(next, caseBit), lowerA);
+        __m256i isBlank = _mm256_cmpeq_epi8(_mm256_min_epu8(next, space), next);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(isOpen, _mm256_or_si256(isA, isBlank)));
+        for (; mask != 0; mask &= mask - 1){
+            const char* tag = p + __builtin_ctz(mask);
+            if (isTag(tag)) return tag;
+        }
+    }
+    return p;
+}
+#endif
@@ -0,0 +1,74 @@
+/**
+ * linkscan.h
+ *
+ * Interface for the crawler's link extractor: the links of a page, exactly the ones
+ * libcs50's webpage_getNextURL would return, in the same order, found in one pass
+ * over the HTML without changing or copying it. getNextURL squeezes the whitespace
+ * out of the whole page on its first call and then searches the rest of the page
+ * again for every link; here the whitespace is skipped as it is met, and the '<' of
+ * each candidate "<a" tag is found sixteen or thirty-two bytes at a time with SSE2
+ * or AVX2.
+ *
+ * Links come back as spans of the HTML, a batch at a time. A span covers the link as
+ * written, so it includes any whitespace inside it, which isn't part of the link:
+ * linkscan_resolve leaves it out as it turns the span into a canonical URL.
+ */
+#ifndef __LINKSCAN_H
+#define __LINKSCAN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "urlcanon.h"
+
+// A link, as it appears in the HTML
+typedef struct linkSpan {
+    size_t start;               // where it starts in the HTML
+    size_t len;                 // its length there, whitespace and all
+    bool relative;              // to be resolved against the page's URL
+    bool spaced;                // has whitespace in it, which isn't part of the link
+} linkSpan_t;
+
+/***
+ * Description: Finds the page's next links, up to maxSpans of them.
+ * @param html: the page's HTML, NUL-terminated; it isn't changed.
+ * @param htmlLen: its length.
+ * @param pos: where to carry on from; 0 on the first call, and updated.
+ * @param spans: where the links are put.
+ * @param maxSpans: the most to put there.
+ * @returns how many links were found; 0 once there are no more.
+ */
+int linkscan_next(const char* html, const size_t htmlLen, size_t* pos,
+                  linkSpan_t* spans, const int maxSpans);
+
+/***
+ * Description: Finds the next links of a page still arriving, up to maxSpans of them:
+ *              only links that no more HTML could change (a link's end, and whether it
+ *              is relative, can depend on what follows it). Once the page is all here,
+ *              linkscan_next carries on from pos and finds the rest, so that between
+ *              them they find just what linkscan_next would have alone.
+ * @param html: the HTML so far, NUL-terminated; it isn't changed.
+ * @param htmlLen: its length.
+ * @param pos: where to carry on from; 0 on the first call, and updated.
+ * @param spans: where the links are put.
+ * @param maxSpans: the most to put there.
+ * @returns how many links were found; 0 once there are no more in the HTML so far.
+ */
+int linkscan_nextPartial(const char* html, const size_t htmlLen, size_t* pos,
+                         linkSpan_t* spans, const int maxSpans);
+
+/***
+ * Description: Turns a link into a canonical URL: the same URL as normalizeURL gives
+ *              for what webpage_getNextURL returns for the link.
+ * @param html: the page's HTML.
+ * @param span: the link.
+ * @param base: the page's URL.
+ * @param buf: where the canonical URL is written.
+ * @param bufSize: the size of buf; strlen(base) + span->len + 2 bytes is always enough.
+ * @param view: set to the canonical URL.
+ * @returns false if the URL is rejected, or doesn't fit buf.
+ */
+bool linkscan_resolve(const char* html, const linkSpan_t* span, const char* base,
+                      char* buf, const size_t bufSize, urlView_t* view);
+
+#endif
@@ -0,0 +1,303 @@
+/**
+ * metrics.c
+ *
+ * Description: Implements the metrics as a list, in registration order. A counter is
+ *              an atomic long; a summary is a histogram (histogram.h) with the sum of
+ *              its times, under a mutex of its own; a gauge is a callback. Writing
+ *              the metrics out takes each summary's lock only long enough to read it.
+ *
+ *              The writer thread sleeps on a condition variable for the interval (a
+ *              delete wakes it early), then writes the file as <path>.tmp and renames
+ *              it over path.
+ */
+#define _POSIX_C_SOURCE 200809L    // clock_gettime, pthread_condattr_setclock
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "metrics.h"
+#include "histogram.h"
+#include "mem.h"
+
+typedef enum { METRIC_COUNTER, METRIC_SUMMARY, METRIC_GAUGE } metricKind_t;
+
+typedef struct metric {
+    metricKind_t kind;
+    char* name;
+    char* help;
+    atomic_long count;          // a counter's value
+    pthread_mutex_t lock;       // a summary's, guarding the three below
+    histogram_t* times;
+    long sumUs;
+    long observed;
+    metrics_gauge_t gauge;      // a gauge's
+    void* arg;
+    struct metric* next;
+} metric_t;
+
+typedef struct metrics {
+    metric_t* first;
+    metric_t* last;
+    char* path;                 // the file rewritten, once started
+    char* tmpPath;
+    int intervalMs;
+    bool started;
+    bool stopping;
+    pthread_mutex_t lock;       // guards stopping
+    pthread_cond_t wake;        // signaled on delete
+    pthread_t writer;
+} metrics_t;
+
+// The percentiles each summary is written out with
+static const double QUANTILES[] = { 0.5, 0.9, 0.99 };
+
+static metric_t* addMetric(metrics_t* metrics, const metricKind_t kind, const char* name, const char* help);
+static bool writeFile(metrics_t* metrics);
+static void* writePeriodically(void* arg);
+static char* copyOf(const char* string);
+
+
+/**
+ * Description: Creates a new empty set of metrics.
+ * @returns pointer to the new set.
+*/
+metrics_t* metrics_new(void){
+    metrics_t* metrics = mem_assert(mem_calloc(1, sizeof(metrics_t)), "Error: Failed to allocate memory for metrics.\n");
+    pthread_mutex_init(&metrics->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&metrics->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    return metrics;
+}
+
+/**
+ * Description: Registers a counter.
+ * @param metrics: the set.
+ * @param name: its name.
+ * @param help: what it counts.
+ * @returns the counter, or NULL if metrics is NULL.
+*/
+metric_t* metrics_counter(metrics_t* metrics, const char* name, const char* help){
+    return addMetric(metrics, METRIC_COUNTER, name, help);
+}
+
+/**
+ * Description: Registers a summary of times.
+ * @param metrics: the set.
+ * @param name: its name.
+ * @param help: what it times.
+ * @returns the summary, or NULL if metrics is NULL.
+*/
+metric_t* metrics_summary(metrics_t* metrics, const char* name, const char* help){
+    metric_t* metric = addMetric(metrics, METRIC_SUMMARY, name, help);
+    if (metric != NULL) metric->times = histogram_new();
+    return metric;
+}
+
+/**
+ * Description: Registers a gauge.
+ * @param metrics: the set.
+ * @param name: its name.
+ * @param help: what it measures.
+ * @param gauge: gives its value.
+ * @param arg: passed to gauge.
+*/
+void metrics_gauge(metrics_t* metrics, const char* name, const char* help, metrics_gauge_t gauge, void* arg){
+    metric_t* metric = addMetric(metrics, METRIC_GAUGE, name, help);
+    if (metric == NULL) return;
+    metric->gauge = gauge;
+    metric->arg = arg;
+}
+
+/**
+ * Description: Adds to a counter.
+ * @param metric: the counter, or NULL.
+ * @param amount: what to add.
+*/
+void metric_add(metric_t* metric, const long amount){
+    if (metric != NULL) atomic_fetch_add(&metric->count, amount);
+}
+
+/**
+ * Description: Counts a time in a summary.
+ * @param metric: the summary, or NULL.
+ * @param us: the time in microseconds.
+*/
+void metric_observe(metric_t* metric, const long us){
+    if (metric == NULL || metric->kind != METRIC_SUMMARY) return;
+    pthread_mutex_lock(&metric->lock);
+    histogram_add(metric->times, us);
+    metric->sumUs += us > 0 ? us : 0;
+    metric->observed++;
+    pthread_mutex_unlock(&metric->lock);
+}
+
+/**
+ * Description: Writes every metric in the Prometheus text format: a HELP and a TYPE line,
+ *              then the value, or for a summary a line per quantile and the sum and count.
+ * @param metrics: the set.
+ * @param fp: where to write.
+*/
+void metrics_write(metrics_t* metrics, FILE* fp){
+    if (metrics == NULL || fp == NULL) return;
+    for (metric_t* metric = metrics->first; metric != NULL; metric = metric->next){
+        static const char* TYPES[] = { "counter", "summary", "gauge" };
+        fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", metric->name, metric->help, metric->name, TYPES[metric->kind]);
+        if (metric->kind == METRIC_COUNTER){
+            fprintf(fp, "%s %ld\n", metric->name, atomic_load(&metric->count));
+        } else if (metric->kind == METRIC_GAUGE){
+            fprintf(fp, "%s %.17g\n", metric->name, metric->gauge(metric->arg));
+        } else {
+            long quantiles[sizeof(QUANTILES) / sizeof(QUANTILES[0])];
+            pthread_mutex_lock(&metric->lock);
+            for (size_t i = 0; i < sizeof(QUANTILES) / sizeof(QUANTILES[0]); i++){
+                quantiles[i] = histogram_percentile(metric->times, QUANTILES[i]);
+            }
+            long sumUs = metric->sumUs;
+            long observed = metric->observed;
+            pthread_mutex_unlock(&metric->lock);
+            for (size_t i = 0; i < sizeof(QUANTILES) / sizeof(QUANTILES[0]); i++){
+                fprintf(fp, "%s{quantile=\"%g\"} %.6f\n", metric->name, QUANTILES[i], quantiles[i] / 1e6);
+            }
+            fprintf(fp, "%s_sum %.6f\n%s_count %ld\n", metric->name, sumUs / 1e6, metric->name, observed);
+        }
+    }
+}
+
+/**
+ * Description: Writes the file once, then starts the thread that rewrites it.
+ * @param metrics: the set.
+ * @param path: the file.
+ * @param intervalMs: how often it is rewritten.
+ * @returns false if the file can't be written.
+*/
+bool metrics_start(metrics_t* metrics, const char* path, const int intervalMs){
+    if (metrics == NULL || path == NULL || metrics->started) return false;
+    metrics->path = copyOf(path);
+    metrics->tmpPath = mem_assert(mem_malloc(strlen(path) + strlen(".tmp") + 1), "Error: Failed to allocate memory for metrics.\n");
+    sprintf(metrics->tmpPath, "%s.tmp", path);
+    metrics->intervalMs = intervalMs > 0 ? intervalMs : 1;
+    if (!writeFile(metrics)) return false;
+    if (pthread_create(&metrics->writer, NULL, writePeriodically, metrics) != 0){
+        fprintf(stderr, "Error: Failed to start metrics writer.\n");
+        exit(1);
+    }
+    metrics->started = true;
+    return true;
+}
+
+/**
+ * Description: Stops the writer thread, which writes the file a last time, and deletes
+ *              the metrics.
+ * @param metrics: the set to delete.
+*/
+void metrics_delete(metrics_t* metrics){
+    if (metrics == NULL) return;
+    if (metrics->started){
+        pthread_mutex_lock(&metrics->lock);
+        metrics->stopping = true;
+        pthread_cond_signal(&metrics->wake);
+        pthread_mutex_unlock(&metrics->lock);
+        pthread_join(metrics->writer, NULL);
+    }
+    metric_t* metric = metrics->first;
+    while (metric != NULL){
+        metric_t* next = metric->next;
+        if (metric->kind == METRIC_SUMMARY){
+            histogram_delete(metric->times);
+            pthread_mutex_destroy(&metric->lock);
+        }
+        mem_free(metric->name);
+        mem_free(metric->help);
+        mem_free(metric);
+        metric = next;
+    }
+    if (metrics->path) mem_free(metrics->path);
+    if (metrics->tmpPath) mem_free(metrics->tmpPath);
+    pthread_mutex_destroy(&metrics->lock);
+    pthread_cond_destroy(&metrics->wake);
+    mem_free(metrics);
+}
+
+/***
+ * Description: Appends a new metric of the given kind to the list.
+ * @returns the metric, or NULL if metrics, name or help is NULL.
+*/
+static metric_t* addMetric(metrics_t* metrics, const metricKind_t kind, const char* name, const char* help){
+    if (metrics == NULL || name == NULL || help == NULL) return NULL;
+    metric_t* metric = mem_assert(mem_calloc(1, sizeof(metric_t)), "Error: Failed to allocate memory for metric.\n");
+    metric->kind = kind;
+    metric->name = copyOf(name);
+    metric->help = copyOf(help);
+    atomic_init(&metric->count, 0);
+    if (kind == METRIC_SUMMARY) pthread_mutex_init(&metric->lock, NULL);
+    if (metrics->last == NULL) metrics->first = metric;
+    else metrics->last->next = metric;
+    metrics->last = metric;
+    return metric;
+}
+
+/***
+ * Description: Writes the metrics to the temporary file and renames it over the file.
+ * @returns false, having said so, if either fails.
+*/
+static bool writeFile(metrics_t* metrics){
+    FILE* fp = fopen(metrics->tmpPath, "w");
+    if (fp == NULL){
+        fprintf(stderr, "Error: Can't write %s.\n", metrics->tmpPath);
+        return false;
+    }
+    metrics_write(metrics, fp);
+    bool written = !ferror(fp);
+    if (fclose(fp) != 0 || !written || rename(metrics->tmpPath, metrics->path) != 0){
+        fprintf(stderr, "Error: Can't write %s.\n", metrics->path);
+        return false;
+    }
+    return true;
+}
+
+/***
+ * Description: Body of the writer thread. Rewrites the file every interval, and once
+ *              more when the metrics are deleted.
+ * @param arg: the metrics.
+ * @returns NULL
+*/
+static void* writePeriodically(void* arg){
+    metrics_t* metrics = arg;
+    pthread_mutex_lock(&metrics->lock);
+    while (true){
+        if (!metrics->stopping){
+            struct timespec until;
+            clock_gettime(CLOCK_MONOTONIC, &until);
+            until.tv_sec += metrics->intervalMs / 1000;
+            until.tv_nsec += (metrics->intervalMs % 1000) * 1000000L;
+            if (until.tv_nsec >= 1000000000){
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&metrics->wake, &metrics->lock, &until);
+        }
+        bool stopping = metrics->stopping;
+        pthread_mutex_unlock(&metrics->lock);
+        writeFile(metrics);
+        pthread_mutex_lock(&metrics->lock);
+        if (stopping) break;
+    }
+    pthread_mutex_unlock(&metrics->lock);
+    return NULL;
+}
+
+/***
+ * Description: Copies a string.
+*/
+static char* copyOf(const char* string){
+    char* copy = mem_assert(mem_malloc(strlen(string) + 1), "Error: Failed to allocate memory for metrics.\n");
+    strcpy(copy, string);
+    return copy;
+}
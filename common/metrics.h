@@ -0,0 +1,102 @@
+/**
+ * metrics.h
+ *
+ * Interface for a set of named metrics in the Prometheus text exposition format:
+ * counters that only go up, summaries of how long something took (a latency
+ * histogram, reported as its 50th, 90th and 99th percentiles with the sum and count
+ * of the times), and gauges whose value a callback gives each time they are
+ * written out. Metrics are registered up front, then updated from any thread; a
+ * NULL metric ignores updates, so code can be instrumented whether or not metrics
+ * are being kept.
+ *
+ * metrics_start starts a thread that rewrites a file with every metric's current
+ * value at a fixed interval. The file is written under a temporary name and renamed
+ * into place, so a reader (node_exporter's textfile collector, say, or cat) never
+ * sees it half written.
+ */
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef struct metrics metrics_t;
+typedef struct metric metric_t;
+
+// Gives a gauge's current value
+typedef double (*metrics_gauge_t)(void* arg);
+
+/***
+ * Description: Creates a new empty set of metrics.
+ * @returns pointer to the new set; exits if out of memory.
+ */
+metrics_t* metrics_new(void);
+
+/***
+ * Description: Registers a counter. Not thread-safe; register before updating.
+ * @param metrics: the set.
+ * @param name: its name, by convention ending in _total.
+ * @param help: a line saying what it counts.
+ * @returns the counter.
+ */
+metric_t* metrics_counter(metrics_t* metrics, const char* name, const char* help);
+
+/***
+ * Description: Registers a summary of times, counted in microseconds and written out
+ *              in seconds. Not thread-safe; register before updating.
+ * @param metrics: the set.
+ * @param name: its name, by convention ending in _seconds.
+ * @param help: a line saying what it times.
+ * @returns the summary.
+ */
+metric_t* metrics_summary(metrics_t* metrics, const char* name, const char* help);
+
+/***
+ * Description: Registers a gauge. Not thread-safe; register before writing out.
+ * @param metrics: the set.
+ * @param name: its name.
+ * @param help: a line saying what it measures.
+ * @param gauge: gives its value; called from whichever thread writes the metrics out.
+ * @param arg: passed to gauge.
+ */
+void metrics_gauge(metrics_t* metrics, const char* name, const char* help, metrics_gauge_t gauge, void* arg);
+
+/***
+ * Description: Adds to a counter. Thread-safe.
+ * @param metric: the counter, or NULL.
+ * @param amount: what to add.
+ */
+void metric_add(metric_t* metric, const long amount);
+
+/***
+ * Description: Counts a time in a summary. Thread-safe.
+ * @param metric: the summary, or NULL.
+ * @param us: the time, in microseconds.
+ */
+void metric_observe(metric_t* metric, const long us);
+
+/***
+ * Description: Writes every metric's current value, in registration order.
+ * @param metrics: the set.
+ * @param fp: where to write.
+ */
+void metrics_write(metrics_t* metrics, FILE* fp);
+
+/***
+ * Description: Starts a thread that rewrites path with the metrics every intervalMs.
+ * @param metrics: the set, with every metric registered.
+ * @param path: the file.
+ * @param intervalMs: how often it is rewritten.
+ * @returns false if the file can't be written.
+ */
+bool metrics_start(metrics_t* metrics, const char* path, const int intervalMs);
+
+/***
+ * Description: Stops the thread, if started, after writing the file one last time, and
+ *              deletes the metrics.
+ * @param metrics: the set to delete.
+ */
+void metrics_delete(metrics_t* metrics);
+
+#endif
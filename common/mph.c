@@ -0,0 +1,160 @@
+/**
+ * mph.c
+ *
+ * Description: Implements the minimal perfect hash. Words are hashed with 64-bit
+ *              FNV-1a, finished with splitmix64's mixer so every bit depends on every
+ *              byte. The low 32 bits choose the bucket; the slot is the hash mixed
+ *              again with the pilot, so two words of a bucket move independently
+ *              from one pilot to the next, however few bits their hashes differ in.
+ *              Both are scaled onto their range by a multiply and shift instead of
+ *              a modulo.
+ *
+ *              Building places the buckets biggest first, while most slots are still
+ *              free, trying pilots 0, 1, 2, ... for each until one sends all of its
+ *              words to free slots. Later buckets, mostly of one word, need more tries
+ *              as the table fills, the last about as many as there are words, but
+ *              with four words a bucket the pilots average a few hundred.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "mph.h"
+#include "mem.h"
+
+#define WORDS_PER_BUCKET 4
+#define MAX_PILOT (1u << 30)        // a bucket needing more than this is given up on
+
+static uint64_t mix(uint64_t x);
+
+
+/**
+ * Description: Hashes a word with FNV-1a, then mixes the result.
+ * @param word: the word.
+*/
+uint64_t mph_hash(const char* word){
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char* p = (const unsigned char*)word; *p != '\0'; p++){
+        hash = (hash ^ *p) * 0x100000001b3ULL;
+    }
+    return mix(hash);
+}
+
+/**
+ * Description: Returns the fingerprint of a hash: the high half of it mixed again, so it
+ *              is independent of the bits that chose the word's slot.
+ * @param hash: from mph_hash.
+*/
+uint32_t mph_fingerprint(const uint64_t hash){
+    return mix(hash ^ 0x9e3779b97f4a7c15ULL) >> 32;
+}
+
+/**
+ * Description: Returns the number of buckets for numWords words: one per WORDS_PER_BUCKET.
+ * @param numWords: the size of the set.
+*/
+uint32_t mph_numBuckets(const uint32_t numWords){
+    return numWords / WORDS_PER_BUCKET + 1;
+}
+
+/**
+ * Description: Returns a hash's bucket, from its low 32 bits.
+ * @param hash: from mph_hash.
+ * @param numBuckets: from mph_numBuckets.
+*/
+uint32_t mph_bucket(const uint64_t hash, const uint32_t numBuckets){
+    return ((hash & 0xffffffffULL) * numBuckets) >> 32;
+}
+
+/**
+ * Description: Returns a hash's slot under a pilot: the high 32 bits of the two mixed.
+ * @param hash: from mph_hash.
+ * @param pilot: the bucket's pilot.
+ * @param numWords: the size of the table.
+*/
+uint32_t mph_position(const uint64_t hash, const uint32_t pilot, const uint32_t numWords){
+    return (mix(hash ^ mix(pilot)) >> 32) * numWords >> 32;
+}
+
+/**
+ * Description: Finds the buckets' pilots: sorts the words by bucket and the buckets by
+ *              size, then places each bucket in turn at the first pilot whose slots are
+ *              all free.
+ * @param hashes: the hashes of the words.
+ * @param numWords: how many.
+ * @param pilots: set to each bucket's pilot.
+ * @param slots: set to each word's slot.
+ * @returns false if two words of a bucket have the same hash, or a bucket can't be placed.
+*/
+bool mph_build(const uint64_t* hashes, const uint32_t numWords, uint32_t* pilots, uint32_t* slots){
+    uint32_t numBuckets = mph_numBuckets(numWords);
+    memset(pilots, 0, numBuckets * sizeof(uint32_t));
+    if (numWords == 0) return true;
+
+    // Words grouped by bucket: bucket b's are byBucket[start[b]] to byBucket[start[b + 1]]
+    uint32_t* start = mem_assert(mem_calloc(numBuckets + 1, sizeof(uint32_t)), "Error: Failed to allocate memory for hash.\n");
+    uint32_t* byBucket = mem_assert(mem_malloc(numWords * sizeof(uint32_t)), "Error: Failed to allocate memory for hash.\n");
+    for (uint32_t i = 0; i < numWords; i++) start[mph_bucket(hashes[i], numBuckets) + 1]++;
+    uint32_t maxSize = 0;
+    for (uint32_t b = 0; b < numBuckets; b++){
+        if (start[b + 1] > maxSize) maxSize = start[b + 1];
+        start[b + 1] += start[b];
+    }
+    uint32_t* fill = mem_assert(mem_malloc(numBuckets * sizeof(uint32_t)), "Error: Failed to allocate memory for hash.\n");
+    memcpy(fill, start, numBuckets * sizeof(uint32_t));
+    for (uint32_t i = 0; i < numWords; i++) byBucket[fill[mph_bucket(hashes[i], numBuckets)]++] = i;
+
+    // Buckets biggest first, by counting sort on their sizes
+    uint32_t* sizeStart = mem_assert(mem_calloc(maxSize + 2, sizeof(uint32_t)), "Error: Failed to allocate memory for hash.\n");
+    for (uint32_t b = 0; b < numBuckets; b++) sizeStart[maxSize - (start[b + 1] - start[b]) + 1]++;
+    for (uint32_t s = 0; s <= maxSize; s++) sizeStart[s + 1] += sizeStart[s];
+    for (uint32_t b = 0; b < numBuckets; b++) fill[sizeStart[maxSize - (start[b + 1] - start[b])]++] = b;
+
+    unsigned char* taken = mem_assert(mem_calloc(numWords, 1), "Error: Failed to allocate memory for hash.\n");
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < numBuckets; i++){
+        uint32_t b = fill[i];
+        uint32_t first = start[b];
+        uint32_t size = start[b + 1] - first;
+        if (size == 0) break;
+        // Words with the same hash go to the same slot under every pilot
+        for (uint32_t j = 0; ok && j < size; j++){
+            for (uint32_t k = j + 1; ok && k < size; k++){
+                if (hashes[byBucket[first + j]] == hashes[byBucket[first + k]]) ok = false;
+            }
+        }
+        uint32_t pilot = 0;
+        while (ok){
+            // Claim the bucket's slots under this pilot, giving them back at the first taken one
+            uint32_t placed = 0;
+            while (placed < size){
+                uint32_t word = byBucket[first + placed];
+                uint32_t slot = mph_position(hashes[word], pilot, numWords);
+                if (taken[slot]) break;
+                taken[slot] = 1;
+                slots[word] = slot;
+                placed++;
+            }
+            if (placed == size) break;
+            for (uint32_t j = 0; j < placed; j++) taken[slots[byBucket[first + j]]] = 0;
+            if (++pilot == MAX_PILOT) ok = false;
+        }
+        pilots[b] = pilot;
+    }
+    mem_free(taken);
+    mem_free(sizeStart);
+    mem_free(fill);
+    mem_free(byBucket);
+    mem_free(start);
+    return ok;
+}
+
+/***
+ * Description: splitmix64's finishing mixer.
+*/
+static uint64_t mix(uint64_t x){
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
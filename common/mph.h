@@ -0,0 +1,69 @@
+/**
+ * mph.h
+ *
+ * Interface for a minimal perfect hash function over a fixed set of words, built by
+ * hash-and-displace: each word's 64-bit hash puts it in one of about a quarter as
+ * many buckets as words, and each bucket gets a pilot, a small number that, mixed
+ * into the hash, sends every word of the bucket to a different free slot. With n
+ * words there are exactly n slots, so once built the function maps the set's words
+ * one-to-one onto 0..n-1 from nothing but the pilots, about a byte per word.
+ *
+ * A word not in the set maps to some slot too, so a table indexed by the function
+ * keeps each word's fingerprint, a second 32 bits of its hash, to tell it from
+ * others: a missing word is taken for the word in its slot about once in four
+ * billion lookups.
+ */
+#ifndef __MPH_H
+#define __MPH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/***
+ * Description: Hashes a word; mph_bucket, mph_position and mph_fingerprint take the hash.
+ * @param word: the word.
+ */
+uint64_t mph_hash(const char* word);
+
+/***
+ * Description: Returns the fingerprint of a word's hash.
+ * @param hash: from mph_hash.
+ */
+uint32_t mph_fingerprint(const uint64_t hash);
+
+/***
+ * Description: Returns how many buckets mph_build uses for numWords words.
+ * @param numWords: the size of the set.
+ */
+uint32_t mph_numBuckets(const uint32_t numWords);
+
+/***
+ * Description: Returns a word's bucket.
+ * @param hash: from mph_hash.
+ * @param numBuckets: from mph_numBuckets.
+ */
+uint32_t mph_bucket(const uint64_t hash, const uint32_t numBuckets);
+
+/***
+ * Description: Returns a word's slot.
+ * @param hash: from mph_hash.
+ * @param pilot: its bucket's pilot.
+ * @param numWords: the size of the set, and of the table.
+ * @returns a slot below numWords.
+ */
+uint32_t mph_position(const uint64_t hash, const uint32_t pilot, const uint32_t numWords);
+
+/***
+ * Description: Finds a pilot for each bucket, biggest buckets first, so the words' slots
+ *              are all different.
+ * @param hashes: the hashes of the words, all different.
+ * @param numWords: how many.
+ * @param pilots: set to each bucket's pilot; mph_numBuckets(numWords) of them.
+ * @param slots: set to each word's slot; numWords of them.
+ * @returns false if two words' hashes are the same, so no pilot can part them.
+ */
+bool mph_build(const uint64_t* hashes, const uint32_t numWords, uint32_t* pilots, uint32_t* slots);
+
+#endif
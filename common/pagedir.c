@@ -1,10 +1,141 @@
+/**
+ * pagedir.c
+ *
+ * Description: Saves and loads the crawler's documents in a page directory, either one
+ *              file per document or appended to an archive of segment files with an
+ *              offset table giving random access to each document (see pagedir.h),
+ *              optionally compressed in blocks. Writes go through one mutex, so
+ *              worker threads can save at once. Archive table lines are held back
+ *              until the segment is flushed, so the table never points past what
+ *              reached the segment; page files are kept open until the next sync, so
+ *              a sync is one pass over what was written since the last. A reader keeps
+ *              the last block it expanded, so reading the documents of a block in turn
+ *              expands it once.
+ *
+ *              Validator and change lines are held back the same way, and written just
+ *              after the table lines (or the page files) of their documents; those of a
+ *              compressed document wait for its block.
+ */
+#define _POSIX_C_SOURCE 200809L    // getline, pread, ftruncate, fsync, fileno
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pagedir.h"
 #include "webpage.h"
+#include "codec.h"
+#include "file.h"
 #include "mem.h"
 
+#define ARCHIVE_MARKER "archive"        // first line of .crawler for the archive layout
+#define COMPRESSED_MARKER "compressed"  // and for the compressed one
+#define TABLE_NAME "pages.idx"
+#define VALIDATORS_NAME ".validators"
+#define CHANGES_NAME ".changes"
+#define SEGMENT_BYTES (64L << 20)       // a new segment is started past this size
+#define BLOCK_BYTES (256L << 10)        // HTML gathered before a block is compressed
+#define BLOCK_HEADER_BYTES 64           // enough to read a block's header line
+#define TABLE_FLUSH_BYTES (64L << 10)   // table lines held back before the segment is flushed
+#define MAX_UNSYNCED_FILES 256          // page files kept open for the next sync
+
+// Where a document's HTML lies in the archive
+typedef struct pageEntry {
+    char* url;                  // NULL if there is no such document
+    int depth;
+    int segment;
+    long block;                 // where its block starts in the segment; compressed only
+    long offset;                // in the segment, or in the block once expanded
+    long length;
+} pageEntry_t;
+
+// Lines held back until the documents they are about have been written out
+typedef struct heldLines {
+    char* text;
+    long len;
+    long cap;
+} heldLines_t;
+
+// A document's validators, as read back from .validators
+typedef struct validators {
+    char* etag;                 // NULL if none
+    char* lastModified;
+    bool recorded;              // there was a line for the document
+} validators_t;
+
+typedef struct pagedir {
+    char* directory;
+    pagedirLayout_t layout;
+    pthread_mutex_t lock;       // guards everything below
+    // Archive writing, opened on the first write
+    FILE* segment;
+    int segmentNum;
+    long segmentSize;
+    FILE* table;
+    heldLines_t tableLines;     // table lines waiting for the segment to be flushed
+    bool failed;                // a segment write failed; nothing more is written to it
+    // Files writing: written since the last sync, still open
+    FILE* unsynced[MAX_UNSYNCED_FILES];
+    int numUnsynced;
+    // Compressed writing: the block being gathered and the table entries waiting for it
+    char* block;
+    long blockLen;
+    long blockCap;
+    pageEntry_t* pending;       // the block's table entries, written once it is
+    int* pendingIDs;            // and their docIDs
+    int numPending;
+    int pendingCap;
+    // Metadata lists, opened on the first lines written to them
+    FILE* validators;
+    FILE* changes;
+    heldLines_t validatorLines; // lines waiting for their documents to be written out
+    heldLines_t changeLines;
+    heldLines_t blockValidators;// and those of the documents in the block being gathered
+    heldLines_t blockChanges;
+    // Validators reading, loaded on the first lookup
+    bool validatorsLoaded;
+    validators_t* known;        // indexed by docID
+    int numKnown;
+    // Archive reading, loaded on the first read
+    bool loaded;
+    pageEntry_t* entries;       // indexed by docID
+    int numEntries;
+    int* segmentFds;            // indexed by segment number; -1 if not open yet
+    int numSegmentFds;
+    char* cached;               // the last block expanded, and where it came from
+    long cachedLen;
+    int cachedSegment;
+    long cachedBlock;
+} pagedir_t;
+
+static FILE* writeFile(const webpage_t* page, const char* pageDirectory, const int docID);
+static bool syncFiles(pagedir_t* pagedir, const bool sync);
+static char* pathOf(const char* pageDirectory, const char* name);
+static char* segmentPath(const char* pageDirectory, const int segment);
+static void removeArchive(const char* pageDirectory);
+static bool openWriter(pagedir_t* pagedir);
+static bool nextSegment(pagedir_t* pagedir);
+static bool writeRecord(pagedir_t* pagedir, const webpage_t* page, const int docID, const pageMeta_t* meta);
+static bool gatherPage(pagedir_t* pagedir, const webpage_t* page, const int docID, const pageMeta_t* meta);
+static bool flushBlock(pagedir_t* pagedir);
+static void holdLine(heldLines_t* held, const char* format, ...);
+static void holdMeta(pagedir_t* pagedir, const webpage_t* page, const int docID, const pageMeta_t* meta, const bool inBlock);
+static bool flushTable(pagedir_t* pagedir, const bool sync);
+static bool writeMeta(pagedir_t* pagedir, const bool sync);
+static bool writeHeld(pagedir_t* pagedir, FILE** fp, const char* name, heldLines_t* held, const bool sync);
+static void loadValidators(pagedir_t* pagedir);
+static char* readHTML(pagedir_t* pagedir, const pageEntry_t* entry);
+static bool expandBlock(pagedir_t* pagedir, const int segment, const long block);
+static bool trimTable(const char* path);
+static void loadTable(pagedir_t* pagedir);
+static void discardEntries(pagedir_t* pagedir, const int docID);
+static int segmentFd(pagedir_t* pagedir, const int segment);
+
 
 /**
  * Description: Initiates a directory with the given name pageDirectory and creates a file
@@ -15,49 +146,952 @@
 */
 bool
 pagedir_init(const char* pageDirectory){
-    // Allocate memory dynamically for the path string
-    char* path = mem_assert(mem_malloc(strlen(pageDirectory) + strlen("/.crawler") + 1), "Error: Couldn't allocate memory for path");
-    // Initializing the path to be pageDirectory/.crawler
-    sprintf(path, "%s/.crawler", pageDirectory);
+    return pagedir_create(pageDirectory, PAGEDIR_FILES);
+}
+
+/**
+ * Description: Loads a document pagedir_write saved in the files layout. The first two
+ *              lines of pageDirectory/docID are the URL and depth; everything after them is
+ *              the HTML body, which is read back verbatim so the page never has to be
+ *              re-fetched.
+ * @param pageDirectory: Pointer to the directory name where pages were saved.
+ * @param docID: The id of the document (page).
+ * @return A new webpage holding the URL, depth and HTML of the document, or NULL if the
+ *         document doesn't exist or is malformed. Caller must webpage_delete it.
+*/
+webpage_t* pagedir_load(const char* pageDirectory, const int docID){
+    if (pageDirectory == NULL || docID < 0) return NULL;
+    // String buffer to convert the integer to a string for use in path
+    char strdocID[20];
+    sprintf(strdocID, "%d", docID);
+    char* path = pathOf(pageDirectory, strdocID);
+    FILE* fp = fopen(path, "r");
+    mem_free(path);
+    if (fp == NULL) return NULL;
+
+    // First line is the URL, second one is the depth
+    char* pageURL = file_readLine(fp);
+    char* depthStr = file_readLine(fp);
+    int depth;
+    if (pageURL == NULL || depthStr == NULL || sscanf(depthStr, "%d", &depth) != 1 || depth < 0){
+        free(pageURL);
+        free(depthStr);
+        fclose(fp);
+        return NULL;
+    }
+    free(depthStr);
+
+    // The rest of the file is the HTML; a page saved with an empty body has nothing left to read
+    char* html = file_readFile(fp);
+    if (html == NULL){
+        html = mem_assert(calloc(1, sizeof(char)), "Error: Couldn't allocate memory for html");
+    }
+    fclose(fp);
+    return webpage_new(pageURL, depth, html);
+}
+
+/**
+ * Description: Starts a new crawl in pageDirectory: writes its .crawler file, naming the
+ *              layout, and deletes any archive an earlier crawl left there.
+ * @param pageDirectory: The directory, which must exist.
+ * @param layout: How documents will be stored.
+ * @return true if the .crawler file was written; false otherwise.
+*/
+bool pagedir_create(const char* pageDirectory, const pagedirLayout_t layout){
+    if (pageDirectory == NULL) return false;
+    char* path = pathOf(pageDirectory, ".crawler");
     // Opening a file in that path (.crawler) to write to
     FILE* fp = fopen(path, "w");
-    if (fp == NULL) {
-        mem_free(path);
-        return false;
+    mem_free(path);
+    if (fp == NULL) return false;
+    if (layout == PAGEDIR_ARCHIVE){
+        fprintf(fp, "%s\n", ARCHIVE_MARKER);
+    } else if (layout == PAGEDIR_COMPRESSED){
+        fprintf(fp, "%s\n", COMPRESSED_MARKER);
     }
     fclose(fp);
+    removeArchive(pageDirectory);
+    // The lists were about the documents just deleted
+    path = pathOf(pageDirectory, VALIDATORS_NAME);
+    remove(path);
+    mem_free(path);
+    path = pathOf(pageDirectory, CHANGES_NAME);
+    remove(path);
     mem_free(path);
     return true;
+}
 
+/**
+ * Description: Opens a page directory, finding its layout in its .crawler file.
+ * @param pageDirectory: The directory.
+ * @return the open page directory, or NULL if it has no .crawler file.
+*/
+pagedir_t* pagedir_open(const char* pageDirectory){
+    if (pageDirectory == NULL) return NULL;
+    char* path = pathOf(pageDirectory, ".crawler");
+    FILE* fp = fopen(path, "r");
+    mem_free(path);
+    if (fp == NULL) return NULL;
+    char* marker = file_readLine(fp);
+    fclose(fp);
+
+    pagedir_t* pagedir = mem_assert(mem_calloc(1, sizeof(pagedir_t)), "Error: Couldn't allocate memory for page directory");
+    pagedir->directory = mem_assert(mem_malloc(strlen(pageDirectory) + 1), "Error: Couldn't allocate memory for page directory");
+    strcpy(pagedir->directory, pageDirectory);
+    pagedir->layout = PAGEDIR_FILES;
+    if (marker != NULL && strcmp(marker, ARCHIVE_MARKER) == 0){
+        pagedir->layout = PAGEDIR_ARCHIVE;
+    } else if (marker != NULL && strcmp(marker, COMPRESSED_MARKER) == 0){
+        pagedir->layout = PAGEDIR_COMPRESSED;
+    }
+    free(marker);
+    pthread_mutex_init(&pagedir->lock, NULL);
+    return pagedir;
 }
 
 /**
- * Description: Saving the content of a page inside the directory pageDirectory with name docID
- * @param page: Pointer to the webpage to be saved.
- * @param pageDirectory: Pointer to the directory name where pages will be saved.
- * @param docID: The id of the document (page).
+ * Description: Returns the layout of an open page directory.
+ * @param pagedir: The page directory.
+*/
+pagedirLayout_t pagedir_layout(pagedir_t* pagedir){
+    return pagedir == NULL ? PAGEDIR_FILES : pagedir->layout;
+}
+
+/**
+ * Description: Saves page as document docID: in its own file, appended to the current
+ *              segment with a line for it in the offset table, or added to the block
+ *              being gathered, which is compressed and written once full. Thread-safe.
+ * @param pagedir: The page directory.
+ * @param page: The page, with its HTML.
+ * @param docID: The id of the document.
+ * @return true if the document was written (or gathered); false otherwise.
 */
-void pagedir_save(const webpage_t* page, const char* pageDirectory, const int docID){
+bool pagedir_write(pagedir_t* pagedir, const webpage_t* page, const int docID){
+    return pagedir_writeMeta(pagedir, page, docID, NULL);
+}
+
+/**
+ * Description: Saves page as document docID, as pagedir_write does, holding back its
+ *              validator and change lines until it has been written out. Thread-safe.
+ * @param pagedir: The page directory.
+ * @param page: The page, with its HTML.
+ * @param docID: The id of the document.
+ * @param meta: Its validators and change, or NULL for no lines.
+ * @return true if the document was written (or gathered); false otherwise.
+*/
+bool pagedir_writeMeta(pagedir_t* pagedir, const webpage_t* page, const int docID, const pageMeta_t* meta){
+    if (pagedir == NULL || page == NULL || docID < 0) return false;
+    pthread_mutex_lock(&pagedir->lock);
+    bool ok;
+    if (pagedir->layout == PAGEDIR_FILES){
+        // Kept open for the next sync, unless too many already are
+        FILE* fp = writeFile(page, pagedir->directory, docID);
+        ok = fp != NULL;
+        if (ok){
+            pagedir->unsynced[pagedir->numUnsynced++] = fp;
+            holdMeta(pagedir, page, docID, meta, false);
+        }
+        if (pagedir->numUnsynced == MAX_UNSYNCED_FILES) ok = syncFiles(pagedir, true) && ok;
+    } else if ((ok = !pagedir->failed && openWriter(pagedir))){
+        ok = pagedir->layout == PAGEDIR_ARCHIVE ? writeRecord(pagedir, page, docID, meta)
+                                                : gatherPage(pagedir, page, docID, meta);
+    }
+    pthread_mutex_unlock(&pagedir->lock);
+    return ok;
+}
+
+/**
+ * Description: Loads document docID with the HTML that was saved for it.
+ * @param pagedir: The page directory.
+ * @param docID: The id of the document.
+ * @return A new webpage, or NULL if there is no such document. Caller must webpage_delete it.
+*/
+webpage_t* pagedir_read(pagedir_t* pagedir, const int docID){
+    if (pagedir == NULL || docID < 0) return NULL;
+    if (pagedir->layout == PAGEDIR_FILES){
+        return pagedir_load(pagedir->directory, docID);
+    }
+
+    pthread_mutex_lock(&pagedir->lock);
+    loadTable(pagedir);
+    webpage_t* page = NULL;
+    if (docID < pagedir->numEntries && pagedir->entries[docID].url != NULL){
+        pageEntry_t* entry = &pagedir->entries[docID];
+        char* html = readHTML(pagedir, entry);
+        if (html != NULL){
+            char* url = mem_assert(malloc(strlen(entry->url) + 1), "Error: Couldn't allocate memory for URL");
+            strcpy(url, entry->url);
+            page = webpage_new(url, entry->depth, html);
+        }
+    }
+    pthread_mutex_unlock(&pagedir->lock);
+    return page;
+}
+
+/**
+ * Description: Returns the URL of document docID, read from the first line of its file or
+ *              from the offset table.
+ * @param pagedir: The page directory.
+ * @param docID: The id of the document.
+ * @return The URL, or NULL if there is no such document. Caller must free it.
+*/
+char* pagedir_getURL(pagedir_t* pagedir, const int docID){
+    if (pagedir == NULL || docID < 0) return NULL;
+    if (pagedir->layout == PAGEDIR_FILES){
+        char strdocID[20];
+        sprintf(strdocID, "%d", docID);
+        char* path = pathOf(pagedir->directory, strdocID);
+        FILE* fp = fopen(path, "r");
+        mem_free(path);
+        if (fp == NULL) return NULL;
+        char* url = file_readLine(fp);
+        fclose(fp);
+        return url;
+    }
+
+    pthread_mutex_lock(&pagedir->lock);
+    loadTable(pagedir);
+    char* url = NULL;
+    if (docID < pagedir->numEntries && pagedir->entries[docID].url != NULL){
+        url = mem_assert(malloc(strlen(pagedir->entries[docID].url) + 1), "Error: Couldn't allocate memory for URL");
+        strcpy(url, pagedir->entries[docID].url);
+    }
+    pthread_mutex_unlock(&pagedir->lock);
+    return url;
+}
+
+/**
+ * Description: Looks up the validators document docID was last saved with, reading
+ *              .validators the first time. Thread-safe.
+ * @param pagedir: The page directory.
+ * @param docID: The id of the document.
+ * @param etag: Set to a copy of its ETag, or NULL.
+ * @param lastModified: Set to a copy of its Last-Modified date, or NULL.
+ * @return false if no validators were recorded for it.
+*/
+bool pagedir_getValidators(pagedir_t* pagedir, const int docID, char** etag, char** lastModified){
+    *etag = *lastModified = NULL;
+    if (pagedir == NULL || docID < 0) return false;
+    pthread_mutex_lock(&pagedir->lock);
+    loadValidators(pagedir);
+    bool recorded = docID < pagedir->numKnown && pagedir->known[docID].recorded;
+    if (recorded){
+        validators_t* known = &pagedir->known[docID];
+        if (known->etag){
+            *etag = mem_assert(malloc(strlen(known->etag) + 1), "Error: Couldn't allocate memory for validators");
+            strcpy(*etag, known->etag);
+        }
+        if (known->lastModified){
+            *lastModified = mem_assert(malloc(strlen(known->lastModified) + 1), "Error: Couldn't allocate memory for validators");
+            strcpy(*lastModified, known->lastModified);
+        }
+    }
+    pthread_mutex_unlock(&pagedir->lock);
+    return recorded;
+}
+
+/**
+ * Description: Removes documents docID and up: the files numbered from docID until one is
+ *              missing, or, in an archive, by a "- docID" line in the offset table that
+ *              cancels every earlier line for those docIDs.
+ * @param pagedir: The page directory.
+ * @param docID: The first docID to remove.
+ * @return false if the table couldn't be written.
+*/
+bool pagedir_discard(pagedir_t* pagedir, const int docID){
+    if (pagedir == NULL || docID < 0) return false;
+    if (pagedir->layout == PAGEDIR_FILES){
+        pthread_mutex_lock(&pagedir->lock);
+        syncFiles(pagedir, false);
+        pthread_mutex_unlock(&pagedir->lock);
+        char docPath[strlen(pagedir->directory) + 16];
+        for (int id = docID; ; id++){
+            sprintf(docPath, "%s/%d", pagedir->directory, id);
+            if (remove(docPath) != 0) break;
+        }
+        return true;
+    }
+
+    pthread_mutex_lock(&pagedir->lock);
+    // Documents gathered before the discard are listed before it
+    bool ok = openWriter(pagedir)
+              && flushBlock(pagedir)
+              && flushTable(pagedir, false)
+              && fprintf(pagedir->table, "- %d\n", docID) > 0
+              && fflush(pagedir->table) == 0;
+    if (pagedir->loaded) discardEntries(pagedir, docID);
+    pthread_mutex_unlock(&pagedir->lock);
+    return ok;
+}
+
+/**
+ * Description: Makes everything written so far durable: flushes the segment, then writes
+ *              the table lines held back and syncs both, or syncs and closes the page files
+ *              written since the last sync and syncs the directory. A compressed block still
+ *              being gathered isn't written. Thread-safe.
+ * @param pagedir: The page directory.
+ * @return false if anything couldn't be written or synced.
+*/
+bool pagedir_sync(pagedir_t* pagedir){
+    if (pagedir == NULL) return false;
+    pthread_mutex_lock(&pagedir->lock);
+    bool ok = true;
+    if (pagedir->layout == PAGEDIR_FILES){
+        ok = syncFiles(pagedir, true);
+        // The files' names are in the directory
+        int fd = open(pagedir->directory, O_RDONLY);
+        if (fd >= 0){
+            fsync(fd);
+            close(fd);
+        }
+    } else if (pagedir->table != NULL){
+        ok = flushTable(pagedir, true);
+    }
+    pthread_mutex_unlock(&pagedir->lock);
+    return ok;
+}
+
+/**
+ * Description: Closes the page directory and frees it, first writing out the block being
+ *              gathered and the table lines held back.
+ * @param pagedir: The page directory.
+*/
+void pagedir_close(pagedir_t* pagedir){
+    if (pagedir == NULL) return;
+    syncFiles(pagedir, false);
+    if (pagedir->table){
+        flushBlock(pagedir);
+        flushTable(pagedir, false);
+    }
+    if (pagedir->tableLines.text) mem_free(pagedir->tableLines.text);
+    if (pagedir->segment) fclose(pagedir->segment);
+    if (pagedir->table) fclose(pagedir->table);
+    // Lines of documents in a block that was never written are dropped with it
+    if (pagedir->validators) fclose(pagedir->validators);
+    if (pagedir->changes) fclose(pagedir->changes);
+    heldLines_t* held[] = { &pagedir->validatorLines, &pagedir->changeLines, &pagedir->blockValidators, &pagedir->blockChanges };
+    for (int i = 0; i < 4; i++){
+        if (held[i]->text) mem_free(held[i]->text);
+    }
+    for (int id = 0; id < pagedir->numKnown; id++){
+        if (pagedir->known[id].etag) mem_free(pagedir->known[id].etag);
+        if (pagedir->known[id].lastModified) mem_free(pagedir->known[id].lastModified);
+    }
+    if (pagedir->known) mem_free(pagedir->known);
+    discardEntries(pagedir, 0);
+    if (pagedir->entries) mem_free(pagedir->entries);
+    for (int i = 0; i < pagedir->numSegmentFds; i++){
+        if (pagedir->segmentFds[i] >= 0) close(pagedir->segmentFds[i]);
+    }
+    if (pagedir->segmentFds) mem_free(pagedir->segmentFds);
+    if (pagedir->block) mem_free(pagedir->block);
+    if (pagedir->pending) mem_free(pagedir->pending);
+    if (pagedir->pendingIDs) mem_free(pagedir->pendingIDs);
+    if (pagedir->cached) mem_free(pagedir->cached);
+    pthread_mutex_destroy(&pagedir->lock);
+    mem_free(pagedir->directory);
+    mem_free(pagedir);
+}
+
+/***
+ * Description: Writes page to the file pageDirectory/docID and flushes it, leaving it open.
+ * @return the file, or NULL if it couldn't be written.
+*/
+static FILE* writeFile(const webpage_t* page, const char* pageDirectory, const int docID){
     // String buffer to convert the integer to a string for use in path
     char strdocID[20];
     sprintf(strdocID, "%d", docID);
-    // Allocate memory dynamically for the path string
-    char* path = mem_assert(mem_malloc(strlen(pageDirectory) + strlen(strdocID) + 2), "Error: Couldn't allocate memory for path");
-    sprintf(path, "%s/%s", pageDirectory, strdocID);
+    char* path = pathOf(pageDirectory, strdocID);
     // Opening a file in that path to write to
     FILE* fp = fopen(path, "w");
-    if (fp == NULL){
-        mem_free(path);
-        exit(1);
-    }
+    mem_free(path);
+    if (fp == NULL) return NULL;
     // Printing information into that document
     char* webpageURL = webpage_getURL(page);
     int pageDepth = webpage_getDepth(page);
     char* pageContent = webpage_getHTML(page);
     fprintf(fp, "%s", webpageURL);
     fprintf(fp, "\n%d", pageDepth);
-    fprintf(fp, "\n%s", pageContent);
+    fprintf(fp, "\n%s", pageContent ? pageContent : "");
+    if (fflush(fp) != 0){
+        fclose(fp);
+        return NULL;
+    }
+    return fp;
+}
+
+/***
+ * Description: Closes the page files written since the last sync, syncing them first if
+ *              asked, then writes out the validator and change lines held for them. The
+ *              caller holds the lock.
+ * @returns false if any couldn't be synced or closed, or the lines couldn't be written.
+*/
+static bool syncFiles(pagedir_t* pagedir, const bool sync){
+    bool ok = true;
+    for (int i = 0; i < pagedir->numUnsynced; i++){
+        if (sync && fsync(fileno(pagedir->unsynced[i])) != 0) ok = false;
+        if (fclose(pagedir->unsynced[i]) != 0) ok = false;
+    }
+    pagedir->numUnsynced = 0;
+    return writeMeta(pagedir, sync) && ok;
+}
+
+/***
+ * Description: Builds the path pageDirectory/name.
+ * @returns the path; caller must mem_free it.
+*/
+static char* pathOf(const char* pageDirectory, const char* name){
+    char* path = mem_assert(mem_malloc(strlen(pageDirectory) + strlen(name) + 2), "Error: Couldn't allocate memory for path");
+    sprintf(path, "%s/%s", pageDirectory, name);
+    return path;
+}
+
+/***
+ * Description: Builds the path of segment number segment, pageDirectory/pages.N.
+ * @returns the path; caller must mem_free it.
+*/
+static char* segmentPath(const char* pageDirectory, const int segment){
+    char name[32];
+    sprintf(name, "pages.%d", segment);
+    return pathOf(pageDirectory, name);
+}
+
+/***
+ * Description: Deletes the offset table and the segments of pageDirectory's archive.
+*/
+static void removeArchive(const char* pageDirectory){
+    char* path = pathOf(pageDirectory, TABLE_NAME);
+    remove(path);
+    mem_free(path);
+    for (int segment = 0; ; segment++){
+        path = segmentPath(pageDirectory, segment);
+        int removed = remove(path);
+        mem_free(path);
+        if (removed != 0) break;
+    }
+}
+
+/***
+ * Description: Opens the archive for appending, if it isn't yet: the last segment there is,
+ *              and the offset table, without any line a crash cut short. The caller holds
+ *              the lock.
+ * @returns false if either can't be opened.
+*/
+static bool openWriter(pagedir_t* pagedir){
+    if (pagedir->table != NULL) return true;
+    // Carry on in the last segment
+    int last = 0;
+    struct stat info;
+    while (true){
+        char* path = segmentPath(pagedir->directory, last + 1);
+        int missing = stat(path, &info);
+        mem_free(path);
+        if (missing != 0) break;
+        last++;
+    }
+    char* path = segmentPath(pagedir->directory, last);
+    pagedir->segment = fopen(path, "a");
+    pagedir->segmentSize = pagedir->segment != NULL && stat(path, &info) == 0 ? info.st_size : 0;
+    mem_free(path);
+    pagedir->segmentNum = last;
+
+    path = pathOf(pagedir->directory, TABLE_NAME);
+    if (pagedir->segment != NULL && trimTable(path)){
+        pagedir->table = fopen(path, "a");
+    }
+    mem_free(path);
+    if (pagedir->table == NULL){
+        if (pagedir->segment) fclose(pagedir->segment);
+        pagedir->segment = NULL;
+        return false;
+    }
+    return true;
+}
+
+/***
+ * Description: Starts the next segment, if the current one has grown past SEGMENT_BYTES,
+ *              first writing the table lines that point into the current one. The caller
+ *              holds the lock.
+ * @returns false if the next segment couldn't be opened.
+*/
+static bool nextSegment(pagedir_t* pagedir){
+    if (pagedir->segmentSize < SEGMENT_BYTES) return true;
+    if (!flushTable(pagedir, false)) return false;
+    char* path = segmentPath(pagedir->directory, pagedir->segmentNum + 1);
+    FILE* next = fopen(path, "a");
+    mem_free(path);
+    if (next == NULL) return false;
+    fclose(pagedir->segment);
+    pagedir->segment = next;
+    pagedir->segmentNum++;
+    pagedir->segmentSize = 0;
+    return true;
+}
+
+/***
+ * Description: Appends page to the current segment as a record (a header line, the URL,
+ *              the HTML and a newline to end it), then lists it in the offset table and
+ *              holds its metadata lines. The caller holds the lock.
+ * @returns false if either couldn't be written.
+*/
+static bool writeRecord(pagedir_t* pagedir, const webpage_t* page, const int docID, const pageMeta_t* meta){
+    char* url = webpage_getURL(page);
+    int depth = webpage_getDepth(page);
+    char* html = webpage_getHTML(page);
+    if (html == NULL) html = "";
+    long length = strlen(html);
+    if (!nextSegment(pagedir)) return false;
+
+    int header = fprintf(pagedir->segment, "TSE-DOC %d %d %ld\n%s\n", docID, depth, length, url);
+    long offset = pagedir->segmentSize + header;
+    bool ok = header > 0
+              && fwrite(html, 1, length, pagedir->segment) == (size_t)length
+              && fputc('\n', pagedir->segment) != EOF;
+    pagedir->segmentSize = offset + length + 1;
+    if (!ok){
+        pagedir->failed = true;
+        return false;
+    }
+    // The table points at the record only once the segment has been flushed
+    holdLine(&pagedir->tableLines, "%d %d %ld %ld %d %s\n", docID, pagedir->segmentNum, offset, length, depth, url);
+    holdMeta(pagedir, page, docID, meta, false);
+    return pagedir->tableLines.len < TABLE_FLUSH_BYTES || flushTable(pagedir, false);
+}
+
+/***
+ * Description: Adds page's HTML to the block being gathered, writing the block out first
+ *              if the page would take it past BLOCK_BYTES (a larger page gets a block of its
+ *              own), and holds its metadata lines with the block's. The caller holds the lock.
+ * @returns false if a block couldn't be written.
+*/
+static bool gatherPage(pagedir_t* pagedir, const webpage_t* page, const int docID, const pageMeta_t* meta){
+    char* html = webpage_getHTML(page);
+    if (html == NULL) html = "";
+    long length = strlen(html);
+    if (pagedir->blockLen > 0 && pagedir->blockLen + length > BLOCK_BYTES && !flushBlock(pagedir)){
+        return false;
+    }
+    if (pagedir->blockLen + length > pagedir->blockCap){
+        long cap = pagedir->blockCap > 0 ? pagedir->blockCap : BLOCK_BYTES;
+        while (pagedir->blockLen + length > cap) cap *= 2;
+        char* bigger = mem_assert(mem_malloc(cap), "Error: Couldn't allocate memory for block");
+        if (pagedir->block){
+            memcpy(bigger, pagedir->block, pagedir->blockLen);
+            mem_free(pagedir->block);
+        }
+        pagedir->block = bigger;
+        pagedir->blockCap = cap;
+    }
+    if (pagedir->numPending == pagedir->pendingCap){
+        int cap = pagedir->pendingCap > 0 ? pagedir->pendingCap * 2 : 64;
+        pageEntry_t* entries = mem_assert(mem_malloc(cap * sizeof(pageEntry_t)), "Error: Couldn't allocate memory for block");
+        int* docIDs = mem_assert(mem_malloc(cap * sizeof(int)), "Error: Couldn't allocate memory for block");
+        if (pagedir->pending){
+            memcpy(entries, pagedir->pending, pagedir->numPending * sizeof(pageEntry_t));
+            memcpy(docIDs, pagedir->pendingIDs, pagedir->numPending * sizeof(int));
+            mem_free(pagedir->pending);
+            mem_free(pagedir->pendingIDs);
+        }
+        pagedir->pending = entries;
+        pagedir->pendingIDs = docIDs;
+        pagedir->pendingCap = cap;
+    }
+    pageEntry_t* entry = &pagedir->pending[pagedir->numPending];
+    pagedir->pendingIDs[pagedir->numPending++] = docID;
+    char* url = webpage_getURL(page);
+    entry->url = mem_assert(mem_malloc(strlen(url) + 1), "Error: Couldn't allocate memory for URL");
+    strcpy(entry->url, url);
+    entry->depth = webpage_getDepth(page);
+    entry->offset = pagedir->blockLen;
+    entry->length = length;
+    memcpy(pagedir->block + pagedir->blockLen, html, length);
+    pagedir->blockLen += length;
+    holdMeta(pagedir, page, docID, meta, true);
+    return pagedir->blockLen < BLOCK_BYTES || flushBlock(pagedir);
+}
+
+/***
+ * Description: Compresses the block gathered so far and appends it to the current segment
+ *              under a "TSE-BLOCK rawLength length" line, then lists its documents in the
+ *              offset table and releases their metadata lines. The caller holds the lock.
+ * @returns false if either couldn't be written; true if there was nothing to write.
+*/
+static bool flushBlock(pagedir_t* pagedir){
+    if (pagedir->numPending == 0) return true;
+    bool ok = nextSegment(pagedir);
+    long block = pagedir->segmentSize;
+    if (ok){
+        char* compressed = mem_assert(mem_malloc(codec_bound(pagedir->blockLen)), "Error: Couldn't allocate memory for block");
+        long length = codec_compress(pagedir->block, pagedir->blockLen, compressed);
+        int header = fprintf(pagedir->segment, "TSE-BLOCK %ld %ld\n", pagedir->blockLen, length);
+        ok = header > 0
+             && fwrite(compressed, 1, length, pagedir->segment) == (size_t)length
+             && fputc('\n', pagedir->segment) != EOF;
+        pagedir->segmentSize = block + header + length + 1;
+        mem_free(compressed);
+        if (!ok) pagedir->failed = true;
+    }
+    for (int i = 0; i < pagedir->numPending; i++){
+        pageEntry_t* entry = &pagedir->pending[i];
+        if (ok){
+            holdLine(&pagedir->tableLines, "%d %d %ld %ld %ld %d %s\n", pagedir->pendingIDs[i], pagedir->segmentNum,
+                     block, entry->offset, entry->length, entry->depth, entry->url);
+        }
+        mem_free(entry->url);
+    }
+    if (ok && pagedir->blockValidators.len > 0){
+        holdLine(&pagedir->validatorLines, "%.*s", (int)pagedir->blockValidators.len, pagedir->blockValidators.text);
+    }
+    if (ok && pagedir->blockChanges.len > 0){
+        holdLine(&pagedir->changeLines, "%.*s", (int)pagedir->blockChanges.len, pagedir->blockChanges.text);
+    }
+    pagedir->blockValidators.len = pagedir->blockChanges.len = 0;
+    pagedir->numPending = 0;
+    pagedir->blockLen = 0;
+    return ok && flushTable(pagedir, false);
+}
+
+/***
+ * Description: Holds back a formatted line (for the offset table, say) until what it
+ *              refers to has been written. The caller holds the lock.
+ * @param held: The lines held so far.
+ * @param format: printf format of the line.
+*/
+static void holdLine(heldLines_t* held, const char* format, ...){
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (held->len + length + 1 > held->cap){
+        long cap = held->cap > 0 ? held->cap : TABLE_FLUSH_BYTES;
+        while (held->len + length + 1 > cap) cap *= 2;
+        char* bigger = mem_assert(mem_malloc(cap), "Error: Couldn't allocate memory for page table");
+        if (held->text){
+            memcpy(bigger, held->text, held->len);
+            mem_free(held->text);
+        }
+        held->text = bigger;
+        held->cap = cap;
+    }
+    va_start(args, format);
+    vsnprintf(held->text + held->len, length + 1, format, args);
+    va_end(args);
+    held->len += length;
+}
+
+/***
+ * Description: Holds back the validator line of a document just written, and its change
+ *              line if it has a change, with the block's if it is in one. An ETag with
+ *              whitespace in it couldn't be read back, so it is left out. The caller
+ *              holds the lock.
+ * @param meta: The document's metadata; nothing is held if NULL.
+ * @param inBlock: Whether the document is in the block being gathered.
+*/
+static void holdMeta(pagedir_t* pagedir, const webpage_t* page, const int docID, const pageMeta_t* meta, const bool inBlock){
+    if (meta == NULL) return;
+    const char* etag = meta->etag != NULL && meta->etag[0] != '\0' && strpbrk(meta->etag, " \t\r\n") == NULL
+                       ? meta->etag : "-";
+    const char* lastModified = meta->lastModified != NULL && meta->lastModified[0] != '\0'
+                               && strpbrk(meta->lastModified, "\r\n") == NULL ? meta->lastModified : "-";
+    holdLine(inBlock ? &pagedir->blockValidators : &pagedir->validatorLines, "%d %s %s\n", docID, etag, lastModified);
+    if (meta->change != 0){
+        holdLine(inBlock ? &pagedir->blockChanges : &pagedir->changeLines, "%c %d %s\n", meta->change, docID, webpage_getURL(page));
+    }
+}
+
+/***
+ * Description: Flushes the segment, then writes out the table lines held back and flushes
+ *              the table; with sync, syncs the segment before the lines are written and the
+ *              table after. The caller holds the lock.
+ * @returns false if anything couldn't be written.
+*/
+static bool flushTable(pagedir_t* pagedir, const bool sync){
+    if (pagedir->failed || fflush(pagedir->segment) != 0 || (sync && fsync(fileno(pagedir->segment)) != 0)){
+        // Some of the records the held lines point at may never have reached the segment:
+        // drop the lines, so those pages are missing rather than wrong, and crawled again
+        pagedir->failed = true;
+        pagedir->tableLines.len = 0;
+        pagedir->validatorLines.len = pagedir->changeLines.len = 0;
+        return false;
+    }
+    bool ok = true;
+    if (pagedir->tableLines.len > 0){
+        ok = fwrite(pagedir->tableLines.text, 1, pagedir->tableLines.len, pagedir->table) == (size_t)pagedir->tableLines.len;
+        pagedir->tableLines.len = 0;
+    }
+    ok = ok && fflush(pagedir->table) == 0 && (!sync || fsync(fileno(pagedir->table)) == 0);
+    if (!ok) pagedir->validatorLines.len = pagedir->changeLines.len = 0;
+    return ok && writeMeta(pagedir, sync);
+}
+
+/***
+ * Description: Writes out the validator and change lines held for documents that have
+ *              been written, syncing them if asked. The caller holds the lock.
+ * @returns false if they couldn't be written.
+*/
+static bool writeMeta(pagedir_t* pagedir, const bool sync){
+    bool ok = writeHeld(pagedir, &pagedir->validators, VALIDATORS_NAME, &pagedir->validatorLines, sync);
+    return writeHeld(pagedir, &pagedir->changes, CHANGES_NAME, &pagedir->changeLines, sync) && ok;
+}
+
+/***
+ * Description: Appends held lines to the list pageDirectory/name, opening it the first
+ *              time (without any line a crash cut short), then flushes it and syncs it if
+ *              asked. The caller holds the lock.
+ * @param fp: The list, or NULL if it isn't open yet.
+ * @returns false if the lines couldn't be written.
+*/
+static bool writeHeld(pagedir_t* pagedir, FILE** fp, const char* name, heldLines_t* held, const bool sync){
+    if (held->len == 0) return true;
+    if (*fp == NULL){
+        char* path = pathOf(pagedir->directory, name);
+        if (trimTable(path)) *fp = fopen(path, "a");
+        mem_free(path);
+        if (*fp == NULL){
+            held->len = 0;
+            return false;
+        }
+    }
+    bool ok = fwrite(held->text, 1, held->len, *fp) == (size_t)held->len;
+    held->len = 0;
+    return ok && fflush(*fp) == 0 && (!sync || fsync(fileno(*fp)) == 0);
+}
+
+/***
+ * Description: Reads the HTML of a document in the archive: straight from its segment, or
+ *              out of its block once expanded. The caller holds the lock.
+ * @returns the HTML, which the caller must free, or NULL if it can't be read.
+*/
+static char* readHTML(pagedir_t* pagedir, const pageEntry_t* entry){
+    if (pagedir->layout == PAGEDIR_COMPRESSED){
+        if (!expandBlock(pagedir, entry->segment, entry->block) || entry->offset + entry->length > pagedir->cachedLen){
+            return NULL;
+        }
+        char* html = mem_assert(malloc(entry->length + 1), "Error: Couldn't allocate memory for html");
+        memcpy(html, pagedir->cached + entry->offset, entry->length);
+        html[entry->length] = '\0';
+        return html;
+    }
+    int fd = segmentFd(pagedir, entry->segment);
+    char* html = mem_assert(malloc(entry->length + 1), "Error: Couldn't allocate memory for html");
+    long got = 0;
+    ssize_t n;
+    while (fd >= 0 && got < entry->length && (n = pread(fd, html + got, entry->length - got, entry->offset + got)) > 0){
+        got += n;
+    }
+    if (got != entry->length){
+        free(html);
+        return NULL;
+    }
+    html[got] = '\0';
+    return html;
+}
+
+/***
+ * Description: Expands the block starting at offset block of a segment into pagedir->cached,
+ *              unless that is the block already there. The caller holds the lock.
+ * @returns false if the block can't be read or is corrupt.
+*/
+static bool expandBlock(pagedir_t* pagedir, const int segment, const long block){
+    if (pagedir->cached != NULL && pagedir->cachedSegment == segment && pagedir->cachedBlock == block){
+        return true;
+    }
+    int fd = segmentFd(pagedir, segment);
+    char header[BLOCK_HEADER_BYTES + 1];
+    ssize_t n = fd >= 0 ? pread(fd, header, BLOCK_HEADER_BYTES, block) : -1;
+    if (n <= 0) return false;
+    header[n] = '\0';
+    long rawLen, length;
+    int start = 0;
+    if (sscanf(header, "TSE-BLOCK %ld %ld\n%n", &rawLen, &length, &start) != 2 || start == 0
+        || rawLen < 0 || length < 0){
+        return false;
+    }
+    char* compressed = mem_assert(mem_malloc(length > 0 ? length : 1), "Error: Couldn't allocate memory for block");
+    long got = 0;
+    while (got < length && (n = pread(fd, compressed + got, length - got, block + start + got)) > 0){
+        got += n;
+    }
+    if (pagedir->cached) mem_free(pagedir->cached);
+    pagedir->cached = mem_assert(mem_malloc(rawLen > 0 ? rawLen : 1), "Error: Couldn't allocate memory for block");
+    bool ok = got == length && codec_expand(compressed, length, pagedir->cached, rawLen);
+    mem_free(compressed);
+    if (!ok){
+        mem_free(pagedir->cached);
+        pagedir->cached = NULL;
+        return false;
+    }
+    pagedir->cachedLen = rawLen;
+    pagedir->cachedSegment = segment;
+    pagedir->cachedBlock = block;
+    return true;
+}
+
+/***
+ * Description: Cuts the offset table (or a metadata list) back to its last complete line,
+ *              so lines appended after a crash don't run on from a torn one.
+ * @param path: The table's path; a missing table is fine.
+ * @returns false if the table couldn't be read or cut.
+*/
+static bool trimTable(const char* path){
+    int fd = open(path, O_RDWR);
+    if (fd < 0) return true;
+    off_t end = lseek(fd, 0, SEEK_END);
+    char c = '\n';
+    while (end > 0 && pread(fd, &c, 1, end - 1) == 1 && c != '\n'){
+        end--;
+    }
+    bool ok = c == '\n' || end == 0 ? ftruncate(fd, end) == 0 : false;
+    close(fd);
+    return ok;
+}
+
+/***
+ * Description: Reads the offset table into pagedir->entries, if it hasn't been yet. Later
+ *              lines replace earlier ones for the same docID, and a torn last line is
+ *              ignored. The caller holds the lock.
+*/
+static void loadTable(pagedir_t* pagedir){
+    if (pagedir->loaded) return;
+    pagedir->loaded = true;
+    char* path = pathOf(pagedir->directory, TABLE_NAME);
+    FILE* fp = fopen(path, "r");
+    mem_free(path);
+    if (fp == NULL) return;
+
+    char* line = NULL;
+    size_t lineCap = 0;
+    ssize_t n;
+    while ((n = getline(&line, &lineCap, fp)) > 0){
+        if (line[n - 1] != '\n') break;
+        line[n - 1] = '\0';
+        int docID, segment, depth, offset = 0;
+        long block = -1, start, length;
+        if (sscanf(line, "- %d", &docID) == 1){
+            discardEntries(pagedir, docID);
+            continue;
+        }
+        bool parsed = pagedir->layout == PAGEDIR_COMPRESSED
+            ? sscanf(line, "%d %d %ld %ld %ld %d %n", &docID, &segment, &block, &start, &length, &depth, &offset) == 6 && block >= 0
+            : sscanf(line, "%d %d %ld %ld %d %n", &docID, &segment, &start, &length, &depth, &offset) == 5;
+        if (!parsed || offset == 0 || docID < 0 || segment < 0 || start < 0 || length < 0){
+            continue;
+        }
+        if (docID >= pagedir->numEntries){
+            int size = pagedir->numEntries > 0 ? pagedir->numEntries : 1024;
+            while (size <= docID) size *= 2;
+            pageEntry_t* bigger = mem_assert(mem_calloc(size, sizeof(pageEntry_t)), "Error: Couldn't allocate memory for page table");
+            if (pagedir->entries){
+                memcpy(bigger, pagedir->entries, pagedir->numEntries * sizeof(pageEntry_t));
+                mem_free(pagedir->entries);
+            }
+            pagedir->entries = bigger;
+            pagedir->numEntries = size;
+        }
+        pageEntry_t* entry = &pagedir->entries[docID];
+        if (entry->url) mem_free(entry->url);
+        entry->url = mem_assert(mem_malloc(strlen(line + offset) + 1), "Error: Couldn't allocate memory for URL");
+        strcpy(entry->url, line + offset);
+        entry->depth = depth;
+        entry->segment = segment;
+        entry->block = block;
+        entry->offset = start;
+        entry->length = length;
+    }
+    free(line);
     fclose(fp);
+}
+
+/***
+ * Description: Reads .validators into pagedir->known, if it hasn't been yet. Later lines
+ *              replace earlier ones for the same docID, and a torn last line is ignored.
+ *              The caller holds the lock.
+*/
+static void loadValidators(pagedir_t* pagedir){
+    if (pagedir->validatorsLoaded) return;
+    pagedir->validatorsLoaded = true;
+    char* path = pathOf(pagedir->directory, VALIDATORS_NAME);
+    FILE* fp = fopen(path, "r");
     mem_free(path);
+    if (fp == NULL) return;
 
-}
\ No newline at end of file
+    char* line = NULL;
+    size_t lineCap = 0;
+    ssize_t n;
+    while ((n = getline(&line, &lineCap, fp)) > 0){
+        if (line[n - 1] != '\n') break;
+        line[n - 1] = '\0';
+        // "docID etag lastModified": the ETag has no spaces, the date runs to the end
+        int docID, etagStart = 0, etagEnd = 0;
+        if (sscanf(line, "%d %n%*s%n", &docID, &etagStart, &etagEnd) != 1 || etagEnd == 0 || docID < 0
+            || line[etagEnd] != ' '){
+            continue;
+        }
+        line[etagEnd] = '\0';
+        char* etag = line + etagStart;
+        char* lastModified = line + etagEnd + 1;
+        if (docID >= pagedir->numKnown){
+            int size = pagedir->numKnown > 0 ? pagedir->numKnown : 1024;
+            while (size <= docID) size *= 2;
+            validators_t* bigger = mem_assert(mem_calloc(size, sizeof(validators_t)), "Error: Couldn't allocate memory for validators");
+            if (pagedir->known){
+                memcpy(bigger, pagedir->known, pagedir->numKnown * sizeof(validators_t));
+                mem_free(pagedir->known);
+            }
+            pagedir->known = bigger;
+            pagedir->numKnown = size;
+        }
+        validators_t* known = &pagedir->known[docID];
+        if (known->etag) mem_free(known->etag);
+        if (known->lastModified) mem_free(known->lastModified);
+        known->etag = known->lastModified = NULL;
+        if (strcmp(etag, "-") != 0){
+            known->etag = mem_assert(mem_malloc(strlen(etag) + 1), "Error: Couldn't allocate memory for validators");
+            strcpy(known->etag, etag);
+        }
+        if (strcmp(lastModified, "-") != 0){
+            known->lastModified = mem_assert(mem_malloc(strlen(lastModified) + 1), "Error: Couldn't allocate memory for validators");
+            strcpy(known->lastModified, lastModified);
+        }
+        known->recorded = true;
+    }
+    free(line);
+    fclose(fp);
+}
+
+/***
+ * Description: Forgets the table entries of docID and up.
+*/
+static void discardEntries(pagedir_t* pagedir, const int docID){
+    for (int id = docID; id < pagedir->numEntries; id++){
+        if (pagedir->entries[id].url){
+            mem_free(pagedir->entries[id].url);
+            pagedir->entries[id].url = NULL;
+        }
+    }
+}
+
+/***
+ * Description: Returns a descriptor for reading segment number segment, opening it the
+ *              first time. The caller holds the lock.
+ * @returns the descriptor, or -1 if the segment can't be opened.
+*/
+static int segmentFd(pagedir_t* pagedir, const int segment){
+    if (segment >= pagedir->numSegmentFds){
+        int size = pagedir->numSegmentFds > 0 ? pagedir->numSegmentFds : 8;
+        while (size <= segment) size *= 2;
+        int* bigger = mem_assert(mem_malloc(size * sizeof(int)), "Error: Couldn't allocate memory for segments");
+        for (int i = 0; i < size; i++){
+            bigger[i] = i < pagedir->numSegmentFds ? pagedir->segmentFds[i] : -1;
+        }
+        if (pagedir->segmentFds) mem_free(pagedir->segmentFds);
+        pagedir->segmentFds = bigger;
+        pagedir->numSegmentFds = size;
+    }
+    if (pagedir->segmentFds[segment] < 0){
+        char* path = segmentPath(pagedir->directory, segment);
+        pagedir->segmentFds[segment] = open(path, O_RDONLY);
+        mem_free(path);
+    }
+    return pagedir->segmentFds[segment];
+}
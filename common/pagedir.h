@@ -1,14 +1,109 @@
 /************************ __PAGEDIR_H***********************/
 /* Interace for functions used to initiate directory to save
- * webpages scanned and fetched.*/
+ * webpages scanned and fetched.
+ *
+ * A page directory holds its documents in one of two layouts, named in its .crawler
+ * file:
+ *   files:   one file per document, pageDirectory/docID, holding the URL, the depth
+ *            and the HTML (an empty .crawler, as every older crawl left).
+ *   archive: documents appended, many to a file, to segments pageDirectory/pages.N,
+ *            each record headed by "TSE-DOC docID depth length" and the URL; the
+ *            offset table pageDirectory/pages.idx has a line
+ *            "docID segment offset length depth URL" per document, locating its HTML.
+ *            A later line for the same docID replaces an earlier one.
+ *   compressed: an archive whose segments hold blocks of about 256KB of HTML, each
+ *            compressed on its own (codec.h) under a "TSE-BLOCK rawLength length"
+ *            line; the table line "docID segment block offset length depth URL"
+ *            locates the block and the HTML within it once expanded, so reading a
+ *            document expands just its block.
+ * A pagedir_t opened on any of them reads any document by docID and writes new ones.
+ *
+ * Documents written with pagedir_writeMeta also leave lines in two lists beside them:
+ *   .validators: "docID etag lastModified" per document, the HTTP validators it was
+ *            fetched with ("-" for none), for a recrawl to send back so that unchanged
+ *            pages needn't be downloaded again. A later line replaces an earlier one.
+ *   .changes: the change list a recrawl leaves for an incremental indexer, a line
+ *            "A docID URL", "M docID URL" or "D docID URL" for every document it
+ *            added, modified or removed (a removed document is saved with no HTML, so
+ *            docIDs stay dense). A consumer reads it and then deletes it.
+ * Their lines are written only once the documents they are about have been: with the
+ * archive table lines, or once the page files are synced. */
 #ifndef __PAGEDIR_H
 #define __PAGEDIR_H
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include "webpage.h"
+
+typedef enum { PAGEDIR_FILES, PAGEDIR_ARCHIVE, PAGEDIR_COMPRESSED } pagedirLayout_t;
+
+typedef struct pagedir pagedir_t;
+
+#define PAGEDIR_ADDED 'A'
+#define PAGEDIR_MODIFIED 'M'
+#define PAGEDIR_REMOVED 'D'
+
+/* What is kept with a document besides its page. */
+typedef struct pageMeta {
+    const char* etag;           // ETag it was fetched with, or NULL
+    const char* lastModified;   // Last-Modified date it was fetched with, or NULL
+    char change;                // PAGEDIR_ADDED, _MODIFIED or _REMOVED to list it in the
+                                // change list; 0 not to
+} pageMeta_t;
 
 bool pagedir_init(const char* pageDirectory);
-void pagedir_save(const webpage_t* page, const char* pageDirectory, const int docID);
 
-#endif
\ No newline at end of file
+/* Loads the document saved as pageDirectory/docID back into a webpage (URL, depth
+ * and the stored HTML), without touching the network. Returns NULL if there is no
+ * such document; caller is responsible for webpage_delete. */
+webpage_t* pagedir_load(const char* pageDirectory, const int docID);
+
+/* Starts a new crawl in pageDirectory with the given layout, writing its .crawler file
+ * and deleting any archive an earlier crawl left. Returns false if that fails. */
+bool pagedir_create(const char* pageDirectory, const pagedirLayout_t layout);
+
+/* Opens the page directory made by pagedir_create (or pagedir_init) for reading and
+ * writing documents. Returns NULL if it has no .crawler file; caller must pagedir_close. */
+pagedir_t* pagedir_open(const char* pageDirectory);
+
+/* Returns the layout of an open page directory. */
+pagedirLayout_t pagedir_layout(pagedir_t* pagedir);
+
+/* Saves page as document docID. Thread-safe. Returns false if it couldn't be written.
+ * Archive documents are listed in the table once the segment is next flushed (as it
+ * fills, and on pagedir_sync or pagedir_close); compressed documents are held until
+ * their block fills and only then written. Nothing is synced to disk before
+ * pagedir_sync. */
+bool pagedir_write(pagedir_t* pagedir, const webpage_t* page, const int docID);
+
+/* Saves page as document docID, as pagedir_write does, and lists its validators and
+ * change (see above) once it is written out. Thread-safe. */
+bool pagedir_writeMeta(pagedir_t* pagedir, const webpage_t* page, const int docID, const pageMeta_t* meta);
+
+/* Looks up the validators document docID was last saved with; .validators is read the
+ * first time. Sets etag and lastModified to new strings, which the caller must free,
+ * or to NULL. Returns false if none were recorded. Thread-safe. */
+bool pagedir_getValidators(pagedir_t* pagedir, const int docID, char** etag, char** lastModified);
+
+/* Loads document docID, as pagedir_load does. The archive's offset table is read the
+ * first time, so documents written after that through another pagedir_t aren't seen.
+ * Returns NULL if there is no such document; caller must webpage_delete it. */
+webpage_t* pagedir_read(pagedir_t* pagedir, const int docID);
+
+/* Returns the URL of document docID without reading its HTML, or NULL if there is no
+ * such document; caller must free it. */
+char* pagedir_getURL(pagedir_t* pagedir, const int docID);
+
+/* Removes documents docID and up (up to the first missing one, for files), so a
+ * resumed crawl can hand those docIDs out again. Returns false if that fails. */
+bool pagedir_discard(pagedir_t* pagedir, const int docID);
+
+/* Syncs everything written so far to disk (but not a compressed block still being
+ * gathered), in one pass. Thread-safe. Returns false if anything couldn't be written. */
+bool pagedir_sync(pagedir_t* pagedir);
+
+/* Closes the page directory, flushing whatever was written. */
+void pagedir_close(pagedir_t* pagedir);
+
+#endif
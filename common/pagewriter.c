@@ -0,0 +1,240 @@
+/**
+ * pagewriter.c
+ *
+ * Description: Implements the page writer as a ring of queued pages guarded by a mutex,
+ *              with one condition variable the writer thread waits on for pages and
+ *              another that pagewriter_put waits on for room. The writer moves every
+ *              queued page into its own batch at once, so putters are released before
+ *              any of the batch is written, and writes the batch without the lock.
+ */
+#define _POSIX_C_SOURCE 200809L    // clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "pagewriter.h"
+#include "pagedir.h"
+#include "webpage.h"
+#include "mem.h"
+
+// A page waiting to be written
+typedef struct queuedPage {
+    webpage_t* page;
+    int docID;
+    bool hasMeta;               // whether the three below are to be saved with it
+    char* etag;
+    char* lastModified;
+    char change;
+} queuedPage_t;
+
+typedef struct pagewriter {
+    pagedir_t* pages;
+    void (*saved)(void* arg, webpage_t* page, const int docID, const bool success, const long writeUs);
+    void* arg;
+    queuedPage_t* queue;        // ring of capacity pages
+    int capacity;
+    int head;                   // next page to write
+    int count;
+    bool writing;               // a batch is being written
+    bool stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t queued;      // signaled when a page is queued, and on delete
+    pthread_cond_t room;        // signaled when the writer empties the queue, and after each batch
+    pthread_t writer;
+    // Counters for pagewriter_report
+    long written;
+    long batches;
+    long waits;
+    long waitMs;
+} pagewriter_t;
+
+static void* writePages(void* arg);
+static char* copyOf(const char* string);
+static long elapsedMs(const struct timespec* since);
+static long elapsedUs(const struct timespec* since);
+
+
+/**
+ * Description: Creates a page writer and starts its thread.
+ * @param pages: the page directory.
+ * @param capacity: most pages queued at once.
+ * @param saved: called after each page is written, with how long writing it took.
+ * @param arg: passed to saved.
+ * @returns pointer to the new page writer.
+*/
+pagewriter_t* pagewriter_new(pagedir_t* pages, const int capacity,
+                             void (*saved)(void* arg, webpage_t* page, const int docID, const bool success,
+                                           const long writeUs),
+                             void* arg){
+    if (pages == NULL || saved == NULL) return NULL;
+    pagewriter_t* writer = mem_assert(mem_calloc(1, sizeof(pagewriter_t)), "Error: Failed to allocate memory for page writer.\n");
+    writer->pages = pages;
+    writer->saved = saved;
+    writer->arg = arg;
+    writer->capacity = capacity > 0 ? capacity : 1;
+    writer->queue = mem_assert(mem_malloc(writer->capacity * sizeof(queuedPage_t)), "Error: Failed to allocate memory for page writer.\n");
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->queued, NULL);
+    pthread_cond_init(&writer->room, NULL);
+    if (pthread_create(&writer->writer, NULL, writePages, writer) != 0){
+        fprintf(stderr, "Error: Failed to start page writer.\n");
+        exit(1);
+    }
+    return writer;
+}
+
+/**
+ * Description: Queues a page to be saved, waiting while the queue is full.
+ * @param writer: the page writer.
+ * @param page: the page; the writer deletes it.
+ * @param docID: its document ID.
+ * @param meta: its metadata, or NULL.
+*/
+void pagewriter_put(pagewriter_t* writer, webpage_t* page, const int docID, const pageMeta_t* meta){
+    if (writer == NULL || page == NULL) return;
+    // Copied outside the lock
+    char* etag = meta ? copyOf(meta->etag) : NULL;
+    char* lastModified = meta ? copyOf(meta->lastModified) : NULL;
+    pthread_mutex_lock(&writer->lock);
+    if (writer->count == writer->capacity){
+        // The disk is behind: hold the crawl back until the writer takes the queue
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        while (writer->count == writer->capacity){
+            pthread_cond_wait(&writer->room, &writer->lock);
+        }
+        writer->waits++;
+        writer->waitMs += elapsedMs(&start);
+    }
+    queuedPage_t* slot = &writer->queue[(writer->head + writer->count) % writer->capacity];
+    slot->page = page;
+    slot->docID = docID;
+    slot->hasMeta = meta != NULL;
+    slot->etag = etag;
+    slot->lastModified = lastModified;
+    slot->change = meta ? meta->change : 0;
+    writer->count++;
+    pthread_cond_signal(&writer->queued);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/**
+ * Description: Waits until every page queued so far has been written.
+ * @param writer: the page writer.
+*/
+void pagewriter_drain(pagewriter_t* writer){
+    if (writer == NULL) return;
+    pthread_mutex_lock(&writer->lock);
+    while (writer->count > 0 || writer->writing){
+        pthread_cond_wait(&writer->room, &writer->lock);
+    }
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/**
+ * Description: Prints the page writer's counters on one line.
+ * @param writer: the page writer.
+ * @param fp: where to print.
+*/
+void pagewriter_report(pagewriter_t* writer, FILE* fp){
+    if (writer == NULL || fp == NULL) return;
+    pthread_mutex_lock(&writer->lock);
+    fprintf(fp, "pages: %ld written in %ld batches, %ld waits for room (%ld ms)\n",
+            writer->written, writer->batches, writer->waits, writer->waitMs);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/**
+ * Description: Writes the pages still queued, stops the writer and deletes it.
+ * @param writer: the page writer to delete.
+*/
+void pagewriter_delete(pagewriter_t* writer){
+    if (writer == NULL) return;
+    pthread_mutex_lock(&writer->lock);
+    writer->stopping = true;
+    pthread_cond_signal(&writer->queued);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->writer, NULL);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->queued);
+    pthread_cond_destroy(&writer->room);
+    mem_free(writer->queue);
+    mem_free(writer);
+}
+
+/***
+ * Description: Body of the writer thread. Waits for pages, takes all of them as a batch,
+ *              writes them and reports each; exits once the queue is empty after a delete.
+ * @param arg: the page writer.
+ * @returns NULL
+*/
+static void* writePages(void* arg){
+    pagewriter_t* writer = arg;
+    queuedPage_t* batch = mem_assert(mem_malloc(writer->capacity * sizeof(queuedPage_t)), "Error: Failed to allocate memory for page writer.\n");
+    pthread_mutex_lock(&writer->lock);
+    while (true){
+        while (writer->count == 0 && !writer->stopping){
+            pthread_cond_wait(&writer->queued, &writer->lock);
+        }
+        if (writer->count == 0) break;
+        int size = writer->count;
+        for (int i = 0; i < size; i++){
+            batch[i] = writer->queue[(writer->head + i) % writer->capacity];
+        }
+        writer->head = (writer->head + size) % writer->capacity;
+        writer->count = 0;
+        writer->writing = true;
+        pthread_cond_broadcast(&writer->room);
+        pthread_mutex_unlock(&writer->lock);
+
+        for (int i = 0; i < size; i++){
+            queuedPage_t* queued = &batch[i];
+            pageMeta_t meta = { .etag = queued->etag, .lastModified = queued->lastModified, .change = queued->change };
+            struct timespec started;
+            clock_gettime(CLOCK_MONOTONIC, &started);
+            bool success = pagedir_writeMeta(writer->pages, queued->page, queued->docID, queued->hasMeta ? &meta : NULL);
+            (*writer->saved)(writer->arg, queued->page, queued->docID, success, elapsedUs(&started));
+            webpage_delete(queued->page);
+            if (queued->etag) mem_free(queued->etag);
+            if (queued->lastModified) mem_free(queued->lastModified);
+        }
+        pthread_mutex_lock(&writer->lock);
+        writer->written += size;
+        writer->batches++;
+        writer->writing = false;
+        pthread_cond_broadcast(&writer->room);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    mem_free(batch);
+    return NULL;
+}
+
+/***
+ * Description: Copies a string.
+ * @returns the copy, or NULL if string is NULL.
+*/
+static char* copyOf(const char* string){
+    if (string == NULL) return NULL;
+    char* copy = mem_assert(mem_malloc(strlen(string) + 1), "Error: Failed to allocate memory for page writer.\n");
+    strcpy(copy, string);
+    return copy;
+}
+
+/***
+ * Description: Returns the milliseconds from since until now, on the monotonic clock.
+*/
+static long elapsedMs(const struct timespec* since){
+    return elapsedUs(since) / 1000;
+}
+
+/***
+ * Description: Returns the microseconds from since until now, on the monotonic clock.
+*/
+static long elapsedUs(const struct timespec* since){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000000 + (now.tv_nsec - since->tv_nsec) / 1000;
+}
@@ -0,0 +1,73 @@
+/**
+ * pagewriter.h
+ *
+ * Interface for the crawler's page writer: a background thread that saves fetched
+ * pages to the page directory, so that the crawl never waits on the disk. Pages are
+ * handed over through a bounded queue; the writer takes everything queued at once and
+ * writes it as a batch. When the queue is full, pagewriter_put waits for room, which
+ * slows the crawl to the pace of the disk instead of letting pages pile up in memory:
+ * at most capacity pages are queued, besides the batch being written.
+ *
+ * Each page's outcome is reported to a callback, from the writer thread, once the
+ * page has been written (or failed to be): the crawl decides what a failure means.
+ * Nothing is synced here; pagedir_sync does that, once per checkpoint.
+ */
+#ifndef __PAGEWRITER_H
+#define __PAGEWRITER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "webpage.h"
+#include "pagedir.h"
+
+typedef struct pagewriter pagewriter_t;
+
+/***
+ * Description: Creates a page writer and starts its thread.
+ * @param pages: the open page directory pages are written to.
+ * @param capacity: most pages queued at once (at least 1).
+ * @param saved: called from the writer thread after each page is written, with success
+ *               false if it couldn't be and how many microseconds writing it took; the
+ *               page is deleted after it returns.
+ * @param arg: passed to saved.
+ * @returns pointer to the new page writer; exits if out of memory.
+ */
+pagewriter_t* pagewriter_new(pagedir_t* pages, const int capacity,
+                             void (*saved)(void* arg, webpage_t* page, const int docID, const bool success,
+                                           const long writeUs),
+                             void* arg);
+
+/***
+ * Description: Queues page to be saved as document docID, waiting while the queue is
+ *              full. Thread-safe.
+ * @param writer: the page writer.
+ * @param page: the page, with its HTML; the writer takes it over and deletes it.
+ * @param docID: its document ID.
+ * @param meta: its validators and change, saved with it (pagedir_writeMeta); copied. Or NULL.
+ */
+void pagewriter_put(pagewriter_t* writer, webpage_t* page, const int docID, const pageMeta_t* meta);
+
+/***
+ * Description: Waits until every page queued so far has been written (whether or not
+ *              it could be). Thread-safe.
+ * @param writer: the page writer.
+ */
+void pagewriter_drain(pagewriter_t* writer);
+
+/***
+ * Description: Prints the pages written, the batches they were written in, and how often
+ *              and how long putting a page had to wait for room, on one line.
+ * @param writer: the page writer.
+ * @param fp: where to print.
+ */
+void pagewriter_report(pagewriter_t* writer, FILE* fp);
+
+/***
+ * Description: Writes every page still queued, stops the writer thread and deletes it.
+ *              The page directory is left open.
+ * @param writer: the page writer to delete.
+ */
+void pagewriter_delete(pagewriter_t* writer);
+
+#endif
@@ -11,12 +11,13 @@
  *   query_new: Creates a new empty query result set.
  *   query_add_document: Adds a document to the query result set.
  *   query_search_index: Searches an index for a word and adds matching documents.
+ *   query_search_map: Searches a mapped index for a word and adds matching documents.
  *   query_intersect: Returns documents common to two query results.
  *   query_union: Returns all unique documents from two query results.
  *   query_delete: Deletes a query result and its documents.
  * 
  * Internal Helpers:
- *   query_search_helper: Helper to add documents from index counters.
+ *   query_search_helper: Helper to add documents from index counters or mapped postings.
  *   query_intersect_helper: Helper for computing intersection of query results.
  *   query_seen_docs_union_helper: Helper for building union of documents.
  *   document_delete_helper: Deletes documents in a query bag.
@@ -27,6 +28,7 @@
 #include <stdbool.h>
 #include "bag.h"
 #include "index.h"
+#include "indexmap.h"
 #include "document.h"
 #include "counters.h"
 #include "hashtable.h"
@@ -120,6 +122,18 @@ void query_search_index(query_t* qresults, index_t* index, char* word){
     }
 }
 
+/***
+ * Description: Searches a mapped binary index for a word and adds matching documents to the query result.
+ * @param qresults: query bag to insert results into.
+ * @param map: mapped index to search.
+ * @param word: word to search for.
+ */
+void query_search_map(query_t* qresults, indexmap_t* map, char* word){
+    if (qresults && map && word){
+        indexmap_iterate(map, word, qresults, query_search_helper);
+    }
+}
+
 /***
  * Description: Returns a new query result set containing only documents present in both inputs.
  * Caller is responsible for freeing qresults1 & qresults2 later.
@@ -206,7 +220,7 @@ static void document_delete_helper(void* item){
 }
 
 /***
- * Description: Helper function used in counters_iterate to create a document from a docID and count,
+ * Description: Helper function used in counters_iterate and indexmap_iterate to create a document from a docID and count,
  *              then add it to the query result set.
  * @param arg: pointer to the query result set (query_t*).
  * @param docID: integer document ID.
@@ -14,6 +14,7 @@
 #include <stdbool.h>
 #include "bag.h"
 #include "index.h"
+#include "indexmap.h"
 #include "document.h"
 #include "counters.h"
 #include "hashtable.h"
@@ -68,6 +69,14 @@ document_t* query_extract(query_t* qresults);
  */
 void query_search_index(query_t* qresults, index_t* index, char* word);
 
+/***
+ * Description: Searches a mapped binary index for a word and adds matching documents to the query result.
+ * @param qresults: query bag to insert results into.
+ * @param map: mapped index to search.
+ * @param word: word to search for.
+ */
+void query_search_map(query_t* qresults, indexmap_t* map, char* word);
+
 /***
  * Description: Returns a new query result set containing only documents present in both inputs.
  * Caller is responsible for freeing qresults1 & qresults2 later.
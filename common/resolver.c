@@ -0,0 +1,208 @@
+/**
+ * resolver.c
+ *
+ * Description: Implements the crawler's DNS cache as a hashtable from "host:port" to
+ *              the addresses getaddrinfo last gave, and when they expire, guarded by one
+ *              mutex. getaddrinfo doesn't report the record's TTL, so every answer is
+ *              kept for the fixed time given to resolver_new. Entries are never
+ *              removed, only refreshed: a crawl only ever sees a handful of hosts.
+ *
+ *              The lock is not held during getaddrinfo, so a slow lookup doesn't stall
+ *              the threads resolving other hosts; two threads missing on the same host
+ *              at once both look it up, and the later answer is kept.
+ */
+#define _POSIX_C_SOURCE 200809L    // clock_gettime, getaddrinfo
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include "resolver.h"
+#include "hashtable.h"
+#include "mem.h"
+
+#define HOST_SLOTS 31               // hashtable slots for hosts
+
+typedef struct answer {
+    resolverAddrs_t addrs;      // count 0 if the host didn't resolve
+    long expires;               // monotonic time (ms) after which the answer is stale
+} answer_t;
+
+typedef struct resolver {
+    hashtable_t* answers;       // "host:port" -> answer_t*
+    long ttlMs;
+    long negativeTtlMs;
+    resolverStats_t stats;
+    answer_t connectTo;         // if it has addresses, the answer to every lookup
+    pthread_mutex_t lock;
+} resolver_t;
+
+static void answer_delete(void* item);
+static long nowMs(void);
+
+
+/**
+ * Description: Creates a new empty DNS cache.
+ * @param ttlMs: how long a resolved address is reused.
+ * @param negativeTtlMs: how long a failed lookup is remembered.
+ * @returns pointer to the new cache.
+*/
+resolver_t* resolver_new(const long ttlMs, const long negativeTtlMs){
+    resolver_t* resolver = mem_assert(mem_malloc(sizeof(resolver_t)), "Error: Failed to allocate memory for resolver.\n");
+    resolver->answers = mem_assert(hashtable_new(HOST_SLOTS), "Error: Failed to allocate memory for resolver hosts.\n");
+    resolver->ttlMs = ttlMs > 0 ? ttlMs : 0;
+    resolver->negativeTtlMs = negativeTtlMs > 0 ? negativeTtlMs : 0;
+    resolver->stats = (resolverStats_t){0};
+    resolver->connectTo.addrs.count = 0;
+    pthread_mutex_init(&resolver->lock, NULL);
+    return resolver;
+}
+
+/**
+ * Description: Finds the addresses of host:port, from the cache when it can.
+ * @param resolver: the cache.
+ * @param host: the host name.
+ * @param port: the port.
+ * @param addrs: filled with the addresses.
+ * @returns false if the host doesn't resolve.
+*/
+bool resolver_lookup(resolver_t* resolver, const char* host, const int port, resolverAddrs_t* addrs){
+    if (resolver == NULL || host == NULL || addrs == NULL) return false;
+    char key[strlen(host) + 8];
+    sprintf(key, "%s:%d", host, port);
+
+    pthread_mutex_lock(&resolver->lock);
+    answer_t* answer = resolver->connectTo.addrs.count > 0 ? &resolver->connectTo : hashtable_find(resolver->answers, key);
+    if (answer != NULL && (answer == &resolver->connectTo || answer->expires > nowMs())){
+        *addrs = answer->addrs;
+        bool found = addrs->count > 0;
+        if (!found) resolver->stats.negativeHits++;
+        resolver->stats.hits++;
+        pthread_mutex_unlock(&resolver->lock);
+        return found;
+    }
+    pthread_mutex_unlock(&resolver->lock);
+
+    // Not cached, or stale: ask getaddrinfo without holding the lock
+    long start = nowMs();
+    bool found = resolver_resolve(host, port, addrs);
+    long finished = nowMs();
+
+    pthread_mutex_lock(&resolver->lock);
+    answer = hashtable_find(resolver->answers, key);
+    if (answer == NULL){
+        answer = mem_assert(mem_malloc(sizeof(answer_t)), "Error: Failed to allocate memory for resolver answer.\n");
+        hashtable_insert(resolver->answers, key, answer);
+    }
+    answer->addrs = *addrs;
+    if (found){
+        answer->expires = finished + resolver->ttlMs;
+    } else {
+        answer->expires = finished + resolver->negativeTtlMs;
+        resolver->stats.failures++;
+    }
+    resolver->stats.misses++;
+    resolver->stats.lookupMs += finished - start;
+    pthread_mutex_unlock(&resolver->lock);
+    return found;
+}
+
+/**
+ * Description: Finds the addresses of host:port with getaddrinfo, keeping the first
+ *              RESOLVER_MAX_ADDRS in the order it sorted them.
+ * @param host: the host name.
+ * @param port: the port.
+ * @param addrs: filled with the addresses.
+ * @returns false if the host doesn't resolve.
+*/
+bool resolver_resolve(const char* host, const int port, resolverAddrs_t* addrs){
+    if (host == NULL || addrs == NULL) return false;
+    addrs->count = 0;
+    struct addrinfo hints = {0};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    char service[8];
+    sprintf(service, "%d", port);
+    struct addrinfo* result;
+    if (getaddrinfo(host, service, &hints, &result) != 0) return false;
+    for (struct addrinfo* ai = result; ai != NULL && addrs->count < RESOLVER_MAX_ADDRS; ai = ai->ai_next){
+        if (ai->ai_addrlen > sizeof(struct sockaddr_storage)) continue;
+        memcpy(&addrs->addr[addrs->count], ai->ai_addr, ai->ai_addrlen);
+        addrs->addrLen[addrs->count++] = ai->ai_addrlen;
+    }
+    freeaddrinfo(result);
+    return addrs->count > 0;
+}
+
+/**
+ * Description: Makes every later lookup answer with the addresses of host:port.
+ * @param resolver: the cache.
+ * @param host: the host to connect to.
+ * @param port: its port.
+ * @returns false if host doesn't resolve.
+*/
+bool resolver_connectTo(resolver_t* resolver, const char* host, const int port){
+    if (resolver == NULL || host == NULL) return false;
+    resolverAddrs_t addrs;
+    if (!resolver_lookup(resolver, host, port, &addrs)) return false;
+    pthread_mutex_lock(&resolver->lock);
+    resolver->connectTo.addrs = addrs;
+    pthread_mutex_unlock(&resolver->lock);
+    return true;
+}
+
+/**
+ * Description: Returns the cache's counters.
+ * @param resolver: the cache.
+*/
+resolverStats_t resolver_stats(resolver_t* resolver){
+    if (resolver == NULL) return (resolverStats_t){0};
+    pthread_mutex_lock(&resolver->lock);
+    resolverStats_t stats = resolver->stats;
+    pthread_mutex_unlock(&resolver->lock);
+    return stats;
+}
+
+/**
+ * Description: Prints the counters on one line.
+ * @param resolver: the cache.
+ * @param fp: where to print.
+*/
+void resolver_report(resolver_t* resolver, FILE* fp){
+    if (resolver == NULL || fp == NULL) return;
+    resolverStats_t stats = resolver_stats(resolver);
+    double meanMs = stats.misses > 0 ? (double)stats.lookupMs / stats.misses : 0;
+    fprintf(fp, "dns: %ld hits (%ld negative), %ld misses (%ld failed), %ld ms resolving, %.1f ms per lookup\n",
+            stats.hits, stats.negativeHits, stats.misses, stats.failures, stats.lookupMs, meanMs);
+}
+
+/**
+ * Description: Deletes the cache.
+ * @param resolver: the cache to delete.
+*/
+void resolver_delete(resolver_t* resolver){
+    if (resolver == NULL) return;
+    hashtable_delete(resolver->answers, answer_delete);
+    pthread_mutex_destroy(&resolver->lock);
+    mem_free(resolver);
+}
+
+/***
+ * Description: Frees a cached answer; passed to hashtable_delete.
+ * @param item: the answer.
+*/
+static void answer_delete(void* item){
+    mem_free(item);
+}
+
+/***
+ * Description: Returns the monotonic clock in milliseconds.
+*/
+static long nowMs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,99 @@
+/**
+ * resolver.h
+ *
+ * Interface for the crawler's DNS cache. Host names are resolved with getaddrinfo
+ * and its addresses are remembered for a while, so fetching many pages from the
+ * same host resolves it once rather than once per page. Failed lookups are
+ * remembered too (for a shorter while), so a dead host doesn't cost a lookup for
+ * every link to it. The cache is thread-safe and may be shared by several fetchers.
+ */
+#ifndef __RESOLVER_H
+#define __RESOLVER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+
+typedef struct resolver resolver_t;
+
+#define RESOLVER_MAX_ADDRS 4        // addresses kept per host, in getaddrinfo's order
+
+/* A host's addresses, best first: a fetcher tries the next when one refuses, as when
+ * localhost is ::1 first but the server listens on 127.0.0.1 only. */
+typedef struct resolverAddrs {
+    int count;                  // 0 if the host doesn't resolve
+    struct sockaddr_storage addr[RESOLVER_MAX_ADDRS];
+    socklen_t addrLen[RESOLVER_MAX_ADDRS];
+} resolverAddrs_t;
+
+/* Lookup counters. Hits are answered from the cache; misses go to getaddrinfo, and
+ * lookupMs is the time they took, which is roughly what each hit saves. */
+typedef struct resolverStats {
+    long hits;                  // answered from the cache, found or not
+    long negativeHits;          // hits for a host known not to resolve
+    long misses;                // lookups passed to getaddrinfo
+    long failures;              // misses that didn't resolve
+    long lookupMs;              // total time spent in getaddrinfo
+} resolverStats_t;
+
+/***
+ * Description: Creates a new empty DNS cache.
+ * @param ttlMs: how long a resolved address is reused.
+ * @param negativeTtlMs: how long a failed lookup is remembered.
+ * @returns pointer to the new cache; exits if out of memory.
+ */
+resolver_t* resolver_new(const long ttlMs, const long negativeTtlMs);
+
+/***
+ * Description: Finds the addresses of host:port, from the cache if it holds an unexpired
+ *              answer and with getaddrinfo otherwise.
+ * @param resolver: the cache.
+ * @param host: the host name.
+ * @param port: the port.
+ * @param addrs: filled with the addresses.
+ * @returns false if the host doesn't resolve.
+ */
+bool resolver_lookup(resolver_t* resolver, const char* host, const int port, resolverAddrs_t* addrs);
+
+/***
+ * Description: Finds the addresses of host:port with getaddrinfo, without a cache.
+ * @param host: the host name.
+ * @param port: the port.
+ * @param addrs: filled with up to RESOLVER_MAX_ADDRS addresses.
+ * @returns false if the host doesn't resolve.
+ */
+bool resolver_resolve(const char* host, const int port, resolverAddrs_t* addrs);
+
+/***
+ * Description: Makes every later lookup, whatever its host and port, answer with the
+ *              addresses of host:port instead, as curl's --connect-to does; used to point
+ *              a crawl at a local stand-in for the real web site. Pages keep their URLs
+ *              and requests their Host header.
+ * @param resolver: the cache.
+ * @param host: the host to connect to.
+ * @param port: its port.
+ * @returns false if host doesn't resolve.
+ */
+bool resolver_connectTo(resolver_t* resolver, const char* host, const int port);
+
+/***
+ * Description: Returns the cache's counters.
+ * @param resolver: the cache.
+ */
+resolverStats_t resolver_stats(resolver_t* resolver);
+
+/***
+ * Description: Prints the counters on one line.
+ * @param resolver: the cache.
+ * @param fp: where to print.
+ */
+void resolver_report(resolver_t* resolver, FILE* fp);
+
+/***
+ * Description: Deletes the cache.
+ * @param resolver: the cache to delete.
+ */
+void resolver_delete(resolver_t* resolver);
+
+#endif
@@ -0,0 +1,340 @@
+/**
+ * scheduler.c
+ *
+ * Description: Implements the crawler's politeness scheduler. Each host has its own
+ *              queue of pages and the earliest time it may release the next one; a
+ *              hashtable finds a host's queue by name, and a list of all hosts is
+ *              scanned for the ready host that has been ready the longest. Crawls are
+ *              confined to a handful of hosts, so the scan is cheap.
+ *
+ *              Each host's pages are kept in a URL queue (urlqueue.h), breadth-first or
+ *              most-recent first (the order the crawler's bag used to give), holding a
+ *              bounded window in memory and spilling the rest to disk. Pages are queued
+ *              as their URL and depth only, and turned back into webpages on release.
+ *
+ *              With a scorer, each host's pages are kept in a URL heap (urlheap.h)
+ *              instead, keyed by their urlcanon fingerprint so that a page's score can
+ *              be raised as more links to it are found, and of the ready hosts the one
+ *              whose best page scores highest releases it.
+ */
+#define _POSIX_C_SOURCE 200809L    // clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "scheduler.h"
+#include "urlqueue.h"
+#include "urlheap.h"
+#include "urlcanon.h"
+#include "scorer.h"
+#include "webpage.h"
+#include "hashtable.h"
+#include "mem.h"
+
+#define HOST_SLOTS 31               // hashtable slots for hosts
+#define MAX_HOST_LENGTH 256         // longer host names are truncated
+
+typedef struct host {
+    char* name;
+    urlqueue_t* pages;          // URLs waiting, with their depth and when they were queued
+    urlheap_t* ranked;          // the same, by score, instead of pages when there is a scorer
+    long queued;                // number of pages waiting
+    long maxQueued;             // most pages waiting at once
+    long nextRelease;           // earliest time (ms) the next page may be released
+    long released;              // pages released so far
+    long totalWait;             // summed time released pages waited (ms)
+    long maxWait;               // longest time a released page waited (ms)
+    struct host* next;          // next host in the scheduler's list
+} host_t;
+
+typedef struct scheduler {
+    hashtable_t* byName;        // host name -> host_t*
+    host_t* hosts;              // every host seen, in order of first appearance
+    host_t* lastHost;
+    int numHosts;
+    int size;                   // pages queued over all hosts
+    int delayMs;
+    queueOrder_t order;
+    int window;                 // pages per host kept in memory before spilling
+    char* spillDirectory;       // where the hosts' queues spill, or NULL
+    const scorer_t* scorer;     // if not NULL, pages come out highest score first
+    FILE* log;                  // if not NULL, every page released is logged to it
+    long released;              // pages released over all hosts
+    long createdAt;             // when the scheduler was created (ms), for the log
+} scheduler_t;
+
+static host_t* findHost(scheduler_t* scheduler, const char* url, const bool create);
+static void hostName(const char* url, char* name);
+static void host_delete(host_t* host);
+static long nowMs(void);
+
+
+/**
+ * Description: Creates a new empty scheduler.
+ * @param delayMs: least time between two pages of the same host.
+ * @param order: the order pages of one host come out in.
+ * @param window: pages per host buffered in memory.
+ * @param spillDirectory: where to spill the rest, or NULL to keep everything in memory.
+ * @returns pointer to the new scheduler.
+*/
+scheduler_t* scheduler_new(const int delayMs, const queueOrder_t order, const int window, const char* spillDirectory){
+    scheduler_t* scheduler = mem_assert(mem_malloc(sizeof(scheduler_t)), "Error: Failed to allocate memory for scheduler.\n");
+    scheduler->byName = mem_assert(hashtable_new(HOST_SLOTS), "Error: Failed to allocate memory for scheduler hosts.\n");
+    scheduler->hosts = scheduler->lastHost = NULL;
+    scheduler->numHosts = 0;
+    scheduler->size = 0;
+    scheduler->delayMs = delayMs > 0 ? delayMs : 0;
+    scheduler->order = order;
+    scheduler->window = window;
+    scheduler->spillDirectory = NULL;
+    scheduler->scorer = NULL;
+    scheduler->log = NULL;
+    scheduler->released = 0;
+    scheduler->createdAt = nowMs();
+    if (spillDirectory != NULL){
+        scheduler->spillDirectory = mem_assert(mem_malloc(strlen(spillDirectory) + 1), "Error: Failed to allocate memory for scheduler.\n");
+        strcpy(scheduler->spillDirectory, spillDirectory);
+    }
+    return scheduler;
+}
+
+/**
+ * Description: Makes the scheduler release each host's pages highest score first.
+ * @param scheduler: the scheduler, with nothing queued yet.
+ * @param scorer: the scorer; the caller keeps it, and deletes it after the scheduler.
+*/
+void scheduler_setScorer(scheduler_t* scheduler, const scorer_t* scorer){
+    if (scheduler == NULL || scheduler->size > 0) return;
+    scheduler->scorer = scorer;
+}
+
+/**
+ * Description: Logs every page released to fp, one line each.
+ * @param scheduler: the scheduler.
+ * @param fp: where to log, or NULL to stop.
+*/
+void scheduler_setLog(scheduler_t* scheduler, FILE* fp){
+    if (scheduler == NULL) return;
+    scheduler->log = fp;
+}
+
+/**
+ * Description: Queues page on its host, creating the host on first sight. Only the URL
+ *              and depth are kept; the page itself is deleted. With a scorer, the page is
+ *              scored as having the one link to it that it was found by (none, at depth 0).
+ * @param scheduler: the scheduler.
+ * @param page: the page.
+*/
+void scheduler_insert(scheduler_t* scheduler, webpage_t* page){
+    if (scheduler == NULL || page == NULL) return;
+    const char* url = webpage_getURL(page);
+    int depth = webpage_getDepth(page);
+    host_t* host = findHost(scheduler, url, true);
+    if (host->ranked != NULL){
+        double score = scorer_score(scheduler->scorer, url, depth, depth > 0 ? 1 : 0);
+        urlheap_push(host->ranked, url, urlcanon_hash(url, strlen(url)), depth, nowMs(), score);
+    } else {
+        urlqueue_push(host->pages, url, depth, nowMs());
+    }
+    webpage_delete(page);
+    host->queued++;
+    if (host->queued > host->maxQueued) host->maxQueued = host->queued;
+    scheduler->size++;
+}
+
+/**
+ * Description: Counts one more link to a queued page, raising its score by the scorer's
+ *              in-link weight.
+ * @param scheduler: the scheduler.
+ * @param url: the page's URL, canonical.
+ * @param key: its urlcanon fingerprint.
+ * @returns false if the page isn't queued, or the scheduler has no scorer.
+*/
+bool scheduler_credit(scheduler_t* scheduler, const char* url, const uint64_t key){
+    if (scheduler == NULL || url == NULL || scheduler->scorer == NULL) return false;
+    host_t* host = findHost(scheduler, url, false);
+    return host != NULL && urlheap_raise(host->ranked, key, scorer_inlinkWeight(scheduler->scorer));
+}
+
+/**
+ * Description: Releases a page from the host that has been ready the longest.
+ * @param scheduler: the scheduler.
+ * @param waitMs: set to the time until a page can be released (-1 if none queued) when
+ *                none is released.
+ * @returns the page, or NULL.
+*/
+webpage_t* scheduler_next(scheduler_t* scheduler, long* waitMs){
+    if (waitMs != NULL) *waitMs = -1;
+    if (scheduler == NULL || scheduler->size == 0) return NULL;
+
+    long now = nowMs();
+    host_t* ready = NULL;
+    double readyScore = 0;
+    long wait = -1;
+    for (host_t* host = scheduler->hosts; host != NULL; host = host->next){
+        if (host->queued == 0) continue;
+        if (host->nextRelease <= now){
+            double score = 0;
+            if (host->ranked != NULL) urlheap_top(host->ranked, &score);
+            if (ready == NULL || score > readyScore || (score == readyScore && host->nextRelease < ready->nextRelease)){
+                ready = host;
+                readyScore = score;
+            }
+        } else if (wait < 0 || host->nextRelease - now < wait){
+            wait = host->nextRelease - now;
+        }
+    }
+    if (ready == NULL){
+        if (waitMs != NULL) *waitMs = wait;
+        return NULL;
+    }
+
+    int depth;
+    long queuedAt;
+    double score = 0;
+    char* url = ready->ranked != NULL ? urlheap_pop(ready->ranked, &depth, &queuedAt, &score)
+                                     : urlqueue_pop(ready->pages, &depth, &queuedAt);
+    if (ready->pages != NULL && urlqueue_failed(ready->pages)){
+        // Pages in segments that couldn't be read back are gone; count them out
+        long lost = ready->queued - (url != NULL ? 1 : 0) - urlqueue_size(ready->pages);
+        ready->queued -= lost;
+        scheduler->size -= lost;
+    }
+    if (url == NULL){
+        if (waitMs != NULL) *waitMs = 0;
+        return NULL;
+    }
+    if (scheduler->log != NULL){
+        fprintf(scheduler->log, "%ld %ld %d %g %s\n", scheduler->released, now - scheduler->createdAt, depth, score, url);
+    }
+    scheduler->released++;
+    webpage_t* page = mem_assert(webpage_new(url, depth, NULL), "Error: Failed to allocate memory for webpage.\n");
+    ready->queued--;
+    scheduler->size--;
+    long waited = now - queuedAt;
+    ready->released++;
+    ready->totalWait += waited;
+    if (waited > ready->maxWait) ready->maxWait = waited;
+    ready->nextRelease = now + scheduler->delayMs;
+    return page;
+}
+
+/**
+ * Description: Returns the number of pages queued.
+ * @param scheduler: the scheduler.
+*/
+int scheduler_size(scheduler_t* scheduler){
+    return scheduler ? scheduler->size : 0;
+}
+
+/**
+ * Description: Returns whether any host's queue couldn't write or read back a segment.
+ * @param scheduler: the scheduler.
+*/
+bool scheduler_spillFailed(scheduler_t* scheduler){
+    if (scheduler == NULL) return false;
+    for (host_t* host = scheduler->hosts; host != NULL; host = host->next){
+        if (host->pages != NULL && urlqueue_failed(host->pages)) return true;
+    }
+    return false;
+}
+
+/**
+ * Description: Prints the per-host statistics, one host per line.
+ * @param scheduler: the scheduler.
+ * @param fp: where to print.
+*/
+void scheduler_report(scheduler_t* scheduler, FILE* fp){
+    if (scheduler == NULL || fp == NULL) return;
+    fprintf(fp, "%-40s %9s %7s %9s %8s %12s %11s\n", "host", "released", "queued", "maxQueued", "onDisk", "meanWaitMs", "maxWaitMs");
+    for (host_t* host = scheduler->hosts; host != NULL; host = host->next){
+        double meanWait = host->released > 0 ? (double)host->totalWait / host->released : 0;
+        fprintf(fp, "%-40s %9ld %7ld %9ld %8ld %12.1f %11ld\n", host->name, host->released, host->queued,
+                host->maxQueued, host->pages ? urlqueue_spilled(host->pages) : 0, meanWait, host->maxWait);
+    }
+}
+
+/**
+ * Description: Deletes the scheduler, its hosts and the pages still queued.
+ * @param scheduler: the scheduler to delete.
+*/
+void scheduler_delete(scheduler_t* scheduler){
+    if (scheduler == NULL) return;
+    // The list owns the hosts; the hashtable only indexes them
+    hashtable_delete(scheduler->byName, NULL);
+    host_t* host = scheduler->hosts;
+    while (host != NULL){
+        host_t* next = host->next;
+        host_delete(host);
+        host = next;
+    }
+    if (scheduler->spillDirectory) mem_free(scheduler->spillDirectory);
+    mem_free(scheduler);
+}
+
+/***
+ * Description: Finds the host of a URL.
+ * @param scheduler: the scheduler.
+ * @param url: the URL.
+ * @param create: whether to create the host, with an empty queue, if it is new.
+ * @returns the host, or NULL if it is new and not created.
+*/
+static host_t* findHost(scheduler_t* scheduler, const char* url, const bool create){
+    char name[MAX_HOST_LENGTH];
+    hostName(url, name);
+    host_t* host = hashtable_find(scheduler->byName, name);
+    if (host != NULL || !create) return host;
+    host = mem_assert(mem_calloc(1, sizeof(host_t)), "Error: Failed to allocate memory for host.\n");
+    host->name = mem_assert(mem_malloc(strlen(name) + 1), "Error: Failed to allocate memory for host name.\n");
+    strcpy(host->name, name);
+    if (scheduler->scorer != NULL){
+        host->ranked = urlheap_new();
+    } else {
+        // Segment files are named by the host's number, which is safe in a file name
+        char queueName[32];
+        sprintf(queueName, "host%d", scheduler->numHosts);
+        host->pages = urlqueue_new(scheduler->order, scheduler->window, scheduler->spillDirectory, queueName);
+    }
+    scheduler->numHosts++;
+    hashtable_insert(scheduler->byName, name, host);
+    if (scheduler->lastHost == NULL) scheduler->hosts = host;
+    else scheduler->lastHost->next = host;
+    scheduler->lastHost = host;
+    return host;
+}
+
+/***
+ * Description: Extracts the host (and port, if any) from a URL.
+ * @param url: the URL.
+ * @param name: receives the host; must have room for MAX_HOST_LENGTH characters.
+*/
+static void hostName(const char* url, char* name){
+    const char* start = url ? strstr(url, "://") : NULL;
+    start = start ? start + 3 : (url ? url : "");
+    size_t length = strcspn(start, "/?#");
+    if (length >= MAX_HOST_LENGTH) length = MAX_HOST_LENGTH - 1;
+    memcpy(name, start, length);
+    name[length] = '\0';
+}
+
+/***
+ * Description: Deletes a host and the pages still queued on it.
+ * @param host: the host.
+*/
+static void host_delete(host_t* host){
+    urlqueue_delete(host->pages);
+    urlheap_delete(host->ranked);
+    mem_free(host->name);
+    mem_free(host);
+}
+
+/***
+ * Description: Returns the monotonic clock in milliseconds.
+*/
+static long nowMs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,120 @@
+/**
+ * scheduler.h
+ *
+ * Interface for the crawler's politeness scheduler. Pages are queued by the host
+ * in their URL, and each host may only have a page released once every delayMs
+ * milliseconds; pages for different hosts are released independently of each
+ * other. The scheduler keeps per-host statistics (pages queued, pages released and
+ * the time they waited) that scheduler_report prints.
+ *
+ * Each host's pages come out breadth-first (QUEUE_FIFO) or most-recent first
+ * (QUEUE_LIFO). Only the URL and depth of a queued page are kept, and with a spill
+ * directory only window of them per host are kept in memory (see urlqueue.h), so a
+ * crawl that discovers far more pages than it can hold still runs in bounded memory.
+ *
+ * Given a scorer (see scorer.h), each host's pages come out highest score first
+ * instead, and the ready host with the best page goes first; a queued page's score
+ * goes up with every further link to it that scheduler_credit reports. Scored pages
+ * are all kept in memory (see urlheap.h), whatever the window.
+ *
+ * The scheduler is not thread-safe; the frontier wraps it with its lock.
+ */
+#ifndef __SCHEDULER_H
+#define __SCHEDULER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "webpage.h"
+#include "urlqueue.h"
+#include "scorer.h"
+
+typedef struct scheduler scheduler_t;
+
+/***
+ * Description: Creates a new empty scheduler.
+ * @param delayMs: least time between releasing two pages of the same host.
+ * @param order: QUEUE_FIFO for breadth-first, QUEUE_LIFO for most-recent first.
+ * @param window: pages per host buffered in memory before spilling.
+ * @param spillDirectory: existing directory for the spilled pages, or NULL to keep
+ *                        every page in memory.
+ * @returns pointer to the new scheduler; exits if out of memory.
+ */
+scheduler_t* scheduler_new(const int delayMs, const queueOrder_t order, const int window, const char* spillDirectory);
+
+/***
+ * Description: Makes the scheduler release pages by score, highest first. Must be
+ *              called before any page is queued.
+ * @param scheduler: the scheduler.
+ * @param scorer: the scorer; it must outlive the scheduler.
+ */
+void scheduler_setScorer(scheduler_t* scheduler, const scorer_t* scorer);
+
+/***
+ * Description: Logs every page released, one line each: how many were released before
+ *              it, the milliseconds since the scheduler was created, its depth, its
+ *              score (0 without a scorer) and its URL.
+ * @param scheduler: the scheduler.
+ * @param fp: where to log, or NULL not to.
+ */
+void scheduler_setLog(scheduler_t* scheduler, FILE* fp);
+
+/***
+ * Description: Queues a page on its host. The scheduler takes the page, keeps its URL and
+ *              depth and deletes it; the page released later is a new one.
+ * @param scheduler: the scheduler.
+ * @param page: the page.
+ */
+void scheduler_insert(scheduler_t* scheduler, webpage_t* page);
+
+/***
+ * Description: Counts another link to a page still queued, raising its score by the
+ *              scorer's in-link weight.
+ * @param scheduler: the scheduler.
+ * @param url: the page's canonical URL.
+ * @param key: the URL's urlcanon fingerprint.
+ * @returns false if the page isn't queued, or the scheduler has no scorer.
+ */
+bool scheduler_credit(scheduler_t* scheduler, const char* url, const uint64_t key);
+
+/***
+ * Description: Releases a page whose host's delay has passed, if there is one. The page
+ *              has a URL and depth but no HTML, and belongs to the caller.
+ * @param scheduler: the scheduler.
+ * @param waitMs: if no page is released, set to how long until one can be, or -1 if
+ *                no page is queued at all; 0 if the host's pages were lost with a spill
+ *                segment (see scheduler_spillFailed).
+ * @returns the page, or NULL.
+ */
+webpage_t* scheduler_next(scheduler_t* scheduler, long* waitMs);
+
+/***
+ * Description: Returns the number of pages queued, over all hosts.
+ * @param scheduler: the scheduler.
+ */
+int scheduler_size(scheduler_t* scheduler);
+
+/***
+ * Description: Returns whether a host's queue couldn't write a spill segment, or read one
+ *              back and lost its pages.
+ * @param scheduler: the scheduler.
+ */
+bool scheduler_spillFailed(scheduler_t* scheduler);
+
+/***
+ * Description: Prints one line per host: pages released, pages still queued, the
+ *              most pages queued at once, how many queued pages are on disk, and the
+ *              mean and longest time pages waited.
+ * @param scheduler: the scheduler.
+ * @param fp: where to print.
+ */
+void scheduler_report(scheduler_t* scheduler, FILE* fp);
+
+/***
+ * Description: Deletes the scheduler and any pages still queued.
+ * @param scheduler: the scheduler to delete.
+ */
+void scheduler_delete(scheduler_t* scheduler);
+
+#endif
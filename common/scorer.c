@@ -0,0 +1,223 @@
+/**
+ * scorer.c
+ *
+ * Description: Implements the URL scorer. A spec is parsed once into a list of terms,
+ *              each a function from a table of known terms and its weight; a URL's
+ *              score is the weighted sum of the terms' values. The patterns term's
+ *              weights file is read into a list of patterns, tried in order with
+ *              fnmatch.
+ */
+#define _POSIX_C_SOURCE 200809L    // strdup, strtok_r
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <fnmatch.h>
+#include "scorer.h"
+#include "file.h"
+#include "mem.h"
+
+#define MAX_TERMS 16
+
+// A term's value for a URL, before it is weighted
+typedef double (*termValue_t)(const scorer_t* scorer, const char* url, const int depth, const int inlinks);
+
+typedef struct termKind {
+    const char* name;
+    termValue_t value;
+} termKind_t;
+
+typedef struct term {
+    const termKind_t* kind;
+    double weight;
+} term_t;
+
+typedef struct pattern {
+    char* glob;
+    double weight;
+} pattern_t;
+
+typedef struct scorer {
+    term_t terms[MAX_TERMS];
+    int numTerms;
+    double inlinkWeight;        // summed weight of the inlinks terms
+    pattern_t* patterns;        // from the weights file, tried in order
+    int numPatterns;
+} scorer_t;
+
+static double depthValue(const scorer_t* scorer, const char* url, const int depth, const int inlinks);
+static double inlinksValue(const scorer_t* scorer, const char* url, const int depth, const int inlinks);
+static double patternsValue(const scorer_t* scorer, const char* url, const int depth, const int inlinks);
+static bool readWeights(scorer_t* scorer, const char* weightsFile);
+
+// The terms a spec can name
+static const termKind_t TERM_KINDS[] = {
+    { "depth", depthValue },
+    { "inlinks", inlinksValue },
+    { "patterns", patternsValue },
+};
+
+
+/**
+ * Description: Creates a scorer from a spec of terms.
+ * @param spec: the terms, comma-separated, each optionally with :weight.
+ * @param weightsFile: the patterns term's weights file, or NULL.
+ * @returns pointer to the new scorer, or NULL if the spec or the weights file is bad.
+*/
+scorer_t* scorer_new(const char* spec, const char* weightsFile){
+    if (spec == NULL) return NULL;
+    scorer_t* scorer = mem_assert(mem_calloc(1, sizeof(scorer_t)), "Error: Failed to allocate memory for scorer.\n");
+    char* terms = mem_assert(strdup(spec), "Error: Failed to allocate memory for scorer.\n");
+    bool ok = true;
+    bool usesPatterns = false;
+    char* save;
+    for (char* name = strtok_r(terms, ",", &save); ok && name != NULL; name = strtok_r(NULL, ",", &save)){
+        double weight = 1;
+        char* colon = strchr(name, ':');
+        if (colon != NULL){
+            *colon = '\0';
+            char* end;
+            weight = strtod(colon + 1, &end);
+            if (end == colon + 1 || *end != '\0'){
+                fprintf(stderr, "Error: The weight of score term %s must be a number.\n", name);
+                ok = false;
+                break;
+            }
+        }
+        const termKind_t* kind = NULL;
+        for (size_t i = 0; i < sizeof(TERM_KINDS) / sizeof(TERM_KINDS[0]); i++){
+            if (strcmp(name, TERM_KINDS[i].name) == 0) kind = &TERM_KINDS[i];
+        }
+        if (kind == NULL || scorer->numTerms == MAX_TERMS){
+            fprintf(stderr, kind == NULL ? "Error: Unknown score term %s (depth, inlinks or patterns).\n"
+                                         : "Error: Too many score terms at %s.\n", name);
+            ok = false;
+            break;
+        }
+        scorer->terms[scorer->numTerms].kind = kind;
+        scorer->terms[scorer->numTerms].weight = weight;
+        scorer->numTerms++;
+        if (kind->value == inlinksValue) scorer->inlinkWeight += weight;
+        if (kind->value == patternsValue) usesPatterns = true;
+    }
+    free(terms);
+    if (ok && scorer->numTerms == 0){
+        fprintf(stderr, "Error: No score terms given.\n");
+        ok = false;
+    }
+    if (ok && usesPatterns && weightsFile == NULL){
+        fprintf(stderr, "Error: Score term patterns needs a weights file.\n");
+        ok = false;
+    }
+    if (ok && weightsFile != NULL) ok = readWeights(scorer, weightsFile);
+    if (!ok){
+        scorer_delete(scorer);
+        return NULL;
+    }
+    return scorer;
+}
+
+/**
+ * Description: Scores a URL: the weighted sum of the scorer's terms.
+ * @param scorer: the scorer.
+ * @param url: the URL.
+ * @param depth: its depth.
+ * @param inlinks: the links to it found so far.
+ * @returns the score.
+*/
+double scorer_score(const scorer_t* scorer, const char* url, const int depth, const int inlinks){
+    if (scorer == NULL || url == NULL) return 0;
+    double score = 0;
+    for (int i = 0; i < scorer->numTerms; i++){
+        score += scorer->terms[i].weight * scorer->terms[i].kind->value(scorer, url, depth, inlinks);
+    }
+    return score;
+}
+
+/**
+ * Description: Returns how much one more link to a URL adds to its score.
+ * @param scorer: the scorer.
+*/
+double scorer_inlinkWeight(const scorer_t* scorer){
+    return scorer ? scorer->inlinkWeight : 0;
+}
+
+/**
+ * Description: Deletes the scorer and its patterns.
+ * @param scorer: the scorer to delete.
+*/
+void scorer_delete(scorer_t* scorer){
+    if (scorer == NULL) return;
+    for (int i = 0; i < scorer->numPatterns; i++) free(scorer->patterns[i].glob);
+    if (scorer->patterns) free(scorer->patterns);
+    mem_free(scorer);
+}
+
+/***
+ * Description: The depth term: shallower is better.
+*/
+static double depthValue(const scorer_t* scorer, const char* url, const int depth, const int inlinks){
+    return -depth;
+}
+
+/***
+ * Description: The inlinks term: the more pages link to it, the better.
+*/
+static double inlinksValue(const scorer_t* scorer, const char* url, const int depth, const int inlinks){
+    return inlinks;
+}
+
+/***
+ * Description: The patterns term: the weight of the first pattern the URL matches, or 0.
+*/
+static double patternsValue(const scorer_t* scorer, const char* url, const int depth, const int inlinks){
+    for (int i = 0; i < scorer->numPatterns; i++){
+        if (fnmatch(scorer->patterns[i].glob, url, 0) == 0) return scorer->patterns[i].weight;
+    }
+    return 0;
+}
+
+/***
+ * Description: Reads a weights file's "weight pattern" lines into the scorer.
+ * @returns false, having said why, if the file can't be read or a line is malformed.
+*/
+static bool readWeights(scorer_t* scorer, const char* weightsFile){
+    FILE* fp = fopen(weightsFile, "r");
+    if (fp == NULL){
+        fprintf(stderr, "Error: Can't read weights file %s.\n", weightsFile);
+        return false;
+    }
+    int cap = 0;
+    int lineNumber = 0;
+    bool ok = true;
+    char* line;
+    while (ok && (line = file_readLine(fp)) != NULL){
+        lineNumber++;
+        char* p = line;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p != '\0' && *p != '#'){
+            char* end;
+            double weight = strtod(p, &end);
+            char* glob = end;
+            while (isspace((unsigned char)*glob)) glob++;
+            if (end == p || glob == end || *glob == '\0'){
+                fprintf(stderr, "Error: %s line %d must be a weight and a pattern.\n", weightsFile, lineNumber);
+                ok = false;
+            } else {
+                if (scorer->numPatterns == cap){
+                    cap = cap > 0 ? cap * 2 : 8;
+                    scorer->patterns = realloc(scorer->patterns, cap * sizeof(pattern_t));
+                    mem_assert(scorer->patterns, "Error: Failed to allocate memory for scorer.\n");
+                }
+                scorer->patterns[scorer->numPatterns].glob = mem_assert(strdup(glob), "Error: Failed to allocate memory for scorer.\n");
+                scorer->patterns[scorer->numPatterns].weight = weight;
+                scorer->numPatterns++;
+            }
+        }
+        free(line);
+    }
+    fclose(fp);
+    return ok;
+}
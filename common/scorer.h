@@ -0,0 +1,63 @@
+/**
+ * scorer.h
+ *
+ * Interface for the crawler's URL scorer, which decides which URLs a priority crawl
+ * fetches first: the higher a URL's score, the sooner. A score is a weighted sum of
+ * terms, named in a spec such as "depth,inlinks:2,patterns":
+ *
+ *   depth      minus the URL's depth, so shallower pages come first
+ *   inlinks    the number of links to the URL found so far, as in OPIC, where a page's
+ *              importance is the credit handed to it by the pages linking to it
+ *   patterns   the weight of the first pattern the URL matches in a weights file
+ *
+ * A term's weight follows a ':' and defaults to 1. A weights file has one pattern per
+ * line, "weight pattern", the pattern a shell glob (fnmatch) matched against the
+ * whole URL; blank lines and lines starting with '#' are ignored. A URL matching no
+ * pattern gets 0.
+ *
+ * New terms are added to the table in scorer.c. The inlinks term grows as a crawl
+ * goes on; scorer_inlinkWeight tells the frontier how much each new link adds.
+ */
+#ifndef __SCORER_H
+#define __SCORER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef struct scorer scorer_t;
+
+/***
+ * Description: Creates a scorer from a spec of terms, printing what is wrong to stderr
+ *              if it can't.
+ * @param spec: the terms, comma-separated, each optionally followed by :weight.
+ * @param weightsFile: the patterns term's weights file, or NULL if it isn't used.
+ * @returns pointer to the new scorer, or NULL if a term is unknown, a weight isn't a
+ *          number, or the weights file can't be read or is needed but missing.
+ */
+scorer_t* scorer_new(const char* spec, const char* weightsFile);
+
+/***
+ * Description: Scores a URL.
+ * @param scorer: the scorer.
+ * @param url: the URL.
+ * @param depth: its depth.
+ * @param inlinks: the links to it found so far.
+ * @returns the score; higher is fetched sooner.
+ */
+double scorer_score(const scorer_t* scorer, const char* url, const int depth, const int inlinks);
+
+/***
+ * Description: Returns how much one more link to a URL adds to its score; 0 if the
+ *              spec doesn't score in-links.
+ * @param scorer: the scorer.
+ */
+double scorer_inlinkWeight(const scorer_t* scorer);
+
+/***
+ * Description: Deletes the scorer.
+ * @param scorer: the scorer to delete.
+ */
+void scorer_delete(scorer_t* scorer);
+
+#endif
@@ -0,0 +1,322 @@
+/**
+ * seenset.c
+ *
+ * Description: Implements the crawler's seen-set as an array of stripes, each guarded
+ *              by its own mutex. A URL is hashed once to a 64-bit fingerprint; its top
+ *              bits pick the stripe, so the check-then-insert in seenset_insert only
+ *              needs that one stripe's lock.
+ *
+ *              In exact mode a stripe is an open-addressed table with linear probing:
+ *              an array of fingerprints (0 marks an empty slot) beside an array of depth
+ *              bytes. The table's size is a power of two, picked by the fingerprint's low
+ *              bits, and it doubles once it is three quarters full.
+ *
+ *              In Bloom mode the stripes share one blocked Bloom filter: a URL's bits
+ *              all fall in one 512-bit block (one cache line), and the block's stripe
+ *              lock makes testing and setting them atomic.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "seenset.h"
+#include "urlcanon.h"
+#include "mem.h"
+
+#define NUM_STRIPES 32              // a power of two; picked by the fingerprint's top 5 bits
+#define STRIPE_SHIFT 59
+#define MIN_SLOTS 8                 // smallest table per stripe
+#define BLOCK_WORDS 8               // 64-bit words per Bloom block: 512 bits
+#define MAX_DEPTH 255               // depths are kept in a byte
+
+typedef struct stripe {
+    uint64_t* fingerprints;     // exact mode: the table, 0 where empty
+    uint8_t* depths;            // exact mode: depth of the URL in the same slot
+    size_t slots;               // exact mode: table size, a power of two
+    int size;                   // number of URLs in this stripe
+    pthread_mutex_t lock;
+} stripe_t;
+
+typedef struct seenset {
+    stripe_t stripes[NUM_STRIPES];
+    uint64_t* bloom;            // Bloom mode: the filter, NULL in exact mode
+    size_t blocks;              // Bloom mode: number of 512-bit blocks
+    int hashes;                 // Bloom mode: bits set per URL
+} seenset_t;
+
+static uint64_t fingerprint(const char* url);
+static uint64_t mix(uint64_t x);
+static bool table_insert(stripe_t* stripe, const uint64_t key, const int depth);
+static int table_find(stripe_t* stripe, const uint64_t key);
+static void table_grow(stripe_t* stripe);
+static bool bloom_testAndSet(seenset_t* seen, const uint64_t key, const bool set);
+static stripe_t* bloom_stripe(seenset_t* seen, const uint64_t key);
+
+
+/**
+ * Description: Creates a new empty exact seen-set with about num_slots slots to start.
+ * @param num_slots: initial number of slots over all stripes.
+ * @returns pointer to the new seen-set.
+*/
+seenset_t* seenset_new(const int num_slots){
+    seenset_t* seen = mem_assert(mem_calloc(1, sizeof(seenset_t)), "Error: Failed to allocate memory for seen-set.\n");
+    size_t slots = MIN_SLOTS;
+    while (slots * NUM_STRIPES < (size_t)num_slots) slots *= 2;
+    for (int i = 0; i < NUM_STRIPES; i++){
+        stripe_t* stripe = &seen->stripes[i];
+        stripe->slots = slots;
+        stripe->fingerprints = mem_assert(mem_calloc(slots, sizeof(uint64_t)), "Error: Failed to allocate memory for seen-set stripe.\n");
+        stripe->depths = mem_assert(mem_malloc(slots), "Error: Failed to allocate memory for seen-set stripe.\n");
+        stripe->size = 0;
+        pthread_mutex_init(&stripe->lock, NULL);
+    }
+    return seen;
+}
+
+/**
+ * Description: Creates a new empty seen-set backed by a Bloom filter.
+ * @param expectedURLs: number of URLs the filter is sized for.
+ * @param bitsPerURL: bits per expected URL.
+ * @returns pointer to the new seen-set.
+*/
+seenset_t* seenset_newBloom(const long expectedURLs, const int bitsPerURL){
+    seenset_t* seen = mem_assert(mem_calloc(1, sizeof(seenset_t)), "Error: Failed to allocate memory for seen-set.\n");
+    long bits = (expectedURLs > 0 ? expectedURLs : 1) * (bitsPerURL > 0 ? bitsPerURL : 1);
+    seen->blocks = (bits + BLOCK_WORDS * 64 - 1) / (BLOCK_WORDS * 64);
+    seen->bloom = mem_assert(mem_calloc(seen->blocks * BLOCK_WORDS, sizeof(uint64_t)), "Error: Failed to allocate memory for seen-set filter.\n");
+    // The false-positive rate is lowest with bitsPerURL * ln 2 bits set per URL
+    seen->hashes = (int)(bitsPerURL * 0.693 + 0.5);
+    if (seen->hashes < 1) seen->hashes = 1;
+    if (seen->hashes > 16) seen->hashes = 16;
+    for (int i = 0; i < NUM_STRIPES; i++){
+        seen->stripes[i].size = 0;
+        pthread_mutex_init(&seen->stripes[i].lock, NULL);
+    }
+    return seen;
+}
+
+/**
+ * Description: Records url at the given depth unless it has been seen before.
+ * @param seen: the seen-set.
+ * @param url: a normalized URL.
+ * @param depth: the depth the URL was found at.
+ * @returns true if the URL was new.
+*/
+bool seenset_insert(seenset_t* seen, const char* url, const int depth){
+    if (!url) return false;
+    return seenset_insertHash(seen, fingerprint(url), depth);
+}
+
+/**
+ * Description: Records a URL, given by its fingerprint, at the given depth unless it has
+ *              been seen before.
+ * @param seen: the seen-set.
+ * @param key: the URL's fingerprint, from urlcanon_hash.
+ * @param depth: the depth the URL was found at.
+ * @returns true if the URL was new.
+*/
+bool seenset_insertHash(seenset_t* seen, const uint64_t key, const int depth){
+    if (!seen || key == 0 || depth < 0) return false;
+    if (seen->bloom != NULL) return bloom_testAndSet(seen, key, true);
+
+    stripe_t* stripe = &seen->stripes[key >> STRIPE_SHIFT];
+    pthread_mutex_lock(&stripe->lock);
+    bool inserted = table_insert(stripe, key, depth);
+    pthread_mutex_unlock(&stripe->lock);
+    return inserted;
+}
+
+/**
+ * Description: Looks up the depth url was first seen at.
+ * @param seen: the seen-set.
+ * @param url: a normalized URL.
+ * @returns the depth, or -1 if not seen.
+*/
+int seenset_find(seenset_t* seen, const char* url){
+    if (!seen || !url) return -1;
+    uint64_t key = fingerprint(url);
+    if (seen->bloom != NULL) return bloom_testAndSet(seen, key, false) ? -1 : 0;
+
+    stripe_t* stripe = &seen->stripes[key >> STRIPE_SHIFT];
+    pthread_mutex_lock(&stripe->lock);
+    int result = table_find(stripe, key);
+    pthread_mutex_unlock(&stripe->lock);
+    return result;
+}
+
+/**
+ * Description: Returns the number of URLs seen.
+ * @param seen: the seen-set.
+*/
+int seenset_size(seenset_t* seen){
+    if (!seen) return 0;
+    int size = 0;
+    for (int i = 0; i < NUM_STRIPES; i++){
+        pthread_mutex_lock(&seen->stripes[i].lock);
+        size += seen->stripes[i].size;
+        pthread_mutex_unlock(&seen->stripes[i].lock);
+    }
+    return size;
+}
+
+/**
+ * Description: Prints the number of URLs seen and the memory they take.
+ * @param seen: the seen-set.
+ * @param fp: where to print.
+*/
+void seenset_report(seenset_t* seen, FILE* fp){
+    if (!seen || !fp) return;
+    size_t bytes = sizeof(seenset_t);
+    if (seen->bloom != NULL){
+        bytes += seen->blocks * BLOCK_WORDS * sizeof(uint64_t);
+    } else {
+        for (int i = 0; i < NUM_STRIPES; i++){
+            pthread_mutex_lock(&seen->stripes[i].lock);
+            bytes += seen->stripes[i].slots * (sizeof(uint64_t) + sizeof(uint8_t));
+            pthread_mutex_unlock(&seen->stripes[i].lock);
+        }
+    }
+    int size = seenset_size(seen);
+    fprintf(fp, "seen: %d URLs (%s), %zu bytes, %.1f bytes per URL\n", size,
+            seen->bloom ? "Bloom filter" : "fingerprints", bytes, size > 0 ? (double)bytes / size : 0);
+}
+
+/**
+ * Description: Deletes the seen-set.
+ * @param seen: the seen-set to delete.
+*/
+void seenset_delete(seenset_t* seen){
+    if (!seen) return;
+    for (int i = 0; i < NUM_STRIPES; i++){
+        if (seen->stripes[i].fingerprints) mem_free(seen->stripes[i].fingerprints);
+        if (seen->stripes[i].depths) mem_free(seen->stripes[i].depths);
+        pthread_mutex_destroy(&seen->stripes[i].lock);
+    }
+    if (seen->bloom) mem_free(seen->bloom);
+    mem_free(seen);
+}
+
+/***
+ * Description: Hashes a URL to its 64-bit fingerprint, the canonicalizer's. Never 0,
+ *              which marks an empty slot.
+ * @param url: the URL.
+ * @returns the fingerprint.
+*/
+static uint64_t fingerprint(const char* url){
+    return urlcanon_hash(url, strlen(url));
+}
+
+/***
+ * Description: The splitmix64 finalizer: scrambles the bits of x.
+ * @param x: the value.
+ * @returns the scrambled value.
+*/
+static uint64_t mix(uint64_t x){
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/***
+ * Description: Inserts key into a stripe's table unless present. The caller holds the lock.
+ * @param stripe: the stripe.
+ * @param key: the fingerprint.
+ * @param depth: its depth.
+ * @returns true if it was inserted.
+*/
+static bool table_insert(stripe_t* stripe, const uint64_t key, const int depth){
+    size_t mask = stripe->slots - 1;
+    size_t slot = key & mask;
+    while (stripe->fingerprints[slot] != 0){
+        if (stripe->fingerprints[slot] == key) return false;
+        slot = (slot + 1) & mask;
+    }
+    stripe->fingerprints[slot] = key;
+    stripe->depths[slot] = depth > MAX_DEPTH ? MAX_DEPTH : depth;
+    stripe->size++;
+    if ((size_t)stripe->size * 4 > stripe->slots * 3) table_grow(stripe);
+    return true;
+}
+
+/***
+ * Description: Looks key up in a stripe's table. The caller holds the lock.
+ * @param stripe: the stripe.
+ * @param key: the fingerprint.
+ * @returns its depth, or -1 if absent.
+*/
+static int table_find(stripe_t* stripe, const uint64_t key){
+    size_t mask = stripe->slots - 1;
+    for (size_t slot = key & mask; stripe->fingerprints[slot] != 0; slot = (slot + 1) & mask){
+        if (stripe->fingerprints[slot] == key) return stripe->depths[slot];
+    }
+    return -1;
+}
+
+/***
+ * Description: Doubles a stripe's table and reinserts its fingerprints.
+ * @param stripe: the stripe, whose lock the caller holds.
+*/
+static void table_grow(stripe_t* stripe){
+    uint64_t* oldFingerprints = stripe->fingerprints;
+    uint8_t* oldDepths = stripe->depths;
+    size_t oldSlots = stripe->slots;
+    stripe->slots *= 2;
+    stripe->fingerprints = mem_assert(mem_calloc(stripe->slots, sizeof(uint64_t)), "Error: Failed to allocate memory for seen-set stripe.\n");
+    stripe->depths = mem_assert(mem_malloc(stripe->slots), "Error: Failed to allocate memory for seen-set stripe.\n");
+    size_t mask = stripe->slots - 1;
+    for (size_t i = 0; i < oldSlots; i++){
+        if (oldFingerprints[i] == 0) continue;
+        size_t slot = oldFingerprints[i] & mask;
+        while (stripe->fingerprints[slot] != 0) slot = (slot + 1) & mask;
+        stripe->fingerprints[slot] = oldFingerprints[i];
+        stripe->depths[slot] = oldDepths[i];
+    }
+    mem_free(oldFingerprints);
+    mem_free(oldDepths);
+}
+
+/***
+ * Description: Tests, and optionally sets, key's bits in the Bloom filter.
+ * @param seen: the seen-set, in Bloom mode.
+ * @param key: the fingerprint.
+ * @param set: whether to set the bits.
+ * @returns true if at least one bit was clear, i.e. the URL is certainly new.
+*/
+static bool bloom_testAndSet(seenset_t* seen, const uint64_t key, const bool set){
+    // The block comes from a second mix of the key; the bits inside it from double
+    // hashing on the key's two halves
+    size_t block = mix(key) % seen->blocks;
+    uint64_t* words = &seen->bloom[block * BLOCK_WORDS];
+    uint32_t h1 = (uint32_t)key;
+    uint32_t h2 = (uint32_t)(key >> 32) | 1;
+    stripe_t* stripe = bloom_stripe(seen, block);
+
+    pthread_mutex_lock(&stripe->lock);
+    bool isNew = false;
+    for (int i = 0; i < seen->hashes; i++){
+        uint32_t bit = (h1 + i * h2) & (BLOCK_WORDS * 64 - 1);
+        uint64_t mask = 1ULL << (bit & 63);
+        if (!(words[bit >> 6] & mask)){
+            isNew = true;
+            if (set) words[bit >> 6] |= mask;
+        }
+    }
+    if (set && isNew) stripe->size++;
+    pthread_mutex_unlock(&stripe->lock);
+    return isNew;
+}
+
+/***
+ * Description: Picks the stripe whose lock guards a Bloom block.
+ * @param seen: the seen-set.
+ * @param block: the block's index.
+ * @returns pointer to the stripe.
+*/
+static stripe_t* bloom_stripe(seenset_t* seen, const uint64_t block){
+    return &seen->stripes[block % NUM_STRIPES];
+}
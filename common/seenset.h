@@ -0,0 +1,94 @@
+/**
+ * seenset.h
+ *
+ * Interface for the crawler's set of URLs seen so far, each with the depth it was
+ * found at. The set is split into independently locked stripes so that worker
+ * threads checking different URLs rarely wait on each other.
+ *
+ * URLs aren't stored: each is reduced to a 64-bit fingerprint, kept with its depth
+ * in an open-addressed table that doubles as it fills: 12 to 24 bytes per URL,
+ * against a hashtable's copy of the URL plus several allocations. Two
+ * different URLs sharing a fingerprint is vanishingly unlikely at crawl sizes (about
+ * one chance in 400000 with ten million URLs).
+ *
+ * A seen-set made with seenset_newBloom is a Bloom filter instead: it takes a fixed
+ * bitsPerURL bits per URL expected, and doesn't keep depths, but occasionally
+ * reports a new URL as seen (about 1% of the time at 10 bits per URL, more once
+ * the expected number of URLs is exceeded); the crawler then skips that page.
+ */
+#ifndef __SEENSET_H
+#define __SEENSET_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct seenset seenset_t;
+
+/***
+ * Description: Creates a new empty seen-set that records URLs exactly.
+ * @param num_slots: initial number of slots, spread across the stripes; the table grows
+ *                   as needed.
+ * @returns pointer to the new seen-set; exits if out of memory.
+ */
+seenset_t* seenset_new(const int num_slots);
+
+/***
+ * Description: Creates a new empty seen-set backed by a Bloom filter of fixed size.
+ * @param expectedURLs: the number of URLs the filter is sized for.
+ * @param bitsPerURL: bits of filter per expected URL (10 gives about 1% false positives).
+ * @returns pointer to the new seen-set; exits if out of memory.
+ */
+seenset_t* seenset_newBloom(const long expectedURLs, const int bitsPerURL);
+
+/***
+ * Description: Atomically checks whether url has been seen and, if not, records it
+ *              with the given depth.
+ * @param seen: the seen-set.
+ * @param url: a normalized URL.
+ * @param depth: the depth the URL was found at; depths above 255 are recorded as 255.
+ * @returns true if the URL is new (and was inserted); false if it was already seen
+ *          or any parameter is invalid.
+ */
+bool seenset_insert(seenset_t* seen, const char* url, const int depth);
+
+/***
+ * Description: Like seenset_insert, for a URL already reduced to its fingerprint by
+ *              the URL canonicalizer (urlcanon_hash), so it isn't hashed again.
+ * @param seen: the seen-set.
+ * @param key: the URL's fingerprint.
+ * @param depth: the depth the URL was found at.
+ * @returns true if the URL is new (and was inserted).
+ */
+bool seenset_insertHash(seenset_t* seen, const uint64_t key, const int depth);
+
+/***
+ * Description: Looks up the depth a URL was first seen at.
+ * @param seen: the seen-set.
+ * @param url: a normalized URL.
+ * @returns the depth, or -1 if the URL hasn't been seen. A Bloom filter keeps no
+ *          depths and returns 0 for every URL it has (probably) seen.
+ */
+int seenset_find(seenset_t* seen, const char* url);
+
+/***
+ * Description: Returns the number of URLs in the seen-set.
+ * @param seen: the seen-set.
+ */
+int seenset_size(seenset_t* seen);
+
+/***
+ * Description: Prints the number of URLs seen and the memory they take, on one line.
+ * @param seen: the seen-set.
+ * @param fp: where to print.
+ */
+void seenset_report(seenset_t* seen, FILE* fp);
+
+/***
+ * Description: Deletes the seen-set and all its contents.
+ * @param seen: the seen-set to delete.
+ */
+void seenset_delete(seenset_t* seen);
+
+#endif
@@ -0,0 +1,248 @@
+/**
+ * urlcanon.c
+ *
+ * Description: Implements the URL canonicalizer. A URL is split by pointers into the
+ *              string, the way normalizeURL's parseURL splits it into copies: the
+ *              scheme runs to the first ':' (and a "//" after it), user information to
+ *              an '@' before any '/', the host to the first '/', the path to the first
+ *              '?' or '#', and the query and fragment to the end. The pieces are then
+ *              written out in order, in one pass: scheme and host lowercased, the path
+ *              through RFC 3986's remove_dot_segments (as the cURL version in webpage.c
+ *              does it, quirks and all), the query and fragment as they are. Every
+ *              piece is written no further along than it was read from, so a URL can be
+ *              canonicalized in place.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include "urlcanon.h"
+
+// Where the pieces of a URL start and end
+typedef struct urlParts {
+    const char* schemeEnd;      // after the ':' and any "//"
+    const char* hostBeg;        // after any user information's '@'
+    const char* hostEnd;        // at the first '/', or the end
+    const char* pathEnd;        // at the first '?' or '#', or the end
+    const char* end;
+} urlParts_t;
+
+static bool splitURL(const char* url, const size_t len, urlParts_t* parts);
+static bool knownExtension(const char* path, const char* pathEnd);
+static char* writeLower(char* out, const char* from, const char* to);
+static char* removeDotSegments(char* out, const char* in, const char* inEnd);
+
+
+/**
+ * Description: Canonicalizes an absolute URL, exactly as normalizeURL does.
+ * @param url: the URL; it may be buf itself.
+ * @param buf: where the canonical URL is written.
+ * @param bufSize: the size of buf.
+ * @param view: set to the canonical URL.
+ * @returns false if the URL is rejected, or doesn't fit buf.
+*/
+bool urlcanon_normalize(const char* url, char* buf, const size_t bufSize, urlView_t* view){
+    if (url == NULL || buf == NULL || view == NULL) return false;
+    size_t len = strlen(url);
+    urlParts_t parts;
+    if (len >= bufSize || !splitURL(url, len, &parts)) return false;
+    // An empty path, or one that starts past the host (a '?' or '#' in the host),
+    // fails normalizeURL
+    if (parts.pathEnd <= parts.hostEnd) return false;
+    if (!knownExtension(parts.hostEnd, parts.pathEnd)) return false;
+
+    char* out = writeLower(buf, url, parts.schemeEnd);
+    memmove(out, parts.schemeEnd, parts.hostBeg - parts.schemeEnd);
+    out += parts.hostBeg - parts.schemeEnd;
+    out = writeLower(out, parts.hostBeg, parts.hostEnd);
+    out = removeDotSegments(out, parts.hostEnd, parts.pathEnd);
+    // Query and fragment, as they are; whichever comes first starts at pathEnd
+    memmove(out, parts.pathEnd, parts.end - parts.pathEnd);
+    out += parts.end - parts.pathEnd;
+    *out = '\0';
+
+    view->url = buf;
+    view->len = out - buf;
+    view->hash = urlcanon_hash(buf, view->len);
+    return true;
+}
+
+/**
+ * Description: Resolves a link relative to its page's URL, the way webpage.c's
+ *              fixRelativeURL does, and canonicalizes the result.
+ * @param base: the page's URL.
+ * @param rel: the relative link.
+ * @param relLen: its length.
+ * @param buf: where the canonical URL is written.
+ * @param bufSize: the size of buf.
+ * @param view: set to the canonical URL.
+ * @returns false if the base can't be parsed, the URL is rejected, or doesn't fit buf.
+*/
+bool urlcanon_resolve(const char* base, const char* rel, const size_t relLen,
+                      char* buf, const size_t bufSize, urlView_t* view){
+    if (base == NULL || rel == NULL || buf == NULL || view == NULL) return false;
+    urlParts_t parts;
+    // parseURL fails on a path that starts past the host; an empty one will do here
+    if (!splitURL(base, strlen(base), &parts) || parts.pathEnd < parts.hostEnd) return false;
+    const char* relEnd = memchr(rel, '\0', relLen);
+    size_t len = relEnd ? (size_t)(relEnd - rel) : relLen;
+
+    // Scheme, user and host, then the link from the root, or from the base's directory
+    size_t dirLen = 0;
+    if (rel[0] != '/'){
+        const char* slash = parts.hostEnd;
+        for (const char* p = parts.hostEnd; p < parts.pathEnd; p++){
+            if (*p == '/') slash = p;
+        }
+        dirLen = slash - parts.hostEnd;
+    }
+    size_t prefixLen = parts.hostEnd - base;
+    size_t joinedLen = prefixLen + dirLen + (rel[0] != '/') + len;
+    if (joinedLen >= bufSize) return false;
+    char* out = writeLower(buf, base, parts.schemeEnd);
+    memcpy(out, parts.schemeEnd, parts.hostBeg - parts.schemeEnd);
+    out += parts.hostBeg - parts.schemeEnd;
+    out = writeLower(out, parts.hostBeg, parts.hostEnd);
+    memcpy(out, parts.hostEnd, dirLen);
+    out += dirLen;
+    if (rel[0] != '/') *out++ = '/';
+    memcpy(out, rel, len);
+    out[len] = '\0';
+    return urlcanon_normalize(buf, buf, bufSize, view);
+}
+
+/**
+ * Description: Returns a URL's 64-bit fingerprint; never 0. The URL is taken eight
+ *              bytes at a time, each word xored in and the state scrambled by a
+ *              multiply and shift (both invertible, so no two states collide), and the
+ *              result finished with the splitmix64 finalizer.
+ * @param url: the URL.
+ * @param len: its length.
+*/
+uint64_t urlcanon_hash(const char* url, const size_t len){
+    uint64_t hash = 14695981039346656037ULL ^ len;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8){
+        uint64_t word;
+        memcpy(&word, url + i, 8);
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 32;
+    }
+    if (i < len){
+        uint64_t word = 0;
+        memcpy(&word, url + i, len - i);
+        hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 32;
+    }
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash != 0 ? hash : 1;
+}
+
+/***
+ * Description: Finds the pieces of an absolute URL, as parseURL does.
+ * @param url: the URL.
+ * @param len: its length.
+ * @param parts: set to where its pieces start and end.
+ * @returns false if it has no scheme.
+*/
+static bool splitURL(const char* url, const size_t len, urlParts_t* parts){
+    // Absolute: a ':' comes before any '/', '?' or '#'
+    const char* schemeEnd = strpbrk(url, ":/?#");
+    if (schemeEnd == NULL || *schemeEnd != ':') return false;
+    schemeEnd++;
+    if (schemeEnd[0] == '/' && schemeEnd[1] == '/') schemeEnd += 2;
+    parts->schemeEnd = schemeEnd;
+    parts->end = url + len;
+
+    // User information is anything up to an '@' before the first '/', even past a '?'
+    const char* at = strpbrk(schemeEnd, "@/");
+    parts->hostBeg = at != NULL && *at == '@' ? at + 1 : schemeEnd;
+    const char* slash = strchr(schemeEnd, '/');
+    parts->hostEnd = slash != NULL ? slash : parts->end;
+    const char* pathEnd = strpbrk(schemeEnd, "?#");
+    parts->pathEnd = pathEnd != NULL ? pathEnd : parts->end;
+    return true;
+}
+
+/***
+ * Description: Checks a path's extension: a last segment with a '.' in it must end in
+ *              something starting with htm (so .html, .htm, and, as normalizeURL has it,
+ *              .htmx), in any case, or in the '.' itself.
+*/
+static bool knownExtension(const char* path, const char* pathEnd){
+    const char* dot = NULL;
+    for (const char* p = pathEnd; p > path; p--){
+        if (p[-1] == '/') break;
+        if (p[-1] == '.'){
+            dot = p - 1;
+            break;
+        }
+    }
+    if (dot == NULL) return true;
+    size_t extLen = pathEnd - dot - 1;
+    return extLen == 0 || (extLen >= 3 && strncasecmp(dot + 1, "htm", 3) == 0);
+}
+
+/***
+ * Description: Writes [from, to) to out with ASCII letters lowercased, as tolower does
+ *              in the C locale; returns where it left off.
+*/
+static char* writeLower(char* out, const char* from, const char* to){
+    while (from < to){
+        unsigned char c = *from++;
+        *out++ = c + ((unsigned char)(c - 'A') < 26 ? 'a' - 'A' : 0);
+    }
+    return out;
+}
+
+/***
+ * Description: Writes the path [in, inEnd) to out with its . and .. segments removed,
+ *              following RFC 3986 section 5.2.4 step by step as webpage.c's
+ *              removeDotSegments does. Where that rewrites a trailing "/." or "/.." in
+ *              its copy of the path to "/", this writes the "/" straight out. out may
+ *              be in itself: nothing is written past what has been read.
+ * @returns where it left off.
+*/
+static char* removeDotSegments(char* out, const char* in, const char* inEnd){
+    char* start = out;
+    while (in < inEnd){
+        size_t n = inEnd - in;
+        if (n >= 2 && in[0] == '.' && in[1] == '/'){                                   // A: "./"
+            in += 2;
+        } else if (n >= 3 && in[0] == '.' && in[1] == '.' && in[2] == '/'){            // A: "../"
+            in += 3;
+        } else if (n >= 3 && in[0] == '/' && in[1] == '.' && in[2] == '/'){            // B: "/./"
+            in += 2;
+        } else if (n == 2 && in[0] == '/' && in[1] == '.'){                            // B: "/." at the end
+            *out++ = '/';
+            in = inEnd;
+        } else if (n >= 3 && in[0] == '/' && in[1] == '.' && in[2] == '.' && (n == 3 || in[3] == '/')){
+            // C: "/../", or "/.." at the end; drop the last segment written
+            while (out > start){
+                out--;
+                if (*out == '/') break;
+            }
+            if (n == 3){
+                *out++ = '/';
+                in = inEnd;
+            } else {
+                in += 3;
+            }
+        } else if ((n == 1 && in[0] == '.') || (n == 2 && in[0] == '.' && in[1] == '.')){   // D
+            in = inEnd;
+        } else {                                                                        // E: one segment
+            const char* next = n > 1 ? memchr(in + 1, '/', n - 1) : NULL;
+            size_t segment = (next != NULL ? next : inEnd) - in;
+            memmove(out, in, segment);
+            out += segment;
+            in += segment;
+        }
+    }
+    return out;
+}
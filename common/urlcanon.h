@@ -0,0 +1,66 @@
+/**
+ * urlcanon.h
+ *
+ * Interface for the crawler's URL canonicalizer: the same URLs as libcs50's
+ * normalizeURL (scheme and host lowercased, . and .. path segments removed, URLs
+ * whose path names a file that isn't .html or .htm rejected), written into a buffer
+ * the caller provides instead of into half a dozen strings allocated along the way.
+ * The result comes back as a view of that buffer, with the URL's length and its
+ * 64-bit fingerprint, the one the seen-set keys URLs by, so a link can be checked
+ * against the seen-set without allocating anything; only a URL that turns out to
+ * be new needs copying.
+ *
+ * A canonical URL is never longer than the URL it came from. URLs normalizeURL
+ * can't parse, including a few it would crash on (a '?' or '#' before the end of
+ * the host), are rejected.
+ */
+#ifndef __URLCANON_H
+#define __URLCANON_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// A canonical URL, as written into the caller's buffer
+typedef struct urlView {
+    const char* url;            // the URL, NUL-terminated; points into the buffer
+    size_t len;                 // its length
+    uint64_t hash;              // its fingerprint, as urlcanon_hash gives it
+} urlView_t;
+
+/***
+ * Description: Canonicalizes an absolute URL, exactly as normalizeURL does.
+ * @param url: the URL; it may be buf itself, canonicalized in place.
+ * @param buf: where the canonical URL is written.
+ * @param bufSize: the size of buf; the URL, with its NUL, must fit.
+ * @param view: set to the canonical URL.
+ * @returns false if the URL is rejected, or doesn't fit buf.
+ */
+bool urlcanon_normalize(const char* url, char* buf, const size_t bufSize, urlView_t* view);
+
+/***
+ * Description: Resolves a link relative to the URL of the page it is on, and
+ *              canonicalizes the result: the same URL as normalizeURL gives for
+ *              webpage_getNextURL's resolution of the link.
+ * @param base: the page's URL.
+ * @param rel: the relative link; it need not be NUL-terminated, but rel[0] must be
+ *             readable even when relLen is 0.
+ * @param relLen: the link's length; it ends at a NUL before then.
+ * @param buf: where the canonical URL is written.
+ * @param bufSize: the size of buf; the joined URL, before it is canonicalized, must fit.
+ * @param view: set to the canonical URL.
+ * @returns false if the base can't be parsed, the URL is rejected, or doesn't fit buf.
+ */
+bool urlcanon_resolve(const char* base, const char* rel, const size_t relLen,
+                      char* buf, const size_t bufSize, urlView_t* view);
+
+/***
+ * Description: Returns a URL's 64-bit fingerprint, hashed eight bytes at a time and
+ *              mixed so that every bit depends on every byte. Never 0.
+ * @param url: the URL.
+ * @param len: its length.
+ */
+uint64_t urlcanon_hash(const char* url, const size_t len);
+
+#endif
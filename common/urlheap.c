@@ -0,0 +1,286 @@
+/**
+ * urlheap.c
+ *
+ * Description: Implements the URL priority queue as a 4-ary max-heap in an array:
+ *              the children of entry i are 4i+1 to 4i+4, so the heap is half as deep
+ *              as a binary one and sifting an entry down compares four siblings that
+ *              sit side by side in memory. Entries are ordered by score, then by the
+ *              order they were pushed in.
+ *
+ *              An open-addressed table (linear probing, doubling when three quarters
+ *              full) maps each key to where its entry is in the array, and is updated
+ *              whenever an entry moves, so an entry whose score is raised is found in
+ *              O(1) and sifted up from there. Keys are removed by shifting the rest of
+ *              their run back, so the table never fills with tombstones.
+ */
+#define _POSIX_C_SOURCE 200809L    // strdup
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "urlheap.h"
+#include "mem.h"
+
+#define ARITY 4
+#define INITIAL_ENTRIES 1024
+#define INITIAL_SLOTS 2048         // a power of two
+
+typedef struct entry {
+    double score;
+    long seq;                   // when it was pushed, among the heap's entries
+    uint64_t key;               // 0 if the entry isn't in the index
+    char* url;
+    long queuedAt;
+    int depth;
+} entry_t;
+
+// Where a key's entry is in the heap; key 0 marks an empty slot
+typedef struct slot {
+    uint64_t key;
+    long pos;
+} slot_t;
+
+typedef struct urlheap {
+    entry_t* entries;
+    long size;
+    long cap;
+    long nextSeq;
+    slot_t* slots;
+    long numSlots;              // a power of two
+    long numKeys;
+} urlheap_t;
+
+static bool above(const entry_t* a, const entry_t* b);
+static void siftUp(urlheap_t* heap, long pos);
+static void siftDown(urlheap_t* heap, long pos);
+static void place(urlheap_t* heap, const entry_t* entry, const long pos);
+static slot_t* findSlot(urlheap_t* heap, const uint64_t key);
+static void indexKey(urlheap_t* heap, const uint64_t key, const long pos);
+static void unindexKey(urlheap_t* heap, const uint64_t key);
+static void growIndex(urlheap_t* heap);
+
+
+/**
+ * Description: Creates a new empty heap.
+ * @returns pointer to the new heap.
+*/
+urlheap_t* urlheap_new(void){
+    urlheap_t* heap = mem_assert(mem_malloc(sizeof(urlheap_t)), "Error: Failed to allocate memory for URL heap.\n");
+    heap->entries = mem_assert(mem_malloc(INITIAL_ENTRIES * sizeof(entry_t)), "Error: Failed to allocate memory for URL heap.\n");
+    heap->size = 0;
+    heap->cap = INITIAL_ENTRIES;
+    heap->nextSeq = 0;
+    heap->slots = mem_assert(mem_calloc(INITIAL_SLOTS, sizeof(slot_t)), "Error: Failed to allocate memory for URL heap.\n");
+    heap->numSlots = INITIAL_SLOTS;
+    heap->numKeys = 0;
+    return heap;
+}
+
+/**
+ * Description: Adds an entry and sifts it up to its place.
+ * @param heap: the heap.
+ * @param url: the URL, copied.
+ * @param key: its fingerprint.
+ * @param depth: its depth.
+ * @param queuedAt: when it was queued.
+ * @param score: its score.
+*/
+void urlheap_push(urlheap_t* heap, const char* url, const uint64_t key, const int depth,
+                  const long queuedAt, const double score){
+    if (heap == NULL || url == NULL) return;
+    if (heap->size == heap->cap){
+        heap->cap *= 2;
+        heap->entries = realloc(heap->entries, heap->cap * sizeof(entry_t));
+        mem_assert(heap->entries, "Error: Failed to allocate memory for URL heap.\n");
+    }
+    entry_t* entry = &heap->entries[heap->size];
+    entry->score = score;
+    entry->seq = heap->nextSeq++;
+    entry->key = key != 0 && findSlot(heap, key)->key == 0 ? key : 0;
+    entry->url = mem_assert(strdup(url), "Error: Failed to allocate memory for URL.\n");
+    entry->queuedAt = queuedAt;
+    entry->depth = depth;
+    if (entry->key != 0) indexKey(heap, entry->key, heap->size);
+    siftUp(heap, heap->size++);
+}
+
+/**
+ * Description: Adds to the score of the entry with the given key and sifts it up.
+ * @param heap: the heap.
+ * @param key: the entry's key.
+ * @param amount: what to add.
+ * @returns false if no entry has that key.
+*/
+bool urlheap_raise(urlheap_t* heap, const uint64_t key, const double amount){
+    if (heap == NULL || key == 0) return false;
+    slot_t* slot = findSlot(heap, key);
+    if (slot->key == 0) return false;
+    heap->entries[slot->pos].score += amount;
+    siftUp(heap, slot->pos);
+    return true;
+}
+
+/**
+ * Description: Removes the entry with the highest score: the last entry takes its place
+ *              and is sifted down.
+ * @param heap: the heap.
+ * @param depth: set to its depth.
+ * @param queuedAt: set to when it was queued.
+ * @param score: set to its score, if not NULL.
+ * @returns its URL, or NULL if the heap is empty.
+*/
+char* urlheap_pop(urlheap_t* heap, int* depth, long* queuedAt, double* score){
+    if (heap == NULL || heap->size == 0) return NULL;
+    entry_t top = heap->entries[0];
+    if (top.key != 0) unindexKey(heap, top.key);
+    heap->size--;
+    if (heap->size > 0){
+        place(heap, &heap->entries[heap->size], 0);
+        siftDown(heap, 0);
+    }
+    if (depth) *depth = top.depth;
+    if (queuedAt) *queuedAt = top.queuedAt;
+    if (score) *score = top.score;
+    return top.url;
+}
+
+/**
+ * Description: Gives the highest score queued.
+ * @param heap: the heap.
+ * @param score: set to the score.
+ * @returns false if the heap is empty.
+*/
+bool urlheap_top(urlheap_t* heap, double* score){
+    if (heap == NULL || heap->size == 0) return false;
+    if (score) *score = heap->entries[0].score;
+    return true;
+}
+
+/**
+ * Description: Returns the number of entries queued.
+ * @param heap: the heap.
+*/
+long urlheap_size(urlheap_t* heap){
+    return heap ? heap->size : 0;
+}
+
+/**
+ * Description: Deletes the heap and the URLs still in it.
+ * @param heap: the heap to delete.
+*/
+void urlheap_delete(urlheap_t* heap){
+    if (heap == NULL) return;
+    for (long i = 0; i < heap->size; i++) free(heap->entries[i].url);
+    mem_free(heap->entries);
+    mem_free(heap->slots);
+    mem_free(heap);
+}
+
+/***
+ * Description: Whether entry a comes out before entry b: a higher score, or the same
+ *              score and pushed earlier.
+*/
+static bool above(const entry_t* a, const entry_t* b){
+    return a->score > b->score || (a->score == b->score && a->seq < b->seq);
+}
+
+/***
+ * Description: Moves the entry at pos up past every parent it comes out before.
+*/
+static void siftUp(urlheap_t* heap, long pos){
+    entry_t entry = heap->entries[pos];
+    while (pos > 0){
+        long parent = (pos - 1) / ARITY;
+        if (!above(&entry, &heap->entries[parent])) break;
+        place(heap, &heap->entries[parent], pos);
+        pos = parent;
+    }
+    place(heap, &entry, pos);
+}
+
+/***
+ * Description: Moves the entry at pos down below every child that comes out before it.
+*/
+static void siftDown(urlheap_t* heap, long pos){
+    entry_t entry = heap->entries[pos];
+    while (true){
+        long first = pos * ARITY + 1;
+        if (first >= heap->size) break;
+        long last = first + ARITY < heap->size ? first + ARITY : heap->size;
+        long best = first;
+        for (long child = first + 1; child < last; child++){
+            if (above(&heap->entries[child], &heap->entries[best])) best = child;
+        }
+        if (!above(&heap->entries[best], &entry)) break;
+        place(heap, &heap->entries[best], pos);
+        pos = best;
+    }
+    place(heap, &entry, pos);
+}
+
+/***
+ * Description: Puts an entry at pos, and points its key there.
+*/
+static void place(urlheap_t* heap, const entry_t* entry, const long pos){
+    heap->entries[pos] = *entry;
+    if (entry->key != 0) findSlot(heap, entry->key)->pos = pos;
+}
+
+/***
+ * Description: Finds the key's slot in the index, or the empty slot it would go in.
+*/
+static slot_t* findSlot(urlheap_t* heap, const uint64_t key){
+    long mask = heap->numSlots - 1;
+    long i = (long)(key & mask);
+    while (heap->slots[i].key != 0 && heap->slots[i].key != key) i = (i + 1) & mask;
+    return &heap->slots[i];
+}
+
+/***
+ * Description: Adds a key, not already in the index, at pos; grows the index first
+ *              when it is three quarters full.
+*/
+static void indexKey(urlheap_t* heap, const uint64_t key, const long pos){
+    if ((heap->numKeys + 1) * 4 > heap->numSlots * 3) growIndex(heap);
+    slot_t* slot = findSlot(heap, key);
+    slot->key = key;
+    slot->pos = pos;
+    heap->numKeys++;
+}
+
+/***
+ * Description: Removes a key from the index, moving back any later key of the same run
+ *              that would no longer be found past the gap.
+*/
+static void unindexKey(urlheap_t* heap, const uint64_t key){
+    long mask = heap->numSlots - 1;
+    long gap = findSlot(heap, key) - heap->slots;
+    if (heap->slots[gap].key == 0) return;
+    heap->numKeys--;
+    for (long i = (gap + 1) & mask; heap->slots[i].key != 0; i = (i + 1) & mask){
+        long home = (long)(heap->slots[i].key & mask);
+        // The key at i can fill the gap unless its home lies cyclically in (gap, i]
+        bool between = gap <= i ? (home > gap && home <= i) : (home > gap || home <= i);
+        if (!between){
+            heap->slots[gap] = heap->slots[i];
+            gap = i;
+        }
+    }
+    heap->slots[gap].key = 0;
+}
+
+/***
+ * Description: Doubles the index and puts every key back in.
+*/
+static void growIndex(urlheap_t* heap){
+    slot_t* old = heap->slots;
+    long oldSlots = heap->numSlots;
+    heap->numSlots *= 2;
+    heap->slots = mem_assert(mem_calloc(heap->numSlots, sizeof(slot_t)), "Error: Failed to allocate memory for URL heap.\n");
+    for (long i = 0; i < oldSlots; i++){
+        if (old[i].key != 0) *findSlot(heap, old[i].key) = old[i];
+    }
+    mem_free(old);
+}
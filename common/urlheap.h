@@ -0,0 +1,81 @@
+/**
+ * urlheap.h
+ *
+ * Interface for a priority queue of URLs to crawl, each with its depth, the time it
+ * was queued and a score: the URL with the highest score comes out first, and of
+ * those with equal scores the one queued first. Each URL is queued under a 64-bit
+ * key (its urlcanon fingerprint) by which its score can be raised while it waits,
+ * as more links to it are found.
+ *
+ * Pushing, popping and raising a score are O(log n). Unlike a urlqueue, the heap
+ * keeps every entry in memory.
+ */
+#ifndef __URLHEAP_H
+#define __URLHEAP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct urlheap urlheap_t;
+
+/***
+ * Description: Creates a new empty heap.
+ * @returns pointer to the new heap; exits if out of memory.
+ */
+urlheap_t* urlheap_new(void);
+
+/***
+ * Description: Adds an entry. The url is copied. A key already queued isn't queued
+ *              again: the new entry just can't be raised.
+ * @param heap: the heap.
+ * @param url: the URL.
+ * @param key: its fingerprint; never 0.
+ * @param depth: its depth.
+ * @param queuedAt: when it was queued, in the caller's clock.
+ * @param score: its score.
+ */
+void urlheap_push(urlheap_t* heap, const char* url, const uint64_t key, const int depth,
+                  const long queuedAt, const double score);
+
+/***
+ * Description: Adds to the score of a queued entry.
+ * @param heap: the heap.
+ * @param key: the entry's key.
+ * @param amount: what to add; not negative.
+ * @returns false if no entry with that key is queued.
+ */
+bool urlheap_raise(urlheap_t* heap, const uint64_t key, const double amount);
+
+/***
+ * Description: Removes the entry with the highest score.
+ * @param heap: the heap.
+ * @param depth: set to the entry's depth.
+ * @param queuedAt: set to the time it was queued.
+ * @param score: set to its score, if not NULL.
+ * @returns the entry's URL, which the caller must free, or NULL if the heap is empty.
+ */
+char* urlheap_pop(urlheap_t* heap, int* depth, long* queuedAt, double* score);
+
+/***
+ * Description: Gives the highest score queued, without removing its entry.
+ * @param heap: the heap.
+ * @param score: set to the score.
+ * @returns false if the heap is empty.
+ */
+bool urlheap_top(urlheap_t* heap, double* score);
+
+/***
+ * Description: Returns the number of entries queued.
+ * @param heap: the heap.
+ */
+long urlheap_size(urlheap_t* heap);
+
+/***
+ * Description: Deletes the heap and its entries.
+ * @param heap: the heap to delete.
+ */
+void urlheap_delete(urlheap_t* heap);
+
+#endif
@@ -0,0 +1,305 @@
+/**
+ * urlqueue.c
+ *
+ * Description: Implements a URL queue that spills to disk. In FIFO order the queue is
+ *              three parts, oldest first: a head buffer that entries are popped from,
+ *              the segment files on disk, and a tail buffer that entries are pushed
+ *              onto. A full tail is written out as the newest segment; an empty head is
+ *              refilled from the oldest segment, or takes over the tail's entries once
+ *              nothing is on disk. In LIFO order only the tail is used, as a stack: when
+ *              it fills up its older half is written out, and when it empties the newest
+ *              segment is read back.
+ *
+ *              A segment holds one entry per line: depth, time queued, then the URL.
+ *
+ *              Disk errors don't end the process. A segment that can't be written is
+ *              removed and its entries kept in memory, and the queue spills no more. A
+ *              segment that can't be read back loses its entries; the crawler's
+ *              checkpoint still lists them, so a resumed crawl queues them again.
+ *              Either way the queue reports it failed, and the crawler stops.
+ */
+#define _POSIX_C_SOURCE 200809L    // strdup
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "urlqueue.h"
+#include "file.h"
+#include "mem.h"
+
+typedef struct entry {
+    char* url;
+    int depth;
+    long queuedAt;
+} entry_t;
+
+typedef struct urlqueue {
+    queueOrder_t order;
+    int window;
+    char* directory;            // where segments go, NULL if the queue never spills
+    char* name;
+    entry_t* head;              // FIFO only: the oldest entries, popped from headStart
+    int headStart;
+    int headCount;
+    int headCap;
+    entry_t* tail;              // the newest entries
+    int tailCount;
+    int tailCap;
+    long firstSegment;          // segments on disk are numbered firstSegment..nextSegment-1
+    long nextSegment;
+    long spilled;               // entries in segments
+    long size;                  // entries in all
+    bool failed;                // a segment couldn't be written or read back
+} urlqueue_t;
+
+static bool writeSegment(urlqueue_t* queue, entry_t* entries, const int count);
+static int readSegment(urlqueue_t* queue, const long segment, entry_t* entries);
+static char* segmentPath(urlqueue_t* queue, const long segment);
+static void grow(entry_t** entries, int* cap);
+
+
+/**
+ * Description: Creates a new empty queue.
+ * @param order: QUEUE_FIFO or QUEUE_LIFO.
+ * @param window: entries per buffer and per segment.
+ * @param directory: directory for segment files, or NULL.
+ * @param name: prefix for the segment files.
+ * @returns pointer to the new queue.
+*/
+urlqueue_t* urlqueue_new(const queueOrder_t order, const int window, const char* directory, const char* name){
+    urlqueue_t* queue = mem_assert(mem_calloc(1, sizeof(urlqueue_t)), "Error: Failed to allocate memory for URL queue.\n");
+    queue->order = order;
+    queue->window = window > 2 ? window : 2;
+    if (directory != NULL){
+        queue->directory = mem_assert(strdup(directory), "Error: Failed to allocate memory for URL queue.\n");
+        queue->name = mem_assert(strdup(name ? name : "queue"), "Error: Failed to allocate memory for URL queue.\n");
+    }
+    // Without a directory the buffers just grow; with one they stay one window long
+    // until a segment can't be written
+    queue->headCap = queue->tailCap = directory ? queue->window : 16;
+    queue->tail = mem_assert(mem_malloc(queue->tailCap * sizeof(entry_t)), "Error: Failed to allocate memory for URL queue.\n");
+    if (order == QUEUE_FIFO){
+        queue->head = mem_assert(mem_malloc(queue->headCap * sizeof(entry_t)), "Error: Failed to allocate memory for URL queue.\n");
+    }
+    return queue;
+}
+
+/**
+ * Description: Adds an entry, spilling the tail to disk if it is full.
+ * @param queue: the queue.
+ * @param url: the URL, copied.
+ * @param depth: its depth.
+ * @param queuedAt: when it was queued.
+*/
+void urlqueue_push(urlqueue_t* queue, const char* url, const int depth, const long queuedAt){
+    if (queue == NULL || url == NULL) return;
+    if (queue->tailCount == queue->tailCap){
+        if (queue->directory == NULL || queue->failed){
+            grow(&queue->tail, &queue->tailCap);
+        } else if (queue->order == QUEUE_FIFO){
+            if (writeSegment(queue, queue->tail, queue->tailCount)) queue->tailCount = 0;
+            else grow(&queue->tail, &queue->tailCap);
+        } else {
+            // Keep the newer half in memory, where the next pops will come from
+            int half = queue->tailCount / 2;
+            if (writeSegment(queue, queue->tail, half)){
+                memmove(queue->tail, queue->tail + half, (queue->tailCount - half) * sizeof(entry_t));
+                queue->tailCount -= half;
+            } else {
+                grow(&queue->tail, &queue->tailCap);
+            }
+        }
+    }
+    entry_t* entry = &queue->tail[queue->tailCount++];
+    entry->url = mem_assert(strdup(url), "Error: Failed to allocate memory for URL.\n");
+    entry->depth = depth;
+    entry->queuedAt = queuedAt;
+    queue->size++;
+}
+
+/**
+ * Description: Removes the next entry, reading a segment back from disk if needed.
+ * @param queue: the queue.
+ * @param depth: set to the entry's depth.
+ * @param queuedAt: set to when it was queued.
+ * @returns the URL, or NULL if the queue is empty (or the segments that couldn't be read
+ *          back held the rest).
+*/
+char* urlqueue_pop(urlqueue_t* queue, int* depth, long* queuedAt){
+    if (queue == NULL || queue->size == 0) return NULL;
+    entry_t entry;
+    if (queue->order == QUEUE_FIFO){
+        while (queue->headCount == 0){
+            if (queue->size == 0) return NULL;
+            queue->headStart = 0;
+            if (queue->firstSegment < queue->nextSegment){
+                queue->headCount = readSegment(queue, queue->firstSegment++, queue->head);
+            } else {
+                // Nothing on disk: the tail's entries are the oldest, so they become the head
+                entry_t* entries = queue->head;
+                int cap = queue->headCap;
+                queue->head = queue->tail;
+                queue->headCap = queue->tailCap;
+                queue->headCount = queue->tailCount;
+                queue->tail = entries;
+                queue->tailCap = cap;
+                queue->tailCount = 0;
+            }
+        }
+        entry = queue->head[queue->headStart++];
+        queue->headCount--;
+    } else {
+        while (queue->tailCount == 0){
+            if (queue->size == 0) return NULL;
+            queue->tailCount = readSegment(queue, --queue->nextSegment, queue->tail);
+        }
+        entry = queue->tail[--queue->tailCount];
+    }
+    queue->size--;
+    if (depth) *depth = entry.depth;
+    if (queuedAt) *queuedAt = entry.queuedAt;
+    return entry.url;
+}
+
+/**
+ * Description: Returns the number of entries queued.
+ * @param queue: the queue.
+*/
+long urlqueue_size(urlqueue_t* queue){
+    return queue ? queue->size : 0;
+}
+
+/**
+ * Description: Returns the number of entries on disk.
+ * @param queue: the queue.
+*/
+long urlqueue_spilled(urlqueue_t* queue){
+    return queue ? queue->spilled : 0;
+}
+
+/**
+ * Description: Returns whether a segment couldn't be written or read back.
+ * @param queue: the queue.
+*/
+bool urlqueue_failed(urlqueue_t* queue){
+    return queue ? queue->failed : false;
+}
+
+/**
+ * Description: Deletes the queue, its entries and its segment files.
+ * @param queue: the queue to delete.
+*/
+void urlqueue_delete(urlqueue_t* queue){
+    if (queue == NULL) return;
+    for (int i = 0; i < queue->headCount; i++){
+        free(queue->head[queue->headStart + i].url);
+    }
+    for (int i = 0; i < queue->tailCount; i++){
+        free(queue->tail[i].url);
+    }
+    for (long segment = queue->firstSegment; segment < queue->nextSegment; segment++){
+        char* path = segmentPath(queue, segment);
+        remove(path);
+        mem_free(path);
+    }
+    if (queue->head) mem_free(queue->head);
+    mem_free(queue->tail);
+    if (queue->directory) free(queue->directory);
+    if (queue->name) free(queue->name);
+    mem_free(queue);
+}
+
+/***
+ * Description: Writes entries out as the newest segment and frees their URLs.
+ * @param queue: the queue.
+ * @param entries: the entries, oldest first.
+ * @param count: how many.
+ * @returns false, with the entries left as they were and the queue marked failed, if the
+ *          segment can't be written.
+*/
+static bool writeSegment(urlqueue_t* queue, entry_t* entries, const int count){
+    char* path = segmentPath(queue, queue->nextSegment);
+    FILE* fp = fopen(path, "w");
+    bool ok = fp != NULL;
+    for (int i = 0; ok && i < count; i++){
+        ok = fprintf(fp, "%d %ld %s\n", entries[i].depth, entries[i].queuedAt, entries[i].url) > 0;
+    }
+    if (fp != NULL && fclose(fp) != 0) ok = false;
+    if (!ok){
+        fprintf(stderr, "Error: Can't write frontier segment %s.\n", path);
+        remove(path);
+        mem_free(path);
+        queue->failed = true;
+        return false;
+    }
+    for (int i = 0; i < count; i++) free(entries[i].url);
+    mem_free(path);
+    queue->nextSegment++;
+    queue->spilled += count;
+    return true;
+}
+
+/***
+ * Description: Reads a segment back into entries and deletes its file. Every segment
+ *              holds a full window (FIFO) or half of one (LIFO), since the queue stops
+ *              spilling once a write fails; entries missing from it are lost, and counted
+ *              out of the queue.
+ * @param queue: the queue.
+ * @param segment: the segment's number.
+ * @param entries: receives the entries, oldest first; has room for a window.
+ * @returns the number of entries read.
+*/
+static int readSegment(urlqueue_t* queue, const long segment, entry_t* entries){
+    char* path = segmentPath(queue, segment);
+    int written = queue->order == QUEUE_FIFO ? queue->window : queue->window / 2;
+    int count = 0;
+    FILE* fp = fopen(path, "r");
+    if (fp != NULL){
+        char* line;
+        while (count < written && (line = file_readLine(fp)) != NULL){
+            int offset = 0;
+            if (sscanf(line, "%d %ld %n", &entries[count].depth, &entries[count].queuedAt, &offset) >= 2 && offset > 0){
+                memmove(line, line + offset, strlen(line + offset) + 1);
+                entries[count++].url = line;
+            } else {
+                free(line);
+            }
+        }
+        fclose(fp);
+    }
+    if (count < written){
+        fprintf(stderr, "Error: Can't read frontier segment %s.\n", path);
+        queue->failed = true;
+        queue->size -= written - count;
+    }
+    remove(path);
+    mem_free(path);
+    queue->spilled -= written;
+    return count;
+}
+
+/***
+ * Description: Builds the path of a segment file.
+ * @param queue: the queue.
+ * @param segment: the segment's number.
+ * @returns a new string the caller must mem_free.
+*/
+static char* segmentPath(urlqueue_t* queue, const long segment){
+    char* path = mem_assert(mem_malloc(strlen(queue->directory) + strlen(queue->name) + 24), "Error: Failed to allocate memory for path.\n");
+    sprintf(path, "%s/%s.%ld", queue->directory, queue->name, segment);
+    return path;
+}
+
+/***
+ * Description: Doubles the room in an array of entries.
+ * @param entries: the array, reallocated.
+ * @param cap: its capacity, doubled.
+*/
+static void grow(entry_t** entries, int* cap){
+    entry_t* bigger = mem_assert(mem_malloc(*cap * 2 * sizeof(entry_t)), "Error: Failed to allocate memory for URL queue.\n");
+    memcpy(bigger, *entries, *cap * sizeof(entry_t));
+    mem_free(*entries);
+    *entries = bigger;
+    *cap *= 2;
+}
@@ -0,0 +1,80 @@
+/**
+ * urlqueue.h
+ *
+ * Interface for a queue of URLs to crawl, each with its depth and the time it was
+ * queued, that keeps a bounded number of entries in memory and spills the rest to
+ * files on disk. Entries come out first-in first-out (breadth-first, for a crawl)
+ * or last-in first-out (the order of the crawler's original bag).
+ *
+ * At most about two windows of entries are held in memory at once; whatever
+ * doesn't fit is written to append-only segment files of one window each, named
+ * <directory>/<name>.<segment number>, which are read back (and deleted) as the
+ * queue drains. A queue without a directory keeps everything in memory.
+ */
+#ifndef __URLQUEUE_H
+#define __URLQUEUE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef struct urlqueue urlqueue_t;
+
+typedef enum { QUEUE_FIFO, QUEUE_LIFO } queueOrder_t;
+
+/***
+ * Description: Creates a new empty queue.
+ * @param order: QUEUE_FIFO or QUEUE_LIFO.
+ * @param window: entries per in-memory buffer and per segment file (at least 2).
+ * @param directory: existing directory for segment files, or NULL to never spill.
+ * @param name: prefix for this queue's segment files; must be unique in directory.
+ * @returns pointer to the new queue; exits if out of memory.
+ */
+urlqueue_t* urlqueue_new(const queueOrder_t order, const int window, const char* directory, const char* name);
+
+/***
+ * Description: Adds an entry. The url is copied. If a segment can't be written its
+ *              entries stay in memory, and the queue is marked failed.
+ * @param queue: the queue.
+ * @param url: the URL.
+ * @param depth: its depth.
+ * @param queuedAt: when it was queued, in the caller's clock.
+ */
+void urlqueue_push(urlqueue_t* queue, const char* url, const int depth, const long queuedAt);
+
+/***
+ * Description: Removes the next entry, in the queue's order. If a segment can't be read
+ *              back its entries are dropped, and the queue is marked failed.
+ * @param queue: the queue.
+ * @param depth: set to the entry's depth.
+ * @param queuedAt: set to the time it was queued.
+ * @returns the entry's URL, which the caller must free, or NULL if the queue is empty.
+ */
+char* urlqueue_pop(urlqueue_t* queue, int* depth, long* queuedAt);
+
+/***
+ * Description: Returns the number of entries queued, in memory and on disk.
+ * @param queue: the queue.
+ */
+long urlqueue_size(urlqueue_t* queue);
+
+/***
+ * Description: Returns the number of entries currently in segment files on disk.
+ * @param queue: the queue.
+ */
+long urlqueue_spilled(urlqueue_t* queue);
+
+/***
+ * Description: Returns whether a segment couldn't be written or read back; the caller
+ *              should stop adding to the queue and record what it still holds elsewhere.
+ * @param queue: the queue.
+ */
+bool urlqueue_failed(urlqueue_t* queue);
+
+/***
+ * Description: Deletes the queue, its entries and its segment files.
+ * @param queue: the queue to delete.
+ */
+void urlqueue_delete(urlqueue_t* queue);
+
+#endif
@@ -0,0 +1,98 @@
+#!/bin/bash
+# bench.sh - benchmarks the crawler against a local testserver, so crawler performance
+#            can be measured without the network and compared from one change to the next.
+#
+# Usage: bash bench.sh [-n pages] [-s bytes] [-d siteDirectory] [-l latencyMs]
+#                      [-b bytesPerSecond] [-e errorPercent] [-p port] [-- crawler options]
+#
+# Builds a synthetic site of n pages (default 2000) of about s bytes each (default 4000)
+# under the CS50 site's URLs (or uses the site in siteDirectory, such as one made by
+# bench/corpusgen --site; its index.html is the seed), serves it with testserver (with
+# the latency, bandwidth and error rate given), crawls it with crawler --connect-to,
+# and prints the crawl's pages/s, bytes/s and median (p50) and 99th percentile (p99)
+# fetch latency. The crawler options default to --threads 8 --delay 0.
+
+PAGES=2000
+PAGE_BYTES=4000
+LATENCY=0
+BANDWIDTH=0
+ERRORS=0
+PORT=18090
+SITE_DIRECTORY=
+while getopts "n:s:d:l:b:e:p:" opt; do
+    case $opt in
+        n) PAGES=$OPTARG ;;
+        s) PAGE_BYTES=$OPTARG ;;
+        d) SITE_DIRECTORY=$(realpath "$OPTARG") ;;
+        l) LATENCY=$OPTARG ;;
+        b) BANDWIDTH=$OPTARG ;;
+        e) ERRORS=$OPTARG ;;
+        p) PORT=$OPTARG ;;
+        *) echo "Usage: bash bench.sh [-n pages] [-s bytes] [-d siteDirectory] [-l latencyMs] [-b bytesPerSecond] [-e errorPercent] [-p port] [-- crawler options]" >&2
+           exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+CRAWLER_OPTIONS=("$@")
+[ ${#CRAWLER_OPTIONS[@]} -eq 0 ] && CRAWLER_OPTIONS=(--threads 8 --delay 0)
+
+SITE=$(mktemp -d)
+OUT=$(mktemp -d)
+SEED_URL="http://cs50tse.cs.dartmouth.edu/tse/bench/index.html"
+
+cleanup() {
+    [ -n "$SERVER" ] && kill "$SERVER" 2> /dev/null
+    rm -rf "$SITE" "$OUT"
+}
+trap cleanup EXIT
+
+# The site: the one given, linked in where the seed URL points, or else one where page i
+# links to pages 2i+1 and 2i+2, so every page is reachable within log2(n) links of the
+# index (page 0), and to three more pages picked by a fixed pseudo-random sequence, so
+# the crawl also finds pages it has already seen
+mkdir -p "$SITE/tse"
+if [ -n "$SITE_DIRECTORY" ]; then
+    ln -s "$SITE_DIRECTORY" "$SITE/tse/bench"
+    PAGES=$(find "$SITE_DIRECTORY" -name '*.html' | wc -l)
+    PAGE_BYTES=$(( $(cat "$SITE_DIRECTORY"/*.html | wc -c) / (PAGES > 0 ? PAGES : 1) ))
+else
+    mkdir -p "$SITE/tse/bench"
+    awk -v pages="$PAGES" -v bytes="$PAGE_BYTES" -v dir="$SITE/tse/bench" 'BEGIN {
+    state = 12345
+    filler = "<p>alpha beta gamma delta epsilon zeta eta theta iota kappa lambda mu nu xi omicron</p>\n"
+    for (i = 0; i < pages; i++) {
+        file = dir "/" (i == 0 ? "index" : i) ".html"
+        printf "<html><head><title>Page %d</title></head><body>\n<h1>Page %d</h1>\n", i, i > file
+        for (k = 1; k <= 2; k++) {
+            if (2 * i + k < pages) printf "<a href=\"%d.html\">page %d</a>\n", 2 * i + k, 2 * i + k > file
+        }
+        for (k = 0; k < 3; k++) {
+            state = (state * 1103515245 + 12345) % 2147483648
+            j = 1 + state % (pages > 1 ? pages - 1 : 1)
+            printf "<a href=\"%d.html\">page %d</a>\n", j, j > file
+        }
+        for (n = 0; n < bytes; n += length(filler)) printf "%s", filler > file
+        printf "</body></html>\n" > file
+        close(file)
+    }
+}'
+fi
+
+SERVER_OPTIONS=()
+[ "$LATENCY" -gt 0 ] && SERVER_OPTIONS+=(--latency "$LATENCY")
+[ "$BANDWIDTH" -gt 0 ] && SERVER_OPTIONS+=(--bandwidth "$BANDWIDTH")
+[ "$ERRORS" -gt 0 ] && SERVER_OPTIONS+=(--errors "$ERRORS")
+./testserver "${SERVER_OPTIONS[@]}" "$PORT" "$SITE" &
+SERVER=$!
+for i in $(seq 50); do
+    (exec 3<> "/dev/tcp/127.0.0.1/$PORT") 2> /dev/null && break
+    sleep 0.1
+done
+
+echo "site: $PAGES pages of about $PAGE_BYTES bytes; server: latency ${LATENCY}ms, bandwidth ${BANDWIDTH} bytes/s (0 unlimited), ${ERRORS}% errors"
+echo "crawler: ${CRAWLER_OPTIONS[*]}"
+if ! ./crawler "${CRAWLER_OPTIONS[@]}" --host-stats --connect-to "127.0.0.1:$PORT" "$SEED_URL" "$OUT" "$PAGES" > /dev/null 2> "$OUT/.stats"; then
+    cat "$OUT/.stats" >&2
+    exit 1
+fi
+grep '^fetches:' "$OUT/.stats" | sed -E 's/^fetches: ([0-9]+) pages \(([0-9]+) failed\), ([0-9]+) bytes in ([0-9.]+) s, ([0-9.]+) pages\/s, ([0-9]+) bytes\/s, latency p50 ([0-9.]+) ms, p99 ([0-9.]+) ms$/pages: \1 (\2 failed) in \4 s\npages\/s: \5\nbytes\/s: \6\np50: \7 ms\np99: \8 ms/'
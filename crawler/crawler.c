@@ -1,50 +1,346 @@
+#define _POSIX_C_SOURCE 200809L    // mkdir, clock_gettime
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
 #include "webpage.h"
-#include "bag.h"
-#include "hashtable.h"
+#include "fetcher.h"
+#include "frontier.h"
+#include "scorer.h"
+#include "seenset.h"
+#include "resolver.h"
+#include "checkpoint.h"
 #include "pagedir.h"
+#include "pagewriter.h"
+#include "histogram.h"
+#include "urlcanon.h"
+#include "linkscan.h"
+#include "metrics.h"
+#include "asynclog.h"
+#include "hashtable.h"
 #include "mem.h"
 
 int NUM_SLOTS = 200;
+#define MAX_THREADS 256
+#define MAX_CONNECTIONS 1024
+#define DEFAULT_DELAY_MS 1000       // per host; the pace webpage_fetch's sleep(1) used to set
+#define DEFAULT_WINDOW 10000        // pages per host kept in memory; the rest spill to disk
+#define MAX_WINDOW 10000000
+#define BLOOM_BITS_PER_URL 10       // about 1% of new URLs mistaken for seen
+#define MAX_BLOOM_URLS 2000000000
+#define DEFAULT_CHECKPOINT_MS 1000  // how often the checkpoint is written out
+#define DNS_TTL_MS 300000           // how long a resolved host address is reused
+#define DNS_NEGATIVE_TTL_MS 30000   // how long a host that didn't resolve is remembered
+#define WRITE_QUEUE_PAGES 256       // fetched pages waiting for the page writer before fetching waits
+#define MAX_URL 4096                // longest URL normalized without allocating
+#define LINK_BATCH 64               // links taken from a page at a time
+#define DEFAULT_SCORE "depth,inlinks"   // what --order priority ranks pages by
+#define DEFAULT_STATS_MS 1000       // how often the --stats file is rewritten
+
+// How the crawl is carried out, as given on the command line
+typedef struct crawlOptions {
+    int numThreads;             // worker threads, each fetching one page at a time
+    int connections;            // if > 0, fetch asynchronously with this many connections instead
+    int delayMs;                // least time between starting two fetches from the same host
+    queueOrder_t order;         // breadth-first or most-recent first, within each host
+    scorer_t* scorer;           // with --order priority, ranks pages instead
+    const char* scoreSpec;      // the scorer's terms
+    const char* weightsFile;    // the scorer's URL pattern weights
+    const char* crawlLog;       // if not NULL, where the order pages are fetched in is logged
+    int window;                 // pages per host the frontier keeps in memory
+    bool hostStats;             // print per-host queue lengths, wait times and DNS counters when done
+    long bloomURLs;             // if > 0, keep the seen-set as a Bloom filter sized for this many URLs
+    bool resume;                // continue the crawl checkpointed in pageDirectory
+    int checkpointMs;           // how often the checkpoint is written out
+    pagedirLayout_t layout;     // one file per page, or pages appended to archive segments,
+                                // optionally compressed
+    char connectHost[256];      // if not empty, every fetch connects here instead of to its host
+    int connectPort;
+    bool recrawl;               // refresh the crawl already in pageDirectory
+    bool stream;                // scan each page for links as it arrives
+    const char* statsFile;      // if not NULL, the crawl's metrics are kept in this file
+    int statsMs;                // how often it is rewritten
+    bool quiet;                 // don't print a line for every page fetched, scanned and found
+} crawlOptions_t;
+
+// The crawl's metrics; each is NULL, and ignores updates, without --stats
+typedef struct crawlMetrics {
+    metric_t* fetched;          // pages fetched
+    metric_t* failed;           // pages that couldn't be fetched
+    metric_t* bytes;            // bytes of HTML fetched
+    metric_t* found;            // new URLs found
+    metric_t* saved;            // pages saved
+    metric_t* fetchTime;        // how long each fetch took, from start to finish
+    metric_t* scanTime;         // how long scanning a fetched page for links took
+    metric_t* saveTime;         // how long the page writer took to save a page
+} crawlMetrics_t;
+
+// Everything the worker threads share during a crawl
+typedef struct crawlState {
+    frontier_t* pagesToCrawl;   // pages waiting to be fetched
+    seenset_t* pagesSeen;       // URLs seen so far, with their depths
+    resolver_t* resolver;       // DNS cache shared by every fetcher
+    checkpoint_t* checkpoint;   // journal the crawl can be resumed from
+    pagedir_t* pages;           // where fetched pages are saved
+    pagewriter_t* writer;       // thread that saves them
+    atomic_bool stopped;        // set when a page, the checkpoint or a frontier segment
+                                // couldn't be written; no more pages are taken
+    int maxDepth;               // pages at this depth are saved but not scanned
+    bool stream;                // pages are scanned as they arrive
+    bool creditLinks;           // links to pages already queued raise their score
+    atomic_int nextDocID;       // docID handed to the next page saved
+    int* freeDocIDs;            // on resume, docIDs left unused by the interrupted crawl
+    int numFreeDocIDs;
+    atomic_int nextFreeDocID;   // index of the next of them to hand out
+    pthread_mutex_t statsLock;  // guards the two below, which each fetcher adds to when done
+    fetcherStats_t fetches;     // pages fetched and failed, and bytes fetched
+    histogram_t* latency;       // microseconds each fetch took
+    // Recrawling: the earlier crawl's documents keep their docIDs, new pages get new ones
+    bool recrawl;
+    hashtable_t* known;         // the earlier crawl's URLs, each with its docID (int*)
+    int numKnown;               // its largest docID
+    atomic_bool* reached;       // by docID, whether the recrawl has come to the page
+    atomic_long unchanged;      // pages found as they were
+    atomic_long modified;
+    atomic_long added;
+    atomic_long removed;
+    asynclog_t* log;            // where the lines for each page go; NULL with --quiet
+    metrics_t* metrics;         // NULL without --stats
+    crawlMetrics_t stats;
+} crawlState_t;
+
+// A worker's blocking fetch: the fetcher callback handles the page and says so through this
+typedef struct fetchResult {
+    crawlState_t* state;
+    bool done;                  // false until the fetch completes
+} fetchResult_t;
 
 static void parseArgs(const int argc, char* argv[],
-                      char** seedURL, char** pageDirectory, int* maxDepth);
-static void crawl(char* seedURL, char* pageDirectory, const int maxDepth);
-static void pageScan(webpage_t* page, bag_t* pagesToCrawl, hashtable_t* pagesSeen);
-static void deleteDepth(void* item);
+                      char** seedURL, char** pageDirectory, int* maxDepth, crawlOptions_t* options);
+static int parseOption(const char* arg, const char* name, const int min, const int max);
+static bool crawl(char* seedURL, char* pageDirectory, const int maxDepth, const crawlOptions_t* options);
+static void* crawlWorker(void* arg);
+static void workerFetched(void* arg, webpage_t* page, const bool success, const fetchResponse_t* response);
+static void crawlAsync(crawlState_t* state, const crawlOptions_t* options);
+static void asyncFetched(void* arg, webpage_t* page, const bool success, const fetchResponse_t* response);
+static bool startFetch(crawlState_t* state, fetcher_t* fetcher, webpage_t* page);
+static void pageDone(crawlState_t* state, webpage_t* page, const bool success, const fetchResponse_t* response);
+static void pageStreamed(void* arg, webpage_t* page, const char* html, const size_t len, size_t* scanned);
+static void pageFetched(webpage_t* page, crawlState_t* state, const int docID, const pageMeta_t* meta,
+                        const size_t scanned);
+static void pageRefreshed(webpage_t* page, crawlState_t* state, const int docID, const bool success,
+                          const fetchResponse_t* response);
+static bool scanStored(webpage_t* page, crawlState_t* state, const int docID);
+static bool sameAsStored(webpage_t* page, crawlState_t* state, const int docID);
+static void pageRemoved(crawlState_t* state, const int docID, webpage_t* stored);
+static bool loadKnown(crawlState_t* state);
+static void removeUnreached(crawlState_t* state);
+static int knownDocID(crawlState_t* state, const char* url);
+static void pageSaved(void* arg, webpage_t* page, const int docID, const bool success, const long writeUs);
+static void pageScan(webpage_t* page, const char* html, const size_t scanned, crawlState_t* state);
+static void scanLinks(webpage_t* page, const char* html, const size_t htmlLen, size_t* pos,
+                      const bool partial, crawlState_t* state);
+static void pageFailed(webpage_t* page, crawlState_t* state);
+static int takeDocID(crawlState_t* state);
+static void fillFreeDocIDs(crawlState_t* state);
+static bool crawlStopped(crawlState_t* state);
+static void addFetches(crawlState_t* state, fetcher_t* fetcher);
+static void reportFetches(crawlState_t* state, const long elapsedUs, FILE* fp);
+static void addMetrics(crawlState_t* state);
+static double frontierGauge(void* arg);
+static double seenGauge(void* arg);
+static long nowUs(void);
+static void removeSegments(const char* spillDirectory);
 
 
-int 
+int
 main(const int argc, char* argv[]){
     // Declaring our arguments for crawling a seedURL
     char* seedURL; char* pageDirectory; int maxDepth;
+    crawlOptions_t options = { .numThreads = 1, .connections = 0, .delayMs = DEFAULT_DELAY_MS,
+                               .order = QUEUE_FIFO, .window = DEFAULT_WINDOW, .hostStats = false,
+                               .bloomURLs = 0, .resume = false, .checkpointMs = DEFAULT_CHECKPOINT_MS,
+                               .layout = PAGEDIR_FILES, .connectHost = "", .connectPort = 0,
+                               .recrawl = false, .stream = false, .scorer = NULL, .scoreSpec = NULL,
+                               .weightsFile = NULL, .crawlLog = NULL, .statsFile = NULL,
+                               .statsMs = DEFAULT_STATS_MS, .quiet = false };
     // Parsing the arguments from the command line into the variables
-    parseArgs(argc, argv, &seedURL, &pageDirectory, &maxDepth);
+    parseArgs(argc, argv, &seedURL, &pageDirectory, &maxDepth, &options);
     // Crawling until maxDepth and saving the webpages to pageDirectory
-    crawl(seedURL, pageDirectory, maxDepth);
-    exit(0);
+    bool finished = crawl(seedURL, pageDirectory, maxDepth, &options);
+    scorer_delete(options.scorer);
+    exit(finished ? 0 : 1);
 }
 
 /**
 * Description: Parses and validates command-line arguments for the crawler.
+*              Usage: ./crawler [--threads N | --async N] [--delay MS] [--order bfs|lifo|priority]
+*                               [--score TERMS] [--url-weights FILE] [--crawl-log FILE]
+*                               [--window N] [--bloom N] [--host-stats] [--resume] [--checkpoint MS]
+*                               [--archive | --compress] [--connect-to HOST:PORT] [--recrawl]
+*                               [--stream] [--stats FILE] [--stats-interval MS] [--quiet]
+*                               seedURL pageDirectory maxDepth
 * @param argc: Number of arguments.
 * @param argv: Argument values.
 * @param seedURL: Pointer to the seedURL to be initialized.
 * @param pageDirectory: Pointer to the directory name where pages will be saved.
 * @param maxDepth: Pointer to the maximum depth.
+* @param options: Pointer to the crawl options; fields not given are left alone.
 * @return void
 */
 static void
 parseArgs(const int argc, char* argv[],
-                      char** seedURL, char** pageDirectory, int* maxDepth)
+                      char** seedURL, char** pageDirectory, int* maxDepth, crawlOptions_t* options)
 {
+    static const struct option longOptions[] = {
+        {"threads", required_argument, NULL, 't'},
+        {"async", required_argument, NULL, 'a'},
+        {"delay", required_argument, NULL, 'd'},
+        {"order", required_argument, NULL, 'o'},
+        {"window", required_argument, NULL, 'w'},
+        {"host-stats", no_argument, NULL, 's'},
+        {"bloom", required_argument, NULL, 'b'},
+        {"resume", no_argument, NULL, 'r'},
+        {"checkpoint", required_argument, NULL, 'c'},
+        {"archive", no_argument, NULL, 'A'},
+        {"compress", no_argument, NULL, 'C'},
+        {"connect-to", required_argument, NULL, 'T'},
+        {"recrawl", no_argument, NULL, 'R'},
+        {"stream", no_argument, NULL, 'S'},
+        {"score", required_argument, NULL, 'P'},
+        {"url-weights", required_argument, NULL, 'W'},
+        {"crawl-log", required_argument, NULL, 'L'},
+        {"stats", required_argument, NULL, 'M'},
+        {"stats-interval", required_argument, NULL, 'I'},
+        {"quiet", no_argument, NULL, 'q'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    bool priority = false;
+    while ((opt = getopt_long(argc, argv, "t:a:d:", longOptions, NULL)) != -1){
+        switch (opt){
+        case 't':
+            options->numThreads = parseOption(optarg, "Number of threads", 1, MAX_THREADS);
+            break;
+        case 'a':
+            options->connections = parseOption(optarg, "Number of connections", 1, MAX_CONNECTIONS);
+            break;
+        case 'd':
+            options->delayMs = parseOption(optarg, "Delay", 0, 60000);
+            break;
+        case 'o':
+            if (strcasecmp(optarg, "bfs") == 0){
+                options->order = QUEUE_FIFO;
+            } else if (strcasecmp(optarg, "lifo") == 0){
+                options->order = QUEUE_LIFO;
+            } else if (strcasecmp(optarg, "priority") == 0){
+                priority = true;
+            } else {
+                fprintf(stderr, "Error: Order must be bfs, lifo or priority.\n");
+                exit(1);
+            }
+            break;
+        case 'w':
+            options->window = parseOption(optarg, "Window", 2, MAX_WINDOW);
+            break;
+        case 's':
+            options->hostStats = true;
+            break;
+        case 'b':
+            options->bloomURLs = parseOption(optarg, "Number of URLs", 1, MAX_BLOOM_URLS);
+            break;
+        case 'r':
+            options->resume = true;
+            break;
+        case 'c':
+            options->checkpointMs = parseOption(optarg, "Checkpoint interval", 1, 3600000);
+            break;
+        case 'A':
+            if (options->layout == PAGEDIR_FILES) options->layout = PAGEDIR_ARCHIVE;
+            break;
+        case 'C':
+            options->layout = PAGEDIR_COMPRESSED;
+            break;
+        case 'T': {
+            char* colon = strrchr(optarg, ':');
+            if (colon == NULL || colon == optarg || colon - optarg >= (long)sizeof(options->connectHost)){
+                fprintf(stderr, "Error: --connect-to must be HOST:PORT.\n");
+                exit(1);
+            }
+            options->connectPort = parseOption(colon + 1, "Port", 1, 65535);
+            memcpy(options->connectHost, optarg, colon - optarg);
+            options->connectHost[colon - optarg] = '\0';
+            break;
+        }
+        case 'R':
+            options->recrawl = true;
+            break;
+        case 'S':
+            options->stream = true;
+            break;
+        case 'P':
+            options->scoreSpec = optarg;
+            break;
+        case 'W':
+            options->weightsFile = optarg;
+            break;
+        case 'L':
+            options->crawlLog = optarg;
+            break;
+        case 'M':
+            options->statsFile = optarg;
+            break;
+        case 'I':
+            options->statsMs = parseOption(optarg, "Stats interval", 1, 3600000);
+            break;
+        case 'q':
+            options->quiet = true;
+            break;
+        default:
+            fprintf(stderr, "Usage: ./crawler [--threads N | --async N] [--delay MS] [--order bfs|lifo|priority] [--score TERMS] [--url-weights FILE] [--crawl-log FILE] [--window N] [--bloom N] [--host-stats] [--resume] [--checkpoint MS] [--archive | --compress] [--connect-to HOST:PORT] [--recrawl] [--stream] [--stats FILE] [--stats-interval MS] [--quiet] seedURL pageDirectory maxDepth\n");
+            exit(1);
+        }
+    }
+    // A recrawl keeps no checkpoint; one that stops is simply run again
+    if (options->recrawl && options->resume){
+        fprintf(stderr, "Error: --recrawl and --resume can't be used together.\n");
+        exit(1);
+    }
+    // A recrawl decides whether a page changed only once it is all here
+    if (options->recrawl && options->stream){
+        fprintf(stderr, "Error: --recrawl and --stream can't be used together.\n");
+        exit(1);
+    }
+    // Scores only decide anything in a priority crawl
+    if (!priority && (options->scoreSpec != NULL || options->weightsFile != NULL)){
+        fprintf(stderr, "Error: --score and --url-weights need --order priority.\n");
+        exit(1);
+    }
+    if (priority){
+        options->scorer = scorer_new(options->scoreSpec != NULL ? options->scoreSpec : DEFAULT_SCORE, options->weightsFile);
+        if (options->scorer == NULL) exit(1);
+    }
+    // The asynchronous fetcher runs in the main thread only
+    if (options->connections > 0 && options->numThreads > 1){
+        fprintf(stderr, "Error: --threads and --async can't be used together.\n");
+        exit(1);
+    }
     // Ensuring user inputted enough arguments.
-    if (argc < 4){
+    if (argc - optind < 3){
         fprintf(stderr, "Error: Not enough arguments supplemented.\n");
         exit(1);
     }
+    argv += optind - 1;
     // Ensuring the seedURL is internal.
     char* normalizedURL = normalizeURL(argv[1]);
     if (!isInternalURL(normalizedURL)){
@@ -54,8 +350,10 @@ parseArgs(const int argc, char* argv[],
     } else {
         *seedURL = normalizedURL;
     }
-    // In case of failure of initiating the page directory.
-    if (!pagedir_init((*pageDirectory = argv[2]))){
+    // In case of failure of initiating the page directory; a resumed crawl or a recrawl keeps
+    // the one it has, in the layout it was started with.
+    *pageDirectory = argv[2];
+    if (!options->resume && !options->recrawl && !pagedir_create(*pageDirectory, options->layout)){
         fprintf(stderr, "Error: Can't write on file.\n");
         exit(1);
     }
@@ -68,92 +366,836 @@ parseArgs(const int argc, char* argv[],
 }
 
 /**
-* Description: Implements the core crawling logic. Fetches pages up to a given depth, scans and saves them.
+* Description: Parses the integer value of a command-line option, exiting if it isn't one
+*              within [min, max].
+* @param arg: The option's value.
+* @param name: What the option is, for the error message.
+* @param min: Smallest value allowed.
+* @param max: Largest value allowed.
+* @return The value.
+*/
+static int
+parseOption(const char* arg, const char* name, const int min, const int max){
+    int value;
+    if (sscanf(arg, "%d", &value) != 1 || value < min || value > max){
+        fprintf(stderr, "Error: %s must be an integer between %d and %d.\n", name, min, max);
+        exit(1);
+    }
+    return value;
+}
+
+/**
+* Description: Implements the core crawling logic. Fetches, saves and scans pages up to a given
+*              depth, either with a pool of worker threads or with the asynchronous fetcher.
 * @param seedURL: seedURL for the crawl.
 * @param pageDirectory: Directory where pages are saved.
 * @param maxDepth: Maximum depth allowed.
-* @return void
+* @param options: Number of threads or asynchronous connections, and the per-host delay.
+* @return true if the crawl ran to the end; false if it stopped because a page, the
+*         checkpoint or a frontier segment couldn't be written, in which case it can be
+*         resumed from its checkpoint.
 */
-static void 
-crawl(char* seedURL, char* pageDirectory, const int maxDepth){
-    // Initializing a hashtable to hold (URLs, URLDepth) seen
-    hashtable_t* pagesSeen = hashtable_new(NUM_SLOTS);
+static bool
+crawl(char* seedURL, char* pageDirectory, const int maxDepth, const crawlOptions_t* options){
+    crawlState_t state;
+    // Initializing the set of (URLs, URLDepth) seen; a Bloom filter if asked, trading a few
+    // skipped pages for a fixed, much smaller memory footprint
+    state.pagesSeen = options->bloomURLs > 0 ? seenset_newBloom(options->bloomURLs, BLOOM_BITS_PER_URL)
+                                             : seenset_new(NUM_SLOTS);
 
-    // Allocating memory for the depth of the seedURL
-    // Adding the seedURL and its depth to the pages seen hashtable
-    int* seedDepth = (int*)mem_malloc(sizeof(int));
-    *seedDepth = 0;
-    hashtable_insert(pagesSeen, seedURL, seedDepth);
+    // Initializing the frontier of pages that need to be crawled; it hands out pages of the
+    // same host no faster than one every delayMs, and keeps window pages per host in memory,
+    // spilling the rest to pageDirectory/.frontier (emptied of any crawl interrupted earlier)
+    char* spillDirectory = mem_assert(mem_malloc(strlen(pageDirectory) + strlen("/.frontier") + 1), "Error: Couldn't allocate memory for path");
+    sprintf(spillDirectory, "%s/.frontier", pageDirectory);
+    if (mkdir(spillDirectory, 0755) != 0 && errno != EEXIST){
+        fprintf(stderr, "Error: Can't create %s.\n", spillDirectory);
+        exit(1);
+    }
+    removeSegments(spillDirectory);
+    state.pagesToCrawl = frontier_new(options->delayMs, options->order, options->window, spillDirectory);
+    // A priority crawl ranks the pages it has queued, and raises a page's rank with every
+    // link to it found while it waits
+    if (options->scorer != NULL) frontier_setScorer(state.pagesToCrawl, options->scorer);
+    state.creditLinks = scorer_inlinkWeight(options->scorer) != 0;
+    FILE* crawlLog = NULL;
+    if (options->crawlLog != NULL){
+        if ((crawlLog = fopen(options->crawlLog, "w")) == NULL){
+            fprintf(stderr, "Error: Can't write %s.\n", options->crawlLog);
+            exit(1);
+        }
+        frontier_setLog(state.pagesToCrawl, crawlLog);
+    }
+
+    // Documents are numbered from 1, as the indexer and querier expect
+    atomic_init(&state.nextDocID, 1);
+    state.freeDocIDs = NULL;
+    state.numFreeDocIDs = 0;
+    atomic_init(&state.nextFreeDocID, 0);
+    state.pages = pagedir_open(pageDirectory);
+    state.recrawl = options->recrawl;
+    state.known = NULL;
+    state.numKnown = 0;
+    state.reached = NULL;
+    atomic_init(&state.unchanged, 0);
+    atomic_init(&state.modified, 0);
+    atomic_init(&state.added, 0);
+    atomic_init(&state.removed, 0);
+    if (options->recrawl){
+        // The earlier crawl's pages keep their docIDs; new ones are numbered after them.
+        // Its checkpoint no longer describes the pages, so it goes
+        if (state.pages == NULL || !loadKnown(&state)){
+            fprintf(stderr, "Error: No crawl to refresh in %s.\n", pageDirectory);
+            exit(1);
+        }
+        if (!checkpoint_remove(pageDirectory)){
+            fprintf(stderr, "Error: Can't remove the checkpoint in %s.\n", pageDirectory);
+            exit(1);
+        }
+        atomic_init(&state.nextDocID, state.numKnown + 1);
+    } else if (options->resume){
+        // Pick up the seen-set, the frontier and the docIDs where the checkpoint left them
+        checkpointRestore_t restore;
+        if (state.pages == NULL || !checkpoint_restore(pageDirectory, state.pages, state.pagesSeen, state.pagesToCrawl, &restore)){
+            fprintf(stderr, "Error: No checkpoint to resume from in %s.\n", pageDirectory);
+            exit(1);
+        }
+        // Pages saved past the last recorded docID would otherwise be indexed twice
+        pagedir_discard(state.pages, restore.nextDocID);
+        fprintf(stdout, "Resuming: %ld pages saved, %ld to crawl\n", restore.saved, restore.pending);
+        atomic_init(&state.nextDocID, restore.nextDocID);
+        state.freeDocIDs = restore.freeDocIDs;
+        state.numFreeDocIDs = restore.numFreeDocIDs;
+    }
+    // A journal that never got as far as the seedURL (its first write failed) starts over
+    bool seed = !options->resume || seenset_size(state.pagesSeen) == 0;
+    if (!seed) mem_free(seedURL);
+    state.checkpoint = options->recrawl ? NULL : checkpoint_new(pageDirectory, state.pages, options->resume, options->checkpointMs);
+    if (state.checkpoint == NULL && !options->recrawl){
+        fprintf(stderr, "Error: Can't write the checkpoint in %s.\n", pageDirectory);
+        exit(1);
+    }
+    if (seed){
+        // Start from the seedURL at depth 0
+        seenset_insert(state.pagesSeen, seedURL, 0);
+        checkpoint_seen(state.checkpoint, seedURL, 0);
+        frontier_insert(state.pagesToCrawl, webpage_new(seedURL, 0, NULL));
+    }
+
+    // Every fetcher resolves hosts through the same cache, which may send them all elsewhere
+    state.resolver = resolver_new(DNS_TTL_MS, DNS_NEGATIVE_TTL_MS);
+    if (options->connectHost[0] != '\0' && !resolver_connectTo(state.resolver, options->connectHost, options->connectPort)){
+        fprintf(stderr, "Error: Can't resolve %s.\n", options->connectHost);
+        exit(1);
+    }
+    pthread_mutex_init(&state.statsLock, NULL);
+    state.fetches = (fetcherStats_t){0};
+    state.latency = histogram_new();
+    long startedUs = nowUs();
+    state.maxDepth = maxDepth;
+    state.stream = options->stream;
+    // The line for each page is written out from a thread of its own, so no fetch waits
+    // on the terminal; the metrics, if kept, are written out every statsMs
+    state.log = options->quiet ? NULL : asynclog_new(stdout);
+    state.metrics = options->statsFile != NULL ? metrics_new() : NULL;
+    addMetrics(&state);
+    if (state.metrics != NULL && !metrics_start(state.metrics, options->statsFile, options->statsMs)) exit(1);
+    // Fetched pages are saved from a thread of their own, so no fetch waits on the disk
+    atomic_init(&state.stopped, false);
+    state.writer = pagewriter_new(state.pages, WRITE_QUEUE_PAGES, pageSaved, &state);
+
+    if (options->connections > 0){
+        crawlAsync(&state, options);
+    } else {
+        // Start the workers; each one runs until the frontier reports the crawl is over
+        int numThreads = options->numThreads;
+        pthread_t* workers = mem_assert(mem_malloc(numThreads * sizeof(pthread_t)), "Error: Failed to allocate memory for workers.\n");
+        for (int i = 0; i < numThreads; i++){
+            if (pthread_create(&workers[i], NULL, crawlWorker, &state) != 0){
+                fprintf(stderr, "Error: Failed to start worker thread.\n");
+                exit(1);
+            }
+        }
+        for (int i = 0; i < numThreads; i++){
+            pthread_join(workers[i], NULL);
+        }
+        mem_free(workers);
+    }
 
-    // Initializing a bag to hold pages that need to be crawled
-    bag_t* pagesToCrawl = bag_new();
-    // Initializin a webpage with out seedURL and adding it to the bag
-    webpage_t* seedURLWebpage = webpage_new(seedURL, *(int*)hashtable_find(pagesSeen, seedURL), NULL);
-    bag_insert(pagesToCrawl, seedURLWebpage);
-    // Declaring a webpage variable to hold the webpage to be extracted from the bag
+    // Pages of the earlier crawl the recrawl never came to are gone from the site
+    if (state.recrawl && !crawlStopped(&state)) removeUnreached(&state);
+    // docIDs a resumed crawl couldn't reuse are filled, so no later document is cut off
+    if (!crawlStopped(&state)) fillFreeDocIDs(&state);
+    pagewriter_drain(state.writer);
+    long elapsedUs = nowUs() - startedUs;
+    if (options->hostStats){
+        frontier_report(state.pagesToCrawl, stderr);
+        resolver_report(state.resolver, stderr);
+        seenset_report(state.pagesSeen, stderr);
+        pagewriter_report(state.writer, stderr);
+        reportFetches(&state, elapsedUs, stderr);
+    }
+    // Stop the page writer, then write out the rest of the checkpoint (syncing the pages
+    // it records first), then delete the frontier (and its now empty spill
+    // directory), the seen-set and the DNS cache
+    pagewriter_delete(state.writer);
+    if (!checkpoint_delete(state.checkpoint)) atomic_store(&state.stopped, true);
+    asynclog_delete(state.log);
+    metrics_delete(state.metrics);
+    if (state.recrawl){
+        pagedir_sync(state.pages);
+        fprintf(stdout, "Recrawled: %ld unchanged, %ld modified, %ld added, %ld removed\n",
+                atomic_load(&state.unchanged), atomic_load(&state.modified),
+                atomic_load(&state.added), atomic_load(&state.removed));
+        hashtable_delete(state.known, mem_free);
+        mem_free(state.reached);
+    }
+    frontier_delete(state.pagesToCrawl);
+    if (crawlLog != NULL) fclose(crawlLog);
+    rmdir(spillDirectory);
+    mem_free(spillDirectory);
+    seenset_delete(state.pagesSeen);
+    resolver_delete(state.resolver);
+    histogram_delete(state.latency);
+    pthread_mutex_destroy(&state.statsLock);
+    pagedir_close(state.pages);
+    if (state.freeDocIDs) mem_free(state.freeDocIDs);
+    if (atomic_load(&state.stopped)){
+        fprintf(stderr, "Crawl stopped; it can be continued with --resume once the disk can be written.\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+* Description: Body of a worker thread. Repeatedly takes a page from the frontier (which waits
+*              out the page's host delay), fetches it, saves it under the next docID and, unless
+*              it is at maxDepth, scans it for links.
+* @param arg: Pointer to the shared crawlState_t.
+* @return NULL
+*/
+static void*
+crawlWorker(void* arg){
+    crawlState_t* state = arg;
+    // Each worker fetches one page at a time through its own single-connection fetcher;
+    // never webpage_fetch, whose gethostbyname isn't safe to call from several threads
+    fetchResult_t result = { .state = state };
+    fetcher_t* fetcher = mem_assert(fetcher_new(1, workerFetched, &result), "Error: Failed to create fetcher.\n");
+    fetcher_setResolver(fetcher, state->resolver);
+    if (state->stream) fetcher_setStream(fetcher, pageStreamed, state);
     webpage_t* webpage;
-    int docID = 0;
-    // While there are still pages to crawl...
-    while ((webpage = bag_extract(pagesToCrawl)) != NULL) {
+    // While there are still pages to crawl, and they can still be saved...
+    while (!crawlStopped(state) && (webpage = frontier_take(state->pagesToCrawl)) != NULL) {
         // Extract a page and try to fetch it contents
-        if(webpage_fetch(webpage)){
-            fprintf(stdout, "Fetched: %s\n", webpage_getURL(webpage));
-            // Save the page with the corresponding document ID and increment 
-            pagedir_save(webpage, pageDirectory, docID);
-            docID++;
-            // Check if we are the maximum depth and don't go any further searching for links.
-            if (*(int*)hashtable_find(pagesSeen, webpage_getURL(webpage)) < maxDepth){
-                pageScan(webpage, pagesToCrawl, pagesSeen);
+        result.done = false;
+        if (startFetch(state, fetcher, webpage)){
+            // Run the fetcher until it has handed the page to the callback
+            while (!result.done){
+                fetcher_run(fetcher, -1);
             }
+        } else {
+            pageDone(state, webpage, false, &(fetchResponse_t){0});
+        }
+        frontier_done(state->pagesToCrawl);
+    }
+    addFetches(state, fetcher);
+    fetcher_delete(fetcher);
+    return NULL;
+}
+
+/**
+* Description: Fetcher callback for a worker's blocking fetch; handles the page and tells
+*              the worker it is done.
+* @param arg: Pointer to the worker's fetchResult_t.
+* @param page: The page, with its HTML if the fetch succeeded.
+* @param success: Whether the fetch succeeded.
+* @param response: The response's status and validators.
+* @return void
+*/
+static void
+workerFetched(void* arg, webpage_t* page, const bool success, const fetchResponse_t* response){
+    fetchResult_t* result = arg;
+    pageDone(result->state, page, success, response);
+    result->done = true;
+}
+
+/**
+* Description: Crawls from the main thread with the asynchronous fetcher. Keeps up to
+*              options->connections fetches in flight, taking pages from the frontier as
+*              their hosts' delays allow, and handles each page as its fetch completes.
+* @param state: The crawl's shared frontier and seen-set.
+* @param options: Number of connections.
+* @return void
+*/
+static void
+crawlAsync(crawlState_t* state, const crawlOptions_t* options){
+    fetcher_t* fetcher = mem_assert(fetcher_new(options->connections, asyncFetched, state), "Error: Failed to create fetcher.\n");
+    fetcher_setResolver(fetcher, state->resolver);
+    if (state->stream) fetcher_setStream(fetcher, pageStreamed, state);
+    while ((frontier_size(state->pagesToCrawl) > 0 && !crawlStopped(state))
+           || fetcher_active(fetcher) > 0){
+        // Start fetches while there are free connections and pages whose host is ready,
+        // unless pages can no longer be saved; then just finish those in flight
+        long waitMs = -1;
+        webpage_t* webpage;
+        while (!crawlStopped(state) && fetcher_active(fetcher) < options->connections
+               && (webpage = frontier_tryTake(state->pagesToCrawl, &waitMs)) != NULL){
+            if (!startFetch(state, fetcher, webpage)){
+                asyncFetched(state, webpage, false, &(fetchResponse_t){0});
+            }
+        }
+        // Wait for network activity, but not past the time the next host becomes ready
+        int timeout = fetcher_active(fetcher) < options->connections ? (int)waitMs : -1;
+        fetcher_run(fetcher, timeout);
+    }
+    addFetches(state, fetcher);
+    fetcher_delete(fetcher);
+}
+
+/**
+* Description: Fetcher callback; handles a page whose asynchronous fetch has completed.
+* @param arg: Pointer to the crawlState_t.
+* @param page: The page, with its HTML if the fetch succeeded.
+* @param success: Whether the fetch succeeded.
+* @param response: The response's status and validators.
+* @return void
+*/
+static void
+asyncFetched(void* arg, webpage_t* page, const bool success, const fetchResponse_t* response){
+    crawlState_t* state = arg;
+    pageDone(state, page, success, response);
+    frontier_done(state->pagesToCrawl);
+}
+
+/**
+* Description: Starts fetching a page; on a recrawl, a page the earlier crawl saved with
+*              validators is fetched only if it has changed since.
+* @param state: The crawl's shared state.
+* @param fetcher: The fetcher.
+* @param page: The page.
+* @return Whether the fetch was started.
+*/
+static bool
+startFetch(crawlState_t* state, fetcher_t* fetcher, webpage_t* page){
+    int docID = state->recrawl ? knownDocID(state, webpage_getURL(page)) : 0;
+    if (docID == 0) return fetcher_start(fetcher, page);
+    char* etag;
+    char* lastModified;
+    pagedir_getValidators(state->pages, docID, &etag, &lastModified);
+    bool started = fetcher_startIf(fetcher, page, etag, lastModified);
+    free(etag);
+    free(lastModified);
+    return started;
+}
+
+/**
+* Description: Handles a page whose fetch has completed, successfully or not. A page
+*              fetched is saved with the validators it came with, under the next docID, or
+*              under its own on a recrawl.
+* @param state: The crawl's shared state.
+* @param page: The page, with its HTML if the fetch succeeded; it is deleted, or taken
+*              over by the page writer.
+* @param success: Whether the fetch succeeded.
+* @param response: The response's status and validators.
+* @return void
+*/
+static void
+pageDone(crawlState_t* state, webpage_t* page, const bool success, const fetchResponse_t* response){
+    if (response->elapsedUs > 0) metric_observe(state->stats.fetchTime, response->elapsedUs);
+    if (success){
+        metric_add(state->stats.fetched, 1);
+        metric_add(state->stats.bytes, strlen(webpage_getHTML(page)));
+    } else if (response->status != FETCH_NOT_MODIFIED){
+        metric_add(state->stats.failed, 1);
+    }
+    int docID = state->recrawl ? knownDocID(state, webpage_getURL(page)) : 0;
+    if (docID > 0){
+        pageRefreshed(page, state, docID, success, response);
+    } else if (success){
+        pageMeta_t meta = { .etag = response->etag, .lastModified = response->lastModified,
+                            .change = state->recrawl ? PAGEDIR_ADDED : 0 };
+        if (state->recrawl) atomic_fetch_add(&state->added, 1);
+        pageFetched(page, state, takeDocID(state), &meta, response->mark);
+    } else {
+        pageFailed(page, state);
+        webpage_delete(page);
+    }
+}
+
+/**
+* Description: Fetcher stream callback; with --stream, scans a page still arriving for the
+*              links the HTML so far settles, and queues them for crawling straight away.
+* @param arg: Pointer to the crawlState_t.
+* @param page: The page being fetched.
+* @param html: Its HTML so far.
+* @param len: Its length.
+* @param scanned: How far the page has been scanned; updated.
+* @return void
+*/
+static void
+pageStreamed(void* arg, webpage_t* page, const char* html, const size_t len, size_t* scanned){
+    crawlState_t* state = arg;
+    if (webpage_getDepth(page) >= state->maxDepth) return;
+    scanLinks(page, html, len, scanned, true, state);
+}
+
+/**
+* Description: Hands a fetched page to the page writer to be saved as docID and, unless it
+*              is at maxDepth, scans it for links. Waits while the writer's queue is full.
+* @param page: The fetched page; it is deleted, or taken over by the page writer.
+* @param state: The crawl's shared frontier and seen-set.
+* @param docID: The document it is saved as.
+* @param meta: Its validators and change, saved with it.
+* @param scanned: How much of the page was scanned as it arrived.
+* @return void
+*/
+static void
+pageFetched(webpage_t* page, crawlState_t* state, const int docID, const pageMeta_t* meta,
+            const size_t scanned){
+    asynclog_printf(state->log, "Fetched: %s\n", webpage_getURL(page));
+    // Check if we are the maximum depth and don't go any further searching for links.
+    if (webpage_getDepth(page) >= state->maxDepth){
+        pagewriter_put(state->writer, page, docID, meta);
+        return;
+    }
+    // Scanning leaves the HTML as fetched; once the writer has the page it may be freed
+    pageScan(page, webpage_getHTML(page), scanned, state);
+    pagewriter_put(state->writer, page, docID, meta);
+}
+
+/**
+* Description: Handles the recrawl of a page the earlier crawl saved as docID. A page
+*              the server says is unchanged, or that comes back as it was saved, is left
+*              as it is and its saved copy scanned; a changed one is saved over it; one
+*              the server no longer has (404 or 410) is removed. A page that can't be
+*              fetched for any other reason is kept, and its saved copy scanned, so a
+*              server's bad moment doesn't cost the pages below it.
+* @param page: The page; it is deleted, or taken over by the page writer.
+* @param state: The crawl's shared state.
+* @param docID: The document the earlier crawl saved it as.
+* @param success: Whether the fetch succeeded.
+* @param response: The response's status and validators.
+* @return void
+*/
+static void
+pageRefreshed(webpage_t* page, crawlState_t* state, const int docID, const bool success,
+              const fetchResponse_t* response){
+    atomic_store(&state->reached[docID], true);
+    if (success && !sameAsStored(page, state, docID)){
+        pageMeta_t meta = { .etag = response->etag, .lastModified = response->lastModified,
+                            .change = PAGEDIR_MODIFIED };
+        atomic_fetch_add(&state->modified, 1);
+        pageFetched(page, state, docID, &meta, 0);
+        return;
+    }
+    if (response->status == 404 || response->status == 410){
+        pageRemoved(state, docID, pagedir_read(state->pages, docID));
+    } else if (scanStored(page, state, docID)){
+        asynclog_printf(state->log, "Unchanged: %s\n", webpage_getURL(page));
+        atomic_fetch_add(&state->unchanged, 1);
+    } else {
+        pageFailed(page, state);
+    }
+    webpage_delete(page);
+}
+
+/**
+* Description: Scans the saved copy of a recrawled page for links, as if it had just been
+*              fetched at the page's depth.
+* @param page: The page, as taken from the frontier.
+* @param state: The crawl's shared state.
+* @param docID: The document it was saved as.
+* @return false if the saved copy can't be read.
+*/
+static bool
+scanStored(webpage_t* page, crawlState_t* state, const int docID){
+    webpage_t* stored = pagedir_read(state->pages, docID);
+    if (stored == NULL) return false;
+    if (webpage_getDepth(page) < state->maxDepth) pageScan(page, webpage_getHTML(stored), 0, state);
+    webpage_delete(stored);
+    return true;
+}
+
+/**
+* Description: Decides whether a recrawled page came back as it was saved. Only a page
+*              fetched without validators is compared: a server that answers a
+*              conditional fetch in full says the page changed, and saving it again keeps
+*              its validators current.
+* @param page: The fetched page.
+* @param state: The crawl's shared state.
+* @param docID: The document it was saved as.
+* @return true if it was fetched unconditionally and its HTML is what was saved.
+*/
+static bool
+sameAsStored(webpage_t* page, crawlState_t* state, const int docID){
+    char* etag;
+    char* lastModified;
+    pagedir_getValidators(state->pages, docID, &etag, &lastModified);
+    bool conditional = etag != NULL || lastModified != NULL;
+    free(etag);
+    free(lastModified);
+    if (conditional) return false;
+    webpage_t* stored = pagedir_read(state->pages, docID);
+    bool same = stored != NULL && strcmp(webpage_getHTML(stored), webpage_getHTML(page)) == 0;
+    webpage_delete(stored);
+    return same;
+}
+
+/**
+* Description: Removes a document of the earlier crawl by saving it again with no HTML,
+*              listed as removed; docIDs stay dense, and the indexer finds no words in it.
+*              A document already removed by an earlier recrawl is left alone.
+* @param state: The crawl's shared state.
+* @param docID: The document.
+* @param stored: Its saved copy, which is deleted or taken over; nothing is done if NULL.
+* @return void
+*/
+static void
+pageRemoved(crawlState_t* state, const int docID, webpage_t* stored){
+    if (stored == NULL) return;
+    if (webpage_getHTML(stored)[0] == '\0'){
+        webpage_delete(stored);
+        return;
+    }
+    asynclog_printf(state->log, "Removed: %s\n", webpage_getURL(stored));
+    atomic_fetch_add(&state->removed, 1);
+    char* URL = mem_assert(mem_malloc(strlen(webpage_getURL(stored)) + 1), "Error: Failed to allocate memory for page.\n");
+    char* html = mem_assert(mem_calloc(1, 1), "Error: Failed to allocate memory for page.\n");
+    strcpy(URL, webpage_getURL(stored));
+    pageMeta_t meta = { .etag = NULL, .lastModified = NULL, .change = PAGEDIR_REMOVED };
+    pagewriter_put(state->writer, webpage_new(URL, webpage_getDepth(stored), html), docID, &meta);
+    webpage_delete(stored);
+}
+
+/**
+* Description: Reads the URLs of the earlier crawl's documents, from docID 1 up to the
+*              first missing one, into state->known.
+* @param state: The crawl's shared state, with its page directory open.
+* @return false if the page directory holds no documents.
+*/
+static bool
+loadKnown(crawlState_t* state){
+    int cap = 1024;
+    char** urls = mem_assert(mem_malloc(cap * sizeof(char*)), "Error: Failed to allocate memory for URLs.\n");
+    int numKnown = 0;
+    char* url;
+    while ((url = pagedir_getURL(state->pages, numKnown + 1)) != NULL){
+        if (numKnown == cap){
+            cap *= 2;
+            char** bigger = mem_assert(mem_malloc(cap * sizeof(char*)), "Error: Failed to allocate memory for URLs.\n");
+            memcpy(bigger, urls, numKnown * sizeof(char*));
+            mem_free(urls);
+            urls = bigger;
+        }
+        urls[numKnown++] = url;
+    }
+    if (numKnown > 0){
+        state->known = mem_assert(hashtable_new(numKnown), "Error: Failed to allocate memory for URLs.\n");
+        state->reached = mem_assert(mem_malloc((numKnown + 1) * sizeof(atomic_bool)), "Error: Failed to allocate memory for URLs.\n");
+        for (int docID = 1; docID <= numKnown; docID++){
+            int* item = mem_assert(mem_malloc(sizeof(int)), "Error: Failed to allocate memory for URLs.\n");
+            *item = docID;
+            // Should a URL have been saved twice, the first docID is kept
+            if (!hashtable_insert(state->known, urls[docID - 1], item)) mem_free(item);
+            atomic_init(&state->reached[docID], false);
+            free(urls[docID - 1]);
+        }
+        state->numKnown = numKnown;
+    }
+    mem_free(urls);
+    return numKnown > 0;
+}
+
+/**
+* Description: Removes the documents of the earlier crawl the recrawl never came to.
+* @param state: The crawl's shared state.
+* @return void
+*/
+static void
+removeUnreached(crawlState_t* state){
+    for (int docID = 1; docID <= state->numKnown; docID++){
+        if (!atomic_load(&state->reached[docID])){
+            pageRemoved(state, docID, pagedir_read(state->pages, docID));
         }
-        // After finshing scanning & saving the page, delete it since we don't need it anymore
-        webpage_delete(webpage);
     }
-    // Delete the bag and the hashtable
-    bag_delete(pagesToCrawl, NULL);
-    hashtable_delete(pagesSeen, deleteDepth);
+}
+
+/**
+* Description: Returns the docID the earlier crawl saved a URL as, on a recrawl.
+* @param state: The crawl's shared state.
+* @param url: The URL.
+* @return The docID, or 0 if it wasn't saved.
+*/
+static int
+knownDocID(crawlState_t* state, const char* url){
+    int* docID = state->known ? hashtable_find(state->known, url) : NULL;
+    return docID ? *docID : 0;
+}
+
+/**
+* Description: Page writer callback, run on the writer's thread once a page is written.
+*              Records a saved page in the checkpoint as done; if the page couldn't be
+*              saved, reports it and stops the crawl, which can then be resumed.
+* @param arg: Pointer to the crawlState_t.
+* @param page: The page.
+* @param docID: Its document ID.
+* @param success: Whether the page was saved.
+* @param writeUs: How long writing it took.
+* @return void
+*/
+static void
+pageSaved(void* arg, webpage_t* page, const int docID, const bool success, const long writeUs){
+    crawlState_t* state = arg;
+    metric_observe(state->stats.saveTime, writeUs);
+    if (!success){
+        fprintf(stderr, "Error: Can't save %s.\n", webpage_getURL(page));
+        atomic_store(&state->stopped, true);
+        return;
+    }
+    // Only now are the page and all its links recorded, so a resumed crawl won't lose them
+    checkpoint_saved(state->checkpoint, docID, webpage_getURL(page));
+    metric_add(state->stats.saved, 1);
+}
+
+/**
+* Description: Records a page whose fetch failed, so a resumed crawl doesn't retry it.
+* @param page: The page.
+* @param state: The crawl's shared state.
+* @return void
+*/
+static void
+pageFailed(webpage_t* page, crawlState_t* state){
+    checkpoint_failed(state->checkpoint, webpage_getURL(page));
+}
+
+/**
+* Description: Hands out the docID for the next page saved: first any docIDs an
+*              interrupted crawl left unused, then the ones after the last it saved.
+* @param state: The crawl's shared state.
+* @return The docID.
+*/
+static int
+takeDocID(crawlState_t* state){
+    if (atomic_load(&state->nextFreeDocID) < state->numFreeDocIDs){
+        int index = atomic_fetch_add(&state->nextFreeDocID, 1);
+        if (index < state->numFreeDocIDs) return state->freeDocIDs[index];
+    }
+    return atomic_fetch_add(&state->nextDocID, 1);
+}
+
+/**
+* Description: Saves an empty page, with no URL, under each docID an interrupted crawl left
+*              unused that the resumed one hasn't reused, as pageRemoved saves a removed
+*              page; the pages re-queued for them may have failed, or the frontier run dry
+*              first. The indexer and --recrawl stop at the first missing docID, so a gap
+*              would lose every document after it; an empty page has no words.
+* @param state: The crawl's shared state, once no more pages are being fetched.
+* @return void
+*/
+static void
+fillFreeDocIDs(crawlState_t* state){
+    while (atomic_load(&state->nextFreeDocID) < state->numFreeDocIDs){
+        int docID = state->freeDocIDs[atomic_fetch_add(&state->nextFreeDocID, 1)];
+        char* URL = mem_assert(mem_calloc(1, 1), "Error: Failed to allocate memory for page.\n");
+        char* html = mem_assert(mem_calloc(1, 1), "Error: Failed to allocate memory for page.\n");
+        pageMeta_t meta = { .etag = NULL, .lastModified = NULL, .change = 0 };
+        pagewriter_put(state->writer, webpage_new(URL, 0, html), docID, &meta);
+    }
+}
+
+/**
+* Description: Whether the crawl should stop: a page couldn't be saved, or the checkpoint
+*              or a frontier segment couldn't be written. Either way what is on disk is a
+*              consistent crawl to resume from, and nothing more should be added to it.
+* @param state: The crawl's shared state.
+* @return true once the crawl is stopped.
+*/
+static bool
+crawlStopped(crawlState_t* state){
+    if (!atomic_load(&state->stopped)
+        && (checkpoint_writeFailed(state->checkpoint) || frontier_spillFailed(state->pagesToCrawl))){
+        atomic_store(&state->stopped, true);
+    }
+    return atomic_load(&state->stopped);
 }
 
 /**
 * Description: Scans a webpage for internal links, normalizes and adds unseen URLs to crawl queue.
+*              Links are found a batch at a time in the HTML as it is, which is left unchanged.
 * @param page: The current page to be scanned.
-* @param pagesToCrawl: Bag of pages to be crawled.
-* @param pagesSeen: Hashtable of URLs already seen with their depths.
-* @return void
-*/
-static void 
-pageScan(webpage_t* page, bag_t* pagesToCrawl, hashtable_t* pagesSeen){
-    fprintf(stdout, "Scanning: %s\n", webpage_getURL(page));
-    char* URL; // String to hold the URL for the next link on the page.
-    int pos = 0;
-    // Check if there's another link to be grabbed in the current page.
-    while ((URL = webpage_getNextURL(page, &pos)) != NULL){
-        // Normalize the URL for the URL grabbed.
-        char* normalizedURL = normalizeURL(URL);
-        // Check if its internal and if it hasn't been seen before
-        if (isInternalURL(normalizedURL) && hashtable_find(pagesSeen, normalizedURL) == NULL){
-            // Allocate memory for its depth
-            int* currentDepth = (int*)mem_malloc(sizeof(int)); 
-            *currentDepth = *(int*)hashtable_find(pagesSeen, webpage_getURL(page)) + 1; // It's one level deeper than its parent
-            hashtable_insert(pagesSeen, normalizedURL, currentDepth); // Add it to pages seen
-            // Initialize a new webpage with the URL and add it to our collection of pages to be crawled
-            webpage_t* webpage = webpage_new(normalizedURL, *currentDepth, NULL);
-            bag_insert(pagesToCrawl, webpage);
-            fprintf(stdout, "Found: %s\n", normalizedURL);
-        } else {
-            mem_free(normalizedURL);
+* @param html: Its HTML.
+* @param scanned: How much of it was scanned as it arrived; the scan carries on from there.
+* @param state: The crawl's shared frontier and seen-set.
+* @return void
+*/
+static void
+pageScan(webpage_t* page, const char* html, const size_t scanned, crawlState_t* state){
+    asynclog_printf(state->log, "Scanning: %s\n", webpage_getURL(page));
+    long startedUs = nowUs();
+    size_t pos = scanned;
+    scanLinks(page, html, strlen(html), &pos, false, state);
+    metric_observe(state->stats.scanTime, nowUs() - startedUs);
+}
+
+/**
+* Description: Adds the unseen internal links of a page's HTML, from pos on, to the crawl
+*              queue; of a page still arriving, only those its HTML so far settles.
+* @param page: The page.
+* @param html: Its HTML, or as much of it as has arrived.
+* @param htmlLen: The HTML's length.
+* @param pos: Where to start; updated to where the scan stopped.
+* @param partial: Whether the page is still arriving.
+* @param state: The crawl's shared frontier and seen-set.
+* @return void
+*/
+static void
+scanLinks(webpage_t* page, const char* html, const size_t htmlLen, size_t* pos,
+          const bool partial, crawlState_t* state){
+    const char* base = webpage_getURL(page);
+    size_t baseLen = strlen(base);
+    int depth = webpage_getDepth(page) + 1; // Links are one level deeper than their parent
+    linkSpan_t spans[LINK_BATCH];
+    char buf[MAX_URL];      // the normalized URL, until it turns out to be new
+    int count;
+    while ((count = partial ? linkscan_nextPartial(html, htmlLen, pos, spans, LINK_BATCH)
+                            : linkscan_next(html, htmlLen, pos, spans, LINK_BATCH)) > 0){
+        for (int i = 0; i < count; i++){
+            // Normalize the link into buf; only a new one is copied out of it. One that
+            // might not fit buf gets a buffer of its own.
+            size_t need = baseLen + spans[i].len + 2;
+            char* out = need <= sizeof(buf) ? buf : mem_assert(mem_malloc(need), "Error: Failed to allocate memory for URL.\n");
+            urlView_t view;
+            bool normalized = linkscan_resolve(html, &spans[i], base, out, out == buf ? sizeof(buf) : need, &view);
+            // Check if its internal and claim it in pages seen if no other thread has yet
+            bool internal = normalized && isInternalURL(view.url);
+            if (internal && seenset_insertHash(state->pagesSeen, view.hash, depth)){
+                char* normalizedURL = mem_assert(mem_malloc(view.len + 1), "Error: Failed to allocate memory for URL.\n");
+                memcpy(normalizedURL, view.url, view.len + 1);
+                // Report and record it before handing it over: once in the frontier another thread
+                // may crawl and free it
+                asynclog_printf(state->log, "Found: %s\n", normalizedURL);
+                metric_add(state->stats.found, 1);
+                checkpoint_seen(state->checkpoint, normalizedURL, depth);
+                // Initialize a new webpage with the URL and add it to our collection of pages to be crawled
+                webpage_t* webpage = webpage_new(normalizedURL, depth, NULL);
+                frontier_insert(state->pagesToCrawl, webpage);
+            } else if (internal && state->creditLinks){
+                // A page already seen may still be waiting; another link to it raises its rank
+                frontier_credit(state->pagesToCrawl, view.url, view.hash);
+            }
+            if (out != buf) mem_free(out);
         }
-        mem_free(URL);
     }
-    
 }
 
 /**
-* Description: Frees the dynamically allocated memory for an integer (used for depth values in hashtable).
-* @param item: A void pointer to the dynamically allocated memory to free.
+* Description: Adds a fetcher's counts of pages and bytes fetched, and its fetch times, to
+*              the crawl's; each fetcher does so once, when it is done.
+* @param state: The crawl's shared state.
+* @param fetcher: The fetcher.
+* @return void
+*/
+static void
+addFetches(crawlState_t* state, fetcher_t* fetcher){
+    fetcherStats_t stats = fetcher_stats(fetcher);
+    pthread_mutex_lock(&state->statsLock);
+    state->fetches.fetched += stats.fetched;
+    state->fetches.failed += stats.failed;
+    state->fetches.bytes += stats.bytes;
+    histogram_merge(state->latency, fetcher_latency(fetcher));
+    pthread_mutex_unlock(&state->statsLock);
+}
+
+/**
+* Description: Prints the crawl's throughput, in pages and bytes per second, and the
+*              median and 99th percentile fetch times, on one line.
+* @param state: The crawl's shared state.
+* @param elapsedUs: How long the crawl took.
+* @param fp: Where to print.
 * @return void
 */
-static void 
-deleteDepth(void* item){
-    mem_free(item);
-}
\ No newline at end of file
+static void
+reportFetches(crawlState_t* state, const long elapsedUs, FILE* fp){
+    pthread_mutex_lock(&state->statsLock);
+    double seconds = elapsedUs > 0 ? elapsedUs / 1e6 : 1e-6;
+    fprintf(fp, "fetches: %ld pages (%ld failed), %ld bytes in %.2f s, %.1f pages/s, %.0f bytes/s, latency p50 %.2f ms, p99 %.2f ms\n",
+            state->fetches.fetched, state->fetches.failed, state->fetches.bytes, seconds,
+            state->fetches.fetched / seconds, state->fetches.bytes / seconds,
+            histogram_percentile(state->latency, 0.5) / 1000.0, histogram_percentile(state->latency, 0.99) / 1000.0);
+    pthread_mutex_unlock(&state->statsLock);
+}
+
+/**
+* Description: Registers the crawl's metrics: counters of pages and bytes, summaries of
+*              how long fetching, scanning and saving a page took, and gauges of the
+*              frontier and the seen-set. Without --stats they are all NULL.
+* @param state: The crawl's shared state, with its metrics, frontier and seen-set.
+* @return void
+*/
+static void
+addMetrics(crawlState_t* state){
+    metrics_t* metrics = state->metrics;
+    state->stats = (crawlMetrics_t){
+        .fetched = metrics_counter(metrics, "tse_crawler_pages_fetched_total", "Pages fetched."),
+        .failed = metrics_counter(metrics, "tse_crawler_pages_failed_total", "Pages that couldn't be fetched."),
+        .bytes = metrics_counter(metrics, "tse_crawler_bytes_fetched_total", "Bytes of HTML fetched."),
+        .found = metrics_counter(metrics, "tse_crawler_urls_found_total", "New URLs found in the pages scanned."),
+        .saved = metrics_counter(metrics, "tse_crawler_pages_saved_total", "Pages saved to the page directory."),
+        .fetchTime = metrics_summary(metrics, "tse_crawler_fetch_seconds", "Time from starting a fetch to its end."),
+        .scanTime = metrics_summary(metrics, "tse_crawler_scan_seconds", "Time scanning a fetched page for links."),
+        .saveTime = metrics_summary(metrics, "tse_crawler_save_seconds", "Time writing a page to the page directory."),
+    };
+    metrics_gauge(metrics, "tse_crawler_frontier_pages", "Pages waiting to be fetched.", frontierGauge, state->pagesToCrawl);
+    metrics_gauge(metrics, "tse_crawler_seen_urls", "URLs seen so far.", seenGauge, state->pagesSeen);
+}
+
+/**
+* Description: Metrics gauge; the number of pages waiting in the frontier.
+* @param arg: The frontier.
+* @return The number.
+*/
+static double
+frontierGauge(void* arg){
+    return frontier_size(arg);
+}
+
+/**
+* Description: Metrics gauge; the number of URLs in the seen-set.
+* @param arg: The seen-set.
+* @return The number.
+*/
+static double
+seenGauge(void* arg){
+    return seenset_size(arg);
+}
+
+/**
+* Description: Deletes the segment files a crawl that was interrupted left in the
+*              frontier's spill directory; the frontier is rebuilt from the checkpoint.
+* @param spillDirectory: The directory.
+* @return void
+*/
+static void
+removeSegments(const char* spillDirectory){
+    DIR* dir = opendir(spillDirectory);
+    if (dir == NULL) return;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL){
+        if (entry->d_name[0] == '.') continue;
+        char path[strlen(spillDirectory) + strlen(entry->d_name) + 2];
+        sprintf(path, "%s/%s", spillDirectory, entry->d_name);
+        remove(path);
+    }
+    closedir(dir);
+}
+
+/**
+* Description: Returns the monotonic clock in microseconds.
+* @return The time.
+*/
+static long
+nowUs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,179 @@
+/**
+ * fetchtest.c
+ *
+ * Description: Fetches the given URLs all at once through the asynchronous fetcher,
+ *              keeping up to the given number of connections in flight, and prints one
+ *              line per URL (in the order given): OK or FAIL, the number of bytes of
+ *              HTML, and the URL. With -o, the HTML of the i-th URL is also written to
+ *              outDirectory/i so it can be compared with what the server holds. The
+ *              number of connections opened and reused, and the DNS cache's counters,
+ *              are printed to stderr. With -e or -m the fetches are conditional on the
+ *              ETag or Last-Modified date given, and a URL the server says has not
+ *              changed is printed as UNCHANGED; with -v each OK line ends with the
+ *              page's ETag and Last-Modified date ("-" if the server sent none).
+ *
+ * Usage: ./fetchtest [-o outDirectory] [-e etag] [-m lastModified] [-v] connections URL...
+ */
+#define _POSIX_C_SOURCE 200809L   // strdup
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "fetcher.h"
+#include "resolver.h"
+#include "webpage.h"
+#include "mem.h"
+
+// What the callback needs to match a completed page to its URL
+typedef struct fetchResults {
+    int numURLs;
+    char** urls;
+    webpage_t** pages;          // fetched pages, by URL index; NULL if the fetch failed
+    int* statuses;              // the HTTP status of each, 0 if there was no response
+    char** etags;               // the validators each page came with, or NULL
+    char** lastModifieds;
+    int remaining;
+} fetchResults_t;
+
+static void fetched(void* arg, webpage_t* page, const bool success, const fetchResponse_t* response);
+static char* copyOf(const char* string);
+
+
+int
+main(const int argc, char* argv[]){
+    const char* usage = "Usage: ./fetchtest [-o outDirectory] [-e etag] [-m lastModified] [-v] connections URL...\n";
+    const char* outDirectory = NULL;
+    const char* etag = NULL;
+    const char* lastModified = NULL;
+    bool showValidators = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "o:e:m:v")) != -1){
+        if (opt == 'o'){
+            outDirectory = optarg;
+        } else if (opt == 'e'){
+            etag = optarg;
+        } else if (opt == 'm'){
+            lastModified = optarg;
+        } else if (opt == 'v'){
+            showValidators = true;
+        } else {
+            fprintf(stderr, "%s", usage);
+            exit(1);
+        }
+    }
+    int connections;
+    if (argc - optind < 2 || sscanf(argv[optind], "%d", &connections) != 1 || connections < 1){
+        fprintf(stderr, "%s", usage);
+        exit(1);
+    }
+
+    fetchResults_t results;
+    results.numURLs = argc - optind - 1;
+    results.urls = argv + optind + 1;
+    results.pages = mem_assert(mem_calloc(results.numURLs, sizeof(webpage_t*)), "Error: Failed to allocate memory for results.\n");
+    results.statuses = mem_assert(mem_calloc(results.numURLs, sizeof(int)), "Error: Failed to allocate memory for results.\n");
+    results.etags = mem_assert(mem_calloc(results.numURLs, sizeof(char*)), "Error: Failed to allocate memory for results.\n");
+    results.lastModifieds = mem_assert(mem_calloc(results.numURLs, sizeof(char*)), "Error: Failed to allocate memory for results.\n");
+    results.remaining = results.numURLs;
+    fetcher_t* fetcher = mem_assert(fetcher_new(connections, fetched, &results), "Error: Failed to create fetcher.\n");
+    resolver_t* resolver = resolver_new(60000, 60000);
+    fetcher_setResolver(fetcher, resolver);
+
+    // Start as many fetches as there is room for, then keep the fetcher full as they complete
+    int next = 0;
+    while (results.remaining > 0){
+        while (next < results.numURLs && fetcher_active(fetcher) < connections){
+            webpage_t* page = webpage_new(strdup(results.urls[next]), 0, NULL);
+            if (!fetcher_startIf(fetcher, page, etag, lastModified)){
+                fetched(&results, page, false, &(fetchResponse_t){0});
+            }
+            next++;
+        }
+        fetcher_run(fetcher, -1);
+    }
+    fetcherStats_t stats = fetcher_stats(fetcher);
+    fprintf(stderr, "connections: %ld opened, %ld reused\n", stats.opened, stats.reused);
+    resolver_report(resolver, stderr);
+    fetcher_delete(fetcher);
+    resolver_delete(resolver);
+
+    int failures = 0;
+    for (int i = 0; i < results.numURLs; i++){
+        webpage_t* page = results.pages[i];
+        if (page == NULL && results.statuses[i] == FETCH_NOT_MODIFIED){
+            printf("UNCHANGED 0 %s\n", results.urls[i]);
+            continue;
+        }
+        if (page == NULL){
+            printf("FAIL 0 %s\n", results.urls[i]);
+            failures++;
+            continue;
+        }
+        printf("OK %zu %s", strlen(webpage_getHTML(page)), results.urls[i]);
+        if (showValidators){
+            printf(" %s %s", results.etags[i] ? results.etags[i] : "-",
+                   results.lastModifieds[i] ? results.lastModifieds[i] : "-");
+        }
+        printf("\n");
+        if (outDirectory != NULL){
+            char path[strlen(outDirectory) + 16];
+            sprintf(path, "%s/%d", outDirectory, i);
+            FILE* fp = fopen(path, "w");
+            if (fp != NULL){
+                fputs(webpage_getHTML(page), fp);
+                fclose(fp);
+            }
+        }
+        webpage_delete(page);
+    }
+    for (int i = 0; i < results.numURLs; i++){
+        free(results.etags[i]);
+        free(results.lastModifieds[i]);
+    }
+    mem_free(results.pages);
+    mem_free(results.statuses);
+    mem_free(results.etags);
+    mem_free(results.lastModifieds);
+    return failures > 0 ? 1 : 0;
+}
+
+/**
+* Description: Fetcher callback; files a completed page under the index of its URL.
+* @param arg: Pointer to the fetchResults_t.
+* @param page: The page.
+* @param success: Whether the fetch succeeded.
+* @param response: The response's status and validators.
+* @return void
+*/
+static void
+fetched(void* arg, webpage_t* page, const bool success, const fetchResponse_t* response){
+    fetchResults_t* results = arg;
+    results->remaining--;
+    // The same URL may be given more than once; file it under the first free index
+    for (int i = 0; i < results->numURLs; i++){
+        if (results->pages[i] == NULL && results->statuses[i] == 0
+            && strcmp(results->urls[i], webpage_getURL(page)) == 0){
+            results->statuses[i] = response->status;
+            results->etags[i] = copyOf(response->etag);
+            results->lastModifieds[i] = copyOf(response->lastModified);
+            if (success){
+                results->pages[i] = page;
+                return;
+            }
+            break;
+        }
+    }
+    webpage_delete(page);
+}
+
+/**
+* Description: Copies a string.
+* @param string: The string, or NULL.
+* @return The copy, or NULL.
+*/
+static char*
+copyOf(const char* string){
+    return string ? strdup(string) : NULL;
+}
@@ -0,0 +1,206 @@
+#!/bin/bash
+# fetchtesting.sh - tests the asynchronous fetcher, and the crawler's recrawl, against
+#                   a local testserver, so it runs without network access.
+#
+# Usage: bash fetchtesting.sh [port]
+
+PORT="${1:-18080}"
+SITE=$(mktemp -d)
+OUT=$(mktemp -d)
+BASE="http://127.0.0.1:$PORT"
+failures=0
+
+cleanup() {
+    [ -n "$SERVER" ] && kill "$SERVER" 2> /dev/null
+    rm -rf "$SITE" "$OUT"
+}
+trap cleanup EXIT
+
+# check description command... - runs the command quietly and reports whether it succeeded
+check() {
+    local description="$1"; shift
+    if "$@" > /dev/null 2>&1; then
+        echo "PASS: $description"
+    else
+        echo "FAIL: $description"
+        failures=$((failures + 1))
+    fi
+}
+
+# startServer [flags] - (re)starts the testserver on $PORT serving $SITE
+startServer() {
+    [ -n "$SERVER" ] && kill "$SERVER" 2> /dev/null && wait "$SERVER" 2> /dev/null
+    ./testserver "$@" "$PORT" "$SITE" &
+    SERVER=$!
+    # Wait until it listens; a page may be set to fail, so don't fetch one
+    for i in $(seq 50); do
+        (exec 3<> "/dev/tcp/127.0.0.1/$PORT") 2> /dev/null && return
+        sleep 0.1
+    done
+}
+
+# A small site: an index, a large page and 300 small ones
+mkdir -p "$SITE/pages"
+echo "<html><body><a href=\"pages/1.html\">one</a></body></html>" > "$SITE/index.html"
+for i in $(seq 2000); do echo "<p>line $i of a page much larger than one read</p>"; done > "$SITE/large.html"
+urls=()
+for i in $(seq 300); do
+    echo "<html><body>page $i</body></html>" > "$SITE/pages/$i.html"
+    urls+=("$BASE/pages/$i.html")
+done
+
+# sameBodies first... - compares the fetched bodies in $OUT with the pages they came from
+sameBodies() {
+    local i=0
+    for path in "$@"; do
+        cmp -s "$OUT/$i" "$SITE/$path" || return 1
+        i=$((i + 1))
+    done
+}
+
+startServer
+check "fetches a page" ./fetchtest -o "$OUT" 1 "$BASE/index.html"
+check "body matches the file served" sameBodies index.html
+check "a directory serves its index.html" ./fetchtest 1 "$BASE/"
+check "fetches a page larger than the read buffer" ./fetchtest -o "$OUT" 1 "$BASE/large.html"
+check "large body matches" sameBodies large.html
+check "a missing page fails" bash -c "! ./fetchtest 1 '$BASE/missing.html'"
+check "an unknown host fails" bash -c "! ./fetchtest 1 'http://nosuchhost.invalid/'"
+check "an unknown host is remembered" bash -c "./fetchtest 1 http://nosuchhost.invalid/a http://nosuchhost.invalid/b 2>&1 >/dev/null | grep -q '1 hits (1 negative), 1 misses (1 failed)'"
+check "a port nobody listens on fails" bash -c "! ./fetchtest 1 'http://localhost:1/'"
+check "a non-http URL fails" bash -c "! ./fetchtest 1 'https://localhost/'"
+check "300 pages through 100 connections" ./fetchtest 100 "${urls[@]}"
+check "300 pages through 1 connection" ./fetchtest 1 "${urls[@]}"
+check "sequential fetches reuse one connection" bash -c "./fetchtest 1 ${urls[*]:0:50} 2>&1 >/dev/null | grep -q '1 opened, 49 reused'"
+check "a 404 keeps the connection" bash -c "./fetchtest 1 '$BASE/missing.html' '$BASE/index.html' 2>&1 >/dev/null | grep -q '1 opened'"
+check "failures don't stop the other fetches" bash -c "./fetchtest 4 '$BASE/index.html' '$BASE/missing.html' '$BASE/large.html' | grep -c '^OK' | grep -qx 2"
+
+# Conditional fetches: the validators a page came with get a 304 until it changes
+etag=$(./fetchtest -v 1 "$BASE/index.html" 2> /dev/null | cut -d' ' -f4)
+check "pages come with validators" bash -c "./fetchtest -v 1 '$BASE/index.html' | grep -q '^OK .* \".*\" .* GMT$'"
+check "a current ETag gets 304" bash -c "./fetchtest -e '$etag' 1 '$BASE/index.html' | grep -q '^UNCHANGED'"
+check "a stale ETag gets the page" bash -c "./fetchtest -e '\"stale\"' 1 '$BASE/index.html' | grep -q '^OK'"
+check "a later If-Modified-Since gets 304" bash -c "./fetchtest -m 'Fri, 01 Jan 2100 00:00:00 GMT' 1 '$BASE/index.html' | grep -q '^UNCHANGED'"
+check "an earlier If-Modified-Since gets the page" bash -c "./fetchtest -m 'Sat, 01 Jan 2000 00:00:00 GMT' 1 '$BASE/index.html' | grep -q '^OK'"
+check "a 304 keeps the connection" bash -c "./fetchtest -e '$etag' 1 '$BASE/index.html' '$BASE/index.html' 2>&1 >/dev/null | grep -q '1 opened, 1 reused'"
+
+# A recrawl of a site where one page changed, one went away and one is new
+mkdir -p "$SITE/tse"
+echo "<html><a href=\"a.html\">a</a> <a href=\"b.html\">b</a> <a href=\"c.html\">c</a></html>" > "$SITE/tse/index.html"
+for page in a b c; do echo "<html>page $page</html>" > "$SITE/tse/$page.html"; done
+mkdir "$OUT/crawl"
+crawl="./crawler --connect-to 127.0.0.1:$PORT"
+crawlArgs="http://cs50tse.cs.dartmouth.edu/tse/index.html $OUT/crawl 2"
+$crawl $crawlArgs > /dev/null 2>&1
+sleep 1
+echo "<html>page b, changed <a href=\"d.html\">d</a></html>" > "$SITE/tse/b.html"
+echo "<html>page d</html>" > "$SITE/tse/d.html"
+rm "$SITE/tse/c.html"
+check "a recrawl counts the changes" bash -c "$crawl --recrawl $crawlArgs 2>&1 | grep -q 'Recrawled: 2 unchanged, 1 modified, 1 added, 1 removed'"
+check "a recrawl lists the changes" bash -c "sort '$OUT/crawl/.changes' | cut -c1-3 | tr '\n' ' ' | grep -qx 'A 5 D 4 M 3 '"
+check "a changed page keeps its docID" grep -q "page b, changed" "$OUT/crawl/3"
+check "a removed page is left empty" bash -c "[ \$(wc -l < '$OUT/crawl/4') -eq 2 ]"
+check "an unchanged site recrawls unchanged" bash -c "$crawl --recrawl $crawlArgs 2>&1 | grep -q 'Recrawled: 4 unchanged, 0 modified, 0 added, 0 removed'"
+check "--recrawl and --resume don't mix" bash -c "! $crawl --recrawl --resume $crawlArgs"
+
+# A crawl interrupted before docID 2 was recorded, resumed once its page has gone: the
+# docID is filled with an empty page, so the indexer still finds document 3
+mkdir -p "$SITE/tse/resume" "$OUT/resume"
+echo "<html><a href=\"x.html\">x</a> <a href=\"z.html\">z</a></html>" > "$SITE/tse/resume/index.html"
+for page in x z; do echo "<html>page $page</html>" > "$SITE/tse/resume/$page.html"; done
+resumeArgs="http://cs50tse.cs.dartmouth.edu/tse/resume/index.html $OUT/resume 1"
+$crawl $resumeArgs > /dev/null 2>&1
+sed -i '/^D 2 /d' "$OUT/resume/.checkpoint"
+rm "$SITE/tse/resume/x.html" "$OUT/resume/2"
+$crawl --resume $resumeArgs > /dev/null 2>&1
+check "a resumed crawl fills a docID its re-queued page couldn't take" bash -c "[ \"\$(sed -n 3p '$OUT/resume/2')\" = '' ] && [ \$(wc -l < '$OUT/resume/2') -eq 2 ]"
+check "documents after a filled docID are indexed" bash -c "../indexer/indexer '$OUT/resume' '$OUT/resume.idx' > /dev/null && grep -qx 'page 3 1' '$OUT/resume.idx'"
+
+# A page with links all through it, crawled with and without scanning it as it arrives
+mkdir -p "$SITE/tse/stream"
+for i in $(seq 200); do
+    echo "<p>paragraph $i of a page that takes a while to arrive <a href=\"$i.html\">link $i</a></p>"
+    echo "<html>page $i</html>" > "$SITE/tse/stream/$i.html"
+done > "$SITE/tse/stream/index.html"
+streamArgs="--delay 0 http://cs50tse.cs.dartmouth.edu/tse/stream/index.html"
+# sameCrawl dir... - compares the URLs crawled into each directory with a plain crawl's
+sameCrawl() {
+    for dir in "$@"; do
+        diff -q <(head -qn1 "$OUT/plain"/* | sort) <(head -qn1 "$OUT/$dir"/* | sort) > /dev/null || return 1
+    done
+}
+mkdir "$OUT/plain" "$OUT/stream" "$OUT/stream4" "$OUT/chunked"
+$crawl $streamArgs "$OUT/plain" 1 > /dev/null 2>&1
+$crawl --stream $streamArgs "$OUT/stream" 1 > /dev/null 2>&1
+$crawl --stream --threads 4 $streamArgs "$OUT/stream4" 1 > /dev/null 2>&1
+check "--stream finds the same pages" sameCrawl stream stream4
+check "--stream and --recrawl don't mix" bash -c "! $crawl --stream --recrawl $crawlArgs"
+
+# A site whose pages are worth fetching in different orders: c.html has the most links to it
+mkdir -p "$SITE/tse/rank"
+echo "<html><a href=\"a.html\">a</a> <a href=\"b.html\">b</a> <a href=\"c.html\">c</a> <a href=\"c.html\">c</a> <a href=\"c.html\">c</a></html>" > "$SITE/tse/rank/index.html"
+for page in a b c; do echo "<html>page $page</html>" > "$SITE/tse/rank/$page.html"; done
+echo "10 */b.html" > "$OUT/weights"
+rankArgs="--delay 0 http://cs50tse.cs.dartmouth.edu/tse/rank/index.html"
+rank="http://cs50tse.cs.dartmouth.edu/tse/rank"
+# firstFetched dir options... - crawls into $OUT/dir with the given options, and prints the
+# page fetched after the seed according to the crawl log
+firstFetched() {
+    local dir="$1"
+    shift
+    mkdir "$OUT/$dir"
+    $crawl --crawl-log "$OUT/$dir.log" "$@" $rankArgs "$OUT/$dir" 1 > /dev/null 2>&1
+    sed -n 2p "$OUT/$dir.log" | cut -d' ' -f5
+}
+check "a bfs crawl fetches pages in the order found" [ "$(firstFetched bfs)" = "$rank/a.html" ]
+check "the crawl log numbers every page fetched" bash -c "cut -d' ' -f1 '$OUT/bfs.log' | tr '\n' ' ' | grep -qx '0 1 2 3 '"
+check "--score inlinks fetches the most linked page first" [ "$(firstFetched inlinks --order priority --score inlinks)" = "$rank/c.html" ]
+check "--url-weights fetches the weighted page first" [ "$(firstFetched weighted --order priority --score patterns,inlinks --url-weights "$OUT/weights")" = "$rank/b.html" ]
+check "a priority crawl finds the same pages" bash -c "diff <(cut -d' ' -f5 '$OUT/bfs.log' | sort) <(cut -d' ' -f5 '$OUT/inlinks.log' | sort)"
+check "an unknown score term is refused" bash -c "! $crawl --order priority --score popularity $rankArgs '$OUT/refused' 1"
+check "--score needs --order priority" bash -c "! $crawl --score depth $rankArgs '$OUT/refused' 1"
+
+# The --stats file counts what the crawl did; --quiet prints no line per page
+mkdir "$OUT/stats" "$OUT/quiet" "$OUT/nostats"
+$crawl --stats "$OUT/stats.prom" $rankArgs "$OUT/stats" 1 > /dev/null 2>&1
+check "--stats counts every page fetched and saved" bash -c "grep -qx 'tse_crawler_pages_fetched_total 4' '$OUT/stats.prom' && grep -qx 'tse_crawler_pages_saved_total 4' '$OUT/stats.prom'"
+check "--stats times every fetch" grep -qx 'tse_crawler_fetch_seconds_count 4' "$OUT/stats.prom"
+check "--stats reports the seen-set" grep -qx 'tse_crawler_seen_urls 4' "$OUT/stats.prom"
+check "--quiet prints no line per page" bash -c "[ -z \"\$($crawl --quiet $rankArgs '$OUT/quiet' 1)\" ]"
+check "an unwritable --stats file is refused" bash -c "! $crawl --stats '$OUT/missing/stats.prom' $rankArgs '$OUT/nostats' 1 2> /dev/null"
+
+startServer --chunked
+check "fetches a chunked page" ./fetchtest -o "$OUT" 2 "$BASE/index.html" "$BASE/large.html"
+check "chunked bodies are decoded" sameBodies index.html large.html
+# grep reads all the output (no -q), so fetchtest isn't cut off by SIGPIPE before writing its files
+check "chunked responses keep the connection" bash -c "./fetchtest -o '$OUT' 1 '$BASE/large.html' '$BASE/index.html' 2>&1 >/dev/null | grep '1 opened, 1 reused'"
+check "bodies after a chunked one are intact" sameBodies large.html index.html
+$crawl --stream $streamArgs "$OUT/chunked" 1 > /dev/null 2>&1
+check "--stream finds the same pages in a chunked page" sameCrawl chunked
+
+startServer --close
+check "a server that closes gets a new connection per page" bash -c "./fetchtest 1 ${urls[*]:0:20} 2>&1 >/dev/null | grep -q '20 opened, 0 reused'"
+check "new connections to a host resolve it once" bash -c "./fetchtest 1 ${urls[*]:0:20} 2>&1 >/dev/null | grep -q '19 hits (0 negative), 1 misses'"
+
+startServer --errors 100
+check "--errors 100 fails every page" bash -c "! ./fetchtest 1 '$BASE/index.html'"
+
+startServer --truncate
+check "a body cut short of its Content-Length fails" bash -c "! ./fetchtest 1 '$BASE/large.html'"
+startServer --truncate --chunked
+check "a chunked body cut mid-chunk fails" bash -c "! ./fetchtest 1 '$BASE/large.html'"
+
+startServer --errors 30 --seed 7
+check "--errors fails the same pages every time" bash -c "[ \"\$(./fetchtest 8 ${urls[*]:0:100} | sort)\" = \"\$(./fetchtest 8 ${urls[*]:0:100} | sort)\" ]"
+check "--errors fails about its share of pages" bash -c "n=\$(./fetchtest 8 ${urls[*]} | grep -c '^OK'); [ \$n -gt 150 ] && [ \$n -lt 270 ]"
+
+startServer --latency 200
+check "--latency delays every response" bash -c "s=\$(date +%s%N); ./fetchtest 1 ${urls[*]:0:3}; [ \$(( (\$(date +%s%N) - s) / 1000000 )) -ge 600 ]"
+
+startServer --bandwidth 20000
+check "--bandwidth paces the body" bash -c "s=\$(date +%s%N); ./fetchtest 1 '$BASE/large.html'; [ \$(( (\$(date +%s%N) - s) / 1000000 )) -ge 3000 ]"
+mkdir "$OUT/slow"
+check "--stream finds links before the page has arrived" bash -c "$crawl --stream $streamArgs '$OUT/slow' 1 | grep -E '^(Found|Fetched):' | head -n1 | grep -q '^Found:'"
+
+echo "$failures failures"
+[ $failures -eq 0 ]
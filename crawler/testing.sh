@@ -10,6 +10,9 @@ LETTERS_0_DIR="./Letters_0"
 LETTERS_1_DIR="./Letters_1"
 LETTERS_2_DIR="./Letters_2"
 LETTERS_10_DIR="./Letters_10"
+LETTERS_10_THREADS_DIR="./Letters_10_threads"
+LETTERS_10_ARCHIVE_DIR="./Letters_10_archive"
+LETTERS_10_COMPRESSED_DIR="./Letters_10_compressed"
 
 TO_SCRAPE_0_DIR="./toscrape_0"
 TO_SCRAPE_1_DIR="./toscrape_1"
@@ -34,6 +37,9 @@ dirs=(
   "./Letters_1"
   "./Letters_2"
   "./Letters_10"
+  "./Letters_10_threads"
+  "./Letters_10_archive"
+  "./Letters_10_compressed"
   "./toscrape_0"
   "./toscrape_1"
   "./toscrape_2"
@@ -67,6 +73,12 @@ done
 # Using a character instead of an integer
 ./crawler "$LETTERS_URL" "$LETTERS_1_DIR" "a"
 
+# Using an invalid number of threads
+./crawler --threads 0 "$LETTERS_URL" "$LETTERS_1_DIR" "$MAX_DEPTH_1"
+
+# Using an unknown frontier order
+./crawler --order dfs "$LETTERS_URL" "$LETTERS_1_DIR" "$MAX_DEPTH_1"
+
 # Using proper input
 #Letters with depth 0
 ./crawler "$LETTERS_URL" "$LETTERS_0_DIR" "$MAX_DEPTH_0"
@@ -80,14 +92,26 @@ done
 #Letters with depth 10
 ./crawler "$LETTERS_URL" "$LETTERS_10_DIR" "$MAX_DEPTH_10"
 
+#Resuming the finished crawl of letters with depth 10 finds nothing left to do
+./crawler --resume "$LETTERS_URL" "$LETTERS_10_DIR" "$MAX_DEPTH_10"
+
+#Letters with depth 10, crawled by 4 threads
+./crawler --threads 4 "$LETTERS_URL" "$LETTERS_10_THREADS_DIR" "$MAX_DEPTH_10"
+
+#Letters with depth 10, saved to an archive of segments instead of one file per page
+./crawler --archive "$LETTERS_URL" "$LETTERS_10_ARCHIVE_DIR" "$MAX_DEPTH_10"
+
+#Letters with depth 10, saved to an archive of compressed blocks
+./crawler --compress "$LETTERS_URL" "$LETTERS_10_COMPRESSED_DIR" "$MAX_DEPTH_10"
+
 #toscrape with depth 0
 ./crawler "$TO_SCRAPE_URL" "$TO_SCRAPE_0_DIR" "$MAX_DEPTH_0"
 
 #toscrape with depth 1
 ./crawler "$TO_SCRAPE_URL" "$TO_SCRAPE_1_DIR" "$MAX_DEPTH_1"
 
-#toscrape with depth 2
-./crawler "$TO_SCRAPE_URL" "$TO_SCRAPE_2_DIR" "$MAX_DEPTH_2"
+#toscrape with depth 2, keeping only 16 queued pages in memory and spilling the rest to disk
+./crawler --window 16 "$TO_SCRAPE_URL" "$TO_SCRAPE_2_DIR" "$MAX_DEPTH_2"
 
 #toscrape with depth 3
 ./crawler "$TO_SCRAPE_URL" "$TO_SCRAPE_3_DIR" "$MAX_DEPTH_3"
@@ -0,0 +1,422 @@
+/**
+ * testserver.c
+ *
+ * Description: A small HTTP/1.1 server that stands in for the real web site in the
+ *              crawler's tests. It serves the files under rootDirectory (a directory
+ *              path serves its index.html) and answers anything else with a 404. Every
+ *              connection is handled by its own thread and kept open for further
+ *              requests until the client closes it, asks to close it, or stays quiet
+ *              for IDLE_TIMEOUT seconds.
+ *
+ *              Every page is sent with an ETag (from the file's size and modification
+ *              time) and a Last-Modified date, and a request whose If-None-Match, or
+ *              failing that If-Modified-Since, shows the client's copy is current is
+ *              answered with 304 Not Modified.
+ *
+ *              It can also play a slow or flaky web site, for benchmarking the crawler
+ *              against something like the real one without the network.
+ *
+ * Usage: ./testserver [--chunked] [--close] [--latency MS] [--bandwidth BYTES]
+ *                     [--errors PERCENT] [--seed N] [--no-validators] [--truncate]
+ *                     port rootDirectory
+ *
+ *        --chunked sends bodies with Transfer-Encoding: chunked instead of Content-Length.
+ *        --close closes every connection after one response.
+ *        --latency waits MS milliseconds before answering each request.
+ *        --bandwidth sends at most BYTES bytes per second on each connection.
+ *        --errors answers PERCENT percent of the pages with 500 Internal Server Error.
+ *              Which pages fail depends only on their path and on --seed (default 0),
+ *              so every run against the same site fails the same pages.
+ *        --no-validators sends no ETag or Last-Modified, and ignores conditional requests.
+ *        --truncate sends only the first half of every page's body, which with --chunked
+ *              ends in the middle of a chunk, then closes the connection.
+ */
+#define _GNU_SOURCE       // strcasestr, usleep, strptime, timegm
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+
+#define CHUNK_SIZE 1000         // bytes per chunk in --chunked mode
+#define IDLE_TIMEOUT 5          // seconds an idle connection is kept open
+#define PACE_SLICES 100         // with --bandwidth, a second's bytes are sent in this many sends
+
+static const char* rootDirectory;
+static bool chunked = false;
+static bool closeAlways = false;
+static int latencyMs = 0;
+static long bandwidth = 0;      // bytes per second per connection; 0 for no limit
+static int errorPercent = 0;
+static unsigned long seed = 0;
+static bool validators = true;
+static bool truncated = false;  // send half of each body, then close
+
+// How much of a response has been sent, and since when, to hold it to --bandwidth
+typedef struct pacer {
+    long startUs;
+    long sent;
+} pacer_t;
+
+static void parseArgs(const int argc, char* argv[], int* port);
+static int parseOption(const char* arg, const char* name, const int min, const int max);
+static void* serveConnection(void* arg);
+static bool serveRequest(const int fd, const char* request);
+static bool failsOn(const char* target);
+static bool notModified(const char* request, const char* etag, const struct stat* info);
+static bool requestHeader(const char* request, const char* name, char* value, const size_t size);
+static char* readFile(const char* path, long* length, struct stat* info);
+static void sendAll(const int fd, const char* data, const size_t length, pacer_t* pacer);
+static long nowUs(void);
+
+
+int
+main(const int argc, char* argv[]){
+    int port;
+    parseArgs(argc, argv, &port);
+    signal(SIGPIPE, SIG_IGN);
+
+    // IPv4 loopback only: the scripts connect to 127.0.0.1, since localhost may be ::1 first
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    if (listener < 0 || bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 1024) < 0){
+        fprintf(stderr, "Error: Can't listen on port %d.\n", port);
+        exit(1);
+    }
+    while (true){
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) continue;
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, serveConnection, (void*)(long)fd) != 0){
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
+
+/**
+* Description: Parses and validates command-line arguments for the server.
+* @param argc: Number of arguments.
+* @param argv: Argument values.
+* @param port: Pointer to the port to listen on.
+* @return void
+*/
+static void
+parseArgs(const int argc, char* argv[], int* port){
+    static const struct option options[] = {
+        {"chunked", no_argument, NULL, 'c'},
+        {"close", no_argument, NULL, 'C'},
+        {"latency", required_argument, NULL, 'l'},
+        {"bandwidth", required_argument, NULL, 'b'},
+        {"errors", required_argument, NULL, 'e'},
+        {"seed", required_argument, NULL, 's'},
+        {"no-validators", no_argument, NULL, 'V'},
+        {"truncate", no_argument, NULL, 't'},
+        {NULL, 0, NULL, 0}
+    };
+    const char* usage = "Usage: ./testserver [--chunked] [--close] [--latency MS] [--bandwidth BYTES] [--errors PERCENT] [--seed N] [--no-validators] [--truncate] port rootDirectory\n";
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1){
+        if (opt == 'c'){
+            chunked = true;
+        } else if (opt == 'C'){
+            closeAlways = true;
+        } else if (opt == 'l'){
+            latencyMs = parseOption(optarg, "Latency", 0, 60000);
+        } else if (opt == 'b'){
+            bandwidth = parseOption(optarg, "Bandwidth", 1, 1000000000);
+        } else if (opt == 'e'){
+            errorPercent = parseOption(optarg, "Error percentage", 0, 100);
+        } else if (opt == 's'){
+            seed = parseOption(optarg, "Seed", 0, 1000000000);
+        } else if (opt == 'V'){
+            validators = false;
+        } else if (opt == 't'){
+            truncated = true;
+        } else {
+            fprintf(stderr, "%s", usage);
+            exit(1);
+        }
+    }
+    if (argc - optind != 2){
+        fprintf(stderr, "%s", usage);
+        exit(1);
+    }
+    if (sscanf(argv[optind], "%d", port) != 1 || *port <= 0 || *port > 65535){
+        fprintf(stderr, "Error: Port must be an integer between 1 and 65535.\n");
+        exit(1);
+    }
+    rootDirectory = argv[optind + 1];
+}
+
+/**
+* Description: Parses the integer value of a command-line option, exiting if it isn't one
+*              within [min, max].
+* @param arg: The option's value.
+* @param name: What the option is, for the error message.
+* @param min: Smallest value allowed.
+* @param max: Largest value allowed.
+* @return The value.
+*/
+static int
+parseOption(const char* arg, const char* name, const int min, const int max){
+    int value;
+    if (sscanf(arg, "%d", &value) != 1 || value < min || value > max){
+        fprintf(stderr, "Error: %s must be an integer between %d and %d.\n", name, min, max);
+        exit(1);
+    }
+    return value;
+}
+
+/**
+* Description: Answers the requests arriving on a connection, one after the other,
+*              until it is closed.
+* @param arg: The connection's socket.
+* @return NULL
+*/
+static void*
+serveConnection(void* arg){
+    int fd = (int)(long)arg;
+    struct timeval timeout = { .tv_sec = IDLE_TIMEOUT };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    // Headers and body go out in separate sends; without this the body waits for the
+    // client's delayed ACK of the headers, adding 40ms to every page
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    char request[8192] = "";
+    size_t len = 0;
+    bool open = true;
+    while (open){
+        // Read until the end of the request headers
+        char* end;
+        while ((end = strstr(request, "\r\n\r\n")) == NULL){
+            if (len >= sizeof(request) - 1) break;
+            ssize_t n = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+            if (n <= 0) break;
+            len += n;
+            request[len] = '\0';
+        }
+        if (end == NULL) break;
+        end += 4;
+        char saved = *end;
+        *end = '\0';
+        open = serveRequest(fd, request);
+        *end = saved;
+        // Keep whatever followed the request; it is the start of the next one
+        len -= end - request;
+        memmove(request, end, len);
+        request[len] = '\0';
+    }
+    close(fd);
+    return NULL;
+}
+
+/**
+* Description: Sends the response to one request.
+* @param fd: The connection's socket.
+* @param request: The request's headers.
+* @return Whether the connection stays open for another request.
+*/
+static bool
+serveRequest(const int fd, const char* request){
+    char target[4096];
+    char* body = NULL;
+    long length = 0;
+    bool failed = false;
+    struct stat info;
+    if (sscanf(request, "GET %4095s HTTP/1.%*d", target) == 1 && strstr(target, "..") == NULL){
+        target[strcspn(target, "?#")] = '\0';
+        char path[strlen(rootDirectory) + strlen(target) + 16];
+        sprintf(path, "%s%s", rootDirectory, target);
+        if (path[strlen(path) - 1] == '/') strcat(path, "index.html");
+        body = readFile(path, &length, &info);
+        failed = body != NULL && failsOn(target);
+    }
+    bool keepAlive = !closeAlways && !truncated && strcasestr(request, "Connection: close") == NULL;
+    const char* connection = keepAlive ? "keep-alive" : "close";
+    if (latencyMs > 0) usleep(latencyMs * 1000);
+
+    // The page's validators, as header lines
+    char etag[64] = "";
+    char validatorLines[192] = "";
+    if (validators && body != NULL && !failed){
+        char date[64];
+        strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&info.st_mtim.tv_sec));
+        sprintf(etag, "\"%lx-%lx\"", (long)info.st_size, (long)info.st_mtim.tv_sec * 1000000000L + info.st_mtim.tv_nsec);
+        sprintf(validatorLines, "ETag: %s\r\nLast-Modified: %s\r\n", etag, date);
+    }
+
+    // With --truncate only this much of the body is sent
+    long sent = truncated ? length / 2 : length;
+
+    char header[512];
+    pacer_t pacer = { .startUs = nowUs(), .sent = 0 };
+    if (body == NULL || failed){
+        const char* status = failed ? "500 Internal Server Error" : "404 Not Found";
+        sprintf(header, "HTTP/1.1 %s\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n", status, connection);
+        sendAll(fd, header, strlen(header), &pacer);
+    } else if (validators && notModified(request, etag, &info)){
+        sprintf(header, "HTTP/1.1 304 Not Modified\r\n%sConnection: %s\r\n\r\n", validatorLines, connection);
+        sendAll(fd, header, strlen(header), &pacer);
+    } else if (!chunked){
+        sprintf(header, "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n%sContent-Length: %ld\r\nConnection: %s\r\n\r\n", validatorLines, length, connection);
+        sendAll(fd, header, strlen(header), &pacer);
+        sendAll(fd, body, sent, &pacer);
+    } else {
+        sprintf(header, "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n%sTransfer-Encoding: chunked\r\nConnection: %s\r\n\r\n", validatorLines, connection);
+        sendAll(fd, header, strlen(header), &pacer);
+        for (long pos = 0; pos < length; pos += CHUNK_SIZE){
+            long size = length - pos < CHUNK_SIZE ? length - pos : CHUNK_SIZE;
+            sprintf(header, "%lx\r\n", size);
+            sendAll(fd, header, strlen(header), &pacer);
+            if (pos + size > sent){
+                // Cut off in the middle of this chunk
+                sendAll(fd, body + pos, sent - pos, &pacer);
+                break;
+            }
+            sendAll(fd, body + pos, size, &pacer);
+            sendAll(fd, "\r\n", 2, &pacer);
+        }
+        if (!truncated) sendAll(fd, "0\r\n\r\n", 5, &pacer);
+    }
+    free(body);
+    return keepAlive;
+}
+
+/**
+* Description: Decides whether a page is one --errors makes fail, from a hash of its path
+*              and the seed (FNV-1a), so the same pages fail every time.
+* @param target: The page's path.
+* @return Whether to answer it with an error.
+*/
+static bool
+failsOn(const char* target){
+    if (errorPercent == 0) return false;
+    unsigned long hash = 14695981039346656037UL ^ seed;
+    for (const char* p = target; *p != '\0'; p++){
+        hash = (hash ^ (unsigned char)*p) * 1099511628211UL;
+    }
+    return (hash >> 16) % 100 < (unsigned long)errorPercent;
+}
+
+/**
+* Description: Decides whether a conditional request's copy of a page is current: its
+*              If-None-Match lists the page's ETag (or is *), or, if it has none, its
+*              If-Modified-Since is no earlier than the file's modification time.
+* @param request: The request's headers.
+* @param etag: The page's ETag, quoted.
+* @param info: The page's file's status.
+* @return Whether to answer 304 Not Modified.
+*/
+static bool
+notModified(const char* request, const char* etag, const struct stat* info){
+    char value[1024];
+    if (requestHeader(request, "If-None-Match", value, sizeof(value))){
+        return strcmp(value, "*") == 0 || strstr(value, etag) != NULL;
+    }
+    if (requestHeader(request, "If-Modified-Since", value, sizeof(value))){
+        struct tm since = {0};
+        char* end = strptime(value, "%a, %d %b %Y %H:%M:%S GMT", &since);
+        return end != NULL && *end == '\0' && info->st_mtim.tv_sec <= timegm(&since);
+    }
+    return false;
+}
+
+/**
+* Description: Finds a header in a request.
+* @param request: The request's headers.
+* @param name: The header's name, matched without regard to case.
+* @param value: Set to the header's value, without surrounding spaces.
+* @param size: The size of value; a longer value is cut short.
+* @return Whether the request has the header.
+*/
+static bool
+requestHeader(const char* request, const char* name, char* value, const size_t size){
+    size_t nameLen = strlen(name);
+    for (const char* line = strstr(request, "\r\n"); line != NULL; line = strstr(line, "\r\n")){
+        line += 2;
+        if (strncasecmp(line, name, nameLen) == 0 && line[nameLen] == ':'){
+            const char* start = line + nameLen + 1;
+            start += strspn(start, " \t");
+            size_t len = strcspn(start, "\r\n");
+            while (len > 0 && (start[len - 1] == ' ' || start[len - 1] == '\t')) len--;
+            if (len >= size) len = size - 1;
+            memcpy(value, start, len);
+            value[len] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+* Description: Reads a whole regular file.
+* @param path: The file's path.
+* @param length: Set to the file's length.
+* @param info: Set to the file's status.
+* @return A new buffer with the file's contents, or NULL if it isn't a readable regular file.
+*/
+static char*
+readFile(const char* path, long* length, struct stat* info){
+    if (stat(path, info) < 0 || !S_ISREG(info->st_mode)) return NULL;
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) return NULL;
+    char* data = malloc(info->st_size + 1);
+    *length = data ? fread(data, 1, info->st_size, fp) : 0;
+    fclose(fp);
+    return data;
+}
+
+/**
+* Description: Sends all of data, giving up quietly if the client goes away. With
+*              --bandwidth, sends it in slices, sleeping between them as needed to keep
+*              the response, counted from its start, within the bandwidth.
+* @param fd: The connection's socket.
+* @param data: What to send.
+* @param length: How many bytes to send.
+* @param pacer: The response's progress so far.
+* @return void
+*/
+static void
+sendAll(const int fd, const char* data, const size_t length, pacer_t* pacer){
+    size_t slice = bandwidth > 0 ? (bandwidth + PACE_SLICES - 1) / PACE_SLICES : length;
+    size_t sent = 0;
+    while (sent < length){
+        if (bandwidth > 0){
+            long dueUs = pacer->startUs + pacer->sent * 1000000 / bandwidth;
+            long nowish = nowUs();
+            if (dueUs > nowish) usleep(dueUs - nowish);
+        }
+        size_t size = length - sent < slice ? length - sent : slice;
+        ssize_t n = send(fd, data + sent, size, 0);
+        if (n <= 0) return;
+        sent += n;
+        pacer->sent += n;
+    }
+}
+
+/**
+* Description: Returns the monotonic clock in microseconds.
+* @return The time.
+*/
+static long
+nowUs(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000;
+}
@@ -5,14 +5,33 @@
  *              and indexes the words into an index struct and saves it to a file
  *              under the name filename.
  *
- * Usage: ./indexer pageDirectory indexFilename
+ * Usage: ./indexer [--refetch] [--threads N] [--memory MB] [--binary] pageDirectory indexFilename
+ *
+ *        By default the HTML saved by the crawler is read back from pageDirectory;
+ *        --refetch re-downloads every page from its URL instead (the old behaviour),
+ *        one page at a time even with --threads.
+ *        --threads N indexes documents with N threads, each building partial indexes
+ *        of ranges of docIDs, which are merged in docID order; the index saved is
+ *        byte for byte the one a single thread builds.
+ *        --memory MB builds the index in runs of at most MB megabytes, each written out
+ *        sorted by word to a file beside indexFilename, then merges the runs into
+ *        indexFilename, so memory stays the same however large the corpus is. Lines
+ *        come out sorted by word instead of in hashtable order.
+ *        --binary writes indexFilename in the compact binary format of index.h instead
+ *        of as text.
  */
 
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include <pthread.h>
+#include <getopt.h>
 #include "index.h"
+#include "pagedir.h"
 #include "mem.h"
 #include "file.h"
 #include "webpage.h"
@@ -20,6 +39,13 @@
 #include "word.h"
 
 #define TYPICAL_INDEX_SIZE 500
+#define MAX_THREADS 256
+#define RANGE_DOCS 256              // documents a thread claims at a time
+#define RANGES_AHEAD 4              // ranges per thread built ahead of the merge, at most
+#define MAX_MEMORY_MB (1 << 20)
+#define WORD_BYTES 96               // memory a word takes in a run besides its text and pairs, about
+#define RUN_SLOTS_BYTES 1024        // hashtable slots of a run: one per this many bytes of budget
+#define MERGE_WAYS 64               // runs merged into one at a time
 
 // Defined internal to the module only. Use it to pass as an arg to hashtable_iterate
 typedef struct indexDocumentPair {
@@ -27,10 +53,95 @@ typedef struct indexDocumentPair {
     int docID;
 } indexDocumentPair_t;
 
-static void parseArgs(const int argc, const char* argv[], const char** pageDirectory, const char** indexFileName);
-index_t* indexBuild(const char* pageDirectory);
+// A word's (docID, count) pairs in one partial index, in docID order
+typedef struct postings {
+    char* word;
+    int* pairs;                 // docID, count, docID, count, ...
+    int len;                    // pairs
+    int cap;
+} postings_t;
+
+// The index of a range of documents, built by one thread. Words are kept in the order
+// they were first inserted, so merging partials in docID order inserts every word into
+// the whole index in the order a single thread would have
+typedef struct partialIndex {
+    hashtable_t* words;         // word -> its postings_t
+    postings_t** order;         // the same postings, in the order their words came
+    int numWords;
+    int cap;
+    long bytes;                 // memory the words and their pairs take, about
+    bool last;                  // a document of the range was missing: no more follow
+} partialIndex_t;
+
+// As indexDocumentPair, for a partial index
+typedef struct partialDocumentPair {
+    partialIndex_t* partial;
+    int docID;
+} partialDocumentPair_t;
+
+// Shared by the threads of a parallel build
+typedef struct buildState {
+    const char* pageDirectory;
+    bool refetch;
+    int window;                 // ranges built but not yet merged, at most
+    pthread_mutex_t lock;       // guards everything below
+    pthread_cond_t changed;     // a range was built or merged, or the build ended
+    int nextRange;              // the next range to claim
+    int merged;                 // ranges merged so far
+    int endDocID;               // the first missing docID found so far; INT_MAX if none
+    bool done;                  // the merge has seen the last range
+    partialIndex_t** built;     // range r's partial index at r % window, once built
+} buildState_t;
+
+// Takes each range's partial index, in docID order; frees nothing
+typedef void (*partialMerge_t)(void* arg, partialIndex_t* partial);
+
+// A bounded-memory build: the run being gathered, and the runs written out so far
+typedef struct runBuilder {
+    partialIndex_t* run;
+    long budget;                // bytes the run may take before it is written out
+    int slots;                  // hashtable slots of a run
+    const char* indexFileName;  // runs are written beside it, as indexFileName.runN
+    int numRuns;
+    bool failed;                // a run couldn't be written
+} runBuilder_t;
+
+// A run being merged: its file and the word its next line starts with
+typedef struct runReader {
+    FILE* fp;
+    int run;                    // its number, which orders runs of the same word
+    char* word;
+    size_t cap;
+} runReader_t;
+
+static void parseArgs(const int argc, const char* argv[], const char** pageDirectory, const char** indexFileName,
+                      bool* refetch, int* numThreads, int* memoryMB, bool* binary);
+index_t* indexBuild(const char* pageDirectory, const bool refetch, const int numThreads);
+static bool indexBuildRuns(const char* pageDirectory, const bool refetch, const int numThreads,
+                           const int memoryMB, const char* indexFileName, const bool binary);
+static void buildRanges(const char* pageDirectory, const bool refetch, const int numThreads,
+                        partialMerge_t merge, void* arg);
+static void* buildWorker(void* arg);
+static partialIndex_t* buildRange(pagedir_t* pages, const int firstDocID, buildState_t* state);
+static partialIndex_t* partialNew(const int slots);
+static postings_t* partialPostings(partialIndex_t* partial, const char* word);
+static void postingsAdd(partialIndex_t* partial, postings_t* postings, const int docID, const int count);
+static void partialInsert(void* partialAndDocument, const char* word, void* count);
+static void mergePartial(void* index, partialIndex_t* partial);
+static void addToRun(void* runs, partialIndex_t* partial);
+static void writeRun(runBuilder_t* runs);
+static int compareWords(const void* a, const void* b);
+static bool mergeRuns(const char* indexFileName, const int first, const int count, const char* outPath,
+                      const bool binary);
+static bool readWord(runReader_t* reader);
+static bool readNumber(runReader_t* reader, int* number);
+static bool readerBefore(const runReader_t* a, const runReader_t* b);
+static void siftDown(runReader_t** heap, const int size, int pos);
+static char* runPath(const char* indexFileName, const int run);
+static void partialDelete(partialIndex_t* partial);
+static webpage_t* refetchPage(pagedir_t* pages, int docID);
 void indexPage(webpage_t* webpage, index_t* index, int docID);
-static char* formatPath(const char* pageDirectory, int docID);
+static hashtable_t* countWords(webpage_t* webpage);
 static void insertWordIntoIndex(void* indexAndDocument, const char* word, void* count);
 
 
@@ -38,12 +149,25 @@ static void insertWordIntoIndex(void* indexAndDocument, const char* word, void*
 int main(const int argc, const char* argv[]){
     const char* pageDirectory;
     const char* indexFileName;
+    bool refetch = false;
+    int numThreads = 1;
+    int memoryMB = 0;
+    bool binary = false;
     // Parse the commandline args
-    parseArgs(argc, argv, &pageDirectory, &indexFileName);
+    parseArgs(argc, argv, &pageDirectory, &indexFileName, &refetch, &numThreads, &memoryMB, &binary);
+    // With a memory budget, the index is built in runs and merged straight into the file
+    if (memoryMB > 0){
+        if (!indexBuildRuns(pageDirectory, refetch, numThreads, memoryMB, indexFileName, binary)){
+            fprintf(stderr, "Failed to save.\n");
+            return 1;
+        }
+        printf("Saved Index Successfully\n");
+        return 0;
+    }
     // Build the index using the page documents from the pageDirectory directory
-    index_t* index = indexBuild(pageDirectory);
+    index_t* index = indexBuild(pageDirectory, refetch, numThreads);
     // Check if saving failed for any reason
-    if(!index_save(index, indexFileName)){
+    if(!(binary ? index_saveBinary(index, indexFileName) : index_save(index, indexFileName))){
         fprintf(stderr, "Failed to save.\n");
         return 1;
     } else {
@@ -55,22 +179,55 @@ int main(const int argc, const char* argv[]){
 }
 
 /**
-* Description: Parses and validates command-line arguments for the crawler.
+* Description: Parses and validates command-line arguments for the indexer.
 * @param argc: Number of arguments.
 * @param argv: Argument values.
-* @param seedURL: Pointer to the seedURL to be initialized.
-* @param pageDirectory: Pointer to the directory name where pages will be saved.
-* @param maxDepth: Pointer to the maximum depth.
+* @param pageDirectory: Pointer to the crawler directory the pages are read from.
+* @param indexFileName: Pointer to the pathname the index will be saved to.
+* @param refetch: Set to true if --refetch was given.
+* @param numThreads: Set to the --threads given.
+* @param memoryMB: Set to the --memory given.
+* @param binary: Set if --binary is given.
 * @return void
 */
 static void
-parseArgs(const int argc, const char* argv[], const char** pageDirectory, const char** indexFileName){
+parseArgs(const int argc, const char* argv[], const char** pageDirectory, const char** indexFileName,
+          bool* refetch, int* numThreads, int* memoryMB, bool* binary){
+    static const struct option options[] = {
+        {"refetch", no_argument, NULL, 'r'},
+        {"threads", required_argument, NULL, 't'},
+        {"memory", required_argument, NULL, 'm'},
+        {"binary", no_argument, NULL, 'b'},
+        {NULL, 0, NULL, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, (char* const*)argv, "", options, NULL)) != -1){
+        if (opt == 'r'){
+            *refetch = true;
+        } else if (opt == 't'){
+            if (sscanf(optarg, "%d", numThreads) != 1 || *numThreads < 1 || *numThreads > MAX_THREADS){
+                fprintf(stderr, "Error: Number of threads must be an integer between 1 and %d.\n", MAX_THREADS);
+                exit(1);
+            }
+        } else if (opt == 'm'){
+            if (sscanf(optarg, "%d", memoryMB) != 1 || *memoryMB < 1 || *memoryMB > MAX_MEMORY_MB){
+                fprintf(stderr, "Error: Memory must be an integer number of MB between 1 and %d.\n", MAX_MEMORY_MB);
+                exit(1);
+            }
+        } else if (opt == 'b'){
+            *binary = true;
+        } else {
+            fprintf(stderr, "Usage: ./indexer [--refetch] [--threads N] [--memory MB] [--binary] pageDirectory indexFilename\n");
+            exit(1);
+        }
+    }
     // Ensuring user inputted enough arguments.
-    if (argc != 3){
+    if (argc - optind != 2){
         fprintf(stderr, "Error: Not the right number of arguments supplied.\n");
         exit(1);
     }
-    char* path = mem_assert(mem_malloc(128 * sizeof(char)), "Error: Failed to allocate memory for path");
+    argv += optind - 1;
+    char* path = mem_assert(mem_malloc(strlen(argv[1]) + strlen("/.crawler") + 1), "Error: Failed to allocate memory for path");
     
     sprintf(path, "%s/.crawler", argv[1]);
     FILE* fp1 = fopen(path, "r");
@@ -95,43 +252,570 @@ parseArgs(const int argc, const char* argv[], const char** pageDirectory, const
 
 /***
  * Description: Builds an index from a collection of webpages stored in the specified page directory.
- *              It reads each page file, extracts and fetches the webpage, then indexes its words.
+ *              Each page is loaded with the HTML the crawler saved (or, with refetch, fetched
+ *              again from its URL), then its words are indexed. Pages are found through
+ *              pagedir, whichever layout the crawler saved them in.
+ * 
+ *              With more than one thread, the partial indexes of ranges of documents
+ *              (see buildRanges) are merged into the index in docID order.
  * 
  * @param pageDirectory: Path to the directory containing crawler-generated webpage files.
+ * @param refetch: Re-download each page instead of reading the stored HTML.
+ * @param numThreads: Threads to index with.
  * @return A pointer to the built index
  */
-index_t* indexBuild(const char* pageDirectory){
-    // Variable to hold the path for a document. It's memory is allocated in formatPath
-    char* path;
+index_t* indexBuild(const char* pageDirectory, const bool refetch, const int numThreads){
     // Initializing the index struct 
     index_t* index = index_new(TYPICAL_INDEX_SIZE);
+    if (numThreads > 1){
+        buildRanges(pageDirectory, refetch, numThreads, mergePartial, index);
+        return index;
+    }
+    pagedir_t* pages = pagedir_open(pageDirectory);
     int docID = 1;
-    FILE* fp;
-    // As long as we are able to find a file with name "pageDirectory/docID"
-    while ((fp = fopen(path = formatPath(pageDirectory, docID), "r")) != NULL){
-        // Read the URL and depth of the page during crawling (first two lines)
-        char* pageURL = file_readLine(fp);
-        char* depthStr = file_readLine(fp);
-        int depth = atoi(depthStr); // Convert depth to integer
-
-        // Create a page with the given URL & Depth and fetch its html content
-        webpage_t* page = webpage_new(pageURL, depth, NULL);
-        webpage_fetch(page);
-
+    webpage_t* page;
+    // As long as we are able to load the document with this docID
+    while ((page = refetch ? refetchPage(pages, docID) : pagedir_read(pages, docID)) != NULL){
         // Scan the page for words to insert into the index
         indexPage(page, index, docID);
-
-        // Free all memory allocated that we no longer need
         webpage_delete(page);
-        mem_free(depthStr);
-        mem_free(path);
-        fclose(fp); // Close the file
         docID++; // Move on to the next document
     }
-    mem_free(path); // Freeing this after exiting the while loop one more time
+    pagedir_close(pages);
     return index;
 }
 
+/***
+ * Description: Builds the index in runs of at most memoryMB: the partial indexes of ranges
+ *              of documents (see buildRanges) are gathered into a run until it reaches the
+ *              budget, when it is written out sorted by word. The runs, each of documents
+ *              after the last's, are then merged MERGE_WAYS at a time, in passes if there
+ *              are more, into indexFilename. Nothing but the run being gathered and a line
+ *              of each run being merged is held in memory.
+ *
+ * @param pageDirectory: Path to the directory containing crawler-generated webpage files.
+ * @param refetch: Re-download each page instead of reading the stored HTML.
+ * @param numThreads: Threads to index with.
+ * @param memoryMB: Megabytes a run may take.
+ * @param indexFileName: The index file; runs are written beside it and removed.
+ * @param binary: Write the index file in the binary format.
+ * @return false if a run or the index couldn't be written.
+ */
+static bool indexBuildRuns(const char* pageDirectory, const bool refetch, const int numThreads,
+                           const int memoryMB, const char* indexFileName, const bool binary){
+    long budget = (long)memoryMB << 20;
+    runBuilder_t runs = { .budget = budget, .indexFileName = indexFileName, .numRuns = 0, .failed = false };
+    runs.slots = budget / RUN_SLOTS_BYTES > TYPICAL_INDEX_SIZE ? (int)(budget / RUN_SLOTS_BYTES) : TYPICAL_INDEX_SIZE;
+    runs.run = partialNew(runs.slots);
+    buildRanges(pageDirectory, refetch, numThreads, addToRun, &runs);
+    writeRun(&runs);
+    partialDelete(runs.run);
+    // Merge passes: runs [first, end) are merged a group at a time into new runs after them
+    int first = 0;
+    int end = runs.numRuns;
+    bool ok = !runs.failed;
+    while (ok && end - first > MERGE_WAYS){
+        int next = end;
+        for (int group = first; ok && group < end; group += MERGE_WAYS){
+            int count = end - group < MERGE_WAYS ? end - group : MERGE_WAYS;
+            char* path = runPath(indexFileName, next++);
+            ok = mergeRuns(indexFileName, group, count, path, false);
+            mem_free(path);
+        }
+        first = end;
+        end = next;
+    }
+    if (ok) ok = mergeRuns(indexFileName, first, end - first, indexFileName, binary);
+    // Remove whatever runs a failure left behind
+    for (int run = 0; run < end; run++){
+        char* path = runPath(indexFileName, run);
+        remove(path);
+        mem_free(path);
+    }
+    return ok;
+}
+
+/***
+ * Description: Indexes the documents in ranges of RANGE_DOCS docIDs: numThreads threads
+ *              claim ranges in turn and build a partial index of each, while this thread
+ *              hands the partials to merge in docID order as they come, up to the first
+ *              range with a missing document. Threads stay at most RANGES_AHEAD ranges
+ *              each ahead of the merge, which bounds the memory the partials take.
+ *
+ * @param pageDirectory: Path to the directory containing crawler-generated webpage files.
+ * @param refetch: Re-download each page instead of reading the stored HTML.
+ * @param numThreads: Threads to index with.
+ * @param merge: Takes each partial index, which is deleted after.
+ * @param arg: Passed to merge.
+ * @return void
+ */
+static void buildRanges(const char* pageDirectory, const bool refetch, const int numThreads,
+                        partialMerge_t merge, void* arg){
+    buildState_t state = { .pageDirectory = pageDirectory, .refetch = refetch,
+                           .window = numThreads * RANGES_AHEAD, .nextRange = 0, .merged = 0,
+                           .endDocID = INT_MAX, .done = false };
+    pthread_mutex_init(&state.lock, NULL);
+    pthread_cond_init(&state.changed, NULL);
+    state.built = mem_assert(mem_calloc(state.window, sizeof(partialIndex_t*)), "Error: Failed to allocate memory for partial indexes");
+    pthread_t* workers = mem_assert(mem_malloc(numThreads * sizeof(pthread_t)), "Error: Failed to allocate memory for workers");
+    for (int i = 0; i < numThreads; i++){
+        if (pthread_create(&workers[i], NULL, buildWorker, &state) != 0){
+            fprintf(stderr, "Error: Failed to start worker thread.\n");
+            exit(1);
+        }
+    }
+    // Merge the ranges in order, each as soon as it is built, up to the first one
+    // with a missing document
+    bool last = false;
+    while (!last){
+        pthread_mutex_lock(&state.lock);
+        partialIndex_t* partial;
+        while ((partial = state.built[state.merged % state.window]) == NULL){
+            pthread_cond_wait(&state.changed, &state.lock);
+        }
+        pthread_mutex_unlock(&state.lock);
+        (*merge)(arg, partial);
+        last = partial->last;
+        partialDelete(partial);
+        pthread_mutex_lock(&state.lock);
+        state.built[state.merged % state.window] = NULL;
+        state.merged++;
+        state.done = last;
+        pthread_cond_broadcast(&state.changed);
+        pthread_mutex_unlock(&state.lock);
+    }
+    for (int i = 0; i < numThreads; i++){
+        pthread_join(workers[i], NULL);
+    }
+    // Ranges past the last may have been built before it was known to be the last
+    for (int i = 0; i < state.window; i++){
+        if (state.built[i] != NULL) partialDelete(state.built[i]);
+    }
+    mem_free(state.built);
+    mem_free(workers);
+    pthread_cond_destroy(&state.changed);
+    pthread_mutex_destroy(&state.lock);
+}
+
+/***
+ * Description: Body of a thread of a parallel build. Claims the next range of docIDs,
+ *              once it is no more than the window ahead of the merge, builds its
+ *              partial index and hands it over, until a range starts past a missing
+ *              document or the merge is done.
+ *
+ * @param arg: Pointer to the buildState_t.
+ * @return NULL
+ */
+static void* buildWorker(void* arg){
+    buildState_t* state = arg;
+    // Each thread reads through a page directory of its own, so no read waits on another's
+    pagedir_t* pages = pagedir_open(state->pageDirectory);
+    pthread_mutex_lock(&state->lock);
+    while (true){
+        while (!state->done && state->nextRange >= state->merged + state->window){
+            pthread_cond_wait(&state->changed, &state->lock);
+        }
+        int range = state->nextRange;
+        long firstDocID = (long)range * RANGE_DOCS + 1;
+        // A range starting at the first missing document is still built, to say it is the last
+        if (state->done || firstDocID > state->endDocID) break;
+        state->nextRange++;
+        pthread_mutex_unlock(&state->lock);
+        partialIndex_t* partial = buildRange(pages, (int)firstDocID, state);
+        pthread_mutex_lock(&state->lock);
+        state->built[range % state->window] = partial;
+        pthread_cond_broadcast(&state->changed);
+    }
+    pthread_mutex_unlock(&state->lock);
+    pagedir_close(pages);
+    return NULL;
+}
+
+/***
+ * Description: Builds the partial index of the RANGE_DOCS documents from firstDocID, or
+ *              of those up to the first that is missing.
+ *
+ * @param pages: The thread's page directory.
+ * @param firstDocID: The range's first docID.
+ * @param state: The build's shared state; its endDocID is lowered on a missing document.
+ * @return The partial index.
+ */
+static partialIndex_t* buildRange(pagedir_t* pages, const int firstDocID, buildState_t* state){
+    partialIndex_t* partial = partialNew(TYPICAL_INDEX_SIZE);
+    for (int docID = firstDocID; docID < firstDocID + RANGE_DOCS; docID++){
+        webpage_t* page = state->refetch ? refetchPage(pages, docID) : pagedir_read(pages, docID);
+        if (page == NULL){
+            partial->last = true;
+            pthread_mutex_lock(&state->lock);
+            if (docID < state->endDocID) state->endDocID = docID;
+            pthread_mutex_unlock(&state->lock);
+            break;
+        }
+        // The same words, counted and visited in the same order, as indexPage
+        hashtable_t* seenWords = countWords(page);
+        partialDocumentPair_t partialDoc = { .partial = partial, .docID = docID };
+        hashtable_iterate(seenWords, &partialDoc, partialInsert);
+        hashtable_delete(seenWords, mem_free);
+        webpage_delete(page);
+    }
+    return partial;
+}
+
+/***
+ * Description: Creates an empty partial index.
+ * @param slots: Slots of its hashtable of words.
+ * @returns The partial index.
+*/
+static partialIndex_t* partialNew(const int slots){
+    partialIndex_t* partial = mem_assert(mem_calloc(1, sizeof(partialIndex_t)), "Error: Failed to allocate memory for partial index");
+    partial->words = mem_assert(hashtable_new(slots), "Error: Failed to allocate memory for partial index");
+    return partial;
+}
+
+/***
+ * Description: Finds a word's postings in a partial index, adding the word with none if
+ *              it is new to the partial.
+ * @param partial: The partial index.
+ * @param word: The word.
+ * @returns Its postings.
+*/
+static postings_t* partialPostings(partialIndex_t* partial, const char* word){
+    postings_t* postings = hashtable_find(partial->words, word);
+    if (postings != NULL) return postings;
+    postings = mem_assert(mem_calloc(1, sizeof(postings_t)), "Error: Failed to allocate memory for postings");
+    postings->word = mem_assert(mem_malloc(strlen(word) + 1), "Error: Failed to allocate memory for postings");
+    strcpy(postings->word, word);
+    hashtable_insert(partial->words, word, postings);
+    if (partial->numWords == partial->cap){
+        partial->cap = partial->cap > 0 ? partial->cap * 2 : TYPICAL_INDEX_SIZE;
+        partial->order = mem_assert(realloc(partial->order, partial->cap * sizeof(postings_t*)), "Error: Failed to allocate memory for partial index");
+    }
+    partial->order[partial->numWords++] = postings;
+    partial->bytes += WORD_BYTES + 2 * (strlen(word) + 1);
+    return postings;
+}
+
+/***
+ * Description: Appends a pair (docID, count) to a word's postings in a partial index.
+ * @param partial: The partial index.
+ * @param postings: The word's postings.
+ * @param docID: The document, after any already in postings.
+ * @param count: The word's number of occurrences in it.
+ * @returns void
+*/
+static void postingsAdd(partialIndex_t* partial, postings_t* postings, const int docID, const int count){
+    if (postings->len == postings->cap){
+        int cap = postings->cap > 0 ? postings->cap * 2 : 4;
+        postings->pairs = mem_assert(realloc(postings->pairs, cap * 2 * sizeof(int)), "Error: Failed to allocate memory for postings");
+        partial->bytes += (long)(cap - postings->cap) * 2 * sizeof(int);
+        postings->cap = cap;
+    }
+    postings->pairs[2 * postings->len] = docID;
+    postings->pairs[2 * postings->len + 1] = count;
+    postings->len++;
+}
+
+/***
+ * Description: Adds a pair (docID, count) to a word's postings in a partial index, first
+ *              adding the word if it is new to the partial.
+ * @param partialAndDocument: The partialDocumentPair_t of the partial index and the document
+ * @param word: The word.
+ * @param count: Its number of occurrences in the document, an int*.
+ * @returns void
+*/
+static void partialInsert(void* partialAndDocument, const char* word, void* count){
+    partialDocumentPair_t* partialDoc = partialAndDocument;
+    postingsAdd(partialDoc->partial, partialPostings(partialDoc->partial, word), partialDoc->docID, *(int*)count);
+}
+
+/***
+ * Description: Inserts a partial index into the index: its words in the order they came,
+ *              each with its pairs in docID order. Merged in docID order, partials leave
+ *              the index as indexing their documents one by one would have.
+ * @param index: The index_t.
+ * @param partial: The partial index of the documents after those already in index.
+ * @returns void
+*/
+static void mergePartial(void* index, partialIndex_t* partial){
+    for (int i = 0; i < partial->numWords; i++){
+        postings_t* postings = partial->order[i];
+        for (int j = 0; j < postings->len; j++){
+            index_insert(index, postings->word, postings->pairs[2 * j], postings->pairs[2 * j + 1]);
+        }
+    }
+}
+
+/***
+ * Description: Adds a partial index to the run being gathered, and writes the run out
+ *              once it has reached its budget.
+ * @param runs: The runBuilder_t.
+ * @param partial: The partial index of the documents after those already in the runs.
+ * @returns void
+*/
+static void addToRun(void* runs, partialIndex_t* partial){
+    runBuilder_t* builder = runs;
+    for (int i = 0; i < partial->numWords; i++){
+        postings_t* from = partial->order[i];
+        postings_t* to = partialPostings(builder->run, from->word);
+        for (int j = 0; j < from->len; j++){
+            postingsAdd(builder->run, to, from->pairs[2 * j], from->pairs[2 * j + 1]);
+        }
+    }
+    if (builder->run->bytes >= builder->budget) writeRun(builder);
+}
+
+/***
+ * Description: Writes the run being gathered out, if it isn't empty, as the next run file:
+ *              a line per word, in strcmp order, in the format of index_save. A new empty
+ *              run takes its place.
+ * @param runs: The run builder; failed is set if the file can't be written.
+ * @returns void
+*/
+static void writeRun(runBuilder_t* runs){
+    partialIndex_t* run = runs->run;
+    if (run->numWords == 0) return;
+    qsort(run->order, run->numWords, sizeof(postings_t*), compareWords);
+    char* path = runPath(runs->indexFileName, runs->numRuns++);
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL){
+        fprintf(stderr, "Error: Can't write %s.\n", path);
+        runs->failed = true;
+    } else {
+        for (int i = 0; i < run->numWords; i++){
+            postings_t* postings = run->order[i];
+            fputs(postings->word, fp);
+            for (int j = 0; j < postings->len; j++){
+                fprintf(fp, " %d %d", postings->pairs[2 * j], postings->pairs[2 * j + 1]);
+            }
+            putc('\n', fp);
+        }
+        if (ferror(fp) | fclose(fp)){
+            fprintf(stderr, "Error: Can't write %s.\n", path);
+            runs->failed = true;
+        }
+    }
+    mem_free(path);
+    partialDelete(run);
+    runs->run = partialNew(runs->slots);
+}
+
+/***
+ * Description: qsort comparator; orders postings by their words.
+*/
+static int compareWords(const void* a, const void* b){
+    return strcmp((*(postings_t* const*)a)->word, (*(postings_t* const*)b)->word);
+}
+
+/***
+ * Description: Merges count runs, numbered from first, into one file and removes them. A
+ *              heap holds each run at its next word, least word first and, among runs of
+ *              the same word, the earliest; a word's line gets the pairs of each run that
+ *              has it, in run order, so its docIDs stay in order. Lines are copied a
+ *              character at a time, or a pair at a time into a binary file, so none is
+ *              ever held whole.
+ * @param indexFileName: The index file the runs are named after.
+ * @param first: The first run.
+ * @param count: How many runs.
+ * @param outPath: The file to write.
+ * @param binary: Write outPath in the binary format instead of as a run.
+ * @returns false if a run can't be read or the file can't be written.
+*/
+static bool mergeRuns(const char* indexFileName, const int first, const int count, const char* outPath,
+                      const bool binary){
+    runReader_t* readers = mem_assert(mem_calloc(count > 0 ? count : 1, sizeof(runReader_t)), "Error: Failed to allocate memory for runs");
+    runReader_t** heap = mem_assert(mem_malloc((count > 0 ? count : 1) * sizeof(runReader_t*)), "Error: Failed to allocate memory for runs");
+    bool ok = true;
+    int size = 0;
+    for (int i = 0; i < count; i++){
+        char* path = runPath(indexFileName, first + i);
+        readers[i].fp = fopen(path, "r");
+        readers[i].run = first + i;
+        if (readers[i].fp == NULL){
+            fprintf(stderr, "Error: Can't read %s.\n", path);
+            ok = false;
+        } else if (readWord(&readers[i])){
+            heap[size++] = &readers[i];
+        }
+        mem_free(path);
+    }
+    FILE* out = ok && !binary ? fopen(outPath, "w") : NULL;
+    indexWriter_t* writer = ok && binary ? indexWriter_new(outPath) : NULL;
+    if (ok && out == NULL && writer == NULL){
+        fprintf(stderr, "Error: Can't write %s.\n", outPath);
+        ok = false;
+    }
+    if (ok){
+        for (int pos = size / 2 - 1; pos >= 0; pos--) siftDown(heap, size, pos);
+        while (size > 0){
+            // The least word, then every run that has it, earliest first
+            if (binary) indexWriter_term(writer, heap[0]->word);
+            else fputs(heap[0]->word, out);
+            char* word = mem_assert(mem_malloc(strlen(heap[0]->word) + 1), "Error: Failed to allocate memory for word");
+            strcpy(word, heap[0]->word);
+            while (size > 0 && strcmp(heap[0]->word, word) == 0){
+                runReader_t* reader = heap[0];
+                if (binary){
+                    int docID, count;
+                    while (readNumber(reader, &docID) && readNumber(reader, &count)){
+                        indexWriter_posting(writer, docID, count);
+                    }
+                } else {
+                    int c;
+                    while ((c = getc(reader->fp)) != EOF && c != '\n') putc(c, out);
+                }
+                if (readWord(reader)){
+                    siftDown(heap, size, 0);
+                } else {
+                    heap[0] = heap[--size];
+                    siftDown(heap, size, 0);
+                }
+            }
+            if (!binary) putc('\n', out);
+            mem_free(word);
+        }
+        if (binary ? !indexWriter_close(writer) : ferror(out) | fclose(out)){
+            fprintf(stderr, "Error: Can't write %s.\n", outPath);
+            ok = false;
+        }
+    }
+    for (int i = 0; i < count; i++){
+        if (readers[i].fp != NULL) fclose(readers[i].fp);
+        if (readers[i].word != NULL) mem_free(readers[i].word);
+        char* path = runPath(indexFileName, first + i);
+        if (ok) remove(path);
+        mem_free(path);
+    }
+    mem_free(heap);
+    mem_free(readers);
+    return ok;
+}
+
+/***
+ * Description: Reads the word a run's next line starts with, and the space after it; the
+ *              line's pairs, each preceded by a space, are left to be read.
+ * @param reader: The run.
+ * @returns false at the end of the run.
+*/
+static bool readWord(runReader_t* reader){
+    size_t len = 0;
+    int c;
+    while ((c = getc(reader->fp)) != EOF && c != ' ' && c != '\n'){
+        if (len + 1 >= reader->cap){
+            size_t cap = reader->cap > 0 ? reader->cap * 2 : 64;
+            char* bigger = mem_assert(mem_malloc(cap), "Error: Failed to allocate memory for word");
+            if (reader->word != NULL){
+                memcpy(bigger, reader->word, len);
+                mem_free(reader->word);
+            }
+            reader->word = bigger;
+            reader->cap = cap;
+        }
+        reader->word[len++] = c;
+    }
+    if (len == 0) return false;
+    reader->word[len] = '\0';
+    // The space goes back with the pairs, and a line without any still ends
+    if (c != EOF) ungetc(c, reader->fp);
+    return true;
+}
+
+/***
+ * Description: Reads the next number of a run's line, with the space before it.
+ * @param reader: The run, within a line's pairs.
+ * @param number: Set to the number.
+ * @returns false, having read the newline, at the end of the line.
+*/
+static bool readNumber(runReader_t* reader, int* number){
+    int c = getc(reader->fp);
+    if (c != ' ') return false;
+    int value = 0;
+    while ((c = getc(reader->fp)) >= '0' && c <= '9') value = value * 10 + (c - '0');
+    if (c != EOF) ungetc(c, reader->fp);
+    *number = value;
+    return true;
+}
+
+/***
+ * Description: Whether run a's next line goes before run b's: a lesser word, or the same
+ *              word in an earlier run.
+*/
+static bool readerBefore(const runReader_t* a, const runReader_t* b){
+    int order = strcmp(a->word, b->word);
+    return order < 0 || (order == 0 && a->run < b->run);
+}
+
+/***
+ * Description: Moves the run at pos down the heap below every run that goes before it.
+*/
+static void siftDown(runReader_t** heap, const int size, int pos){
+    runReader_t* reader = heap[pos];
+    while (true){
+        int child = 2 * pos + 1;
+        if (child >= size) break;
+        if (child + 1 < size && readerBefore(heap[child + 1], heap[child])) child++;
+        if (!readerBefore(heap[child], reader)) break;
+        heap[pos] = heap[child];
+        pos = child;
+    }
+    if (size > 0) heap[pos] = reader;
+}
+
+/***
+ * Description: Builds the path of a run: indexFileName.runN.
+ * @returns A new string the caller must mem_free.
+*/
+static char* runPath(const char* indexFileName, const int run){
+    char* path = mem_assert(mem_malloc(strlen(indexFileName) + strlen(".run") + 12), "Error: Failed to allocate memory for path");
+    sprintf(path, "%s.run%d", indexFileName, run);
+    return path;
+}
+
+/***
+ * Description: Deletes a partial index and its postings.
+ * @param partial: The partial index.
+ * @returns void
+*/
+static void partialDelete(partialIndex_t* partial){
+    for (int i = 0; i < partial->numWords; i++){
+        free(partial->order[i]->pairs);
+        mem_free(partial->order[i]->word);
+        mem_free(partial->order[i]);
+    }
+    free(partial->order);
+    // The postings were freed through order
+    hashtable_delete(partial->words, NULL);
+    mem_free(partial);
+}
+
+/***
+ * Description: Reads the URL and depth of document docID and fetches its HTML again from
+ *              the web, ignoring the copy the crawler saved. webpage_fetch isn't thread-safe
+ *              (it resolves with gethostbyname) and sleeps a second after every fetch to be
+ *              polite, so the threads of a parallel build take turns fetching.
+ *
+ * @param pages: The crawler's page directory.
+ * @param docID: ID of the page document of interest.
+ * @return The fetched page (its HTML may be NULL if the fetch failed), or NULL if there's no
+ *         such document.
+ */
+static webpage_t* refetchPage(pagedir_t* pages, int docID){
+    webpage_t* saved = pagedir_read(pages, docID);
+    if (saved == NULL) return NULL;
+    // Keep the URL and depth of the page during crawling
+    char* pageURL = mem_assert(malloc(strlen(webpage_getURL(saved)) + 1), "Error: Failed to allocate memory for URL");
+    strcpy(pageURL, webpage_getURL(saved));
+    int depth = webpage_getDepth(saved);
+    webpage_delete(saved);
+
+    // Create a page with the given URL & Depth and fetch its html content
+    static pthread_mutex_t fetchLock = PTHREAD_MUTEX_INITIALIZER;
+    webpage_t* page = webpage_new(pageURL, depth, NULL);
+    pthread_mutex_lock(&fetchLock);
+    webpage_fetch(page);
+    pthread_mutex_unlock(&fetchLock);
+    return page;
+}
+
 /***
  * Description: Reads words from a webpage, extract their count and inserts the pair (docID, count) into
  *              the counterset associated with the word in the index. Only words longer than 3 characters
@@ -143,6 +827,28 @@ index_t* indexBuild(const char* pageDirectory){
  * @return void
  */
 void indexPage(webpage_t* webpage, index_t* index, int docID) {
+    // Count the page's words
+    hashtable_t* seenWords = countWords(webpage);
+
+    // Passed to hashtable_iterate as arg
+    indexDocumentPair_t* indexDoc = mem_assert(mem_malloc(sizeof(indexDocumentPair_t)), "Error: Failed to allocate memory for indexDoc");
+    indexDoc->index = index;
+    indexDoc->docID = docID;
+
+    // Iterate each word through the hashtable, fetch its count & the docID from indexDoc
+    // & add them as a counter to the counterset of the word in the index.
+    hashtable_iterate(seenWords, indexDoc, insertWordIntoIndex);
+    hashtable_delete(seenWords, mem_free); // Clean up hashtable and counts
+    mem_free(indexDoc); // Clean up the indexDoc
+}
+
+/***
+ * Description: Counts the normalized words of a webpage, of 3 characters or more.
+ *
+ * @param webpage: Pointer to a webpage_t containing the page content to be indexed.
+ * @return A hashtable from each word to its count (an int*), which the caller deletes.
+ */
+static hashtable_t* countWords(webpage_t* webpage){
     // Create a hashtable to track words seen so far and their count
     hashtable_t* seenWords = hashtable_new(TYPICAL_INDEX_SIZE);
     
@@ -168,31 +874,7 @@ void indexPage(webpage_t* webpage, index_t* index, int docID) {
         // Free each word after usage
         mem_free(word);
     }
-
-    // Passed to hashtable_iterate as arg
-    indexDocumentPair_t* indexDoc = mem_assert(mem_malloc(sizeof(indexDocumentPair_t)), "Error: Failed to allocate memory for indexDoc");
-    indexDoc->index = index;
-    indexDoc->docID = docID;
-
-    // Iterate each word through the hashtable, fetch its count & the docID from indexDoc
-    // & add them as a counter to the counterset of the word in the index.
-    hashtable_iterate(seenWords, indexDoc, insertWordIntoIndex);
-    hashtable_delete(seenWords, mem_free); // Clean up hashtable and counts
-    mem_free(indexDoc); // Clean up the indexDoc
-}
-
-/***
- * Description: Formats the file path for a specific document page ID within the given page directory.
- *              Allocates memory for the resulting path string.
- *
- * @param pageDirectory: Path to the base directory containing all document page files.
- * @param docID: ID of the page document of interest.
- * @return path: String of the full path "pageDirectory/docID"
- */
-static char* formatPath(const char* pageDirectory, int docID){
-    char* path = mem_assert(mem_malloc(128 * sizeof(char)), "Error: Failed to allocate memory for path.");
-    sprintf(path, "%s/%d", pageDirectory, docID);
-    return path;
+    return seenWords;
 }
 
 /***
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
 #include "index.h"
 #include "mem.h"
 #include "file.h"
@@ -11,11 +12,13 @@
 #include "hashtable.h"
 #include "word.h"
 
-/**Builds an inverted index from documents it finds in pageDirectory*/
-index_t* indexBuild(const char* pageDirectory);
+/**Builds an inverted index from documents it finds in pageDirectory, reading the
+ * HTML the crawler saved (or re-fetching every page from the web if refetch is set),
+ * with numThreads threads; the index is the same however many there are*/
+index_t* indexBuild(const char* pageDirectory, const bool refetch, const int numThreads);
 
-/**Scans a webpage to find words and indexes them*/
-void indexPage(webpage_t* webpage, index_t* index);
+/**Scans a webpage to find words and indexes them under docID*/
+void indexPage(webpage_t* webpage, index_t* index, int docID);
 
 /**Parses inputs into variables*/
 void parseArgs(const int argc, const char* argv[], const char** pageDirectory, const char** indexFileName);
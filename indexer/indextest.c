@@ -2,35 +2,123 @@
  * indextest.c    Ahmed  Al Sunbati    May 13, 2025
  *
  * Description: Reads index from an old file, saves it into an index struct
- *              and then saves this index in a new file.
+ *              and then saves this index in a new file. The old file may be in
+ *              either format; the new one is text, or binary with --binary. The
+ *              new file is then loaded back and checked to hold the same index.
  *
- * Usage: ./indextest oldIndexFilename newIndexFilename
+ * Usage: ./indextest [--binary] oldIndexFilename newIndexFilename
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "indexer.h"
 #include "index.h"
 #include "file.h"
 
-static void parseArgs2(const int argc, const char* argv[], 
-                    const char** oldIndexFilename, const char** newIndexFilename)
+// What sameWord and sameCount compare against, and whether all has matched so far
+typedef struct indexCompare {
+    index_t* other;
+    counters_t* otherCtrs;
+    int num;
+    bool same;
+} indexCompare_t;
+
+static bool sameIndex(index_t* index, index_t* other);
+static void sameWord(void* compare, const char* word, void* item);
+static void sameCount(void* compare, const int docID, const int count);
+static void countWord(void* num, const char* word, void* item);
+static void countDocument(void* num, const int docID, const int count);
+
+static void parseArgs2(const int argc, const char* argv[],
+                    const char** oldIndexFilename, const char** newIndexFilename, bool* binary)
 {
-    if (argc < 3){
+    int first = 1;
+    if (argc > 1 && strcmp(argv[1], "--binary") == 0){
+        *binary = true;
+        first = 2;
+    }
+    if (argc < first + 2){
         fprintf(stderr, "Error: Not enough arguments supplied.");
         exit(1);
     }
-    *oldIndexFilename = argv[1];
-    *newIndexFilename = argv[2];
+    *oldIndexFilename = argv[first];
+    *newIndexFilename = argv[first + 1];
 }
 int main(const int argc, const char* argv[]){
     const char* oldIndexFilename;
     const char* newIndexFilename;
+    bool binary = false;
 
-    parseArgs2(argc, argv, &oldIndexFilename, &newIndexFilename);
+    parseArgs2(argc, argv, &oldIndexFilename, &newIndexFilename, &binary);
     index_t* index;
     index = index_load(oldIndexFilename);
-    index_save(index, newIndexFilename);
+    if (index == NULL){
+        fprintf(stderr, "Error: Can't load index %s.\n", oldIndexFilename);
+        return 1;
+    }
+    if (!(binary ? index_saveBinary(index, newIndexFilename) : index_save(index, newIndexFilename))){
+        fprintf(stderr, "Error: Can't save index %s.\n", newIndexFilename);
+        index_delete(index);
+        return 1;
+    }
+    // Round trip: the new file must load back as the same index
+    index_t* loaded = index_load(newIndexFilename);
+    bool same = loaded != NULL && sameIndex(index, loaded);
+    printf(same ? "Round trip OK: %s\n" : "Round trip FAILED: %s\n", newIndexFilename);
     index_delete(index);
-    return 0;
-}
\ No newline at end of file
+    if (loaded != NULL) index_delete(loaded);
+    return same ? 0 : 1;
+}
+
+/***
+ * Description: Whether two indexes have the same words, each with the same (docID, count) pairs.
+*/
+static bool sameIndex(index_t* index, index_t* other){
+    indexCompare_t compare = { other, NULL, 0, true };
+    hashtable_iterate(index, &compare, sameWord);
+    int otherWords = 0;
+    hashtable_iterate(other, &otherWords, countWord);
+    return compare.same && compare.num == otherWords;
+}
+
+/***
+ * Description: hashtable_iterate helper: checks a word has the same pairs in the other index.
+*/
+static void sameWord(void* compare, const char* word, void* item){
+    indexCompare_t* cmp = compare;
+    cmp->num++;
+    counters_t* otherCtrs = index_find(cmp->other, word);
+    if (otherCtrs == NULL){
+        cmp->same = false;
+        return;
+    }
+    indexCompare_t pairs = { NULL, otherCtrs, 0, true };
+    counters_iterate(item, &pairs, sameCount);
+    int otherDocs = 0;
+    counters_iterate(otherCtrs, &otherDocs, countDocument);
+    if (!pairs.same || pairs.num != otherDocs) cmp->same = false;
+}
+
+/***
+ * Description: counters_iterate helper: checks a pair is in the other counters set.
+*/
+static void sameCount(void* compare, const int docID, const int count){
+    indexCompare_t* cmp = compare;
+    cmp->num++;
+    if (counters_get(cmp->otherCtrs, docID) != count) cmp->same = false;
+}
+
+/***
+ * Description: hashtable_iterate helper: counts the words.
+*/
+static void countWord(void* num, const char* word, void* item){
+    (*(int*)num)++;
+}
+
+/***
+ * Description: counters_iterate helper: counts the documents.
+*/
+static void countDocument(void* num, const int docID, const int count){
+    (*(int*)num)++;
+}
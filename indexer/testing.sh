@@ -18,6 +18,9 @@ echo "- Two arguments" >> testing.out
 echo "- Four or more arguments" >> testing.out
 ./indexer "$HOME/cs50-dev/shared/tse/output/crawler/pages-letters-depth-10" "indexFileName" "another arg" >> testing.out 2>&1
 
+echo "- Unknown option" >> testing.out
+./indexer --unknown "$HOME/cs50-dev/shared/tse/output/crawler/pages-letters-depth-10" "indexFileName" >> testing.out 2>&1
+
 echo "- Not a valid crawler directory" >> testing.out
 ./indexer "../crawler" "indexFileName">> testing.out 2>&1
 
@@ -69,6 +72,63 @@ echo "Running indextest on  ${OUTPUTS[1]}" >> testing.out
 echo "Comparing newIndexFile with" "${OUTPUTS[1]}" >> testing.out
 $HOME/cs50-dev/shared/tse/indexcmp "${OUTPUTS[1]}" "newIndexFile" >> testing.out
 
+echo "===== Testing the binary format on" "${OUTPUTS[1]}" "=====" >> testing.out
+# Text to binary and back; indextest checks each file loads back as the index it saved
+./indextest --binary "${OUTPUTS[1]}" "newIndexFile.bin" >> testing.out
+./indextest "newIndexFile.bin" "newIndexFile.txt" >> testing.out
+$HOME/cs50-dev/shared/tse/indexcmp "${OUTPUTS[1]}" "newIndexFile.txt" >> testing.out
+echo "- Truncated binary index" >> testing.out
+head -c 100 "newIndexFile.bin" > "newIndexFile.trunc"
+./indextest "newIndexFile.trunc" "newIndexFile.txt" >> testing.out 2>&1
+
+for flags in "--binary" "--binary --memory 1"; do
+    echo "Running indexer with $flags on ${DIRS[1]}" >> testing.out
+    ./indexer $flags "${DIRS[1]}" "${OUTPUTS[1]}-binary" >> testing.out
+    # Words are sorted and docIDs in order, so the file is the same however it was built
+    if cmp -s "newIndexFile.bin" "${OUTPUTS[1]}-binary"; then
+        echo "Same binary index as indextest's" >> testing.out
+    else
+        echo "Binary index differs from indextest's" >> testing.out
+    fi
+done
+rm -f "newIndexFile.bin" "newIndexFile.txt" "newIndexFile.trunc"
+echo "" >> testing.out
+
+echo "===== Testing --threads on" "${DIRS[0]}" "=====" >> testing.out
+echo "- Invalid number of threads" >> testing.out
+./indexer --threads 0 "${DIRS[0]}" "indexFileName" >> testing.out 2>&1
+
+for threads in 2 8; do
+    echo "Running indexer with --threads $threads on ${DIRS[0]}" >> testing.out
+    ./indexer --threads $threads "${DIRS[0]}" "${OUTPUTS[0]}-threads" >> testing.out
+    # The partial indexes are merged in docID order, so the file is the same byte for byte
+    if cmp -s "${OUTPUTS[0]}" "${OUTPUTS[0]}-threads"; then
+        echo "Same index as one thread" >> testing.out
+    else
+        echo "Index differs from one thread's" >> testing.out
+    fi
+done
+echo "" >> testing.out
+
+echo "===== Testing --memory on" "${DIRS[0]}" "=====" >> testing.out
+echo "- Invalid memory budget" >> testing.out
+./indexer --memory 0 "${DIRS[0]}" "indexFileName" >> testing.out 2>&1
+
+for flags in "--memory 1" "--memory 1 --threads 4"; do
+    echo "Running indexer with $flags on ${DIRS[0]}" >> testing.out
+    ./indexer $flags "${DIRS[0]}" "${OUTPUTS[0]}-memory" >> testing.out
+    # Lines come out in word order instead of hashtable order, so compare them sorted
+    if cmp -s <(sort "${OUTPUTS[0]}") <(sort "${OUTPUTS[0]}-memory"); then
+        echo "Same index as the in-memory build" >> testing.out
+    else
+        echo "Index differs from the in-memory build's" >> testing.out
+    fi
+    if ls "${OUTPUTS[0]}-memory".run* > /dev/null 2>&1; then
+        echo "Runs left behind" >> testing.out
+    fi
+done
+echo "" >> testing.out
+
 echo "===== Test with Valgrind =====" >> testing.out
 echo "Running indexer on ${DIRS[0]} with Valgrind" >> testing.out
 
@@ -15,6 +15,8 @@
 #include "querier.h"
 #include "query.h"
 #include "index.h"
+#include "indexmap.h"
+#include "pagedir.h"
 #include "bag.h"
 #include "word.h"
 #include "mem.h"
@@ -24,21 +26,28 @@
 #define MAX_QUERY_LENGTH 128
 
 void parseArgs(const int argc, const char* argv[], char** pageDirectory, char** indexFilename);
-query_t* querierProcess(char* normalizedQuery, index_t* index, char* pageDir);
+query_t* querierProcess(char* normalizedQuery, index_t* index, indexmap_t* map, char* pageDir);
 bool isInputValid(char* normalizedQuery);
-void printDocuments(FILE* fp, query_t* qresults, char* pageDir);
+void printDocuments(FILE* fp, query_t* qresults, pagedir_t* pages);
 static int compareDocs(const void* a, const void* b);
 static document_t** extractDocumentsSorted(query_t* qresults);
 static void queryExtractHelper(document_t** docsArray, query_t* qresults);
-static void printDocumentsHelper(FILE* fp, document_t* doc, char* pageDir);
+static void printDocumentsHelper(FILE* fp, document_t* doc, pagedir_t* pages);
 
 
 int main(const int argc, const char* argv[]){
     char* pageDirectory; char* indexFilename;
     // Parse CLI input into pageDirectoy and indexFilename
     parseArgs(argc, argv, &pageDirectory, &indexFilename);
-    // Load the index from the given pathname for index
-    index_t* index = index_load(indexFilename);
+    // A binary index is mapped and read in place; a text one is loaded
+    indexmap_t* map = indexmap_open(indexFilename);
+    index_t* index = map == NULL ? index_load(indexFilename) : NULL;
+    if (map == NULL && index == NULL){
+        fprintf(stderr, "Error: Can't load index file %s.\n", indexFilename);
+        return 1;
+    }
+    // Open the page directory the URLs of matching documents are looked up in
+    pagedir_t* pages = pagedir_open(pageDirectory);
     // Prompt the user
     char line[MAX_QUERY_LENGTH];
     printf("Query: ");
@@ -77,7 +86,7 @@ int main(const int argc, const char* argv[]){
         }
 
         // Find documents that match the search query
-        query_t* queryResult = querierProcess(normalizedQuery, index, pageDirectory);
+        query_t* queryResult = querierProcess(normalizedQuery, index, map, pageDirectory);
         
         // Check if the resulting documents are empty
         int querySize = query_size(queryResult);
@@ -85,7 +94,7 @@ int main(const int argc, const char* argv[]){
             printf("No documents matched.\n");
         } else {
             // If not, print out the documents in descending order of their scores
-            printDocuments(stdout, queryResult, pageDirectory);
+            printDocuments(stdout, queryResult, pages);
             // Free the query and its contents
             query_delete(queryResult);
         }
@@ -96,7 +105,10 @@ int main(const int argc, const char* argv[]){
         fflush(stdout);
     }
     printf("\n"); // For clean newline after EOF
-    index_delete(index);  // Cleanup
+    // Cleanup
+    if (index != NULL) index_delete(index);
+    indexmap_close(map);
+    pagedir_close(pages);
 
     return 0;
 }
@@ -142,11 +154,12 @@ void parseArgs(const int argc, const char* argv[], char** pageDirectory, char**
 /***
  * Description: Searches up documents that matches the normalized query using the index and the crawler pageDir
  * @param normalizedQuery: The string that represents the normalized and valid query to be searched.
- * @param index: Pointer to the index object to be searched.
+ * @param index: Pointer to the index object to be searched, or NULL if map is given.
+ * @param map: Pointer to the mapped binary index to be searched, or NULL if index is given.
  * @param pageDir: Pathname for a valid crawler Directory.
  * @returns A pointer to a query object with the matching documents.
 */
-query_t* querierProcess(char* normalizedQuery, index_t* index, char* pageDir){
+query_t* querierProcess(char* normalizedQuery, index_t* index, indexmap_t* map, char* pageDir){
     // Deconstruct the normalized query to words to be searched individually
     char** listOfWords = deconstructLine(normalizedQuery);
     // The query object that will hold the final result
@@ -175,7 +188,8 @@ query_t* querierProcess(char* normalizedQuery, index_t* index, char* pageDir){
             // If it's not an operator, then
             query_t* tempQueryResult = query_new();
             // Search up matching documents for current word
-            query_search_index(tempQueryResult, index, word);
+            if (map != NULL) query_search_map(tempQueryResult, map, word);
+            else query_search_index(tempQueryResult, index, word);
             // And intersect it with the growing <and sequence> in currQueryResult
             query_t* queryIntersect = query_intersect(tempQueryResult, currQueryResult);
             
@@ -311,14 +325,14 @@ static void queryExtractHelper(document_t** docsArray, query_t* qresults){
  *              Each document's score, ID, and URL are printed. Also handles cleanup of allocated memory.
  * @param fp: The output file stream to print the documents to.
  * @param qresults: The query result set to be printed.
- * @param pageDir: The directory path used to locate or generate URLs for the documents.
+ * @param pages: The page directory the documents' URLs are looked up in.
  */
-void printDocuments(FILE* fp, query_t* qresults, char* pageDir){
+void printDocuments(FILE* fp, query_t* qresults, pagedir_t* pages){
     int querySize = query_size(qresults);
     document_t** docsSorted = extractDocumentsSorted(qresults);
 
     for(int i = 0; i < querySize; i++){
-        printDocumentsHelper(fp, docsSorted[i], pageDir);
+        printDocumentsHelper(fp, docsSorted[i], pages);
     }
     mem_free(docsSorted);
 }
@@ -328,13 +342,13 @@ void printDocuments(FILE* fp, query_t* qresults, char* pageDir){
  *              Also frees memory associated with the document and its generated URL.
  * @param fp: The output file stream to print the document information to.
  * @param doc: The document to be printed and deleted.
- * @param pageDir: The directory used to generate the document's URL.
+ * @param pages: The page directory the document's URL is looked up in.
  */
-static void printDocumentsHelper(FILE* fp, document_t* doc, char* pageDir){
-    char* URL = document_getURL(doc, pageDir);
+static void printDocumentsHelper(FILE* fp, document_t* doc, pagedir_t* pages){
+    char* URL = document_getURL(doc, pages);
     char* docID = document_getID(doc);
     int docScore = document_getScore(doc);
-    fprintf(fp, "Score: %d, ID: %s, URL:%s\n", docScore, docID, URL);
+    fprintf(fp, "Score: %d, ID: %s, URL:%s\n", docScore, docID, URL ? URL : "");
     mem_free(URL);
     document_delete(doc);
 }
\ No newline at end of file
@@ -17,14 +17,16 @@
 #include "querier.h"
 #include "query.h"
 #include "index.h"
+#include "indexmap.h"
+#include "pagedir.h"
 #include "bag.h"
 #include "word.h"
 #include "mem.h"
 #include "file.h"
 
 void parseArgs(const int argc, const char* argv[], char** pageDirectory, char** indexFilename);
-query_t* querierProcess(char* normalizedQuery, index_t* index, char* pageDir);
+query_t* querierProcess(char* normalizedQuery, index_t* index, indexmap_t* map, char* pageDir);
 bool isInputValid(char* line);
-void printDocuments(FILE* fp, query_t* qresults, char* pageDir);
+void printDocuments(FILE* fp, query_t* qresults, pagedir_t* pages);
 
 #endif
\ No newline at end of file
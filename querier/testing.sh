@@ -102,6 +102,24 @@ echo
 echo "-------------------------------------------------"
 
 
+echo "===== Testing out some queries on a binary index ====="
+# The mapped binary index must answer exactly as the loaded text one
+../indexer/indextest --binary "$indexFileName" index.bin > /dev/null
+queries=$'playground\nplayground or page\nplayground and page\ncoding or playground\nplayground page or the tse\nnotaword'
+if cmp -s <(./querier "$pageDirectory" "$indexFileName" <<< "$queries") <(./querier "$pageDirectory" index.bin <<< "$queries"); then
+    echo "Same results as the text index"
+else
+    echo "Results differ from the text index"
+fi
+echo "- Truncated binary index"
+head -c 100 index.bin > index.trunc
+./querier "$pageDirectory" index.trunc < /dev/null
+rm -f index.bin index.trunc
+
+echo
+echo "-------------------------------------------------"
+
+
 echo "===== Testing valgrind ====="
 $VALGRIND ./querier "$pageDirectory" "$indexFileName" <<EOF
 coding or playground